@@ -1528,9 +1528,9 @@ void ArgMax(int64_t I, int64_t J, int32_t bwA, int32_t bw_index, MASK_PAIR(Group
 void Sigmoid_threads_helper(int thread_idx, int size, GroupElement *A, GroupElement *tmpB, SplineKeyPack *keys)
 {
     auto p = get_start_end(size, thread_idx);
+    evalSigmoid_main_wrapper(party - SERVER, p.second - p.first, A + p.first, keys + p.first, tmpB + p.first);
     for(int i = p.first; i < p.second; ++i)
     {
-        tmpB[i] = evalSigmoid_main_wrapper(party - SERVER, A[i], keys[i]);
         freeSplineKey(keys[i]);
     }
 }
@@ -1541,8 +1541,8 @@ void Sigmoid_dealer_threads_helper(int thread_idx, int size, int ib, int ob, int
     for(int i = p.first; i < p.second; ++i)
     {
         tmpB_mask[i] = random_ge(ob);
-        keys[i] = keyGenSigmoid_main_wrapper(ib, ob, shift_in, shift_out, tmpA_mask[i], tmpB_mask[i]);
     }
+    keyGenSigmoid_main_wrapper(p.second - p.first, ib, ob, shift_in, shift_out, tmpA_mask + p.first, tmpB_mask + p.first, keys + p.first);
 }
 
 /// @brief Calculates elementwise Sigmoid of values
@@ -1685,17 +1685,17 @@ void Tanh_dealer_threads_helper(int thread_idx, int size, int ib, int ob, int sh
     for(int i = p.first; i < p.second; ++i)
     {
         tmpB_mask[i] = random_ge(ob);
-        keys[i] = keyGenTanh_main_wrapper(ib, ob, shift_in, shift_out, tmpA_mask[i], tmpB_mask[i]);
     }
+    keyGenTanh_main_wrapper(p.second - p.first, ib, ob, shift_in, shift_out, tmpA_mask + p.first, tmpB_mask + p.first, keys + p.first);
 }
 
 
 void Tanh_threads_helper(int thread_idx, int size, GroupElement *A, GroupElement *tmpB, SplineKeyPack *keys)
 {
     auto p = get_start_end(size, thread_idx);
+    evalTanh_main_wrapper(party - SERVER, p.second - p.first, A + p.first, keys + p.first, tmpB + p.first);
     for(int i = p.first; i < p.second; ++i)
     {
-        tmpB[i] = evalTanh_main_wrapper(party - SERVER, A[i], keys[i]);
         freeSplineKey(keys[i]);
     }
 }
@@ -1832,9 +1832,9 @@ void TanH(int64_t I, int64_t J, int64_t scale_in, int64_t scale_out,
 void Invsqrt_threads_helper(int thread_idx, int size, GroupElement *A, GroupElement *tmpB, SplineKeyPack *keys)
 {
     auto p = get_start_end(size, thread_idx);
+    evalInvsqrt_main_wrapper(party - SERVER, p.second - p.first, A + p.first, keys + p.first, tmpB + p.first);
     for(int i = p.first; i < p.second; ++i)
     {
-        tmpB[i] = evalInvsqrt_main_wrapper(party - SERVER, A[i], keys[i]);
         freeSplineKey(keys[i]);
     }
 }
@@ -1845,8 +1845,8 @@ void Invsqrt_dealer_threads_helper(int thread_idx, int size, int ib, int ob, int
     for(int i = p.first; i < p.second; ++i)
     {
         tmpB_mask[i] = random_ge(ob);
-        keys[i] = keyGenInvsqrt_main_wrapper(ib, ob, shift_in, shift_out, tmpA_mask[i], tmpB_mask[i]);
     }
+    keyGenInvsqrt_main_wrapper(p.second - p.first, ib, ob, shift_in, shift_out, tmpA_mask + p.first, tmpB_mask + p.first, keys + p.first);
 }
 
 /// @brief Calculates elementwise Reciprocal-Squareroot of values
@@ -20,6 +20,7 @@ SOFTWARE.
 */
 
 #include "dcf.h"
+#include <algorithm>
 
 using namespace osuCrypto;
 // uint64_t aes_evals_count = 0;
@@ -311,6 +312,97 @@ void evalDCFPartial(int party, GroupElement *res, GroupElement idx, const DCFKey
     evalDCF(key.Bin, key.Bout, key.groupSize, res, party, idx, key.k, key.g, key.v, false, start, len);
 }
 
+// One node of the prefix-tree walk used by evalDCFMulti. order[lo, hi) are the points
+// (sorted by their Bin-bit index) that share the path to this node; vacc is the v share
+// accumulated along that path, and scratch holds one groupSize buffer per level below.
+static void visitDCFPrefix(int party, const DCFKeyPack &key, int level, const block &s,
+                           const uint64_t *vacc, const uint64_t *pts, const int *order, int lo, int hi,
+                           uint64_t *scratch, uint64_t *converted, GroupElement *out)
+{
+    static const block notThreeBlock = toBlock(~0, ~3);
+    static const block TwoBlock = toBlock(0, 2);
+    static const block ThreeBlock = toBlock(0, 3);
+    static const block blocks[4] = {ZeroBlock, TwoBlock, OneBlock, ThreeBlock};
+    const int Bin = key.Bin, Bout = key.Bout, groupSize = key.groupSize;
+    const uint64_t sign = (party == SERVER1) ? -1 : 1;
+
+    if (level == Bin)
+    {
+        u8 t = lsb(s);
+        convert(Bout, groupSize, s & notThreeBlock, converted);
+        for (int lp = 0; lp < groupSize; ++lp)
+        {
+            uint64_t final_term = converted[lp];
+            if (t)
+                final_term = final_term + key.g[lp].value;
+            if (party == SERVER1)
+                final_term = -final_term;
+            converted[lp] = vacc[lp] + final_term;
+        }
+        for (int p = lo; p < hi; ++p)
+        {
+            GroupElement *o = out + (size_t)order[p] * groupSize;
+            for (int lp = 0; lp < groupSize; ++lp)
+                o[lp].value = converted[lp];
+        }
+        return;
+    }
+
+    // points are sorted, so the ones going left form a prefix of [lo, hi)
+    const int bit = Bin - 1 - level;
+    int mid = lo;
+    while (mid < hi && ((pts[order[mid]] >> bit) & 1) == 0)
+        ++mid;
+
+    const block cw = key.k[level + 1];
+    const block scw = cw & notThreeBlock;
+    const block ds[] = {((cw >> 1) & OneBlock), (cw & OneBlock)};
+    const u8 t_previous = lsb(s);
+    const block mask = zeroAndAllOne[t_previous];
+    AES ak(s & notThreeBlock);
+    block ct[4];
+    if (mid > lo && mid < hi)
+        ak.ecbEncFourBlocks(blocks, ct);
+    else
+        ak.ecbEncTwoBlocks(blocks + 2 * (mid == lo), ct + 2 * (mid == lo));
+
+    uint64_t *vnext = scratch;
+    const GroupElement *vlevel = key.v + (size_t)level * groupSize;
+    for (int keep = 0; keep < 2; ++keep)
+    {
+        int clo = keep ? mid : lo, chi = keep ? hi : mid;
+        if (clo == chi)
+            continue;
+        block snext = ((scw ^ ds[keep]) & mask) ^ ct[2 * keep];
+        convert(Bout, groupSize, ct[2 * keep + 1], converted);
+        for (int lp = 0; lp < groupSize; ++lp)
+            vnext[lp] = vacc[lp] + sign * (converted[lp] + t_previous * vlevel[lp].value);
+        visitDCFPrefix(party, key, level + 1, snext, vnext, pts, order, clo, chi, scratch + groupSize, converted, out);
+    }
+}
+
+void evalDCFMulti(int party, const DCFKeyPack &key, int numPoints, const GroupElement *idx, GroupElement *out)
+{
+    if (numPoints == 0)
+        return;
+    const int Bin = key.Bin, groupSize = key.groupSize;
+    const uint64_t idxMask = (Bin == 64) ? uint64_t(-1) : ((uint64_t(1) << Bin) - 1);
+
+    std::vector<uint64_t> pts(numPoints);
+    std::vector<int> order(numPoints);
+    for (int i = 0; i < numPoints; ++i)
+    {
+        pts[i] = idx[i].value & idxMask;
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return pts[a] < pts[b]; });
+
+    // [root vacc | one buffer per level | convert output]
+    std::vector<uint64_t> scratch((size_t)(Bin + 2) * groupSize, 0);
+    visitDCFPrefix(party, key, 0, key.k[0], scratch.data(), pts.data(), order.data(), 0, numPoints,
+                   scratch.data() + groupSize, scratch.data() + (size_t)(Bin + 1) * groupSize, out);
+}
+
 // Dual DCF
 
 std::pair<DualDCFKeyPack, DualDCFKeyPack> keyGenDualDCF(int Bin, int Bout, int groupSize, GroupElement idx, GroupElement *payload1, GroupElement *payload2)
@@ -58,6 +58,11 @@ void evalDCF(int Bin, int Bout, int groupSize,
 
 void evalDCFPartial(int party, GroupElement *res, GroupElement idx, const DCFKeyPack &key, int start, int len);
 
+// Evaluates the full group of one DCF key at numPoints indices with a single walk of the
+// prefix tree, so points sharing high bits share the AES expansions along that prefix.
+// out: numPoints x groupSize
+void evalDCFMulti(int party, const DCFKeyPack &key, int numPoints, const GroupElement *idx, GroupElement *out);
+
 std::pair<DualDCFKeyPack, DualDCFKeyPack> keyGenDualDCF(int Bin, int Bout, int groupSize, GroupElement idx, GroupElement *payload1, GroupElement *payload2);
 
 std::pair<DualDCFKeyPack, DualDCFKeyPack> keyGenDualDCF(int Bin, int Bout, GroupElement idx, GroupElement payload1, GroupElement payload2);
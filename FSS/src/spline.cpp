@@ -268,86 +268,96 @@ std::pair<SplineKeyPack, SplineKeyPack> keyGenSigmoid(int Bin, int Bout, int num
 
 
 
-GroupElement evalSigmoid(int party, GroupElement x, SplineKeyPack &k)
+// Evaluates size polynomials of the given degree (coefficients highest power first, one
+// row of degree + 1 per element) at x in Horner form. Plain uint64_t arithmetic so the loop
+// over the batch vectorises; callers reduce mod 2^Bout.
+static void hornerEval(int size, int degree, const uint64_t *coef, const uint64_t *x, uint64_t *out)
 {
-    bool print = false;
-    if(print) std::cout << "==== entered eval " << std::endl;
+    for (int e = 0; e < size; ++e)
+        out[e] = coef[e * (degree + 1)];
+    for (int i = 1; i < degree + 1; ++i)
+    {
+        for (int e = 0; e < size; ++e)
+            out[e] = out[e] * x[e] + coef[e * (degree + 1) + i];
+    }
+}
 
+void evalSigmoid(int party, int size, const GroupElement *x, SplineKeyPack *keys, GroupElement *out)
+{
     /*
-    this function is same as evalSpline, except:
-    
-    todo: if you make any "core" code changes here reflect the same in evalSpline
+    for every element, the m interval-containment DCFs on the shifted inputs
+    x - p[i] - 2 are evaluated in a single prefix-tree walk of the DCF key and the selected
+    polynomial's coefficient shares are collected into a (size x degree+1) array;
+    all polynomials are then evaluated together in Horner form
     */
-
-    const int m = k.numPoly, degree = k.degree;
-    // size of p: m + 1
-    // do modifications similar to keygen (make p[0] = N-1)
-    assert((k.p[0] == GroupElement(0, k.Bin)) && (k.p[m] == GroupElement(-1, k.Bin)));
-    k.p[0] = k.p[0] - GroupElement(1, k.Bin);
-
-    std::vector<std::vector<GroupElement>> s (m, std::vector<GroupElement>(m * (degree + 1)));
-
-    int dcfGroupSize = m * (degree + 1);
-    for (int i = 0; i <m ; ++i)
+    if (size == 0)
+        return;
+    const int m = keys[0].numPoly, degree = keys[0].degree;
+    const int dcfGroupSize = m * (degree + 1);
+
+    std::vector<GroupElement> xi(m);
+    std::vector<GroupElement> s((size_t)m * dcfGroupSize);
+    std::vector<uint64_t> coef((size_t)size * (degree + 1), 0);
+    std::vector<uint64_t> xAdjusted(size);
+    std::vector<uint64_t> sum(size);
+
+    for (int e = 0; e < size; ++e)
     {
-        GroupElement xi = x + (GroupElement(-1, k.Bin) - (k.p[i] + GroupElement(1, k.Bin)));
-        evalDCFPartial(party, s[i].data(), xi, k.dcfKey, (i - 1) * (degree + 1), 2 * (degree + 1));
-    }
+        const SplineKeyPack &k = keys[e];
+        assert(k.numPoly == m && k.degree == degree);
+        // size of p: m + 1, with p[0] moved to N-1 as in keygen
+        assert((k.p[0] == GroupElement(0, k.Bin)) && (k.p[m] == GroupElement(-1, k.Bin)));
+        auto knot = [&](int i) { return i == 0 ? k.p[0] - GroupElement(1, k.Bin) : k.p[i]; };
 
-    GroupElement w_b[m][degree + 1];
-    for (int i = 0; i < m; ++i)
-    {
-#ifdef SIGMOID_TANH_37
-        int newBitlen = 37;
-        GroupElement cx = GroupElement((changeBitsize(x, newBitlen) > (changeBitsize(k.p[i], newBitlen) + GroupElement(1, newBitlen))) - (changeBitsize(x, newBitlen) > (changeBitsize(k.p[i+1], newBitlen) + GroupElement(1, newBitlen))), k.Bout);
-#elif defined(SIGMOID_12_12) || defined(TANH_12_12) 
-        GroupElement cx = GroupElement((changeBitsize(x, 16) > (changeBitsize(k.p[i], 16) + GroupElement(1, 16))) - (changeBitsize(x, 16) > (changeBitsize(k.p[i+1], 16) + GroupElement(1, 16))), k.Bout);
-        // GroupElement cx = GroupElement((x > k.p[i - 1] + 1) - (x > k.p[i] + 1), k.Bout);
-#else // all equal bit case
-        // assert(k.Bin == k.Bout);
-        // GroupElement cx = GroupElement((x > k.p[i] + 1) - (x > k.p[i+1] + 1), k.Bout);
-        GroupElement cx = GroupElement((changeBitsize(x, 16) > (changeBitsize(k.p[i], 16) + GroupElement(1, 16))) - (changeBitsize(x, 16) > (changeBitsize(k.p[i+1], 16) + GroupElement(1, 16))), k.Bout);
-#endif 
-        if(print) std::cout << " i " << i << " cx " << cx << std::endl;
-        for (int j = 0; j < degree + 1; ++j)
+        for (int i = 0; i < m; ++i)
         {
-            w_b[i][j] = cx * k.beta_b[i * (degree + 1) + j] - s[i][i * (degree + 1) + j] + s[(i+1) % (m)][i * (degree + 1) + j] + k.e_b[i][j];
+            xi[i] = x[e] + (GroupElement(-1, k.Bin) - (knot(i) + GroupElement(1, k.Bin)));
         }
-    }
+        evalDCFMulti(party, k.dcfKey, m, xi.data(), s.data());
 
-    std::vector<GroupElement> tb(degree + 1, GroupElement(0, k.Bout));
-    for (int i = 0; i < m; ++i)
-    {
-        for (int j = 0; j < degree + 1; ++j)
+        uint64_t *tb = coef.data() + (size_t)e * (degree + 1);
+        for (int i = 0; i < m; ++i)
         {
-            tb[j] = tb[j] + w_b[i][j];
+#ifdef SIGMOID_TANH_37
+            int newBitlen = 37;
+            uint64_t cx = (int)(changeBitsize(x[e], newBitlen) > (changeBitsize(knot(i), newBitlen) + GroupElement(1, newBitlen))) - (int)(changeBitsize(x[e], newBitlen) > (changeBitsize(knot(i + 1), newBitlen) + GroupElement(1, newBitlen)));
+#else // 16 bit comparison for the 12_12 and all equal bit cases
+            uint64_t cx = (int)(changeBitsize(x[e], 16) > (changeBitsize(knot(i), 16) + GroupElement(1, 16))) - (int)(changeBitsize(x[e], 16) > (changeBitsize(knot(i + 1), 16) + GroupElement(1, 16)));
+#endif
+            const GroupElement *si = s.data() + (size_t)i * dcfGroupSize + i * (degree + 1);
+            const GroupElement *si1 = s.data() + (size_t)((i + 1) % m) * dcfGroupSize + i * (degree + 1);
+            for (int j = 0; j < degree + 1; ++j)
+            {
+                tb[j] += cx * k.beta_b[i * (degree + 1) + j].value - si[j].value + si1[j].value + k.e_b[i][j].value;
+            }
         }
+        xAdjusted[e] = changeBitsize(x[e], k.Bout).value;
     }
 
-    GroupElement sum = tb[0];
-    // GroupElement x_adjusted(x.value, k.Bout);
-    GroupElement x_adjusted = changeBitsize(x, k.Bout);
+    hornerEval(size, degree, coef.data(), xAdjusted.data(), sum.data());
 
-    for (int i = 1; i < degree + 1; i++)
+    for (int e = 0; e < size; ++e)
     {
-        sum = sum * x_adjusted + tb[i];
-        if(print) std::cout << "i " << i << " sum " << sum << " tb[i] " << tb[i] << std::endl;
-        // // sum = sum + (tb[i] * pow(x_upscaled, degree - i));
-        
-        // GroupElement coef_scale_adjusted = GroupElement(tb[i].value << (uint64_t(i) * 12), 64);
-        // sum = sum * x_adjusted + coef_scale_adjusted;
+        out[e] = keys[e].r_b + sum[e];
     }
+}
 
-    GroupElement ub = k.r_b + sum;
-    if(print) std::cout << " ub " << ub << std::endl;
+GroupElement evalSigmoid(int party, GroupElement x, SplineKeyPack &k)
+{
+    GroupElement ub(0, k.Bout);
+    evalSigmoid(party, 1, &x, &k, &ub);
     return ub;
 }
 
+// Knots and fixed-point polynomial coefficients of one spline, as consumed by keyGenSigmoid.
+struct SplineTable
+{
+    int Bin, Bout, degree;
+    std::vector<std::vector<GroupElement>> polynomials;
+    std::vector<GroupElement> p;
+};
 
-
-
-std::pair<SplineKeyPack, SplineKeyPack> keyGenSigmoid_main_wrapper(int Bin, int Bout, int scaleIn, int scaleOut,
-                    GroupElement rin, GroupElement rout)
+static SplineTable sigmoidSplineTable(int Bin, int Bout, int scaleIn, int scaleOut)
 {
     // todo: add other scales
     assert((Bin == 64) && (Bout == 64));
@@ -829,19 +839,13 @@ std::pair<SplineKeyPack, SplineKeyPack> keyGenSigmoid_main_wrapper(int Bin, int
     throw std::invalid_argument("no scales selected for sigmoid");    
 #endif
 
-    int numPoly = fxd_polynomials.size(), m = numPoly;
     fxd_p.push_back(GroupElement(-1, ib));
 
-    return keyGenSigmoid(ib, ob, numPoly, degree, fxd_polynomials, fxd_p, rin, rout);
+    return SplineTable{ib, ob, degree, fxd_polynomials, fxd_p};
 }
 
-GroupElement evalSigmoid_main_wrapper(int party, GroupElement x, SplineKeyPack &k)
-{
-    return evalSigmoid(party, x, k);
-}
 
-std::pair<SplineKeyPack, SplineKeyPack> keyGenTanh_main_wrapper(int Bin, int Bout, int scaleIn, int scaleOut,
-                    GroupElement rin, GroupElement rout)
+static SplineTable tanhSplineTable(int Bin, int Bout, int scaleIn, int scaleOut)
 {
     // todo: add other scales
     assert((Bin == 64) && (Bout == 64));
@@ -1139,19 +1143,13 @@ std::pair<SplineKeyPack, SplineKeyPack> keyGenTanh_main_wrapper(int Bin, int Bou
     throw std::invalid_argument("no scales selected for tanh");
 #endif
 
-    int numPoly = fxd_polynomials.size(), m = numPoly;
     fxd_p.push_back(GroupElement(-1, ib));
 
-    return keyGenSigmoid(ib, ob, numPoly, degree, fxd_polynomials, fxd_p, rin, rout);
+    return SplineTable{ib, ob, degree, fxd_polynomials, fxd_p};
 }                    
 
-GroupElement evalTanh_main_wrapper(int party, GroupElement x, SplineKeyPack &k)
-{
-    return evalSigmoid(party, x, k);
-}
 
-std::pair<SplineKeyPack, SplineKeyPack> keyGenInvsqrt_main_wrapper(int Bin, int Bout, int scaleIn, int scaleOut,
-                    GroupElement rin, GroupElement rout)
+static SplineTable invsqrtSplineTable(int Bin, int Bout, int scaleIn, int scaleOut)
 {
     // todo: add other scales
     assert((Bin == 64) && (Bout == 64));
@@ -1219,13 +1217,89 @@ std::pair<SplineKeyPack, SplineKeyPack> keyGenInvsqrt_main_wrapper(int Bin, int
     throw std::invalid_argument("no scales selected for invsqrt");
 #endif
 
-    int numPoly = fxd_polynomials.size(), m = numPoly;
     fxd_p.push_back(GroupElement(-1, ib));
 
-    return keyGenSigmoid(ib, ob, numPoly, degree, fxd_polynomials, fxd_p, rin, rout);
+    return SplineTable{ib, ob, degree, fxd_polynomials, fxd_p};
+}
+
+
+static void keyGenSpline(const SplineTable &t, int size, const GroupElement *rin, const GroupElement *rout,
+                    std::pair<SplineKeyPack, SplineKeyPack> *keys)
+{
+    for (int i = 0; i < size; ++i)
+    {
+        keys[i] = keyGenSigmoid(t.Bin, t.Bout, t.polynomials.size(), t.degree, t.polynomials, t.p, rin[i], rout[i]);
+    }
+}
+
+std::pair<SplineKeyPack, SplineKeyPack> keyGenSigmoid_main_wrapper(int Bin, int Bout, int scaleIn, int scaleOut,
+                    GroupElement rin, GroupElement rout)
+{
+    std::pair<SplineKeyPack, SplineKeyPack> keys;
+    keyGenSpline(sigmoidSplineTable(Bin, Bout, scaleIn, scaleOut), 1, &rin, &rout, &keys);
+    return keys;
+}
+
+void keyGenSigmoid_main_wrapper(int size, int Bin, int Bout, int scaleIn, int scaleOut,
+                    const GroupElement *rin, const GroupElement *rout, std::pair<SplineKeyPack, SplineKeyPack> *keys)
+{
+    keyGenSpline(sigmoidSplineTable(Bin, Bout, scaleIn, scaleOut), size, rin, rout, keys);
+}
+
+GroupElement evalSigmoid_main_wrapper(int party, GroupElement x, SplineKeyPack &k)
+{
+    return evalSigmoid(party, x, k);
+}
+
+void evalSigmoid_main_wrapper(int party, int size, const GroupElement *x, SplineKeyPack *keys, GroupElement *out)
+{
+    evalSigmoid(party, size, x, keys, out);
+}
+
+std::pair<SplineKeyPack, SplineKeyPack> keyGenTanh_main_wrapper(int Bin, int Bout, int scaleIn, int scaleOut,
+                    GroupElement rin, GroupElement rout)
+{
+    std::pair<SplineKeyPack, SplineKeyPack> keys;
+    keyGenSpline(tanhSplineTable(Bin, Bout, scaleIn, scaleOut), 1, &rin, &rout, &keys);
+    return keys;
+}
+
+void keyGenTanh_main_wrapper(int size, int Bin, int Bout, int scaleIn, int scaleOut,
+                    const GroupElement *rin, const GroupElement *rout, std::pair<SplineKeyPack, SplineKeyPack> *keys)
+{
+    keyGenSpline(tanhSplineTable(Bin, Bout, scaleIn, scaleOut), size, rin, rout, keys);
+}
+
+GroupElement evalTanh_main_wrapper(int party, GroupElement x, SplineKeyPack &k)
+{
+    return evalSigmoid(party, x, k);
+}
+
+void evalTanh_main_wrapper(int party, int size, const GroupElement *x, SplineKeyPack *keys, GroupElement *out)
+{
+    evalSigmoid(party, size, x, keys, out);
+}
+
+std::pair<SplineKeyPack, SplineKeyPack> keyGenInvsqrt_main_wrapper(int Bin, int Bout, int scaleIn, int scaleOut,
+                    GroupElement rin, GroupElement rout)
+{
+    std::pair<SplineKeyPack, SplineKeyPack> keys;
+    keyGenSpline(invsqrtSplineTable(Bin, Bout, scaleIn, scaleOut), 1, &rin, &rout, &keys);
+    return keys;
+}
+
+void keyGenInvsqrt_main_wrapper(int size, int Bin, int Bout, int scaleIn, int scaleOut,
+                    const GroupElement *rin, const GroupElement *rout, std::pair<SplineKeyPack, SplineKeyPack> *keys)
+{
+    keyGenSpline(invsqrtSplineTable(Bin, Bout, scaleIn, scaleOut), size, rin, rout, keys);
 }
 
 GroupElement evalInvsqrt_main_wrapper(int party, GroupElement x, SplineKeyPack &k)
 {
     return evalSigmoid(party, x, k);
 }
+
+void evalInvsqrt_main_wrapper(int party, int size, const GroupElement *x, SplineKeyPack *keys, GroupElement *out)
+{
+    evalSigmoid(party, size, x, keys, out);
+}
@@ -36,11 +36,23 @@ std::pair<SplineKeyPack, SplineKeyPack> keyGenSigmoid_main_wrapper(int Bin, int
 
 GroupElement evalSigmoid_main_wrapper(int party, GroupElement x, SplineKeyPack &k);
 
+// Array versions: keygen builds the spline table once for the whole batch, eval walks each
+// element's interval DCFs in one prefix-tree pass and runs Horner over the batch.
+void keyGenSigmoid_main_wrapper(int size, int Bin, int Bout, int scaleIn, int scaleOut,
+                    const GroupElement *rin, const GroupElement *rout, std::pair<SplineKeyPack, SplineKeyPack> *keys);
+
+void evalSigmoid_main_wrapper(int party, int size, const GroupElement *x, SplineKeyPack *keys, GroupElement *out);
+
 std::pair<SplineKeyPack, SplineKeyPack> keyGenTanh_main_wrapper(int Bin, int Bout, int scaleIn, int scaleOut,
                     GroupElement rin, GroupElement rout);
 
 GroupElement evalTanh_main_wrapper(int party, GroupElement x, SplineKeyPack &k);
 
+void keyGenTanh_main_wrapper(int size, int Bin, int Bout, int scaleIn, int scaleOut,
+                    const GroupElement *rin, const GroupElement *rout, std::pair<SplineKeyPack, SplineKeyPack> *keys);
+
+void evalTanh_main_wrapper(int party, int size, const GroupElement *x, SplineKeyPack *keys, GroupElement *out);
+
 // Note: for input bitlen 12, octave spline's ulp is calculated over bitlen 6 = 12/2, but truncate-reduce is called keeping in mind output bitlen 11
 
 std::pair<SplineKeyPack, SplineKeyPack> keyGenInvsqrt_main_wrapper(int Bin, int Bout, int scaleIn, int scaleOut,
@@ -48,9 +60,16 @@ std::pair<SplineKeyPack, SplineKeyPack> keyGenInvsqrt_main_wrapper(int Bin, int
 
 GroupElement evalInvsqrt_main_wrapper(int party, GroupElement x, SplineKeyPack &k);
 
+void keyGenInvsqrt_main_wrapper(int size, int Bin, int Bout, int scaleIn, int scaleOut,
+                    const GroupElement *rin, const GroupElement *rout, std::pair<SplineKeyPack, SplineKeyPack> *keys);
+
+void evalInvsqrt_main_wrapper(int party, int size, const GroupElement *x, SplineKeyPack *keys, GroupElement *out);
+
 std::pair<SplineKeyPack, SplineKeyPack> keyGenSigmoid(int Bin, int Bout, int numPoly, int degree, 
                     std::vector<std::vector<GroupElement>> polynomials,
                     std::vector<GroupElement> p,
                     GroupElement rin, GroupElement rout);
 
 GroupElement evalSigmoid(int party, GroupElement x, SplineKeyPack &k);
+
+void evalSigmoid(int party, int size, const GroupElement *x, SplineKeyPack *keys, GroupElement *out);
@@ -144,23 +144,10 @@ void AuxProtocols::lookup_table(T **spec, T *x, T *y, int32_t size,
 
   T mask_x = (bw_x == T_size ? -1 : ((1ULL << bw_x) - 1));
   T mask_y = (bw_y == T_size ? -1 : ((1ULL << bw_y) - 1));
-  uint64_t N = 1 << bw_x;
 
   if (party == sci::ALICE) {
-    PRG128 prg;
-    T **data = new T *[size];
-    for (int i = 0; i < size; i++) {
-      data[i] = new T[N];
-      for (uint64_t j = 0; j < N; j++) {
-        data[i][j] = spec[i][j];
-      }
-    }
-
-    otpack->kkot[bw_x - 1]->send(data, size, bw_y);
-
-    for (int i = 0; i < size; i++)
-      delete[] data[i];
-    delete[] data;
+    // KKOT only reads the messages, so the spec is sent as is
+    otpack->kkot[bw_x - 1]->send(spec, size, bw_y);
   } else { // party == sci::BOB
     uint8_t *choice = new uint8_t[size];
     for (int i = 0; i < size; i++) {
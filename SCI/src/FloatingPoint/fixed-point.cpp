@@ -20,10 +20,32 @@ SOFTWARE.
 */
 
 #include "FloatingPoint/fixed-point.h"
+#include <immintrin.h>
 
 using namespace std;
 using namespace sci;
 
+// Fills the spec of a lookup table over M-entry rows, one per element, for a
+// public function f of a shared index x: spec[i][j] = (f[(x[i] + j) mod M] -
+// r[i]) & mask. f2 holds f twice, so that row i is a contiguous window of it.
+static void fill_rotated_spec(uint64_t *spec, const uint64_t *f2, int M,
+                              const uint64_t *x, const uint64_t *r,
+                              uint64_t mask, int sz) {
+  __m256i mask_v = _mm256_set1_epi64x(mask);
+  for (int i = 0; i < sz; i++) {
+    const uint64_t *f_i = f2 + (x[i] & (M - 1));
+    uint64_t *spec_i = spec + size_t(i) * M;
+    __m256i r_v = _mm256_set1_epi64x(r[i]);
+    int j = 0;
+    for (; j + 4 <= M; j += 4) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(f_i + j));
+      v = _mm256_and_si256(_mm256_sub_epi64(v, r_v), mask_v);
+      _mm256_storeu_si256((__m256i *)(spec_i + j), v);
+    }
+    for (; j < M; j++) spec_i[j] = (f_i[j] - r[i]) & mask;
+  }
+}
+
 FixArray FixArray::subset(int i, int j) {
   assert(i >= 0 && j <= size && i < j);
   int sz = j - i;
@@ -315,28 +337,26 @@ FixArray FixOp::left_shift(const FixArray &x, const FixArray &s, int ell,
   FixArray pow2_s(x.party, x.size, x.signed_, pow2_s_ell, 0);
   int M = 1 << m;
   uint64_t pow2_s_mask = pow2_s.ell_mask();
-  uint64_t s_mask = M - 1;
   if (party == ALICE) {
     uint64_t **spec;
     spec = new uint64_t *[x.size];
+    uint64_t *spec_data = new uint64_t[size_t(x.size) * M];
     PRG128 prg;
     prg.random_data(pow2_s.data, x.size * sizeof(uint64_t));
     for (int i = 0; i < x.size; i++) {
-      spec[i] = new uint64_t[M];
+      spec[i] = spec_data + size_t(i) * M;
       pow2_s.data[i] &= pow2_s_mask;
-      for (int j = 0; j < M; j++) {
-        int idx = (s.data[i] + j) & s_mask;
-        if (idx > pow2_s_ell - 2) {
-          spec[i][j] = (0 - pow2_s.data[i]) & pow2_s_mask;
-        } else {
-          spec[i][j] = ((1ULL << idx) - pow2_s.data[i]) & pow2_s_mask;
-        }
-      }
     }
+    vector<uint64_t> pow2(2 * M);
+    for (int idx = 0; idx < M; idx++) {
+      pow2[idx] = (idx > pow2_s_ell - 2 ? 0 : 1ULL << idx);
+      pow2[idx + M] = pow2[idx];
+    }
+    fill_rotated_spec(spec_data, pow2.data(), M, s.data, pow2_s.data,
+                      pow2_s_mask, x.size);
     aux->lookup_table<uint64_t>(spec, nullptr, nullptr, x.size, m, pow2_s_ell);
 
-    for (int i = 0; i < x.size; i++)
-      delete[] spec[i];
+    delete[] spec_data;
     delete[] spec;
   } else {
     aux->lookup_table<uint64_t>(nullptr, s.data, pow2_s.data, x.size, m,
@@ -358,27 +378,29 @@ FixArray FixOp::right_shift(const FixArray &x, const FixArray &s, int bound,
   FixArray pow2_neg_s(x.party, x.size, x.signed_, bound + 2, bound);
   int M = 1 << m;
   uint64_t pow2_neg_s_mask = pow2_neg_s.ell_mask();
-  uint64_t s_mask = M - 1;
   if (party == ALICE) {
     uint64_t **spec;
     spec = new uint64_t *[x.size];
+    uint64_t *spec_data = new uint64_t[size_t(x.size) * M];
     PRG128 prg;
     prg.random_data(pow2_neg_s.data, x.size * sizeof(uint64_t));
     for (int i = 0; i < x.size; i++) {
-      spec[i] = new uint64_t[M];
+      spec[i] = spec_data + size_t(i) * M;
       pow2_neg_s.data[i] &= pow2_neg_s_mask;
-      for (int j = 0; j < M; j++) {
-        int idx = (s.data[i] + j) & s_mask;
-        int exp = bound - idx;
-        if (exp < 0)
-          exp += M;
-        spec[i][j] = ((1ULL << exp) - pow2_neg_s.data[i]) & pow2_neg_s_mask;
-      }
     }
+    vector<uint64_t> pow2_neg(2 * M);
+    for (int idx = 0; idx < M; idx++) {
+      int exp = bound - idx;
+      if (exp < 0)
+        exp += M;
+      pow2_neg[idx] = 1ULL << exp;
+      pow2_neg[idx + M] = pow2_neg[idx];
+    }
+    fill_rotated_spec(spec_data, pow2_neg.data(), M, s.data, pow2_neg_s.data,
+                      pow2_neg_s_mask, x.size);
     aux->lookup_table<uint64_t>(spec, nullptr, nullptr, x.size, m, bound + 2);
 
-    for (int i = 0; i < x.size; i++)
-      delete[] spec[i];
+    delete[] spec_data;
     delete[] spec;
   } else {
     aux->lookup_table<uint64_t>(nullptr, s.data, pow2_neg_s.data, x.size, m,
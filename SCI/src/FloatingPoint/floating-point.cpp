@@ -20,6 +20,7 @@ SOFTWARE.
 */
 
 #include "FloatingPoint/floating-point.h"
+#include <immintrin.h>
 #include <omp.h>
 #include <cstdlib>
 
@@ -27,6 +28,136 @@ SOFTWARE.
 using namespace std;
 using namespace sci;
 
+// Per-thread cache of the blocks of destroyed FPArrays, most recent last. It
+// is plain data so that arrays destroyed after the thread's destructors have
+// run (e.g. globals) still see a valid cache, which is then closed.
+struct FPBlockCache {
+  static const int max_blocks = 16;
+  static const size_t max_words = size_t(1) << 24; // 128 MiB
+  int n_blocks;
+  size_t words;
+  size_t block_words[max_blocks];
+  uint64_t *blocks[max_blocks];
+  bool closed;
+};
+
+static thread_local FPBlockCache fp_block_cache;
+
+struct FPBlockCacheReaper {
+  ~FPBlockCacheReaper() {
+    FPBlockCache &cache = fp_block_cache;
+    for (int i = 0; i < cache.n_blocks; i++) delete[] cache.blocks[i];
+    cache.n_blocks = 0;
+    cache.words = 0;
+    cache.closed = true;
+  }
+};
+
+uint64_t *FPArray::acquire_block(int sz) {
+  size_t n = block_words(sz);
+  FPBlockCache &cache = fp_block_cache;
+  for (int i = cache.n_blocks - 1; i >= 0; i--) {
+    if (cache.block_words[i] == n) {
+      uint64_t *blk = cache.blocks[i];
+      for (int j = i + 1; j < cache.n_blocks; j++) {
+        cache.block_words[j - 1] = cache.block_words[j];
+        cache.blocks[j - 1] = cache.blocks[j];
+      }
+      cache.n_blocks--;
+      cache.words -= n;
+      return blk;
+    }
+  }
+  return new uint64_t[n];
+}
+
+void FPArray::release_block(uint64_t *blk, int sz) {
+  if (blk == nullptr) return;
+  static thread_local FPBlockCacheReaper reaper;
+  (void)reaper;
+  size_t n = block_words(sz);
+  FPBlockCache &cache = fp_block_cache;
+  if (cache.closed || n > FPBlockCache::max_words) {
+    delete[] blk;
+    return;
+  }
+  // evict the oldest blocks to make room
+  int evict = 0;
+  size_t words = cache.words;
+  while (evict < cache.n_blocks &&
+         (cache.n_blocks - evict == FPBlockCache::max_blocks ||
+          words + n > FPBlockCache::max_words)) {
+    delete[] cache.blocks[evict];
+    words -= cache.block_words[evict];
+    evict++;
+  }
+  for (int j = evict; j < cache.n_blocks; j++) {
+    cache.block_words[j - evict] = cache.block_words[j];
+    cache.blocks[j - evict] = cache.blocks[j];
+  }
+  cache.n_blocks -= evict;
+  cache.block_words[cache.n_blocks] = n;
+  cache.blocks[cache.n_blocks] = blk;
+  cache.n_blocks++;
+  cache.words = words + n;
+}
+
+// dst[i] = src[i] & mask
+static void and_copy(uint64_t *dst, const uint64_t *src, uint64_t mask, int sz) {
+  int i = 0;
+  __m256i mask_v = _mm256_set1_epi64x(mask);
+  for (; i + 4 <= sz; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_and_si256(v, mask_v));
+  }
+  for (; i < sz; i++) dst[i] = src[i] & mask;
+}
+
+static void and_copy(uint8_t *dst, const uint8_t *src, uint8_t mask, int sz) {
+  int i = 0;
+  __m256i mask_v = _mm256_set1_epi8(mask);
+  for (; i + 32 <= sz; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_and_si256(v, mask_v));
+  }
+  for (; i < sz; i++) dst[i] = src[i] & mask;
+}
+
+static inline uint64_t hsum_epi64(__m256i v) {
+  __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  return uint64_t(_mm_cvtsi128_si64(s)) + uint64_t(_mm_extract_epi64(s, 1));
+}
+
+// For each row i of the n-wide one-hot array oh (arithmetic shares):
+//   k[i] = sum_j oh[i][j] << shift[j] (shift[j] >= 64 contributes 0)
+//   e_adj[i] = sum_j oh[i][j] * coef[j] (mod 2^32)
+static void one_hot_reduce(const uint64_t *oh, int n, int size,
+                           const uint64_t *shift, const uint64_t *coef,
+                           uint64_t *k, uint64_t *e_adj) {
+  for (int i = 0; i < size; i++) {
+    const uint64_t *row = oh + size_t(i) * n;
+    __m256i k_v = _mm256_setzero_si256();
+    __m256i e_v = _mm256_setzero_si256();
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+      __m256i x = _mm256_loadu_si256((const __m256i *)(row + j));
+      __m256i sh = _mm256_loadu_si256((const __m256i *)(shift + j));
+      __m256i c = _mm256_loadu_si256((const __m256i *)(coef + j));
+      k_v = _mm256_add_epi64(k_v, _mm256_sllv_epi64(x, sh));
+      e_v = _mm256_add_epi64(e_v, _mm256_mul_epu32(x, c));
+    }
+    uint64_t k_i = hsum_epi64(k_v);
+    uint64_t e_i = hsum_epi64(e_v);
+    for (; j < n; j++) {
+      if (shift[j] < 64) k_i += row[j] << shift[j];
+      e_i += uint64_t(uint32_t(row[j])) * uint32_t(coef[j]);
+    }
+    k[i] = k_i;
+    e_adj[i] = e_i;
+  }
+}
+
 FPArray FPArray::subset(int i, int j) {
   assert(i >= 0 && j <= size && i < j);
   int sz = j - i;
@@ -224,23 +355,15 @@ FPArray FPOp::input(int party_, int sz, uint8_t* s_, uint8_t* z_, uint64_t* m_,
   uint64_t m_mask_ = ret.m_mask();
   uint64_t e_mask_ = ret.e_mask();
   if ((this->party == party_) || (party_ == PUBLIC)) {
-    memcpy(ret.s, s_, sz * sizeof(uint8_t));
-    memcpy(ret.z, z_, sz * sizeof(uint8_t));
-    memcpy(ret.m, m_, sz * sizeof(uint64_t));
-    memcpy(ret.e, e_, sz * sizeof(uint64_t));
-    for (int i = 0; i < sz; i++) {
-      ret.s[i] &= 1;
-      ret.z[i] &= 1;
-      ret.m[i] &= m_mask_;
-      ret.e[i] &= e_mask_;
-    }
+    and_copy(ret.s, s_, 1, sz);
+    and_copy(ret.z, z_, 1, sz);
+    and_copy(ret.m, m_, m_mask_, sz);
+    and_copy(ret.e, e_, e_mask_, sz);
   } else {
     memset(ret.s, 0, sz * sizeof(uint8_t));
     memset(ret.z, 0, sz * sizeof(uint8_t));
-    for (int i = 0; i < sz; i++) {
-      ret.m[i] = 0;
-      ret.e[i] = 0;
-    }
+    memset(ret.m, 0, sz * sizeof(uint64_t));
+    memset(ret.e, 0, sz * sizeof(uint64_t));
   }
   return ret;
 }
@@ -1057,16 +1180,18 @@ void FPOp::normalize(FixArray &m, FixArray &e, int e_offset, int ell) {
   FixArray e_adj(m.party, m.size, e.signed_, e.ell, e.s);
   uint64_t m_mask_ = m.ell_mask();
   uint64_t e_mask_ = e.ell_mask();
-  for (int i = 0; i < m.size; i++) {
-    k.data[i] = 0;
-    e_adj.data[i] = 0;
-    for (int j = 0; j < m.ell; j++) {
-      k.data[i] += (1ULL << (ell - 1 - j)) * m_one_hot_64[i * m.ell + j];
-      e_adj.data[i] += (j - e_offset) * m_one_hot_64[i * m.ell + j];
-    }
-    k.data[i] &= m_mask_;
-    e_adj.data[i] &= e_mask_;
-  }
+  // k = 2^(ell - 1 - j) and e_adj = j - e_offset for the one-hot position j;
+  // e_adj is computed mod 2^32, which covers e.ell
+  assert(e.ell <= 32);
+  vector<uint64_t> shift(m.ell), coef(m.ell);
+  for (int j = 0; j < m.ell; j++) {
+    shift[j] = (j <= ell - 1 ? ell - 1 - j : 64);
+    coef[j] = uint32_t(j - e_offset);
+  }
+  one_hot_reduce(m_one_hot_64, m.ell, m.size, shift.data(), coef.data(),
+                 k.data, e_adj.data);
+  and_copy(k.data, k.data, m_mask_, m.size);
+  and_copy(e_adj.data, e_adj.data, e_mask_, m.size);
   e = fix->add(e, e_adj);
   m = fix->mul(m, k, m.ell);
 
@@ -1759,6 +1884,19 @@ FPArray FPOp::general_vector_sum(vector<FPArray> &x, int b_, int sc, int m_bits,
   }
   int num_chunks = ceil(n/double(chunk_size));
 
+  // The partial sums of the chunks carry g guard bits, as many as the second
+  // level accumulator has room for, so that each output is effectively
+  // rounded to m_bits only once
+  int g = 0;
+  if (num_chunks > 1) {
+    int logc = ceil(log2(num_chunks));
+    int logchunk = ceil(log2(chunk_size));
+    int ell_chunk = 2*b - b_ + sc + 2*logchunk;
+    g = (63 - (2*m_bits + 2 + 2*logc)) / 2;
+    g = std::min(g, ell_chunk - 2 - m_bits);
+    g = std::max(g, 0);
+  }
+
   vector<FPArray> x_slices(N*num_chunks) ;
   for (uint64_t j = 0; j < num_chunks; j++) {
     uint64_t end = (n < (j + 1) * chunk_size) ? n : (j + 1) * chunk_size;
@@ -1771,7 +1909,7 @@ FPArray FPOp::general_vector_sum(vector<FPArray> &x, int b_, int sc, int m_bits,
   } else {
     FPArray sum_tr;
     if (num_chunks * chunk_size == n) {
-      sum_tr = general_vector_sum_core(x_slices, b_, sc, m_bits, e_bits);
+      sum_tr = general_vector_sum_core(x_slices, b_, sc, m_bits + g, e_bits);
     } else {
       vector<FPArray> x_slices_1(N*(num_chunks - 1));
       vector<FPArray> x_slices_2(N);
@@ -1783,13 +1921,13 @@ FPArray FPOp::general_vector_sum(vector<FPArray> &x, int b_, int sc, int m_bits,
       for (int i = 0; i < N; i++) {
         x_slices_2[i] = x_slices[(num_chunks-1)*N + i];
       }
-      FPArray sum_tr_1 = general_vector_sum_core(x_slices_1, b_, sc, m_bits, e_bits);
-      FPArray sum_tr_2 = general_vector_sum_core(x_slices_2, b_, sc, m_bits, e_bits);
+      FPArray sum_tr_1 = general_vector_sum_core(x_slices_1, b_, sc, m_bits + g, e_bits);
+      FPArray sum_tr_2 = general_vector_sum_core(x_slices_2, b_, sc, m_bits + g, e_bits);
       sum_tr = concat({ sum_tr_1, sum_tr_2 });
     }
     vector<FPArray> summ(N);
     for (int i = 0; i < N; i++) {
-      summ[i] = FPArray(party, num_chunks, m_bits, e_bits);
+      summ[i] = FPArray(party, num_chunks, m_bits + g, e_bits);
       for (int j = 0; j < num_chunks; j++) {
         summ[i].s[j] = sum_tr.s[j*N + i];
         summ[i].z[j] = sum_tr.z[j*N + i];
@@ -1797,7 +1935,7 @@ FPArray FPOp::general_vector_sum(vector<FPArray> &x, int b_, int sc, int m_bits,
         summ[i].e[j] = sum_tr.e[j*N + i];
       }
     }
-    return general_vector_sum(summ, m_bits, m_bits, m_bits, e_bits) ;
+    return general_vector_sum(summ, m_bits + g, m_bits + g, m_bits, e_bits) ;
   }
 }
 
@@ -1856,16 +1994,14 @@ FPArray FPOp::dot_product(const vector<FPArray> &x, const vector<FPArray> &y) {
     sc = m_bits;
   }
 
+  // The products go into the accumulator as they are: products that underflow
+  // fall below its exponent threshold unless the sum itself underflows, which
+  // the accumulator checks once per output
   vector<FPArray> prod(N);
   for (int i = 0; i < N; i++) {
     prod[i] = this->input(this->party, n, prod_s.data + i*n, prod_z.data + i*n,
         prod_m.data + i*n, prod_e.data + i*n, b-1, e_bits);
   }
-  FPArray prod_concat = concat(prod);
-  prod_concat = fp_op->check_bounds(prod_concat, true);
-  for (int i = 0; i < N; i++) {
-    prod[i] = prod_concat.subset(i*n, (i+1)*n);
-  }
 
   delete[] flat_x_z; delete[] flat_y_z;
   delete[] flat_x_s; delete[] flat_y_s;
@@ -1944,16 +2080,12 @@ vector<FPArray> matmul_intermediate_products_beacon(FPOp* fp_op, const FPMatrix
   // not used, just a placeholder
   BoolArray prod_z = bool_op->input(ALICE, N*n, uint8_t(0));
 
+  // see FPOp::dot_product
   vector<FPArray> prod(N);
   for (int i = 0; i < N; i++) {
     prod[i] = fp_op->input(fp_op->party, n, prod_s.data + i*n, prod_z.data + i*n,
         prod_m.data + i*n, prod_e.data + i*n, b-1, e_bits);
   }
-  FPArray prod_concat = concat(prod);
-  prod_concat = fp_op->check_bounds(prod_concat, true);
-  for (int i = 0; i < N; i++) {
-    prod[i] = prod_concat.subset(i*n, (i+1)*n);
-  }
 
   return prod ;
 }
@@ -1992,13 +2124,14 @@ vector<FPArray> matmul_intermediate_products_secfloat(FPOp* fp_op, const FPMatri
   return fp_op->mul(prod_x, prod_y) ;
 }
 
-FPMatrix FPOp::matrix_multiplication_beacon(const FPMatrix &x, const FPMatrix &y, int chunk_exp) {
+FPMatrix FPOp::matrix_multiplication_beacon(const FPMatrix &x, const FPMatrix &y, int chunk_exp, int output_m_bits) {
   assert(x.party != PUBLIC); assert(y.party != PUBLIC);
   assert(x.dim2 == y.dim1);
   assert(x.m_bits == y.m_bits); assert(x.e_bits == y.e_bits);
 
   int N = x.dim1*y.dim2; int n = x.dim2;
   int m_bits = x.m_bits; int e_bits = x.e_bits;
+  if (output_m_bits == -1) output_m_bits = m_bits;
 
   int b, b_, sc;
   if ((m_bits == BFLOAT16_M_BITS && e_bits == BFLOAT16_E_BITS)
@@ -2019,12 +2152,12 @@ FPMatrix FPOp::matrix_multiplication_beacon(const FPMatrix &x, const FPMatrix &y
   vector<FPArray> prod = matmul_intermediate_products_beacon(this, x, y, chunk_exp) ;
   assert(prod[0].m_bits == b-1);
 
-  FPMatrix ret(this->party, x.dim1, y.dim2, m_bits, e_bits);
+  FPMatrix ret(this->party, x.dim1, y.dim2, output_m_bits, e_bits);
 
   for (int i = 0; i < N; i += rows_per_batch) {
     int j = std::min(i + rows_per_batch, N);
     vector<FPArray> prod_i = {prod.begin() + i, prod.begin() + j};
-    FPArray ret_i = general_vector_sum(prod_i, b_, sc, m_bits, e_bits);
+    FPArray ret_i = general_vector_sum(prod_i, b_, sc, output_m_bits, e_bits);
     memcpy(ret.s + i, ret_i.s, (j-i) * sizeof(uint8_t));
     memcpy(ret.z + i, ret_i.z, (j-i) * sizeof(uint8_t));
     memcpy(ret.m + i, ret_i.m, (j-i) * sizeof(uint64_t));
@@ -2059,7 +2192,7 @@ FPMatrix FPOp::matrix_multiplication_secfloat(const FPMatrix &x, const FPMatrix
   return ret ;
 }
 
-vector<FPMatrix> FPOp::matrix_multiplication_beacon(const vector<FPMatrix> &x, const vector<FPMatrix> &y, int chunk_exp) {
+vector<FPMatrix> FPOp::matrix_multiplication_beacon(const vector<FPMatrix> &x, const vector<FPMatrix> &y, int chunk_exp, int output_m_bits) {
   int m, n, p, L ;
   int m_bits, e_bits ;
   m = x[0].dim1 ;
@@ -2069,6 +2202,7 @@ vector<FPMatrix> FPOp::matrix_multiplication_beacon(const vector<FPMatrix> &x, c
 
   m_bits = x[0].m_bits ;
   e_bits = x[0].e_bits ;
+  if (output_m_bits == -1) output_m_bits = m_bits ;
 
   for (int i = 1 ; i < (int)x.size() ; i++) {
     assert(x[i].dim1 == m) ;
@@ -2117,7 +2251,7 @@ vector<FPMatrix> FPOp::matrix_multiplication_beacon(const vector<FPMatrix> &x, c
 
   vector<FPMatrix> ret ;
   for (int l = 0 ; l < L ; l++) {
-    FPMatrix ret_l(this->party, m, p, m_bits, e_bits) ;
+    FPMatrix ret_l(this->party, m, p, output_m_bits, e_bits) ;
     for (int i = 0 ; i < m*p ; i += rows_per_batch) {
       int j = std::min(i + rows_per_batch, m*p) ;
       int sz = j - i ;
@@ -2126,7 +2260,7 @@ vector<FPMatrix> FPOp::matrix_multiplication_beacon(const vector<FPMatrix> &x, c
       for (int k = i ; k < j ; k++)
         tosum.push_back(prod[k].subset(l*n, (l+1)*n)) ;
 
-      FPArray summed = general_vector_sum(tosum, b_, sc, m_bits, e_bits) ;
+      FPArray summed = general_vector_sum(tosum, b_, sc, output_m_bits, e_bits) ;
       memcpy(ret_l.s + i, summed.s, (j-i)*sizeof(uint8_t)) ;
       memcpy(ret_l.z + i, summed.z, (j-i)*sizeof(uint8_t)) ;
       memcpy(ret_l.m + i, summed.m, (j-i)*sizeof(uint64_t)) ;
@@ -69,10 +69,7 @@ public:
     this->size = sz;
     this->m_bits = m_bits_;
     this->e_bits = e_bits_;
-    s = new uint8_t[sz];
-    z = new uint8_t[sz];
-    m = new uint64_t[sz];
-    e = new uint64_t[sz];
+    this->allocate();
   }
 
   // copy constructor
@@ -81,14 +78,10 @@ public:
     this->size = other.size;
     this->m_bits = other.m_bits;
     this->e_bits = other.e_bits;
-    this->s = new uint8_t[size];
-    this->z = new uint8_t[size];
-    this->m = new uint64_t[size];
-    this->e = new uint64_t[size];
-    memcpy(this->s, other.s, size * sizeof(uint8_t));
-    memcpy(this->z, other.z, size * sizeof(uint8_t));
-    memcpy(this->m, other.m, size * sizeof(uint64_t));
-    memcpy(this->e, other.e, size * sizeof(uint64_t));
+    if (other.block != nullptr) {
+      this->allocate();
+      memcpy(this->block, other.block, block_words(size) * sizeof(uint64_t));
+    }
   }
 
   // move constructor
@@ -97,22 +90,10 @@ public:
     this->size = other.size;
     this->m_bits = other.m_bits;
     this->e_bits = other.e_bits;
-    this->s = other.s;
-    this->z = other.z;
-    this->m = other.m;
-    this->e = other.e;
-    other.s = nullptr;
-    other.z = nullptr;
-    other.m = nullptr;
-    other.e = nullptr;
+    this->steal(other);
   }
 
-  ~FPArray() {
-    delete[] s;
-    delete[] z;
-    delete[] m;
-    delete[] e;
-  }
+  ~FPArray() { release_block(block, size); }
 
   template <class T> std::vector<T> get_native_type();
 
@@ -152,22 +133,21 @@ public:
   FPArray &operator=(const FPArray &other) {
     if (this == &other) return *this;
 
-    delete[] this->s;
-    delete[] this->z;
-    delete[] this->m;
-    delete[] this->e;
+    // the block is reused when the sizes match
+    if (this->size != other.size || other.block == nullptr) {
+      release_block(this->block, this->size);
+      this->block = nullptr;
+      this->s = this->z = nullptr;
+      this->m = this->e = nullptr;
+    }
     this->party = other.party;
     this->size = other.size;
     this->m_bits = other.m_bits;
     this->e_bits = other.e_bits;
-    this->s = new uint8_t[size];
-    this->z = new uint8_t[size];
-    this->m = new uint64_t[size];
-    this->e = new uint64_t[size];
-    memcpy(this->s, other.s, size * sizeof(uint8_t));
-    memcpy(this->z, other.z, size * sizeof(uint8_t));
-    memcpy(this->m, other.m, size * sizeof(uint64_t));
-    memcpy(this->e, other.e, size * sizeof(uint64_t));
+    if (other.block != nullptr) {
+      if (this->block == nullptr) this->allocate();
+      memcpy(this->block, other.block, block_words(size) * sizeof(uint64_t));
+    }
     return *this;
   }
 
@@ -175,28 +155,50 @@ public:
   FPArray &operator=(FPArray &&other) noexcept {
     if (this == &other) return *this;
 
-    delete[] this->s;
-    delete[] this->z;
-    delete[] this->m;
-    delete[] this->e;
+    release_block(this->block, this->size);
     this->party = other.party;
     this->size = other.size;
     this->m_bits = other.m_bits;
     this->e_bits = other.e_bits;
+    this->steal(other);
+    return *this;
+  }
+
+  // FPArray[i, j)
+  FPArray subset(int i, int j);
+
+private:
+  // m, e, s and z live in one block (in that order), so that an FPArray costs
+  // a single allocation and a copy is a single memcpy
+  uint64_t *block = nullptr;
+
+  static size_t block_words(int sz) { return 2 * size_t(sz) + (2 * size_t(sz) + 7) / 8; }
+
+  // blocks are recycled through a small per-thread cache, as FPOp creates
+  // many short-lived arrays of the same size
+  static uint64_t *acquire_block(int sz);
+  static void release_block(uint64_t *blk, int sz);
+
+  void allocate() {
+    block = acquire_block(size);
+    m = block;
+    e = block + size;
+    s = (uint8_t *)(block + 2 * size_t(size));
+    z = s + size;
+  }
+
+  void steal(FPArray &other) {
+    this->block = other.block;
     this->s = other.s;
     this->z = other.z;
     this->m = other.m;
     this->e = other.e;
+    other.block = nullptr;
     other.s = nullptr;
     other.z = nullptr;
     other.m = nullptr;
     other.e = nullptr;
-    return *this;
   }
-
-  // FPArray[i, j)
-  FPArray subset(int i, int j);
-
 };
 
 std::ostream &operator<<(std::ostream &os, FPArray &other);
@@ -488,11 +490,13 @@ public:
 
   FPArray dot_product(const vector<FPArray> &x, const vector<FPArray> &y);
 
-  FPMatrix matrix_multiplication_beacon(const FPMatrix &x, const FPMatrix &y, int chunk_exp=26) ;
+  // output_m_bits (default x.m_bits) sets the precision of the accumulated
+  // result, e.g. FP32 outputs from bfloat16 operands
+  FPMatrix matrix_multiplication_beacon(const FPMatrix &x, const FPMatrix &y, int chunk_exp=26, int output_m_bits=-1) ;
 
   FPMatrix matrix_multiplication_secfloat(const FPMatrix &x, const FPMatrix &y, int chunk_exp=15) ;
 
-  vector<FPMatrix> matrix_multiplication_beacon(const vector<FPMatrix> &x, const vector<FPMatrix> &y, int chunk_exp=26) ;
+  vector<FPMatrix> matrix_multiplication_beacon(const vector<FPMatrix> &x, const vector<FPMatrix> &y, int chunk_exp=26, int output_m_bits=-1) ;
 
   vector<FPMatrix> matrix_multiplication_secfloat(const vector<FPMatrix> &x, const vector<FPMatrix> &y, int chunk_exp=15) ;
 
@@ -24,6 +24,7 @@ Modified by Deevashwer Rathee
 */
 
 #include "LinearHE/conv-field.h"
+#include <limits>
 
 using namespace std;
 using namespace sci;
@@ -221,13 +222,12 @@ vector<Ciphertext> HE_encrypt(vector<vector<uint64_t>> &pt,
 }
 
 // Creates filter masks for an image input that has been output packed.
-vector<vector<vector<Plaintext>>>
-HE_preprocess_filters_OP(Filters &filters, const ConvMetadata &data,
-                         BatchEncoder &batch_encoder) {
-  // Mask is convolutions x cts per convolution x mask size
-  vector<vector<vector<Plaintext>>> encoded_masks(
-      data.convs, vector<vector<Plaintext>>(
-                      data.inp_ct, vector<Plaintext>(data.filter_size)));
+vector<Plaintext> HE_preprocess_filters_OP(Filters &filters,
+                                           const ConvMetadata &data,
+                                           BatchEncoder &batch_encoder) {
+  // Mask is convolutions x cts per convolution x mask size, flattened (see
+  // mask_index)
+  vector<Plaintext> encoded_masks(data.convs * data.inp_ct * data.filter_size);
   // Since a half in a permutation may have a variable number of rotations we
   // use this index to track where we are at in the masks tensor
   // Build each half permutation as well as it's inward rotations
@@ -305,12 +305,13 @@ HE_preprocess_filters_OP(Filters &filters, const ConvMetadata &data,
               }
             }
           }
-          batch_encoder.encode(masks[0],
-                               encoded_masks[conv_idx + rot][ct_idx][f]);
+          batch_encoder.encode(
+              masks[0],
+              encoded_masks[mask_index(data, conv_idx + rot, ct_idx, f)]);
           if (data.half_perms > 1) {
             batch_encoder.encode(
-                masks[1],
-                encoded_masks[conv_idx + data.half_rots + rot][ct_idx][f]);
+                masks[1], encoded_masks[mask_index(
+                              data, conv_idx + data.half_rots + rot, ct_idx, f)]);
           }
         }
       }
@@ -320,28 +321,47 @@ HE_preprocess_filters_OP(Filters &filters, const ConvMetadata &data,
 }
 
 // Performs convolution for an output packed image. Returns the intermediate
-// rotation sets
-vector<Ciphertext> HE_conv_OP(vector<vector<vector<Plaintext>>> &masks,
+// rotation sets. The masks are in NTT form and the rotations are brought to NTT
+// form here, once for all convolutions.
+vector<Ciphertext> HE_conv_OP(const vector<Plaintext> &masks,
                               vector<vector<Ciphertext>> &rotations,
                               const ConvMetadata &data, Evaluator &evaluator,
                               Ciphertext &zero) {
   vector<Ciphertext> result(data.convs);
 
+#pragma omp parallel for num_threads(num_threads) schedule(static) collapse(2)
+  for (int ct_idx = 0; ct_idx < data.inp_ct; ct_idx++) {
+    for (int f = 0; f < data.filter_size; f++) {
+      evaluator.transform_to_ntt_inplace(rotations[ct_idx][f]);
+    }
+  }
+
   // Multiply masks and add for each convolution
 #pragma omp parallel for num_threads(num_threads) schedule(static)
   for (int conv_idx = 0; conv_idx < data.convs; conv_idx++) {
-    result[conv_idx] = zero;
+    bool empty = true;
     for (int ct_idx = 0; ct_idx < data.inp_ct; ct_idx++) {
       for (int f = 0; f < data.filter_size; f++) {
         Ciphertext tmp;
-        if (!masks[conv_idx][ct_idx][f].is_zero()) {
-          evaluator.multiply_plain(rotations[ct_idx][f],
-                                   masks[conv_idx][ct_idx][f], tmp);
-
-          evaluator.add_inplace(result[conv_idx], tmp);
+        auto &mask = masks[mask_index(data, conv_idx, ct_idx, f)];
+        if (!mask.is_zero()) {
+          if (empty) {
+            evaluator.multiply_plain(rotations[ct_idx][f], mask,
+                                     result[conv_idx]);
+            empty = false;
+          } else {
+            evaluator.multiply_plain(rotations[ct_idx][f], mask, tmp);
+            evaluator.add_inplace(result[conv_idx], tmp);
+          }
         }
       }
     }
+    if (empty) {
+      result[conv_idx] = zero;
+    } else {
+      evaluator.transform_from_ntt_inplace(result[conv_idx]);
+      evaluator.add_inplace(result[conv_idx], zero);
+    }
     evaluator.mod_switch_to_next_inplace(result[conv_idx]);
   }
   return result;
@@ -458,23 +478,291 @@ uint64_t **HE_decrypt(vector<Ciphertext> &enc_result, const ConvMetadata &data,
   return final_result;
 }
 
-ConvField::ConvField(int party, NetIO *io) {
+// Rough costs of the HE operations, relative to a multiply_plain in NTT form
+// at N = 8192, with the ciphertexts sent over a 1 Gbps link. A rotation is
+// counted once although it may be composed from a few power-of-2 steps.
+static const double HE_MULT_COST = 1;
+static const double HE_NTT_COST = 2;
+static const double HE_ROTATION_COST = 20;
+static const double HE_CT_COMM_COST = 60;
+
+double rotation_conv_cost(const ConvMetadata &data) {
+  if (data.depthwise || data.image_size > (size_t)data.pack_num) {
+    return numeric_limits<double>::infinity();
+  }
+  double rots = (double)data.inp_ct * data.filter_size + data.convs +
+                data.half_perms;
+  double mults = (double)data.convs * data.inp_ct * data.filter_size;
+  double ntts = (double)data.inp_ct * data.filter_size + data.convs;
+  double cts = data.inp_ct + data.out_ct;
+  double scale = (double)data.slot_count / POLY_MOD_DEGREE;
+  return scale * (HE_ROTATION_COST * rots + HE_MULT_COST * mults +
+                  HE_NTT_COST * ntts + HE_CT_COMM_COST * cts);
+}
+
+double coeff_conv_cost(const ConvMetadata &data) {
+  if (data.coeff_chans == 0) {
+    return numeric_limits<double>::infinity();
+  }
+  double tiles = (double)data.tiles_h * data.tiles_w;
+  double mults = data.depthwise
+                     ? (double)data.coeff_out_ct
+                     : tiles * coeff_blocks(data) * data.out_chans;
+  double cts = data.coeff_inp_ct + data.coeff_out_ct;
+  double scale = (double)data.coeff_degree / POLY_MOD_DEGREE;
+  return scale * (HE_MULT_COST * mults + HE_NTT_COST * cts +
+                  HE_CT_COMM_COST * cts);
+}
+
+// For a tile of tile_h x tile_w, the input polynomial holds channel c at
+// coefficients c * S + i * tile_w + j (S = tile_h * tile_w) and the filter
+// polynomial holds its channel c at O - c * S - l * tile_w - m, where
+// O = (coeff_chans - 1) * S + (filter_h - 1) * tile_w + filter_w - 1. The
+// product then has output (i, j), summed over the channels, at coefficient
+// O + i * tile_w + j as long as coeff_chans * S <= N. A depthwise filter
+// polynomial holds channel c at c * coeff_chans * S instead, so that channel c
+// alone lands at c * (coeff_chans + 1) * S, which needs coeff_chans^2 * S <= N.
+void configure_coeff(ConvMetadata &data) {
+  int N = data.coeff_degree = POLY_MOD_DEGREE;
+  int mult = data.depthwise ? data.out_chans / data.inp_chans : 1;
+  data.coeff_chans = 0;
+  if (data.stride_h != 1 || data.stride_w != 1 || data.pad_t || data.pad_b ||
+      data.pad_l || data.pad_r) {
+    return;
+  }
+
+  ConvMetadata cand = data;
+  double best = numeric_limits<double>::infinity();
+  for (int th = data.filter_h; th <= data.image_h; th++) {
+    for (int tw = data.filter_w; tw <= data.image_w && th * tw <= N; tw++) {
+      int S = th * tw;
+      int chans = N / S;
+      if (data.depthwise) {
+        chans = sqrt(chans);
+        while ((chans + 1) * (chans + 1) * S <= N)
+          chans++;
+        while (chans * chans * S > N)
+          chans--;
+      }
+      cand.coeff_chans = min(chans, data.inp_chans);
+      cand.tile_h = th;
+      cand.tile_w = tw;
+      cand.tiles_h = ceil((float)data.output_h / (th - data.filter_h + 1));
+      cand.tiles_w = ceil((float)data.output_w / (tw - data.filter_w + 1));
+      int tiles = cand.tiles_h * cand.tiles_w;
+      cand.coeff_inp_ct = tiles * coeff_blocks(cand);
+      cand.coeff_out_ct = data.depthwise ? cand.coeff_inp_ct * mult
+                                         : tiles * data.out_chans;
+      double cost = coeff_conv_cost(cand);
+      if (cost < best) {
+        best = cost;
+        data.coeff_chans = cand.coeff_chans;
+        data.tile_h = th;
+        data.tile_w = tw;
+        data.tiles_h = cand.tiles_h;
+        data.tiles_w = cand.tiles_w;
+        data.coeff_inp_ct = cand.coeff_inp_ct;
+        data.coeff_out_ct = cand.coeff_out_ct;
+      }
+    }
+  }
+}
+
+void coeff_output_position(const ConvMetadata &data, int out_c, int row,
+                           int col, int &ct_idx, int &coeff) {
+  int out_tile_h = data.tile_h - data.filter_h + 1;
+  int out_tile_w = data.tile_w - data.filter_w + 1;
+  int tile = (row / out_tile_h) * data.tiles_w + col / out_tile_w;
+  int S = data.tile_h * data.tile_w;
+  int base = (data.filter_h - 1 + row % out_tile_h) * data.tile_w +
+             data.filter_w - 1 + col % out_tile_w;
+  if (data.depthwise) {
+    int mult = data.out_chans / data.inp_chans;
+    int chan = out_c / mult;
+    int block = chan / data.coeff_chans;
+    int block_off = chan % data.coeff_chans;
+    ct_idx = (tile * coeff_blocks(data) + block) * mult + out_c % mult;
+    coeff = block_off * (data.coeff_chans + 1) * S + base;
+  } else {
+    ct_idx = tile * data.out_chans + out_c;
+    coeff = (data.coeff_chans - 1) * S + base;
+  }
+}
+
+vector<vector<uint64_t>> preprocess_image_coeff(Image &image,
+                                                const ConvMetadata &data) {
+  int blocks = coeff_blocks(data);
+  int out_tile_h = data.tile_h - data.filter_h + 1;
+  int out_tile_w = data.tile_w - data.filter_w + 1;
+  int S = data.tile_h * data.tile_w;
+  vector<vector<uint64_t>> pt(data.coeff_inp_ct,
+                              vector<uint64_t>(data.coeff_degree, 0));
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (int ct_idx = 0; ct_idx < data.coeff_inp_ct; ct_idx++) {
+    int tile = ct_idx / blocks;
+    int block = ct_idx % blocks;
+    int row_base = (tile / data.tiles_w) * out_tile_h;
+    int col_base = (tile % data.tiles_w) * out_tile_w;
+    for (int chan = 0; chan < data.coeff_chans &&
+                       block * data.coeff_chans + chan < data.inp_chans;
+         chan++) {
+      auto &channel = image[block * data.coeff_chans + chan];
+      for (int i = 0; i < data.tile_h && row_base + i < data.image_h; i++) {
+        for (int j = 0; j < data.tile_w && col_base + j < data.image_w; j++) {
+          pt[ct_idx][chan * S + i * data.tile_w + j] =
+              channel(row_base + i, col_base + j);
+        }
+      }
+    }
+  }
+  return pt;
+}
+
+vector<vector<uint64_t>> preprocess_filters_coeff(Filters &filters,
+                                                  const ConvMetadata &data) {
+  int blocks = coeff_blocks(data);
+  int mult = data.depthwise ? data.out_chans / data.inp_chans : 1;
+  int S = data.tile_h * data.tile_w;
+  int last = (data.filter_h - 1) * data.tile_w + data.filter_w - 1;
+  int num = data.depthwise ? blocks * mult : data.out_chans * blocks;
+  vector<vector<uint64_t>> pt(num, vector<uint64_t>(data.coeff_degree, 0));
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (int idx = 0; idx < num; idx++) {
+    int block = data.depthwise ? idx / mult : idx % blocks;
+    for (int chan = 0; chan < data.coeff_chans &&
+                       block * data.coeff_chans + chan < data.inp_chans;
+         chan++) {
+      int inp_c = block * data.coeff_chans + chan;
+      Channel *filter;
+      int offset;
+      if (data.depthwise) {
+        filter = &filters[inp_c * mult + idx % mult][0];
+        offset = chan * data.coeff_chans * S + last;
+      } else {
+        filter = &filters[idx / blocks][inp_c];
+        offset = (data.coeff_chans - 1 - chan) * S + last;
+      }
+      for (int l = 0; l < data.filter_h; l++) {
+        for (int m = 0; m < data.filter_w; m++) {
+          pt[idx][offset - l * data.tile_w - m] = (*filter)(l, m);
+        }
+      }
+    }
+  }
+  return pt;
+}
+
+vector<Ciphertext> HE_encrypt_coeff(vector<vector<uint64_t>> &pt,
+                                    Encryptor &encryptor) {
+  vector<Ciphertext> ct(pt.size());
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (size_t ct_idx = 0; ct_idx < pt.size(); ct_idx++) {
+    Plaintext tmp(pt[ct_idx].size());
+    copy(pt[ct_idx].begin(), pt[ct_idx].end(), tmp.data());
+    encryptor.encrypt(tmp, ct[ct_idx]);
+  }
+  return ct;
+}
+
+// Multiplies the inputs with the filter polynomials, in NTT form, and sums
+// over the channel blocks. Like HE_conv_OP the results are re-randomized with
+// zero and switched to the next level.
+vector<Ciphertext> HE_conv_coeff(const vector<Plaintext> &filters,
+                                 vector<Ciphertext> &input,
+                                 const ConvMetadata &data, Evaluator &evaluator,
+                                 Ciphertext &zero) {
+  int blocks = coeff_blocks(data);
+  int mult = data.depthwise ? data.out_chans / data.inp_chans : 1;
+  vector<Ciphertext> result(data.coeff_out_ct);
+
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (int ct_idx = 0; ct_idx < data.coeff_inp_ct; ct_idx++) {
+    evaluator.transform_to_ntt_inplace(input[ct_idx]);
+  }
+
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (int out_idx = 0; out_idx < data.coeff_out_ct; out_idx++) {
+    bool empty = true;
+    // A depthwise output takes one input, a standard one sums over the blocks
+    int first = data.depthwise ? out_idx / mult
+                               : (out_idx / data.out_chans) * blocks;
+    int count = data.depthwise ? 1 : blocks;
+    for (int k = 0; k < count; k++) {
+      int filter_idx = data.depthwise
+                           ? (out_idx / mult) % blocks * mult + out_idx % mult
+                           : (out_idx % data.out_chans) * blocks + k;
+      auto &filter = filters[filter_idx];
+      if (filter.is_zero()) {
+        continue;
+      }
+      if (empty) {
+        evaluator.multiply_plain(input[first + k], filter, result[out_idx]);
+        empty = false;
+      } else {
+        Ciphertext tmp;
+        evaluator.multiply_plain(input[first + k], filter, tmp);
+        evaluator.add_inplace(result[out_idx], tmp);
+      }
+    }
+    if (empty) {
+      result[out_idx] = zero;
+    } else {
+      evaluator.transform_from_ntt_inplace(result[out_idx]);
+      evaluator.add_inplace(result[out_idx], zero);
+    }
+    evaluator.mod_switch_to_next_inplace(result[out_idx]);
+  }
+  return result;
+}
+
+uint64_t **HE_decrypt_coeff(vector<Ciphertext> &enc_result,
+                            const ConvMetadata &data, Decryptor &decryptor) {
+  vector<vector<uint64_t>> result(data.coeff_out_ct,
+                                  vector<uint64_t>(data.coeff_degree, 0));
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (int ct_idx = 0; ct_idx < data.coeff_out_ct; ct_idx++) {
+    Plaintext tmp;
+    decryptor.decrypt(enc_result[ct_idx], tmp);
+    copy(tmp.data(), tmp.data() + min<size_t>(tmp.coeff_count(),
+                                              data.coeff_degree),
+         result[ct_idx].begin());
+  }
+
+  uint64_t **final_result = new uint64_t *[data.out_chans];
+  for (int out_c = 0; out_c < data.out_chans; out_c++) {
+    final_result[out_c] = new uint64_t[data.output_h * data.output_w];
+    for (int row = 0; row < data.output_h; row++) {
+      for (int col = 0; col < data.output_w; col++) {
+        int ct_idx, coeff;
+        coeff_output_position(data, out_c, row, col, ct_idx, coeff);
+        final_result[out_c][row * data.output_w + col] =
+            result[ct_idx][coeff];
+      }
+    }
+  }
+  return final_result;
+}
+
+ConvField::ConvField(int party, NetIO *io, HESession *session) {
   this->party = party;
   this->io = io;
-  this->slot_count = POLY_MOD_DEGREE_LARGE;
-  generate_new_keys(party, io, slot_count, context[1], encryptor[1],
-                    decryptor[1], evaluator[1], encoder[1], gal_keys[1],
-                    zero[1]);
-  this->slot_count = POLY_MOD_DEGREE;
-  generate_new_keys(party, io, slot_count, context[0], encryptor[0],
-                    decryptor[0], evaluator[0], encoder[0], gal_keys[0],
-                    zero[0]);
+  this->own_session = (session == nullptr);
+  this->session = own_session ? new HESession(party, io) : session;
+  for (int i = 1; i >= 0; i--) {
+    this->slot_count = i ? POLY_MOD_DEGREE_LARGE : POLY_MOD_DEGREE;
+    auto &keys = this->session->keys(slot_count);
+    context[i] = keys.context;
+    encryptor[i] = keys.encryptor;
+    decryptor[i] = keys.decryptor;
+    evaluator[i] = keys.evaluator;
+    encoder[i] = keys.encoder;
+    zero[i] = keys.zero;
+  }
 }
 
 ConvField::~ConvField() {
-  for (int i = 0; i < 2; i++) {
-    free_keys(party, encryptor[i], decryptor[i], evaluator[i], encoder[i],
-              gal_keys[i], zero[i]);
+  if (own_session) {
+    delete session;
   }
 }
 
@@ -485,10 +773,32 @@ void ConvField::configure() {
   data.filter_size = data.filter_h * data.filter_w;
 
   assert(data.out_chans > 0 && data.inp_chans > 0);
-  // Doesn't currently support a channel being larger than a half ciphertext
-  assert(data.image_size <= (slot_count / 2));
+  assert(!data.depthwise || data.out_chans % data.inp_chans == 0);
 
+  data.output_h = 1 + (data.image_h + data.pad_t + data.pad_b - data.filter_h) /
+                          data.stride_h;
+  data.output_w = 1 + (data.image_w + data.pad_l + data.pad_r - data.filter_w) /
+                          data.stride_w;
+
+  configure_coeff(data);
   data.pack_num = slot_count / 2;
+  // The rotation engine doesn't support a channel being larger than a half
+  // ciphertext, or depthwise convolutions
+  if (!data.depthwise && data.image_size <= (size_t)data.pack_num) {
+    configure_rotation();
+  }
+  if (engine == ConvEngine::AUTO) {
+    data.engine = coeff_conv_cost(data) < rotation_conv_cost(data)
+                      ? ConvEngine::COEFF
+                      : ConvEngine::ROTATION;
+  } else {
+    data.engine = engine;
+  }
+  assert(isfinite(data.engine == ConvEngine::COEFF ? coeff_conv_cost(data)
+                                                   : rotation_conv_cost(data)));
+}
+
+void ConvField::configure_rotation() {
   data.chans_per_half = data.pack_num / data.image_size;
   data.out_ct = ceil((float)data.out_chans / (2 * data.chans_per_half));
   data.inp_ct = ceil((float)data.inp_chans / (2 * data.chans_per_half));
@@ -509,11 +819,146 @@ void ConvField::configure() {
           ? data.chans_per_half
           : max(data.chans_per_half, max(data.out_chans, data.inp_chans));
   data.convs = data.half_perms * data.half_rots;
+}
 
-  data.output_h = 1 + (data.image_h + data.pad_t + data.pad_b - data.filter_h) /
-                          data.stride_h;
-  data.output_w = 1 + (data.image_w + data.pad_l + data.pad_r - data.filter_w) /
-                          data.stride_w;
+const vector<Plaintext> &ConvField::filter_masks(Filters &filters,
+                                                shared_ptr<SEALContext> context_,
+                                                BatchEncoder &encoder_,
+                                                Evaluator &evaluator_) {
+  PlaintextCache::Key key(context_->first_parms_id());
+  key.put((int64_t)ConvEngine::ROTATION);
+  for (int64_t v : {data.image_h, data.image_w, data.inp_chans, data.out_chans,
+                    data.filter_h, data.filter_w, data.pad_t, data.pad_b,
+                    data.pad_l, data.pad_r, data.stride_h, data.stride_w}) {
+    key.put(v);
+  }
+  for (auto &filter : filters) {
+    for (auto &chan : filter) {
+      key.put(chan.data(), chan.size() * sizeof(uint64_t));
+    }
+  }
+  return plain_cache.lookup(key, context_, [&]() {
+    auto masks = HE_preprocess_filters_OP(filters, data, encoder_);
+    plaintexts_to_ntt(masks, evaluator_, context_->first_parms_id());
+    return masks;
+  });
+}
+
+const vector<Plaintext> &ConvField::filter_polys(Filters &filters,
+                                                shared_ptr<SEALContext> context_,
+                                                Evaluator &evaluator_) {
+  PlaintextCache::Key key(context_->first_parms_id());
+  key.put((int64_t)ConvEngine::COEFF);
+  for (int64_t v : {data.image_h, data.image_w, data.inp_chans, data.out_chans,
+                    data.filter_h, data.filter_w, (int32_t)data.depthwise,
+                    data.coeff_chans, data.tile_h, data.tile_w}) {
+    key.put(v);
+  }
+  for (auto &filter : filters) {
+    for (auto &chan : filter) {
+      key.put(chan.data(), chan.size() * sizeof(uint64_t));
+    }
+  }
+  return plain_cache.lookup(key, context_, [&]() {
+    auto coeffs = preprocess_filters_coeff(filters, data);
+    vector<Plaintext> polys(coeffs.size());
+    for (size_t i = 0; i < coeffs.size(); i++) {
+      polys[i].resize(coeffs[i].size());
+      copy(coeffs[i].begin(), coeffs[i].end(), polys[i].data());
+    }
+    plaintexts_to_ntt(polys, evaluator_, context_->first_parms_id());
+    return polys;
+  });
+}
+
+// The filter elements that the stride offset (s_row, s_col) applies, reduced
+// mod prime_mod
+static Filters strided_filters(
+    vector<vector<vector<vector<uint64_t>>>> &filterArr, int32_t CI,
+    int32_t CO, int32_t strideH, int32_t strideW, int s_row, int s_col,
+    int lFH, int lFW) {
+  Filters lFilters(CO);
+  for (int out_c = 0; out_c < CO; out_c++) {
+    Image tmp_img(CI);
+    for (int inp_c = 0; inp_c < CI; inp_c++) {
+      Channel tmp_chan(lFH, lFW);
+      for (int row = 0; row < lFH; row++) {
+        for (int col = 0; col < lFW; col++) {
+          int idxFH = row * strideH + s_row;
+          int idxFW = col * strideW + s_col;
+          tmp_chan(row, col) = neg_mod(filterArr[idxFH][idxFW][inp_c][out_c],
+                                       (int64_t)prime_mod);
+        }
+      }
+      tmp_img[inp_c] = tmp_chan;
+    }
+    lFilters[out_c] = tmp_img;
+  }
+  return lFilters;
+}
+
+void ConvField::prepare_filters(
+    int32_t H, int32_t W, int32_t CI, int32_t FH, int32_t FW, int32_t CO,
+    int32_t zPadHLeft, int32_t zPadHRight, int32_t zPadWLeft,
+    int32_t zPadWRight, int32_t strideH, int32_t strideW,
+    vector<vector<vector<vector<uint64_t>>>> &filterArr, bool depthwise) {
+  assert(party == ALICE);
+  int paddedH = H + zPadHLeft + zPadHRight;
+  int paddedW = W + zPadWLeft + zPadWRight;
+  int limitH = FH + ((paddedH - FH) / strideH) * strideH;
+  int limitW = FW + ((paddedW - FW) / strideW) * strideW;
+
+  // Same split into non-strided convolutions as in convolution
+  for (int s_row = 0; s_row < strideH; s_row++) {
+    for (int s_col = 0; s_col < strideW; s_col++) {
+      int lH = ((limitH - s_row + strideH - 1) / strideH);
+      int lW = ((limitW - s_col + strideW - 1) / strideW);
+      int lFH = ((FH - s_row + strideH - 1) / strideH);
+      int lFW = ((FW - s_col + strideW - 1) / strideW);
+      if (lFH <= 0 || lFW <= 0) {
+        continue;
+      }
+      Filters lFilters =
+          strided_filters(filterArr, depthwise ? 1 : CI, CO, strideH, strideW,
+                          s_row, s_col, lFH, lFW);
+      data.image_h = lH;
+      data.image_w = lW;
+      data.inp_chans = CI;
+      data.out_chans = CO;
+      data.filter_h = lFH;
+      data.filter_w = lFW;
+      data.pad_t = 0;
+      data.pad_b = 0;
+      data.pad_l = 0;
+      data.pad_r = 0;
+      data.stride_h = 1;
+      data.stride_w = 1;
+      data.depthwise = depthwise;
+      this->slot_count =
+          min(SEAL_POLY_MOD_DEGREE_MAX, max(8192, 2 * next_pow2(lH * lW)));
+      configure();
+      if (data.engine == ConvEngine::COEFF) {
+        this->slot_count = data.coeff_degree;
+      }
+
+      // The encoding only depends on the parameters, not on the keys
+      shared_ptr<SEALContext> context_;
+      if (slot_count == POLY_MOD_DEGREE) {
+        context_ = this->context[0];
+      } else if (slot_count == POLY_MOD_DEGREE_LARGE) {
+        context_ = this->context[1];
+      } else {
+        context_ = make_context(slot_count);
+      }
+      BatchEncoder encoder_(context_);
+      Evaluator evaluator_(context_);
+      if (data.engine == ConvEngine::COEFF) {
+        filter_polys(lFilters, context_, evaluator_);
+      } else {
+        filter_masks(lFilters, context_, encoder_, evaluator_);
+      }
+    }
+  }
 }
 
 Image ConvField::ideal_functionality(Image &image, Filters &filters) {
@@ -524,19 +969,29 @@ Image ConvField::ideal_functionality(Image &image, Filters &filters) {
   int output_w = data.output_w;
 
   auto p_image = pad_image(data, image);
-  const int col_height = filter_h * filter_w * channels;
+  // A depthwise filter only sees its own channel, so each channel gets its
+  // own columns
+  const int groups = data.depthwise ? channels : 1;
+  const int group_chans = channels / groups;
+  const int col_height = filter_h * filter_w * group_chans;
   const int col_width = output_h * output_w;
-  Channel image_col(col_height, col_width);
-  i2c(p_image, image_col, data.filter_h, data.filter_w, data.stride_h,
-      data.stride_w, data.output_h, data.output_w);
+  vector<Channel> image_cols(groups);
+  for (int g = 0; g < groups; g++) {
+    Image group_image(p_image.begin() + g * group_chans,
+                      p_image.begin() + (g + 1) * group_chans);
+    image_cols[g].resize(col_height, col_width);
+    i2c(group_image, image_cols[g], data.filter_h, data.filter_w,
+        data.stride_h, data.stride_w, data.output_h, data.output_w);
+  }
 
   // For each filter, flatten it into and multiply with image_col
   Image result;
-  for (auto &filter : filters) {
+  for (size_t out_c = 0; out_c < filters.size(); out_c++) {
+    auto &filter = filters[out_c];
     Channel filter_col(1, col_height);
     // Use im2col with a filter size 1x1 to translate
     i2c(filter, filter_col, 1, 1, 1, 1, filter_h, filter_w);
-    Channel tmp = filter_col * image_col;
+    Channel tmp = filter_col * image_cols[out_c * groups / filters.size()];
 
     // Reshape result of multiplication to the right size
     // SEAL stores matrices in RowMajor form
@@ -551,7 +1006,7 @@ void ConvField::non_strided_conv(int32_t H, int32_t W, int32_t CI, int32_t FH,
                                  int32_t FW, int32_t CO, Image *image,
                                  Filters *filters,
                                  vector<vector<vector<uint64_t>>> &outArr,
-                                 bool verbose) {
+                                 bool verbose, bool depthwise) {
   data.image_h = H;
   data.image_w = W;
   data.inp_chans = CI;
@@ -564,9 +1019,18 @@ void ConvField::non_strided_conv(int32_t H, int32_t W, int32_t CI, int32_t FH,
   data.pad_r = 0;
   data.stride_h = 1;
   data.stride_w = 1;
+  data.depthwise = depthwise;
   this->slot_count =
       min(SEAL_POLY_MOD_DEGREE_MAX, max(8192, 2 * next_pow2(H * W)));
   configure();
+  if (verbose)
+    cout << "[Conv] Engine: "
+         << (data.engine == ConvEngine::COEFF ? "coefficient" : "rotation")
+         << endl;
+  if (data.engine == ConvEngine::COEFF) {
+    coeff_conv(image, filters, outArr, verbose);
+    return;
+  }
 
   shared_ptr<SEALContext> context_;
   Encryptor *encryptor_;
@@ -581,7 +1045,6 @@ void ConvField::non_strided_conv(int32_t H, int32_t W, int32_t CI, int32_t FH,
     decryptor_ = this->decryptor[0];
     evaluator_ = this->evaluator[0];
     encoder_ = this->encoder[0];
-    gal_keys_ = this->gal_keys[0];
     zero_ = this->zero[0];
   } else if (slot_count == POLY_MOD_DEGREE_LARGE) {
     context_ = this->context[1];
@@ -589,12 +1052,20 @@ void ConvField::non_strided_conv(int32_t H, int32_t W, int32_t CI, int32_t FH,
     decryptor_ = this->decryptor[1];
     evaluator_ = this->evaluator[1];
     encoder_ = this->encoder[1];
-    gal_keys_ = this->gal_keys[1];
     zero_ = this->zero[1];
   } else {
-    generate_new_keys(party, io, slot_count, context_, encryptor_, decryptor_,
-                      evaluator_, encoder_, gal_keys_, zero_, verbose);
+    auto &keys = session->keys(slot_count);
+    context_ = keys.context;
+    encryptor_ = keys.encryptor;
+    decryptor_ = keys.decryptor;
+    evaluator_ = keys.evaluator;
+    encoder_ = keys.encoder;
+    zero_ = keys.zero;
   }
+  // The rotation amounts depend on the layer, so rotations are composed from
+  // power-of-2 steps. The keys are sent the first time a layer needs them.
+  gal_keys_ = &session->galois_keys(slot_count,
+                                    power_of_two_galois_steps(slot_count));
 
   if (party == BOB) {
     auto pt = preprocess_image_OP(*image, data);
@@ -602,12 +1073,12 @@ void ConvField::non_strided_conv(int32_t H, int32_t W, int32_t CI, int32_t FH,
       cout << "[Client] Image preprocessed" << endl;
 
     auto ct = HE_encrypt(pt, data, *encryptor_, *encoder_);
-    send_encrypted_vector(io, ct);
+    send_encrypted_vector(io, ct, context_);
     if (verbose)
       cout << "[Client] Image encrypted and sent" << endl;
 
     vector<Ciphertext> enc_result(data.out_ct);
-    recv_encrypted_vector(io, enc_result);
+    recv_encrypted_vector(io, enc_result, context_);
     auto HE_result = HE_decrypt(enc_result, data, *decryptor_, *encoder_);
 
     if (verbose)
@@ -634,8 +1105,7 @@ void ConvField::non_strided_conv(int32_t H, int32_t W, int32_t CI, int32_t FH,
     if (verbose)
       cout << "[Server] Noise processed" << endl;
 
-    vector<vector<vector<Plaintext>>> masks_OP;
-    masks_OP = HE_preprocess_filters_OP(*filters, data, *encoder_);
+    auto &masks_OP = filter_masks(*filters, context_, *encoder_, *evaluator_);
 
     if (verbose)
       cout << "[Server] Filters processed" << endl;
@@ -646,7 +1116,7 @@ void ConvField::non_strided_conv(int32_t H, int32_t W, int32_t CI, int32_t FH,
     for (int i = 0; i < data.inp_ct; i++) {
       rotations[i].resize(data.filter_size);
     }
-    recv_encrypted_vector(io, ct);
+    recv_encrypted_vector(io, ct, context_);
     rotations = filter_rotations(ct, data, evaluator_, gal_keys_);
     if (verbose)
       cout << "[Server] Filter Rotations done" << endl;
@@ -678,23 +1148,28 @@ void ConvField::non_strided_conv(int32_t H, int32_t W, int32_t CI, int32_t FH,
     parms_id_type parms_id = result[0].parms_id();
     shared_ptr<const SEALContext::ContextData> context_data =
         context_->get_context_data(parms_id);
+    // Each output ciphertext is sent as soon as it is flooded and packed, so
+    // the transfer overlaps with finishing the rest
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1) ordered
     for (size_t ct_idx = 0; ct_idx < result.size(); ct_idx++) {
       flood_ciphertext(result[ct_idx], context_data, SMUDGING_BITLEN);
-    }
 
 #ifdef HE_DEBUG
-    PRINT_NOISE_BUDGET(decryptor_, result[0], "after noise flooding");
+      if (!ct_idx)
+        PRINT_NOISE_BUDGET(decryptor_, result[0], "after noise flooding");
 #endif
 
-    for (size_t ct_idx = 0; ct_idx < result.size(); ct_idx++) {
       evaluator_->mod_switch_to_next_inplace(result[ct_idx]);
-    }
 
 #ifdef HE_DEBUG
-    PRINT_NOISE_BUDGET(decryptor_, result[0], "after mod-switch");
+      if (!ct_idx)
+        PRINT_NOISE_BUDGET(decryptor_, result[0], "after mod-switch");
 #endif
 
-    send_encrypted_vector(io, result);
+      vector<uint64_t> packed = pack_ciphertext(result[ct_idx], context_);
+#pragma omp ordered
+      send_packed_ciphertext(io, packed);
+    }
     if (verbose)
       cout << "[Server] Result computed and sent" << endl;
 
@@ -708,9 +1183,107 @@ void ConvField::non_strided_conv(int32_t H, int32_t W, int32_t CI, int32_t FH,
       delete[] secret_share[i];
     delete[] secret_share;
   }
-  if (slot_count > POLY_MOD_DEGREE && slot_count < POLY_MOD_DEGREE_LARGE) {
-    free_keys(party, encryptor_, decryptor_, evaluator_, encoder_, gal_keys_,
-              zero_);
+}
+
+void ConvField::coeff_conv(Image *image, Filters *filters,
+                           vector<vector<vector<uint64_t>>> &outArr,
+                           bool verbose) {
+  auto &keys = session->keys(data.coeff_degree);
+  shared_ptr<SEALContext> context_ = keys.context;
+  int CO = data.out_chans;
+
+  if (party == BOB) {
+    auto pt = preprocess_image_coeff(*image, data);
+    if (verbose)
+      cout << "[Client] Image preprocessed" << endl;
+
+    auto ct = HE_encrypt_coeff(pt, *keys.encryptor);
+    send_encrypted_vector(io, ct, context_);
+    if (verbose)
+      cout << "[Client] Image encrypted and sent" << endl;
+
+    vector<Ciphertext> enc_result(data.coeff_out_ct);
+    recv_encrypted_vector(io, enc_result, context_);
+    auto HE_result = HE_decrypt_coeff(enc_result, data, *keys.decryptor);
+
+    if (verbose)
+      cout << "[Client] Result received and decrypted" << endl;
+
+    for (int idx = 0; idx < data.output_h * data.output_w; idx++) {
+      for (int chan = 0; chan < CO; chan++) {
+        outArr[idx / data.output_w][idx % data.output_w][chan] +=
+            HE_result[chan][idx];
+      }
+    }
+    for (int chan = 0; chan < CO; chan++)
+      delete[] HE_result[chan];
+    delete[] HE_result;
+  } else // party == ALICE
+  {
+    // Every coefficient of a result is masked, since the ones outside the
+    // outputs hold partial sums of the filters
+    PRG128 prg;
+    vector<vector<uint64_t>> mask(data.coeff_out_ct,
+                                  vector<uint64_t>(data.coeff_degree));
+    for (int ct_idx = 0; ct_idx < data.coeff_out_ct; ct_idx++) {
+      prg.random_mod_p<uint64_t>(mask[ct_idx].data(), data.coeff_degree,
+                                 prime_mod);
+    }
+
+    auto &filter_pt = filter_polys(*filters, context_, *keys.evaluator);
+    if (verbose)
+      cout << "[Server] Filters processed" << endl;
+
+    vector<Ciphertext> ct(data.coeff_inp_ct);
+    recv_encrypted_vector(io, ct, context_);
+
+#ifdef HE_DEBUG
+    PRINT_NOISE_BUDGET(keys.decryptor, ct[0], "before homomorphic convolution");
+#endif
+
+    auto result =
+        HE_conv_coeff(filter_pt, ct, data, *keys.evaluator, *keys.zero);
+    if (verbose)
+      cout << "[Server] Convolution done" << endl;
+
+#ifdef HE_DEBUG
+    PRINT_NOISE_BUDGET(keys.decryptor, result[0],
+                       "after homomorphic convolution");
+#endif
+
+    parms_id_type parms_id = result[0].parms_id();
+    shared_ptr<const SEALContext::ContextData> context_data =
+        context_->get_context_data(parms_id);
+    // As in non_strided_conv, each result is sent as soon as it is ready
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1) ordered
+    for (int ct_idx = 0; ct_idx < data.coeff_out_ct; ct_idx++) {
+      Plaintext mask_pt(data.coeff_degree);
+      copy(mask[ct_idx].begin(), mask[ct_idx].end(), mask_pt.data());
+      keys.evaluator->add_plain_inplace(result[ct_idx], mask_pt);
+      flood_ciphertext(result[ct_idx], context_data, SMUDGING_BITLEN);
+      keys.evaluator->mod_switch_to_next_inplace(result[ct_idx]);
+
+#ifdef HE_DEBUG
+      if (!ct_idx)
+        PRINT_NOISE_BUDGET(keys.decryptor, result[0], "after mod-switch");
+#endif
+
+      vector<uint64_t> packed = pack_ciphertext(result[ct_idx], context_);
+#pragma omp ordered
+      send_packed_ciphertext(io, packed);
+    }
+    if (verbose)
+      cout << "[Server] Result computed and sent" << endl;
+
+    for (int chan = 0; chan < CO; chan++) {
+      for (int row = 0; row < data.output_h; row++) {
+        for (int col = 0; col < data.output_w; col++) {
+          int ct_idx, coeff;
+          coeff_output_position(data, chan, row, col, ct_idx, coeff);
+          outArr[row][col][chan] += (prime_mod - mask[ct_idx][coeff]);
+        }
+      }
+    }
   }
 }
 
@@ -723,6 +1296,34 @@ void ConvField::convolution(int32_t N, int32_t H, int32_t W, int32_t CI,
                             vector<vector<vector<vector<uint64_t>>>> &filterArr,
                             vector<vector<vector<vector<uint64_t>>>> &outArr,
                             bool verify_output, bool verbose) {
+  strided_conv(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft,
+               zPadWRight, strideH, strideW, false, inputArr, filterArr, outArr,
+               verify_output, verbose);
+}
+
+void ConvField::depthwise_convolution(
+    int32_t N, int32_t H, int32_t W, int32_t CI, int32_t FH, int32_t FW,
+    int32_t CO, int32_t zPadHLeft, int32_t zPadHRight, int32_t zPadWLeft,
+    int32_t zPadWRight, int32_t strideH, int32_t strideW,
+    vector<vector<vector<vector<uint64_t>>>> &inputArr,
+    vector<vector<vector<vector<uint64_t>>>> &filterArr,
+    vector<vector<vector<vector<uint64_t>>>> &outArr, bool verify_output,
+    bool verbose) {
+  strided_conv(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft,
+               zPadWRight, strideH, strideW, true, inputArr, filterArr, outArr,
+               verify_output, verbose);
+}
+
+void ConvField::strided_conv(
+    int32_t N, int32_t H, int32_t W, int32_t CI, int32_t FH, int32_t FW,
+    int32_t CO, int32_t zPadHLeft, int32_t zPadHRight, int32_t zPadWLeft,
+    int32_t zPadWRight, int32_t strideH, int32_t strideW, bool depthwise,
+    vector<vector<vector<vector<uint64_t>>>> &inputArr,
+    vector<vector<vector<vector<uint64_t>>>> &filterArr,
+    vector<vector<vector<vector<uint64_t>>>> &outArr, bool verify_output,
+    bool verbose) {
+  // A depthwise filter has a single input channel
+  int filter_chans = depthwise ? 1 : CI;
   int paddedH = H + zPadHLeft + zPadHRight;
   int paddedW = W + zPadWLeft + zPadWRight;
   int newH = 1 + (paddedH - FH) / strideH;
@@ -779,7 +1380,7 @@ void ConvField::convolution(int32_t N, int32_t H, int32_t W, int32_t CI,
         }
         if (lFH > 0 && lFW > 0) {
           non_strided_conv(lH, lW, CI, lFH, lFW, CO, &lImage, nullptr,
-                           outArr[0], verbose);
+                           outArr[0], verbose, depthwise);
         }
       }
     }
@@ -795,8 +1396,8 @@ void ConvField::convolution(int32_t N, int32_t H, int32_t W, int32_t CI,
   {
     filters.resize(CO);
     for (int out_c = 0; out_c < CO; out_c++) {
-      Image tmp_img(CI);
-      for (int inp_c = 0; inp_c < CI; inp_c++) {
+      Image tmp_img(filter_chans);
+      for (int inp_c = 0; inp_c < filter_chans; inp_c++) {
         Channel tmp_chan(FH, FW);
         for (int idx = 0; idx < FH * FW; idx++) {
           int64_t val = (int64_t)filterArr[idx / FW][idx % FW][inp_c][out_c];
@@ -816,26 +1417,12 @@ void ConvField::convolution(int32_t N, int32_t H, int32_t W, int32_t CI,
         int lW = ((limitW - s_col + strideW - 1) / strideW);
         int lFH = ((FH - s_row + strideH - 1) / strideH);
         int lFW = ((FW - s_col + strideW - 1) / strideW);
-        Filters lFilters(CO);
-        for (int out_c = 0; out_c < CO; out_c++) {
-          Image tmp_img(CI);
-          for (int inp_c = 0; inp_c < CI; inp_c++) {
-            Channel tmp_chan(lFH, lFW);
-            for (int row = 0; row < lFH; row++) {
-              for (int col = 0; col < lFW; col++) {
-                int idxFH = row * strideH + s_row;
-                int idxFW = col * strideW + s_col;
-                tmp_chan(row, col) = neg_mod(
-                    filterArr[idxFH][idxFW][inp_c][out_c], (int64_t)prime_mod);
-              }
-            }
-            tmp_img[inp_c] = tmp_chan;
-          }
-          lFilters[out_c] = tmp_img;
-        }
         if (lFH > 0 && lFW > 0) {
+          Filters lFilters =
+              strided_filters(filterArr, filter_chans, CO, strideH, strideW,
+                              s_row, s_col, lFH, lFW);
           non_strided_conv(lH, lW, CI, lFH, lFW, CO, nullptr, &lFilters,
-                           outArr[0], verbose);
+                           outArr[0], verbose, depthwise);
         }
       }
     }
@@ -851,6 +1438,7 @@ void ConvField::convolution(int32_t N, int32_t H, int32_t W, int32_t CI,
     data.pad_r = zPadWRight;
     data.stride_h = strideH;
     data.stride_w = strideW;
+    data.depthwise = depthwise;
 
     // The filter values should be small enough to not overflow uint64_t
     Image local_result = ideal_functionality(image, filters);
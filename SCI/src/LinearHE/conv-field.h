@@ -26,7 +26,8 @@ Modified by Deevashwer Rathee
 #ifndef CONV_FIELD_H__
 #define CONV_FIELD_H__
 
-#include "LinearHE/utils-HE.h"
+#include "LinearHE/he-session.h"
+#include "LinearHE/plaintext-cache.h"
 #include <Eigen/Dense>
 
 // This is to keep compatibility for im2col implementations
@@ -35,6 +36,17 @@ typedef Eigen::Matrix<uint64_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
 typedef std::vector<Channel> Image;
 typedef std::vector<Image> Filters;
 
+// How non_strided_conv computes a convolution
+enum class ConvEngine {
+  // Picked per layer, by comparing rotation_conv_cost and coeff_conv_cost
+  AUTO,
+  // Channels batch-encoded into slots, filters applied with rotations
+  ROTATION,
+  // Channels coefficient-encoded into polynomials, whose products leave the
+  // convolution in some of the coefficients. Needs no rotations.
+  COEFF,
+};
+
 struct ConvMetadata {
   int slot_count;
   // Number of plaintext slots in a half ciphertext
@@ -76,6 +88,22 @@ struct ConvMetadata {
   int32_t pad_b;
   int32_t pad_r;
   int32_t pad_l;
+  // Output channel o only sees input channel o / (out_chans / inp_chans)
+  bool depthwise;
+  // The engine chosen by configure
+  ConvEngine engine;
+  // Coefficient encoding: the polynomial degree, the input channels in one
+  // polynomial, the size of an input tile (neighbouring tiles overlap by
+  // filter_h - 1 rows and filter_w - 1 columns) and the number of tiles
+  int32_t coeff_degree;
+  int32_t coeff_chans;
+  int32_t tile_h;
+  int32_t tile_w;
+  int32_t tiles_h;
+  int32_t tiles_w;
+  // Number of input and output ciphertexts with coefficient encoding
+  int32_t coeff_inp_ct;
+  int32_t coeff_out_ct;
 };
 
 /* Use casting to do two conditionals instead of one - check if a > 0 and a < b
@@ -109,12 +137,19 @@ std::vector<seal::Ciphertext> HE_encrypt(std::vector<std::vector<uint64_t>> &pt,
                                          seal::Encryptor &encryptor,
                                          seal::BatchEncoder &batch_encoder);
 
-std::vector<std::vector<std::vector<seal::Plaintext>>>
+// Position of the mask for (convolution, input ciphertext, filter element)
+inline int mask_index(const ConvMetadata &data, int conv_idx, int ct_idx,
+                      int f) {
+  return (conv_idx * data.inp_ct + ct_idx) * data.filter_size + f;
+}
+
+std::vector<seal::Plaintext>
 HE_preprocess_filters_OP(Filters &filters, const ConvMetadata &data,
                          seal::BatchEncoder &batch_encoder);
 
+// masks are in NTT form (see plaintexts_to_ntt)
 std::vector<seal::Ciphertext>
-HE_conv_OP(std::vector<std::vector<std::vector<seal::Plaintext>>> &masks,
+HE_conv_OP(const std::vector<seal::Plaintext> &masks,
            std::vector<std::vector<seal::Ciphertext>> &rotations,
            const ConvMetadata &data, seal::Evaluator &evaluator,
            seal::Ciphertext &zero);
@@ -129,6 +164,49 @@ uint64_t **HE_decrypt(std::vector<seal::Ciphertext> &enc_result,
                       const ConvMetadata &data, seal::Decryptor &decryptor,
                       seal::BatchEncoder &batch_encoder);
 
+// Chooses the coefficient encoding parameters of data for the lowest
+// coeff_conv_cost. Convolutions with padding or stride get none.
+void configure_coeff(ConvMetadata &data);
+
+// Estimated cost of a convolution with each engine, infinite when the engine
+// cannot compute it
+double rotation_conv_cost(const ConvMetadata &data);
+
+double coeff_conv_cost(const ConvMetadata &data);
+
+// Number of input channel blocks of coeff_chans channels
+inline int coeff_blocks(const ConvMetadata &data) {
+  return (data.inp_chans + data.coeff_chans - 1) / data.coeff_chans;
+}
+
+// Output ciphertext and coefficient holding output (out_c, row, col) with
+// coefficient encoding
+void coeff_output_position(const ConvMetadata &data, int out_c, int row,
+                           int col, int &ct_idx, int &coeff);
+
+// Coefficients of the input polynomials, one per tile and channel block
+std::vector<std::vector<uint64_t>> preprocess_image_coeff(Image &image,
+                                                          const ConvMetadata &data);
+
+// Coefficients of the filter polynomials, one per output channel and channel
+// block, or for depthwise convolutions one per channel block and multiplier
+std::vector<std::vector<uint64_t>>
+preprocess_filters_coeff(Filters &filters, const ConvMetadata &data);
+
+std::vector<seal::Ciphertext>
+HE_encrypt_coeff(std::vector<std::vector<uint64_t>> &pt,
+                 seal::Encryptor &encryptor);
+
+// filters are in NTT form (see plaintexts_to_ntt)
+std::vector<seal::Ciphertext>
+HE_conv_coeff(const std::vector<seal::Plaintext> &filters,
+              std::vector<seal::Ciphertext> &input, const ConvMetadata &data,
+              seal::Evaluator &evaluator, seal::Ciphertext &zero);
+
+uint64_t **HE_decrypt_coeff(std::vector<seal::Ciphertext> &enc_result,
+                            const ConvMetadata &data,
+                            seal::Decryptor &decryptor);
+
 class ConvField {
 public:
   int party;
@@ -138,23 +216,58 @@ public:
   seal::Decryptor *decryptor[2];
   seal::Evaluator *evaluator[2];
   seal::BatchEncoder *encoder[2];
-  seal::GaloisKeys *gal_keys[2];
   seal::Ciphertext *zero[2];
+  // Keys, shared with the other protocols when the session is passed in
+  HESession *session;
+  bool own_session;
   size_t slot_count;
   ConvMetadata data;
+  // Engine for every layer, or AUTO to choose per layer. Must be the same for
+  // both parties.
+  ConvEngine engine = ConvEngine::AUTO;
+  // Encoded filter masks, reused across calls (server only)
+  PlaintextCache plain_cache;
 
-  ConvField(int party, sci::NetIO *io);
+  ConvField(int party, sci::NetIO *io, HESession *session = nullptr);
 
   ~ConvField();
 
+  // Sets up data for the current layer and chooses its engine
   void configure();
 
+  // The rotation engine part of configure
+  void configure_rotation();
+
+  // Encodes the filters of a convolution ahead of the first call to
+  // convolution with them, without communication (server only)
+  void prepare_filters(
+      int32_t H, int32_t W, int32_t CI, int32_t FH, int32_t FW, int32_t CO,
+      int32_t zPadHLeft, int32_t zPadHRight, int32_t zPadWLeft,
+      int32_t zPadWRight, int32_t strideH, int32_t strideW,
+      std::vector<std::vector<std::vector<std::vector<uint64_t>>>> &filterArr,
+      bool depthwise = false);
+
+  // Encoded masks of filters for the current data, from plain_cache
+  const std::vector<seal::Plaintext> &
+  filter_masks(Filters &filters, std::shared_ptr<seal::SEALContext> context_,
+               seal::BatchEncoder &encoder_, seal::Evaluator &evaluator_);
+
+  // Encoded filter polynomials for the current data, from plain_cache
+  const std::vector<seal::Plaintext> &
+  filter_polys(Filters &filters, std::shared_ptr<seal::SEALContext> context_,
+               seal::Evaluator &evaluator_);
+
   Image ideal_functionality(Image &image, Filters &filters);
 
   void non_strided_conv(int32_t H, int32_t W, int32_t CI, int32_t FH,
                         int32_t FW, int32_t CO, Image *image, Filters *filters,
                         std::vector<std::vector<std::vector<uint64_t>>> &outArr,
-                        bool verbose = false);
+                        bool verbose = false, bool depthwise = false);
+
+  // non_strided_conv with the coefficient engine, for the configured data
+  void coeff_conv(Image *image, Filters *filters,
+                  std::vector<std::vector<std::vector<uint64_t>>> &outArr,
+                  bool verbose = false);
 
   void convolution(
       int32_t N, int32_t H, int32_t W, int32_t CI, int32_t FH, int32_t FW,
@@ -165,6 +278,27 @@ public:
       std::vector<std::vector<std::vector<std::vector<uint64_t>>>> &outArr,
       bool verify_output = false, bool verbose = false);
 
+  // Convolution of each input channel c with the filters c * M to
+  // (c + 1) * M - 1, where M = CO / CI. filterArr is FH x FW x 1 x CO.
+  void depthwise_convolution(
+      int32_t N, int32_t H, int32_t W, int32_t CI, int32_t FH, int32_t FW,
+      int32_t CO, int32_t zPadHLeft, int32_t zPadHRight, int32_t zPadWLeft,
+      int32_t zPadWRight, int32_t strideH, int32_t strideW,
+      std::vector<std::vector<std::vector<std::vector<uint64_t>>>> &inputArr,
+      std::vector<std::vector<std::vector<std::vector<uint64_t>>>> &filterArr,
+      std::vector<std::vector<std::vector<std::vector<uint64_t>>>> &outArr,
+      bool verify_output = false, bool verbose = false);
+
+  // Splits a strided, padded convolution into non-strided ones
+  void strided_conv(
+      int32_t N, int32_t H, int32_t W, int32_t CI, int32_t FH, int32_t FW,
+      int32_t CO, int32_t zPadHLeft, int32_t zPadHRight, int32_t zPadWLeft,
+      int32_t zPadWRight, int32_t strideH, int32_t strideW, bool depthwise,
+      std::vector<std::vector<std::vector<std::vector<uint64_t>>>> &inputArr,
+      std::vector<std::vector<std::vector<std::vector<uint64_t>>>> &filterArr,
+      std::vector<std::vector<std::vector<std::vector<uint64_t>>>> &outArr,
+      bool verify_output, bool verbose);
+
   void
   verify(int H, int W, int CI, int CO, Image &image, Filters *filters,
          std::vector<std::vector<std::vector<std::vector<uint64_t>>>> &outArr);
@@ -25,16 +25,28 @@ using namespace std;
 using namespace seal;
 using namespace sci;
 
-ElemWiseProdField::ElemWiseProdField(int party, NetIO *io) {
+ElemWiseProdField::ElemWiseProdField(int party, NetIO *io,
+                                     HESession *session) {
   this->party = party;
   this->io = io;
+  this->own_session = (session == nullptr);
+  this->session = own_session ? new HESession(party, io) : session;
   this->slot_count = POLY_MOD_DEGREE;
-  generate_new_keys(party, io, slot_count, context, encryptor, decryptor,
-                    evaluator, encoder, gal_keys, zero);
+  // Slot-wise products need no Galois keys
+  auto &keys = this->session->keys(slot_count);
+  context = keys.context;
+  encryptor = keys.encryptor;
+  decryptor = keys.decryptor;
+  evaluator = keys.evaluator;
+  encoder = keys.encoder;
+  gal_keys = keys.gal_keys;
+  zero = keys.zero;
 }
 
 ElemWiseProdField::~ElemWiseProdField() {
-  free_keys(party, encryptor, decryptor, evaluator, encoder, gal_keys, zero);
+  if (own_session) {
+    delete session;
+  }
 }
 
 vector<uint64_t>
@@ -66,10 +78,10 @@ void ElemWiseProdField::elemwise_product(int32_t size, vector<uint64_t> &inArr,
       encoder->encode(tmp_vec, tmp_pt);
       encryptor->encrypt(tmp_pt, ct[i]);
     }
-    send_encrypted_vector(io, ct);
+    send_encrypted_vector(io, ct, context);
 
     vector<Ciphertext> enc_result(num_ct);
-    recv_encrypted_vector(io, enc_result);
+    recv_encrypted_vector(io, enc_result, context);
     for (int i = 0; i < num_ct; i++) {
       int offset = i * slot_count;
       vector<uint64_t> tmp_vec(slot_count, 0);
@@ -106,9 +118,12 @@ void ElemWiseProdField::elemwise_product(int32_t size, vector<uint64_t> &inArr,
     }
 
     vector<Ciphertext> ct(num_ct);
-    recv_encrypted_vector(io, ct);
+    recv_encrypted_vector(io, ct, context);
 
+    // Each product is sent as soon as it is finished, so the transfer
+    // overlaps with computing the rest
     vector<Ciphertext> enc_result(num_ct);
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1) ordered
     for (int i = 0; i < num_ct; i++) {
 #ifdef HE_DEBUG
       if (!i)
@@ -150,8 +165,11 @@ void ElemWiseProdField::elemwise_product(int32_t size, vector<uint64_t> &inArr,
       if (!i)
         PRINT_NOISE_BUDGET(decryptor, enc_result[i], "after mod-switch");
 #endif
+
+      vector<uint64_t> packed = pack_ciphertext(enc_result[i], context);
+#pragma omp ordered
+      send_packed_ciphertext(io, packed);
     }
-    send_encrypted_vector(io, enc_result);
 
     vector<uint64_t> multArr_lifted(size, 0);
     for (int i = 0; i < size; i++) {
@@ -22,7 +22,7 @@ SOFTWARE.
 #ifndef ELEMWISEPROD_FIELD_H__
 #define ELEMWISEPROD_FIELD_H__
 
-#include "LinearHE/utils-HE.h"
+#include "LinearHE/he-session.h"
 
 class ElemWiseProdField {
 public:
@@ -35,9 +35,12 @@ public:
   seal::BatchEncoder *encoder;
   seal::GaloisKeys *gal_keys;
   seal::Ciphertext *zero;
+  // Keys, shared with the other protocols when the session is passed in
+  HESession *session;
+  bool own_session;
   int slot_count;
 
-  ElemWiseProdField(int party, sci::NetIO *io);
+  ElemWiseProdField(int party, sci::NetIO *io, HESession *session = nullptr);
 
   ~ElemWiseProdField();
 
@@ -83,8 +83,21 @@ vector<Plaintext> preprocess_matrix(const uint64_t *const *matrix,
     }
   }
 
+  // fc_online rotates the sum of each group of baby_steps diagonals by the
+  // giant step afterwards, so diagonal j * baby_steps + i is rotated back by
+  // j * baby_steps here. Rotations act on each half of the slots.
+  int half = data.slot_count / 2;
   vector<Plaintext> enc_mat(data.inp_ct);
   for (int ct = 0; ct < data.inp_ct; ct++) {
+    int giant = (ct / data.baby_steps) * data.baby_steps;
+    if (giant != 0) {
+      vector<uint64_t> rotated(data.slot_count);
+      for (int col = 0; col < data.slot_count; col++) {
+        int base = col - col % half;
+        rotated[base + (col % half + giant) % half] = mat_diag[ct][col];
+      }
+      mat_diag[ct] = move(rotated);
+    }
     batch_encoder.encode(mat_diag[ct], enc_mat[ct]);
   }
   return enc_mat;
@@ -116,18 +129,58 @@ Ciphertext fc_preprocess_noise(const uint64_t *secret_share,
   return enc_noise;
 }
 
-Ciphertext fc_online(Ciphertext &ct, vector<Plaintext> &enc_mat,
+Ciphertext fc_online(Ciphertext &ct, const vector<Plaintext> &enc_mat,
                      const FCMetadata &data, Evaluator &evaluator,
                      GaloisKeys &gal_keys, Ciphertext &zero,
                      Ciphertext &enc_noise) {
+  // Baby-step giant-step: sum_k diag_k * rot_k(x) is computed as
+  // sum_j rot_{j*n1}(sum_i diag'_{j*n1+i} * rot_i(x)) with the diagonals
+  // pre-rotated by preprocess_matrix. That takes n1 + n2 rotations instead of
+  // inp_ct. The baby-step rotations of the input are shared by all giant steps
+  // and kept in NTT form, and products are summed in NTT form.
+  int n1 = data.baby_steps;
+  int n2 = data.giant_steps;
+  vector<Ciphertext> baby(n1);
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (int i = 0; i < n1; i++) {
+    if (i == 0) {
+      baby[i] = ct;
+    } else {
+      evaluator.rotate_rows(ct, i, gal_keys, baby[i]);
+    }
+    evaluator.transform_to_ntt_inplace(baby[i]);
+  }
+
+  vector<Ciphertext> giant(n2);
+  vector<char> giant_used(n2, false);
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (int j = 0; j < n2; j++) {
+    Ciphertext tmp;
+    for (int i = 0; i < n1; i++) {
+      auto &mat = enc_mat[j * n1 + i];
+      if (mat.is_zero()) {
+        continue;
+      }
+      if (!giant_used[j]) {
+        evaluator.multiply_plain(baby[i], mat, giant[j]);
+        giant_used[j] = true;
+      } else {
+        evaluator.multiply_plain(baby[i], mat, tmp);
+        evaluator.add_inplace(giant[j], tmp);
+      }
+    }
+    if (giant_used[j]) {
+      evaluator.transform_from_ntt_inplace(giant[j]);
+      if (j != 0) {
+        evaluator.rotate_rows_inplace(giant[j], j * n1, gal_keys);
+      }
+    }
+  }
+
   Ciphertext result = zero;
-  // For each matrix ciphertext, rotate the input vector once and multiply + add
-  Ciphertext tmp;
-  for (int ct_idx = 0; ct_idx < data.inp_ct; ct_idx++) {
-    if (!enc_mat[ct_idx].is_zero()) {
-      evaluator.rotate_rows(ct, ct_idx, gal_keys, tmp);
-      evaluator.multiply_plain_inplace(tmp, enc_mat[ct_idx]);
-      evaluator.add_inplace(result, tmp);
+  for (int j = 0; j < n2; j++) {
+    if (giant_used[j]) {
+      evaluator.add_inplace(result, giant[j]);
     }
   }
   evaluator.mod_switch_to_next_inplace(result);
@@ -148,6 +201,20 @@ Ciphertext fc_online(Ciphertext &ct, vector<Plaintext> &enc_mat,
   return result;
 }
 
+vector<int> fc_galois_steps(const FCMetadata &data) {
+  vector<int> steps;
+  for (int i = 1; i < data.baby_steps; i++) {
+    steps.push_back(i);
+  }
+  for (int j = 1; j < data.giant_steps; j++) {
+    steps.push_back(j * data.baby_steps);
+  }
+  for (int rot = data.inp_ct; rot < next_pow2(data.image_size); rot *= 2) {
+    steps.push_back(rot == data.slot_count / 2 ? 0 : rot);
+  }
+  return steps;
+}
+
 uint64_t *fc_postprocess(Ciphertext &ct, const FCMetadata &data,
                          BatchEncoder &batch_encoder, Decryptor &decryptor) {
   vector<uint64_t> plain(data.slot_count, 0ULL);
@@ -164,16 +231,27 @@ uint64_t *fc_postprocess(Ciphertext &ct, const FCMetadata &data,
   return result;
 }
 
-FCField::FCField(int party, NetIO *io) {
+FCField::FCField(int party, NetIO *io, HESession *session) {
   this->party = party;
   this->io = io;
+  this->own_session = (session == nullptr);
+  this->session = own_session ? new HESession(party, io) : session;
   this->slot_count = POLY_MOD_DEGREE;
-  generate_new_keys(party, io, slot_count, context, encryptor, decryptor,
-                    evaluator, encoder, gal_keys, zero);
+  // Galois keys are requested per layer shape, see matrix_multiplication
+  auto &keys = this->session->keys(slot_count);
+  context = keys.context;
+  encryptor = keys.encryptor;
+  decryptor = keys.decryptor;
+  evaluator = keys.evaluator;
+  encoder = keys.encoder;
+  gal_keys = keys.gal_keys;
+  zero = keys.zero;
 }
 
 FCField::~FCField() {
-  free_keys(party, encryptor, decryptor, evaluator, encoder, gal_keys, zero);
+  if (own_session) {
+    delete session;
+  }
 }
 
 void FCField::configure() {
@@ -186,6 +264,60 @@ void FCField::configure() {
   data.pack_num = slot_count / next_pow2(data.filter_w);
   // How many total ciphertexts we'll need
   data.inp_ct = ceil((float)next_pow2(data.filter_h) / data.pack_num);
+  // inp_ct is a power of 2, split it into about sqrt(inp_ct) baby steps
+  data.baby_steps = 1;
+  while (data.baby_steps * data.baby_steps < data.inp_ct) {
+    data.baby_steps *= 2;
+  }
+  data.giant_steps = data.inp_ct / data.baby_steps;
+}
+
+const vector<Plaintext> &
+FCField::encoded_matrix(const uint64_t *const *matrix_mod_p,
+                        shared_ptr<SEALContext> context_,
+                        BatchEncoder &encoder_, Evaluator &evaluator_) {
+  PlaintextCache::Key key(context_->first_parms_id());
+  key.put(data.filter_h);
+  key.put(data.filter_w);
+  key.put(data.baby_steps);
+  for (int i = 0; i < data.filter_h; i++) {
+    key.put(matrix_mod_p[i], data.filter_w * sizeof(uint64_t));
+  }
+  return plain_cache.lookup(key, context_, [&]() {
+    auto enc_mat = preprocess_matrix(matrix_mod_p, data, encoder_);
+    plaintexts_to_ntt(enc_mat, evaluator_, context_->first_parms_id());
+    return enc_mat;
+  });
+}
+
+void FCField::prepare_matrix(int32_t num_rows, int32_t common_dim,
+                             vector<vector<uint64_t>> &A) {
+  assert(party == ALICE);
+  data.filter_h = num_rows;
+  data.filter_w = common_dim;
+  data.image_size = common_dim;
+  this->slot_count =
+      min(max(8192, 2 * next_pow2(common_dim)), SEAL_POLY_MOD_DEGREE_MAX);
+  configure();
+
+  // The encoding only depends on the parameters, not on the keys
+  shared_ptr<SEALContext> context_ = this->context;
+  if (slot_count > POLY_MOD_DEGREE) {
+    context_ = make_context(slot_count);
+  }
+  BatchEncoder encoder_(context_);
+  Evaluator evaluator_(context_);
+
+  vector<vector<uint64_t>> matrix_mod_p(num_rows,
+                                        vector<uint64_t>(common_dim));
+  vector<uint64_t *> rows(num_rows);
+  for (int i = 0; i < num_rows; i++) {
+    for (int j = 0; j < common_dim; j++) {
+      matrix_mod_p[i][j] = neg_mod((int64_t)A[i][j], (int64_t)prime_mod);
+    }
+    rows[i] = matrix_mod_p[i].data();
+  }
+  encoded_matrix(rows.data(), context_, encoder_, evaluator_);
 }
 
 vector<uint64_t> FCField::ideal_functionality(uint64_t *vec,
@@ -221,17 +353,15 @@ void FCField::matrix_multiplication(int32_t num_rows, int32_t common_dim,
   BatchEncoder *encoder_;
   GaloisKeys *gal_keys_;
   Ciphertext *zero_;
-  if (slot_count > POLY_MOD_DEGREE) {
-    generate_new_keys(party, io, slot_count, context_, encryptor_, decryptor_,
-                      evaluator_, encoder_, gal_keys_, zero_);
-  } else {
-    context_ = this->context;
-    encryptor_ = this->encryptor;
-    decryptor_ = this->decryptor;
-    evaluator_ = this->evaluator;
-    encoder_ = this->encoder;
-    gal_keys_ = this->gal_keys;
-    zero_ = this->zero;
+  {
+    auto &keys = session->keys(slot_count);
+    context_ = keys.context;
+    encryptor_ = keys.encryptor;
+    decryptor_ = keys.decryptor;
+    evaluator_ = keys.evaluator;
+    encoder_ = keys.encoder;
+    zero_ = keys.zero;
+    gal_keys_ = &session->galois_keys(slot_count, fc_galois_steps(data));
   }
 
   if (party == BOB) {
@@ -243,12 +373,12 @@ void FCField::matrix_multiplication(int32_t num_rows, int32_t common_dim,
       cout << "[Client] Vector Generated" << endl;
 
     auto ct = preprocess_vec(vec.data(), data, *encryptor_, *encoder_);
-    send_ciphertext(io, ct);
+    send_ciphertext(io, ct, context_);
     if (verbose)
       cout << "[Client] Vector processed and sent" << endl;
 
     Ciphertext enc_result;
-    recv_ciphertext(io, enc_result);
+    recv_ciphertext(io, enc_result, context_);
     auto HE_result = fc_postprocess(enc_result, data, *encoder_, *decryptor_);
     if (verbose)
       cout << "[Client] Result received and decrypted" << endl;
@@ -291,12 +421,13 @@ void FCField::matrix_multiplication(int32_t num_rows, int32_t common_dim,
 
     Ciphertext enc_noise =
         fc_preprocess_noise(secret_share, data, *encryptor_, *encoder_);
-    auto encoded_mat = preprocess_matrix(matrix_mod_p.data(), data, *encoder_);
+    auto &encoded_mat =
+        encoded_matrix(matrix_mod_p.data(), context_, *encoder_, *evaluator_);
     if (verbose)
       cout << "[Server] Matrix and noise processed" << endl;
 
     Ciphertext ct;
-    recv_ciphertext(io, ct);
+    recv_ciphertext(io, ct, context_);
 
 #ifdef HE_DEBUG
     PRINT_NOISE_BUDGET(decryptor_, ct, "before FC Online");
@@ -324,7 +455,7 @@ void FCField::matrix_multiplication(int32_t num_rows, int32_t common_dim,
     PRINT_NOISE_BUDGET(decryptor_, HE_result, "after mod-switch");
 #endif
 
-    send_ciphertext(io, HE_result);
+    send_ciphertext(io, HE_result, context_);
     if (verbose)
       cout << "[Server] Result computed and sent" << endl;
 
@@ -343,10 +474,6 @@ void FCField::matrix_multiplication(int32_t num_rows, int32_t common_dim,
     }
     delete[] secret_share;
   }
-  if (slot_count > POLY_MOD_DEGREE) {
-    free_keys(party, encryptor_, decryptor_, evaluator_, encoder_, gal_keys_,
-              zero_);
-  }
 }
 
 void FCField::verify(vector<uint64_t> *vec, vector<uint64_t *> *matrix,
@@ -26,12 +26,16 @@ Modified by Deevashwer Rathee
 #ifndef FC_FIELD_H__
 #define FC_FIELD_H__
 
-#include "LinearHE/utils-HE.h"
+#include "LinearHE/he-session.h"
+#include "LinearHE/plaintext-cache.h"
 
 struct FCMetadata {
   int slot_count;
   int32_t pack_num;
   int32_t inp_ct;
+  // The inp_ct diagonals are summed as giant_steps groups of baby_steps
+  int32_t baby_steps;
+  int32_t giant_steps;
   // Filter is a matrix
   int32_t filter_h;
   int32_t filter_w;
@@ -53,8 +57,12 @@ seal::Ciphertext fc_preprocess_noise(const uint64_t *secret_share,
                                      seal::Encryptor &encryptor,
                                      seal::BatchEncoder &batch_encoder);
 
+// Rotation steps fc_online needs Galois keys for (0 is the column rotation)
+std::vector<int> fc_galois_steps(const FCMetadata &data);
+
+// enc_mat is in NTT form (see plaintexts_to_ntt)
 seal::Ciphertext fc_online(seal::Ciphertext &ct,
-                           std::vector<seal::Plaintext> &enc_mat,
+                           const std::vector<seal::Plaintext> &enc_mat,
                            const FCMetadata &data, seal::Evaluator &evaluator,
                            seal::GaloisKeys &gal_keys, seal::Ciphertext &zero,
                            seal::Ciphertext &enc_noise);
@@ -75,14 +83,30 @@ public:
   seal::BatchEncoder *encoder;
   seal::GaloisKeys *gal_keys;
   seal::Ciphertext *zero;
+  // Keys, shared with the other protocols when the session is passed in
+  HESession *session;
+  bool own_session;
   size_t slot_count;
+  // Encoded weight matrices, reused across calls (server only)
+  PlaintextCache plain_cache;
 
-  FCField(int party, sci::NetIO *io);
+  FCField(int party, sci::NetIO *io, HESession *session = nullptr);
 
   ~FCField();
 
   void configure();
 
+  // Encodes the matrix A (num_rows x common_dim) ahead of the first
+  // matrix_multiplication with it, without communication (server only)
+  void prepare_matrix(int32_t num_rows, int32_t common_dim,
+                      std::vector<std::vector<uint64_t>> &A);
+
+  // Encoded diagonals of matrix_mod_p for the current data, from plain_cache
+  const std::vector<seal::Plaintext> &
+  encoded_matrix(const uint64_t *const *matrix_mod_p,
+                 std::shared_ptr<seal::SEALContext> context_,
+                 seal::BatchEncoder &encoder_, seal::Evaluator &evaluator_);
+
   std::vector<uint64_t> ideal_functionality(uint64_t *vec, uint64_t **matrix);
 
   void matrix_multiplication(int32_t num_rows, int32_t common_dim,
@@ -0,0 +1,103 @@
+/*
+Authors: Deevashwer Rathee
+Copyright:
+Copyright (c) 2020 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "LinearHE/he-session.h"
+
+using namespace std;
+using namespace sci;
+using namespace seal;
+
+HESession::HESession(int party, NetIO *io) {
+  this->party = party;
+  this->io = io;
+}
+
+HESession::~HESession() {
+  for (auto &s : sets) {
+    auto &k = s.second;
+    free_keys(party, k.encryptor, k.decryptor, k.evaluator, k.encoder,
+              k.gal_keys, k.zero);
+    delete k.keygen;
+  }
+}
+
+HEKeys &HESession::keys(int slot_count) {
+  auto it = sets.find(slot_count);
+  if (it != sets.end()) {
+    return it->second;
+  }
+  auto &k = sets[slot_count];
+  generate_new_keys(party, io, slot_count, k.context, k.encryptor, k.decryptor,
+                    k.evaluator, k.encoder, k.gal_keys, k.zero, false,
+                    &k.keygen);
+  return k;
+}
+
+GaloisKeys &HESession::galois_keys(int slot_count, const vector<int> &steps) {
+  auto &k = keys(slot_count);
+  vector<int> missing;
+  for (int step : steps) {
+    if (k.galois_steps.insert(step).second) {
+      missing.push_back(step);
+    }
+  }
+  if (missing.empty()) {
+    return *k.gal_keys;
+  }
+
+  GaloisKeys new_keys;
+  exchange_galois_keys(party, io, k.context, k.keygen, missing, new_keys);
+  // BOB only makes the keys, ALICE adds them to the ones it has
+  if (party == ALICE) {
+    if (k.gal_keys->size() == 0) {
+      *k.gal_keys = move(new_keys);
+    } else {
+      auto &dst = k.gal_keys->data();
+      auto &src = new_keys.data();
+      if (dst.size() < src.size()) {
+        dst.resize(src.size());
+      }
+      for (size_t i = 0; i < src.size(); i++) {
+        if (!src[i].empty()) {
+          dst[i] = move(src[i]);
+        }
+      }
+    }
+  }
+  return *k.gal_keys;
+}
+
+size_t HESession::galois_keys_sent() const {
+  size_t n = 0;
+  for (auto &s : sets) {
+    n += s.second.galois_steps.size();
+  }
+  return n;
+}
+
+vector<int> power_of_two_galois_steps(int slot_count) {
+  vector<int> steps = {0};
+  for (int step = 1; step < slot_count / 2; step *= 2) {
+    steps.push_back(step);
+    steps.push_back(-step);
+  }
+  return steps;
+}
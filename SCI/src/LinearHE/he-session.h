@@ -0,0 +1,79 @@
+/*
+Authors: Deevashwer Rathee
+Copyright:
+Copyright (c) 2020 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef HE_SESSION_H__
+#define HE_SESSION_H__
+
+#include "LinearHE/utils-HE.h"
+#include <map>
+#include <set>
+
+// The keys of one parameter set. BOB holds the secret key and the key
+// generator, ALICE the public key, an encryption of zero and the Galois keys
+// received so far.
+struct HEKeys {
+  std::shared_ptr<seal::SEALContext> context;
+  seal::Encryptor *encryptor = nullptr;
+  seal::Decryptor *decryptor = nullptr;
+  seal::Evaluator *evaluator = nullptr;
+  seal::BatchEncoder *encoder = nullptr;
+  seal::GaloisKeys *gal_keys = nullptr;
+  seal::Ciphertext *zero = nullptr;
+  seal::KeyGenerator *keygen = nullptr;
+  // Rotation steps gal_keys has keys for (0 is the column rotation)
+  std::set<int> galois_steps;
+};
+
+/* Keys shared by all LinearHE protocols of a session.
+ *
+ * Keys for a slot count are generated the first time a layer needs them and
+ * are then reused by every later layer and inference, instead of each
+ * protocol (and each call with an unusual slot count) generating its own.
+ * Galois keys are sent per rotation step, only for the steps a layer asks for
+ * that have not been sent before. Both parties must make the same sequence of
+ * requests. */
+class HESession {
+public:
+  int party;
+  sci::NetIO *io;
+
+  HESession(int party, sci::NetIO *io);
+
+  ~HESession();
+
+  // Keys for slot_count, generated on first use
+  HEKeys &keys(int slot_count);
+
+  // Galois keys for slot_count that cover steps
+  seal::GaloisKeys &galois_keys(int slot_count, const std::vector<int> &steps);
+
+  // Number of Galois keys sent so far, over all slot counts
+  size_t galois_keys_sent() const;
+
+private:
+  std::map<int, HEKeys> sets;
+};
+
+// Steps +-2^i and the column rotation, with which rotate_rows can reach any
+// step (as with SEAL's default Galois keys)
+std::vector<int> power_of_two_galois_steps(int slot_count);
+
+#endif // HE_SESSION_H__
@@ -0,0 +1,171 @@
+/*
+Authors: Deevashwer Rathee
+Copyright:
+Copyright (c) 2020 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "LinearHE/plaintext-cache.h"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+using namespace sci;
+using namespace seal;
+
+// Header of a stored entry, followed by count plaintexts in length bytes
+struct PlaintextCacheHeader {
+  char magic[8];
+  parms_id_type parms_id;
+  array<char, Hash::DIGEST_SIZE> content;
+  uint64_t count;
+  uint64_t length;
+};
+
+static const char plaintext_cache_magic[8] = {'S', 'C', 'I', 'P',
+                                              'T', 'C', '0', '1'};
+
+PlaintextCache::Key::Key(const parms_id_type &parms_id) : parms_id_(parms_id) {}
+
+void PlaintextCache::Key::put(const void *data, size_t nbyte) {
+  assert(!finalized);
+  // Hash::put takes an int length
+  const char *ptr = (const char *)data;
+  while (nbyte > 0) {
+    int len = (int)min(nbyte, (size_t)(1 << 30));
+    hash.put(ptr, len);
+    ptr += len;
+    nbyte -= len;
+  }
+}
+
+const array<char, Hash::DIGEST_SIZE> &PlaintextCache::Key::content_digest() {
+  if (!finalized) {
+    hash.digest(content.data());
+    finalized = true;
+  }
+  return content;
+}
+
+string PlaintextCache::Key::digest() {
+  Hash name_hash;
+  name_hash.put(parms_id_.data(), parms_id_.size() * sizeof(uint64_t));
+  name_hash.put(content_digest().data(), Hash::DIGEST_SIZE);
+  char d[Hash::DIGEST_SIZE];
+  name_hash.digest(d);
+  stringstream ss;
+  for (int i = 0; i < Hash::DIGEST_SIZE; i++) {
+    ss << hex << setw(2) << setfill('0') << (int)(uint8_t)d[i];
+  }
+  return ss.str();
+}
+
+// Loads the entry at path into pt. Returns false if the file is missing, was
+// written for other parameters or weights, or is shorter than its header says.
+static bool load_entry(const string &path, PlaintextCache::Key &key,
+                       shared_ptr<SEALContext> context, vector<Plaintext> &pt) {
+  ifstream is(path, ios::binary);
+  if (!is.good()) {
+    return false;
+  }
+  PlaintextCacheHeader header;
+  if (!is.read((char *)&header, sizeof(header)) ||
+      memcmp(header.magic, plaintext_cache_magic, sizeof(header.magic)) ||
+      header.parms_id != key.parms_id() ||
+      header.content != key.content_digest()) {
+    return false;
+  }
+  is.seekg(0, ios::end);
+  if ((uint64_t)is.tellg() != sizeof(header) + header.length) {
+    return false;
+  }
+  is.seekg(sizeof(header));
+  try {
+    pt.resize(header.count);
+    for (auto &p : pt) {
+      p.load(context, is);
+    }
+  } catch (const exception &) {
+    return false;
+  }
+  return (uint64_t)is.tellg() == sizeof(header) + header.length;
+}
+
+// Writes pt to path through a temporary file, so that an interrupted write
+// never leaves a partial entry behind.
+static void save_entry(const string &path, PlaintextCache::Key &key,
+                       const vector<Plaintext> &pt) {
+  string tmp_path = path + ".tmp";
+  ofstream os(tmp_path, ios::binary);
+  PlaintextCacheHeader header;
+  memcpy(header.magic, plaintext_cache_magic, sizeof(header.magic));
+  header.parms_id = key.parms_id();
+  header.content = key.content_digest();
+  header.count = pt.size();
+  header.length = 0;
+  os.write((char *)&header, sizeof(header));
+  for (auto &p : pt) {
+    p.save(os);
+  }
+  header.length = (uint64_t)os.tellp() - sizeof(header);
+  os.seekp(0);
+  os.write((char *)&header, sizeof(header));
+  os.close();
+  if (os.good()) {
+    rename(tmp_path.c_str(), path.c_str());
+  } else {
+    remove(tmp_path.c_str());
+  }
+}
+
+const vector<Plaintext> &
+PlaintextCache::lookup(Key &key, shared_ptr<SEALContext> context,
+                       const function<vector<Plaintext>()> &encode) {
+  string name = key.digest();
+  auto it = entries.find(name);
+  if (it != entries.end()) {
+    return it->second;
+  }
+
+  string path = dir.empty() ? "" : dir + "/" + name + ".pt";
+  if (!path.empty()) {
+    vector<Plaintext> pt;
+    if (load_entry(path, key, context, pt)) {
+      return entries[name] = move(pt);
+    }
+  }
+
+  auto &pt = entries[name] = encode();
+  if (!path.empty()) {
+    save_entry(path, key, pt);
+  }
+  return pt;
+}
+
+void plaintexts_to_ntt(vector<Plaintext> &pt, Evaluator &evaluator,
+                       parms_id_type parms_id) {
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+  for (size_t i = 0; i < pt.size(); i++) {
+    if (!pt[i].is_zero()) {
+      evaluator.transform_to_ntt_inplace(pt[i], parms_id);
+    }
+  }
+}
@@ -0,0 +1,89 @@
+/*
+Authors: Deevashwer Rathee
+Copyright:
+Copyright (c) 2020 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef PLAINTEXT_CACHE_H__
+#define PLAINTEXT_CACHE_H__
+
+#include "LinearHE/utils-HE.h"
+#include "utils/hash.h"
+#include <array>
+#include <functional>
+#include <map>
+#include <string>
+
+/* Server-side cache of encoded model weights.
+ *
+ * The weights of a layer do not change between queries, so the plaintexts a
+ * layer multiplies with are packed, encoded and brought to NTT form once and
+ * then reused by every later call with the same weights and geometry. Entries
+ * are keyed by a digest of the weights, the layer metadata and the encryption
+ * parameters. If dir is set, entries are also stored there and picked up by
+ * later runs. A stored entry starts with a header holding the parameters, a
+ * digest of the weights and the payload length; entries whose header does
+ * not match the key or whose payload is short are encoded again and
+ * overwritten. */
+class PlaintextCache {
+public:
+  // Directory for persistent entries, empty to keep them in memory only
+  std::string dir;
+
+  // Digest of everything the encoding depends on, built with put
+  class Key {
+  public:
+    Key(const seal::parms_id_type &parms_id);
+    void put(const void *data, size_t nbyte);
+    void put(int64_t val) { put(&val, sizeof(int64_t)); }
+    // Name of the entry, a digest of the parameters and everything put
+    std::string digest();
+
+    const seal::parms_id_type &parms_id() const { return parms_id_; }
+    // Digest of everything put (weights and layer metadata)
+    const std::array<char, sci::Hash::DIGEST_SIZE> &content_digest();
+
+  private:
+    seal::parms_id_type parms_id_;
+    sci::Hash hash;
+    bool finalized = false;
+    std::array<char, sci::Hash::DIGEST_SIZE> content;
+  };
+
+  // Returns the entry for key, calling encode to make it on a miss. encode
+  // must return plaintexts at the first data level of context.
+  const std::vector<seal::Plaintext> &
+  lookup(Key &key, std::shared_ptr<seal::SEALContext> context,
+         const std::function<std::vector<seal::Plaintext>()> &encode);
+
+  void clear() { entries.clear(); }
+
+  size_t size() const { return entries.size(); }
+
+private:
+  std::map<std::string, std::vector<seal::Plaintext>> entries;
+};
+
+// Transforms the non-zero plaintexts to NTT form at parms_id, so that they can
+// be multiplied with NTT-form ciphertexts. Zero plaintexts stay as they are and
+// are meant to be skipped.
+void plaintexts_to_ntt(std::vector<seal::Plaintext> &pt,
+                       seal::Evaluator &evaluator,
+                       seal::parms_id_type parms_id);
+
+#endif // PLAINTEXT_CACHE_H__
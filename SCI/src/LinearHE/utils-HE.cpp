@@ -21,36 +21,43 @@ SOFTWARE.
 
 #include "LinearHE/utils-HE.h"
 #include "seal/util/polyarithsmallmod.h"
+#include <algorithm>
 
 using namespace std;
 using namespace sci;
 using namespace seal;
 using namespace seal::util;
 
+shared_ptr<SEALContext> make_context(int slot_count) {
+  EncryptionParameters parms(scheme_type::BFV);
+  parms.set_poly_modulus_degree(slot_count);
+  parms.set_coeff_modulus(CoeffModulus::Create(slot_count, {60, 60, 60, 38}));
+  parms.set_plain_modulus(prime_mod);
+  return SEALContext::Create(parms, true, sec_level_type::none);
+}
+
 void generate_new_keys(int party, NetIO *io, int slot_count,
                        shared_ptr<SEALContext> &context_,
                        Encryptor *&encryptor_, Decryptor *&decryptor_,
                        Evaluator *&evaluator_, BatchEncoder *&encoder_,
                        GaloisKeys *&gal_keys_, Ciphertext *&zero_,
-                       bool verbose) {
-  EncryptionParameters parms(scheme_type::BFV);
-  parms.set_poly_modulus_degree(slot_count);
-  parms.set_coeff_modulus(CoeffModulus::Create(slot_count, {60, 60, 60, 38}));
-  parms.set_plain_modulus(prime_mod);
-  // auto context = SEALContext::Create(parms, true, sec_level_type::none);
-  context_ = SEALContext::Create(parms, true, sec_level_type::none);
+                       bool verbose, KeyGenerator **keygen_) {
+  // A caller that keeps the key generator makes its own Galois keys later
+  bool send_galois = (keygen_ == nullptr);
+  context_ = make_context(slot_count);
   encoder_ = new BatchEncoder(context_);
   evaluator_ = new Evaluator(context_);
   if (party == BOB) {
-    KeyGenerator keygen(context_);
-    auto pub_key = keygen.public_key();
-    auto sec_key = keygen.secret_key();
-    auto gal_keys_ = keygen.galois_keys();
+    KeyGenerator *keygen = new KeyGenerator(context_);
+    auto pub_key = keygen->public_key();
+    auto sec_key = keygen->secret_key();
 
     stringstream os;
     pub_key.save(os);
     uint64_t pk_size = os.tellp();
-    gal_keys_.save(os);
+    if (send_galois) {
+      keygen->galois_keys().save(os);
+    }
     uint64_t gk_size = (uint64_t)os.tellp() - pk_size;
 
     string keys_ser = os.str();
@@ -68,6 +75,12 @@ void generate_new_keys(int party, NetIO *io, int slot_count,
 #endif
     encryptor_ = new Encryptor(context_, pub_key);
     decryptor_ = new Decryptor(context_, sec_key);
+    gal_keys_ = new GaloisKeys();
+    if (keygen_ != nullptr) {
+      *keygen_ = keygen;
+    } else {
+      delete keygen;
+    }
   } else // party == ALICE
   {
     uint64_t pk_size;
@@ -81,8 +94,10 @@ void generate_new_keys(int party, NetIO *io, int slot_count,
     is.write(key_share, pk_size);
     pub_key.load(context_, is);
     gal_keys_ = new GaloisKeys();
-    is.write(key_share + pk_size, gk_size);
-    gal_keys_->load(context_, is);
+    if (send_galois) {
+      is.write(key_share + pk_size, gk_size);
+      gal_keys_->load(context_, is);
+    }
     delete[] key_share;
 
 #ifdef HE_DEBUG
@@ -103,17 +118,46 @@ void generate_new_keys(int party, NetIO *io, int slot_count,
     encoder_->encode(pod_matrix, tmp);
     zero_ = new Ciphertext;
     encryptor_->encrypt(tmp, *zero_);
+    if (keygen_ != nullptr) {
+      *keygen_ = nullptr;
+    }
   }
   if (verbose)
     cout << "Keys Generated (slot_count: " << slot_count << ")" << endl;
 }
 
+void exchange_galois_keys(int party, NetIO *io,
+                          shared_ptr<SEALContext> &context_,
+                          KeyGenerator *keygen_, const vector<int> &steps,
+                          GaloisKeys &gal_keys_) {
+  if (party == BOB) {
+    gal_keys_ = keygen_->galois_keys(steps);
+    stringstream os;
+    gal_keys_.save(os);
+    uint64_t gk_size = os.tellp();
+    string keys_ser = os.str();
+    io->send_data(&gk_size, sizeof(uint64_t));
+    io->send_data(keys_ser.c_str(), gk_size);
+  } else // party == ALICE
+  {
+    uint64_t gk_size;
+    io->recv_data(&gk_size, sizeof(uint64_t));
+    char *key_share = new char[gk_size];
+    io->recv_data(key_share, gk_size);
+    stringstream is;
+    is.write(key_share, gk_size);
+    gal_keys_.load(context_, is);
+    delete[] key_share;
+  }
+}
+
 void free_keys(int party, Encryptor *&encryptor_, Decryptor *&decryptor_,
                Evaluator *&evaluator_, BatchEncoder *&encoder_,
                GaloisKeys *&gal_keys_, Ciphertext *&zero_) {
   delete encoder_;
   delete evaluator_;
   delete encryptor_;
+  delete gal_keys_;
   if (party == BOB) {
     delete decryptor_;
   } else // party ==ALICE
@@ -121,58 +165,141 @@ void free_keys(int party, Encryptor *&encryptor_, Decryptor *&decryptor_,
 #ifdef HE_DEBUG
     delete decryptor_;
 #endif
-    delete gal_keys_;
     delete zero_;
   }
 }
 
-void send_encrypted_vector(NetIO *io, vector<Ciphertext> &ct_vec) {
+// parms_id, number of polynomials and the NTT flag
+static const size_t ct_header_words = 6;
+
+static size_t packed_ciphertext_words(const EncryptionParameters &parms,
+                                      size_t size) {
+  size_t bits = 0;
+  for (auto &q : parms.coeff_modulus())
+    bits += q.bit_count();
+  return ct_header_words +
+         (size * parms.poly_modulus_degree() * bits + 63) / 64;
+}
+
+vector<uint64_t> pack_ciphertext(const Ciphertext &ct,
+                                 shared_ptr<SEALContext> &context_) {
+  auto context_data = context_->get_context_data(ct.parms_id());
+  assert(context_data);
+  auto &parms = context_data->parms();
+  auto &coeff_modulus = parms.coeff_modulus();
+  size_t coeff_count = parms.poly_modulus_degree();
+  size_t coeff_mod_count = coeff_modulus.size();
+
+  vector<uint64_t> packed(packed_ciphertext_words(parms, ct.size()), 0);
+  copy(ct.parms_id().begin(), ct.parms_id().end(), packed.begin());
+  packed[4] = ct.size();
+  packed[5] = ct.is_ntt_form();
+
+  uint64_t *out = packed.data() + ct_header_words;
+  size_t bit = 0;
+  for (size_t i = 0; i < ct.size(); i++) {
+    const uint64_t *poly = ct.data(i);
+    for (size_t j = 0; j < coeff_mod_count; j++) {
+      int width = coeff_modulus[j].bit_count();
+      for (size_t k = 0; k < coeff_count; k++, bit += width) {
+        uint64_t val = poly[j * coeff_count + k];
+        size_t off = bit % 64;
+        out[bit / 64] |= val << off;
+        if (off + width > 64)
+          out[bit / 64 + 1] |= val >> (64 - off);
+      }
+    }
+  }
+  return packed;
+}
+
+void unpack_ciphertext(const vector<uint64_t> &packed, Ciphertext &ct,
+                       shared_ptr<SEALContext> &context_) {
+  if (packed.size() < ct_header_words)
+    error("unpack_ciphertext: truncated ciphertext");
+  parms_id_type parms_id;
+  copy(packed.begin(), packed.begin() + 4, parms_id.begin());
+  auto context_data = context_->get_context_data(parms_id);
+  size_t size = packed[4];
+  if (!context_data || size < 2 ||
+      packed.size() != packed_ciphertext_words(context_data->parms(), size))
+    error("unpack_ciphertext: ciphertext does not match the context");
+  auto &parms = context_data->parms();
+  auto &coeff_modulus = parms.coeff_modulus();
+  size_t coeff_count = parms.poly_modulus_degree();
+  size_t coeff_mod_count = coeff_modulus.size();
+
+  // Reuses the ciphertext's buffer when it already has this shape
+  ct.resize(context_, parms_id, size);
+  ct.is_ntt_form() = packed[5];
+
+  const uint64_t *in = packed.data() + ct_header_words;
+  size_t bit = 0;
+  for (size_t i = 0; i < size; i++) {
+    uint64_t *poly = ct.data(i);
+    for (size_t j = 0; j < coeff_mod_count; j++) {
+      int width = coeff_modulus[j].bit_count();
+      uint64_t mask = (1ULL << width) - 1;
+      for (size_t k = 0; k < coeff_count; k++, bit += width) {
+        size_t off = bit % 64;
+        uint64_t val = in[bit / 64] >> off;
+        if (off + width > 64)
+          val |= in[bit / 64 + 1] << (64 - off);
+        poly[j * coeff_count + k] = val & mask;
+      }
+    }
+  }
+}
+
+void send_packed_ciphertext(NetIO *io, const vector<uint64_t> &packed) {
+  uint64_t words = packed.size();
+  io->send_data(&words, sizeof(uint64_t));
+  io->send_data(packed.data(), words * sizeof(uint64_t));
+}
+
+void recv_packed_ciphertext(NetIO *io, vector<uint64_t> &packed) {
+  uint64_t words;
+  io->recv_data(&words, sizeof(uint64_t));
+  packed.resize(words);
+  io->recv_data(packed.data(), words * sizeof(uint64_t));
+}
+
+void send_encrypted_vector(NetIO *io, const vector<Ciphertext> &ct_vec,
+                           shared_ptr<SEALContext> &context_) {
   assert(ct_vec.size() > 0);
-  stringstream os;
-  uint64_t ct_size;
+  // Ciphertexts are packed in parallel and each is sent as soon as the ones
+  // before it have gone out
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1) ordered
   for (size_t ct = 0; ct < ct_vec.size(); ct++) {
-    ct_vec[ct].save(os);
-    if (!ct)
-      ct_size = os.tellp();
+    vector<uint64_t> packed = pack_ciphertext(ct_vec[ct], context_);
+#pragma omp ordered
+    send_packed_ciphertext(io, packed);
   }
-  string ct_ser = os.str();
-  io->send_data(&ct_size, sizeof(uint64_t));
-  io->send_data(ct_ser.c_str(), ct_ser.size());
 }
 
-void recv_encrypted_vector(NetIO *io, vector<Ciphertext> &ct_vec) {
+void recv_encrypted_vector(NetIO *io, vector<Ciphertext> &ct_vec,
+                           shared_ptr<SEALContext> &context_) {
   assert(ct_vec.size() > 0);
-  stringstream is;
-  uint64_t ct_size;
-  io->recv_data(&ct_size, sizeof(uint64_t));
-  char *c_enc_result = new char[ct_size * ct_vec.size()];
-  io->recv_data(c_enc_result, ct_size * ct_vec.size());
+  vector<vector<uint64_t>> packed(ct_vec.size());
+  for (size_t ct = 0; ct < ct_vec.size(); ct++) {
+    recv_packed_ciphertext(io, packed[ct]);
+  }
+#pragma omp parallel for num_threads(num_threads) schedule(static)
   for (size_t ct = 0; ct < ct_vec.size(); ct++) {
-    is.write(c_enc_result + ct_size * ct, ct_size);
-    ct_vec[ct].unsafe_load(is);
+    unpack_ciphertext(packed[ct], ct_vec[ct], context_);
   }
-  delete[] c_enc_result;
 }
 
-void send_ciphertext(NetIO *io, Ciphertext &ct) {
-  stringstream os;
-  uint64_t ct_size;
-  ct.save(os);
-  ct_size = os.tellp();
-  string ct_ser = os.str();
-  io->send_data(&ct_size, sizeof(uint64_t));
-  io->send_data(ct_ser.c_str(), ct_ser.size());
+void send_ciphertext(NetIO *io, const Ciphertext &ct,
+                     shared_ptr<SEALContext> &context_) {
+  send_packed_ciphertext(io, pack_ciphertext(ct, context_));
 }
 
-void recv_ciphertext(NetIO *io, Ciphertext &ct) {
-  stringstream is;
-  uint64_t ct_size;
-  io->recv_data(&ct_size, sizeof(uint64_t));
-  char *c_enc_result = new char[ct_size];
-  io->recv_data(c_enc_result, ct_size);
-  is.write(c_enc_result, ct_size);
-  ct.unsafe_load(is);
-  delete[] c_enc_result;
+void recv_ciphertext(NetIO *io, Ciphertext &ct,
+                     shared_ptr<SEALContext> &context_) {
+  vector<uint64_t> packed;
+  recv_packed_ciphertext(io, packed);
+  unpack_ciphertext(packed, ct, context_);
 }
 
 void set_poly_coeffs_uniform(
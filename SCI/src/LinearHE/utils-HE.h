@@ -32,6 +32,12 @@ SOFTWARE.
             << decryptor->invariant_noise_budget(ct) << " bits" << RESET       \
             << std::endl
 
+// The BFV context used by all LinearHE protocols for the given slot count.
+// Contexts made for the same slot count share their parms_id.
+std::shared_ptr<seal::SEALContext> make_context(int slot_count);
+
+// If keygen_ is given, no Galois keys are exchanged here: BOB gets the key
+// generator (owned by the caller) to make them with exchange_galois_keys.
 void generate_new_keys(int party, sci::NetIO *io, int slot_count,
                        std::shared_ptr<seal::SEALContext> &context_,
                        seal::Encryptor *&encryptor_,
@@ -39,22 +45,53 @@ void generate_new_keys(int party, sci::NetIO *io, int slot_count,
                        seal::Evaluator *&evaluator_,
                        seal::BatchEncoder *&encoder_,
                        seal::GaloisKeys *&gal_keys_, seal::Ciphertext *&zero_,
-                       bool verbose = false);
+                       bool verbose = false,
+                       seal::KeyGenerator **keygen_ = nullptr);
+
+// Galois keys for exactly the given row rotation steps, where a step of 0
+// stands for the column rotation. BOB makes them with the key generator kept
+// from generate_new_keys and sends them, ALICE receives them.
+void exchange_galois_keys(int party, sci::NetIO *io,
+                          std::shared_ptr<seal::SEALContext> &context_,
+                          seal::KeyGenerator *keygen_,
+                          const std::vector<int> &steps,
+                          seal::GaloisKeys &gal_keys_);
 
 void free_keys(int party, seal::Encryptor *&encryptor_,
                seal::Decryptor *&decryptor_, seal::Evaluator *&evaluator_,
                seal::BatchEncoder *&encoder_, seal::GaloisKeys *&gal_keys_,
                seal::Ciphertext *&zero_);
 
+// Ciphertexts go over the wire as their parms_id, number of polynomials, NTT
+// flag and coefficients, each coefficient packed into the bit width of its
+// modulus. Receiving writes the coefficients straight into the ciphertext,
+// reusing its buffer when it already has the right shape.
+std::vector<uint64_t>
+pack_ciphertext(const seal::Ciphertext &ct,
+                std::shared_ptr<seal::SEALContext> &context_);
+
+void unpack_ciphertext(const std::vector<uint64_t> &packed,
+                       seal::Ciphertext &ct,
+                       std::shared_ptr<seal::SEALContext> &context_);
+
+void send_packed_ciphertext(sci::NetIO *io,
+                            const std::vector<uint64_t> &packed);
+
+void recv_packed_ciphertext(sci::NetIO *io, std::vector<uint64_t> &packed);
+
 void send_encrypted_vector(sci::NetIO *io,
-                           std::vector<seal::Ciphertext> &ct_vec);
+                           const std::vector<seal::Ciphertext> &ct_vec,
+                           std::shared_ptr<seal::SEALContext> &context_);
 
 void recv_encrypted_vector(sci::NetIO *io,
-                           std::vector<seal::Ciphertext> &ct_vec);
+                           std::vector<seal::Ciphertext> &ct_vec,
+                           std::shared_ptr<seal::SEALContext> &context_);
 
-void send_ciphertext(sci::NetIO *io, seal::Ciphertext &ct);
+void send_ciphertext(sci::NetIO *io, const seal::Ciphertext &ct,
+                     std::shared_ptr<seal::SEALContext> &context_);
 
-void recv_ciphertext(sci::NetIO *io, seal::Ciphertext &ct);
+void recv_ciphertext(sci::NetIO *io, seal::Ciphertext &ct,
+                     std::shared_ptr<seal::SEALContext> &context_);
 
 void set_poly_coeffs_uniform(
     uint64_t *poly, uint32_t bitlen,
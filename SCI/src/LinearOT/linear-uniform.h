@@ -21,12 +21,9 @@ SOFTWARE.
 
 #ifndef LINEAR_UNIFORM_H__
 #define LINEAR_UNIFORM_H__
+#include <algorithm>
 #include <iostream>
 
-#ifdef USE_EIGEN
-#include <Eigen/Dense>
-#endif
-
 #include "OT/iknp.h"
 
 // Special case of LinearOT which works only for uniform bitwidth multiplication
@@ -45,12 +42,27 @@ public:
                   // matmul dimensions are too large.
 
   const uint64_t MaxMemToUseInBytes = 2.5 * (1 << 30); // 2.5 GiB
+                                                        // shared by all the
+                                                        // instances that run
+                                                        // concurrently
+  const uint32_t otExtBlockSize =
+      1024 * 16; // IKNP pads every batch to a multiple of this many OTs
+
+  // Tile sizes of the plaintext matmul kernel, in elements. A (gemmTileK,
+  // gemmTileJ) panel of B stays in L2 while gemmTileI rows of A stream over it.
+  const int gemmTileI = 32;
+  const int gemmTileK = 128;
+  const int gemmTileJ = 256;
+
+  int numInstances; // #MatMulUniform objects doing OTs at the same time
   intType moduloMask;
 
   MatMulUniform(int party, int bitlength, IO *io, sci::OT<otType> *otImpl,
-                sci::OT<otType> *otImplRoleReversed) {
+                sci::OT<otType> *otImplRoleReversed, int numInstances = 1) {
     this->party = party;
     assert(((party == 1) || (party == 2)) && "PartyNum should be 1 or 2.");
+    assert(numInstances >= 1);
+    this->numInstances = numInstances;
     this->bitlength = bitlength;
     this->io = io;
     assert(io != nullptr && "IO can't be nullptr.");
@@ -65,50 +77,44 @@ public:
 
   ~MatMulUniform() {}
 
-#ifdef USE_EIGEN
-  void ideal_func_eigen(int s1, int s2, int s3, const intType *A,
-                        const intType *B, intType *C) {
-    Eigen::Matrix<intType, Eigen::Dynamic, Eigen::Dynamic> eigen_a(s1, s2);
-    Eigen::Matrix<intType, Eigen::Dynamic, Eigen::Dynamic> eigen_b(s2, s3);
-    Eigen::Matrix<intType, Eigen::Dynamic, Eigen::Dynamic> eigen_c(s1, s3);
-
-    for (int i = 0; i < s1; i++) {
-      for (int j = 0; j < s2; j++) {
-        eigen_a(i, j) = Arr2DIdxRowM(A, s1, s2, i, j);
-      }
-    }
-    for (int i = 0; i < s2; i++) {
-      for (int j = 0; j < s3; j++) {
-        eigen_b(i, j) = Arr2DIdxRowM(B, s2, s3, i, j);
-      }
-    }
-    eigen_c = eigen_a * eigen_b;
-    for (int i = 0; i < s1; i++) {
-      for (int j = 0; j < s3; j++) {
-        Arr2DIdxRowM(C, s1, s3, i, j) = eigen_c(i, j);
-      }
-    }
-  }
-#endif
-
+  /*
+          - Plaintext matmul C = A * B, where A is (s1,s2), B is (s2,s3) and C is
+     (s1,s3), all row-major
+          - Cache-blocked: each (gemmTileI, gemmTileJ) tile of C is accumulated
+     over gemmTileK-deep panels of A and B
+          - Single-threaded: callers already run this from their own per-thread
+     workers, so it must not start a team of its own
+  */
   void ideal_func(int s1, int s2, int s3, const intType *A, const intType *B,
                   intType *C) {
-#ifndef USE_EIGEN
-    for (int i = 0; i < s1; i++) {
-      for (int j = 0; j < s3; j++) {
-        Arr2DIdxRowM(C, s1, s3, i, j) = 0;
-        for (int k = 0; k < s2; k++) {
-          Arr2DIdxRowM(C, s1, s3, i, j) +=
-              (Arr2DIdxRowM(A, s1, s2, i, k) * Arr2DIdxRowM(B, s2, s3, k, j));
+    for (int ti = 0; ti < s1; ti += gemmTileI) {
+      for (int tj = 0; tj < s3; tj += gemmTileJ) {
+        int iEnd = std::min(ti + gemmTileI, s1);
+        int jEnd = std::min(tj + gemmTileJ, s3);
+        for (int i = ti; i < iEnd; i++) {
+          std::fill(C + (uint64_t)i * s3 + tj, C + (uint64_t)i * s3 + jEnd, 0);
+        }
+        for (int tk = 0; tk < s2; tk += gemmTileK) {
+          int kEnd = std::min(tk + gemmTileK, s2);
+          for (int i = ti; i < iEnd; i++) {
+            intType *CRow = C + (uint64_t)i * s3;
+            const intType *ARow = A + (uint64_t)i * s2;
+            for (int k = tk; k < kEnd; k++) {
+              const intType a = ARow[k];
+              const intType *BRow = B + (uint64_t)k * s3;
+              for (int j = tj; j < jEnd; j++) {
+                CRow[j] += a * BRow[j];
+              }
+            }
+          }
+        }
+        for (int i = ti; i < iEnd; i++) {
+          for (int j = tj; j < jEnd; j++) {
+            C[(uint64_t)i * s3 + j] &= moduloMask;
+          }
         }
       }
     }
-#else
-    ideal_func_eigen(s1, s2, s3, A, B, C);
-#endif
-    for (int i = 0; i < s1 * s3; i++) {
-      C[i] = C[i] & moduloMask;
-    }
   }
 
   void verifyMatmulShares(int s1, int s2, int s3, const intType *A_share,
@@ -286,13 +292,25 @@ public:
     delete[] numChunks;
   }
 
+  /*
+          - #OTs to do in one batch when every OT carries senderMatmulDims
+     elements. Sender and receiver must agree on it, so it is sized for the
+     sender, which holds both corrData and data for the batch.
+          - The memory budget is split between the numInstances instances, so
+     that the per-thread instances of a multithreaded matmul together stay
+     within MaxMemToUseInBytes
+  */
   int chooseOptimalBatchSize(int senderMatmulDims) {
-    uint64_t temp =
-        MaxMemToUseInBytes / ((uint64_t)senderMatmulDims * sizeof(intType));
+    uint64_t bytesPerOT = 2 * (uint64_t)senderMatmulDims * sizeof(intType);
+    uint64_t temp = (MaxMemToUseInBytes / numInstances) / bytesPerOT;
     if (temp > batchSizeOTs) {
       temp = batchSizeOTs;
     }
-    return temp;
+    // A batch that is not a whole number of IKNP blocks pays for the padding
+    if (temp > otExtBlockSize) {
+      temp -= temp % otExtBlockSize;
+    }
+    return std::max<uint64_t>(temp, 1);
   }
 
   /*
@@ -658,12 +676,14 @@ public:
   }
 
   /*
-          This code is unoptimized and not being used anywhere currently.
+          This code is not being used anywhere currently.
           - Matrix triplet of size (s1,s2)*(s2,s3)
           - A_share, B_share, C_share are shares of A,B,C
           - shape(A_share) = (s1,s2)
           - shape(B_share) = (s2,s3)
           - shape(C_share) = (s1,s3)
+          - C is built a block of columns at a time, so apart from the shares
+     only one block of B and C is held in memory
   */
   void generateBeaverMatrixTriplet(int s1, int s2, int s3, sci::PRG128 prg,
                                    intType *A_share, intType *B_share,
@@ -671,21 +691,69 @@ public:
     assert(otImplRoleReversed != nullptr);
     prg.random_data(A_share, s1 * s2 * sizeof(intType));
     prg.random_data(B_share, s2 * s3 * sizeof(intType));
-    intType *temp = new intType[s1 * s3];
-    if (party == sci::ALICE) {
-      // The OTs can be done in parallel
-      funcOTSenderInputA(s1, s2, s3, A_share, C_share, otImpl);
-      funcOTReceiverInputB(s1, s2, s3, B_share, temp, otImplRoleReversed);
-    } else if (party == sci::BOB) {
-      funcOTReceiverInputB(s1, s2, s3, B_share, C_share, otImpl);
-      funcOTSenderInputA(s1, s2, s3, A_share, temp, otImplRoleReversed);
-    } else {
-      assert(false);
+    for (int i = 0; i < s1 * s2; i++) {
+      A_share[i] &= moduloMask;
+    }
+    for (int i = 0; i < s2 * s3; i++) {
+      B_share[i] &= moduloMask;
+    }
+
+    // A column block of B is contiguous in column-major order
+    intType *AColumnMajor = new intType[s1 * s2];
+    intType *BColumnMajor = new intType[s2 * s3];
+    sci::convertRowToColMajor<intType>(s1, s2, A_share, AColumnMajor);
+    sci::convertRowToColMajor<intType>(s2, s3, B_share, BColumnMajor);
+
+    uint64_t bytesPerCol = ((uint64_t)s2 + 3 * (uint64_t)s1) * sizeof(intType);
+    int blockCols = std::max<uint64_t>(
+        1, std::min<uint64_t>(s3, (MaxMemToUseInBytes / numInstances) /
+                                      bytesPerCol));
+    intType *BBlock = new intType[(uint64_t)s2 * blockCols];
+    intType *CBlock = new intType[(uint64_t)s1 * blockCols];
+    intType *crossBlock = new intType[(uint64_t)s1 * blockCols];
+    intType *localBlock = new intType[(uint64_t)s1 * blockCols];
+
+    for (int c0 = 0; c0 < s3; c0 += blockCols) {
+      int curCols = std::min(blockCols, s3 - c0);
+      const intType *BBlockColumnMajor = BColumnMajor + (uint64_t)c0 * s2;
+      if (party == sci::ALICE) {
+        funcOTSenderInputA(s1, s2, curCols, AColumnMajor, CBlock, otImpl,
+                           true);
+        funcOTReceiverInputB(s1, s2, curCols, BBlockColumnMajor, crossBlock,
+                             otImplRoleReversed, true);
+      } else if (party == sci::BOB) {
+        funcOTReceiverInputB(s1, s2, curCols, BBlockColumnMajor, CBlock,
+                             otImpl, true);
+        funcOTSenderInputA(s1, s2, curCols, AColumnMajor, crossBlock,
+                           otImplRoleReversed, true);
+      } else {
+        assert(false);
+      }
+
+      for (int k = 0; k < s2; k++) {
+        for (int j = 0; j < curCols; j++) {
+          Arr2DIdxRowM(BBlock, s2, curCols, k, j) =
+              Arr2DIdxRowM(B_share, s2, s3, k, c0 + j);
+        }
+      }
+      ideal_func(s1, s2, curCols, A_share, BBlock, localBlock);
+      for (int i = 0; i < s1; i++) {
+        for (int j = 0; j < curCols; j++) {
+          Arr2DIdxRowM(C_share, s1, s3, i, c0 + j) =
+              (Arr2DIdxRowM(CBlock, s1, curCols, i, j) +
+               Arr2DIdxRowM(crossBlock, s1, curCols, i, j) +
+               Arr2DIdxRowM(localBlock, s1, curCols, i, j)) &
+              moduloMask;
+        }
+      }
     }
 
-    sci::elemWiseAdd<intType>(s1 * s3, C_share, temp, C_share);
-    ideal_func(s1, s2, s3, A_share, B_share, temp);
-    sci::elemWiseAdd<intType>(s1 * s3, C_share, temp, C_share);
+    delete[] AColumnMajor;
+    delete[] BColumnMajor;
+    delete[] BBlock;
+    delete[] CBlock;
+    delete[] crossBlock;
+    delete[] localBlock;
   }
 
   /*
@@ -67,6 +67,67 @@ uint64_t lookup_A1(uint64_t index, int m) {
   return val;
 }
 
+uint64_t lookup_neg_exp(uint64_t val_in, int32_t s_in, int32_t s_out) {
+  if (s_in < 0) {
+    s_in *= -1;
+    val_in *= (1ULL << (s_in));
+    s_in = 0;
+  }
+  uint64_t res_val =
+      exp(-1.0 * (val_in / double(1ULL << s_in))) * (1ULL << s_out);
+  return res_val;
+}
+
+uint64_t lookup_sqrt(int32_t index, int32_t m, int32_t exp_parity) {
+  int32_t k = 1 << m;
+  double u = (1.0 + (double(index) / double(k))) * (1 << exp_parity);
+  double Y = 1.0 / sqrt(u);
+  int32_t scale = m + SQRT_LOOKUP_SCALE;
+  uint64_t val = (Y * (1ULL << scale));
+  return val;
+}
+
+const vector<uint64_t> &MathFunctions::lookup_function_table(LUTFunction f,
+                                                           int32_t bw_in,
+                                                           int32_t s_in,
+                                                           int32_t s_out) {
+  auto key = make_tuple(f, bw_in, s_in, s_out);
+  auto it = lut_cache.find(key);
+  if (it != lut_cache.end()) {
+    return it->second;
+  }
+  assert(bw_in >= 1 && bw_in < 32);
+  uint64_t N = 1ULL << bw_in;
+  vector<uint64_t> table(N);
+  switch (f) {
+  case LUTFunction::NegExp: {
+    uint64_t mask_out = ((s_out + 2) == 64 ? -1 : (1ULL << (s_out + 2)) - 1);
+    for (uint64_t idx = 0; idx < N; idx++) {
+      table[idx] = lookup_neg_exp(idx, s_in, s_out) & mask_out;
+    }
+    break;
+  }
+  case LUTFunction::Reciprocal: {
+    // A0 || A1 (MSB -> LSB), A1 takes the low 2m + 3 bits
+    int32_t m = bw_in;
+    for (uint64_t idx = 0; idx < N; idx++) {
+      table[idx] = (lookup_A0(idx, m) << (2 * m + 3)) | lookup_A1(idx, m);
+    }
+    break;
+  }
+  case LUTFunction::InvSqrt: {
+    // idx = adjusted_x_m || exp_parity (MSB -> LSB)
+    int32_t m = bw_in - 1;
+    uint64_t mask_out = (1ULL << (m + SQRT_LOOKUP_SCALE + 1)) - 1;
+    for (uint64_t idx = 0; idx < N; idx++) {
+      table[idx] = lookup_sqrt(idx >> 1, m, idx & 1) & mask_out;
+    }
+    break;
+  }
+  }
+  return lut_cache.emplace(key, std::move(table)).first->second;
+}
+
 void MathFunctions::reciprocal_approximation(int32_t dim, int32_t m,
                                              uint64_t *dn, uint64_t *out,
                                              int32_t bw_dn, int32_t bw_out,
@@ -92,26 +153,27 @@ void MathFunctions::reciprocal_approximation(int32_t dim, int32_t m,
   uint64_t *c0 = new uint64_t[dim];
   uint64_t *c1 = new uint64_t[dim];
   if (party == ALICE) {
-    uint64_t **spec;
-    spec = new uint64_t *[dim];
+    const vector<uint64_t> &table =
+        lookup_function_table(LUTFunction::Reciprocal, m);
+    uint64_t *spec_data = new uint64_t[uint64_t(dim) * M];
+    uint64_t **spec = new uint64_t *[dim];
     PRG128 prg;
     prg.random_data(c0, dim * sizeof(uint64_t));
     prg.random_data(c1, dim * sizeof(uint64_t));
     for (int i = 0; i < dim; i++) {
-      spec[i] = new uint64_t[M];
+      spec[i] = spec_data + uint64_t(i) * M;
       c0[i] &= c0_mask;
       c1[i] &= c1_mask;
       for (int j = 0; j < M; j++) {
-        int idx = (tmp_2[i] + j) & m_mask;
-        spec[i][j] = (lookup_A0(idx, m) - c0[i]) & c0_mask;
+        uint64_t entry = table[(tmp_2[i] + j) & m_mask];
+        spec[i][j] = ((entry >> (2 * m + 3)) - c0[i]) & c0_mask;
         spec[i][j] <<= (2 * m + 3);
-        spec[i][j] |= (lookup_A1(idx, m) - c1[i]) & c1_mask;
+        spec[i][j] |= (entry - c1[i]) & c1_mask;
       }
     }
     aux->lookup_table<uint64_t>(spec, nullptr, nullptr, dim, m, 3 * m + 7);
 
-    for (int i = 0; i < dim; i++)
-      delete[] spec[i];
+    delete[] spec_data;
     delete[] spec;
   } else {
     aux->lookup_table<uint64_t>(nullptr, tmp_2, c1, dim, m, 3 * m + 7);
@@ -321,23 +383,11 @@ void MathFunctions::div(int32_t dim, uint64_t *nm, uint64_t *dn, uint64_t *out,
   }
 }
 
-uint64_t lookup_neg_exp(uint64_t val_in, int32_t s_in, int32_t s_out) {
-  if (s_in < 0) {
-    s_in *= -1;
-    val_in *= (1ULL << (s_in));
-    s_in = 0;
-  }
-  uint64_t res_val =
-      exp(-1.0 * (val_in / double(1ULL << s_in))) * (1ULL << s_out);
-  return res_val;
-}
-
 void MathFunctions::lookup_table_exp(int32_t dim, uint64_t *x, uint64_t *y,
                                      int32_t bw_x, int32_t bw_y, int32_t s_x,
                                      int32_t s_y) {
   assert(bw_y >= (s_y + 2));
-
-  int LUT_size = KKOT_LIMIT;
+  assert(exp_digit_size >= 1 && exp_digit_size <= KKOT_LIMIT);
 
   uint64_t bw_x_mask = (bw_x == 64 ? -1 : (1ULL << bw_x) - 1);
   uint64_t LUT_out_mask = ((s_y + 2) == 64 ? -1 : (1ULL << (s_y + 2)) - 1);
@@ -346,66 +396,67 @@ void MathFunctions::lookup_table_exp(int32_t dim, uint64_t *x, uint64_t *y,
   for (int i = 0; i < dim; i++) {
     tmp_1[i] = (-1 * x[i]) & bw_x_mask;
   }
-  int digit_size = LUT_size;
+  int digit_size = exp_digit_size;
   int num_digits = ceil(double(bw_x) / digit_size);
   int last_digit_size = bw_x - (num_digits - 1) * digit_size;
   uint64_t *x_digits = new uint64_t[num_digits * dim];
 
   aux->digit_decomposition_sci(dim, tmp_1, x_digits, bw_x, digit_size);
 
-  uint64_t digit_mask = (digit_size == 64 ? -1 : (1ULL << digit_size) - 1);
-  uint64_t last_digit_mask =
-      (last_digit_size == 64 ? -1 : (1ULL << last_digit_size) - 1);
-  int N = (1ULL << digit_size);
-  int last_N = (1ULL << last_digit_size);
-  int N_digits = (digit_size == last_digit_size ? num_digits : num_digits - 1);
+  // The full-size digits of all elements go through a single lookup on
+  // digit_size-bit inputs. A shorter last digit gets a second lookup on its own
+  // width, so its table and KKOT only cover 2^last_digit_size entries.
+  int num_full_digits =
+      (last_digit_size == digit_size ? num_digits : num_digits - 1);
+  uint64_t num_full = uint64_t(num_full_digits) * dim;
+  uint64_t N_full = 1ULL << digit_size;
+  uint64_t N_last = 1ULL << last_digit_size;
   uint64_t *digits_exp = new uint64_t[num_digits * dim];
   if (party == ALICE) {
-    uint64_t **spec;
-    spec = new uint64_t *[num_digits * dim];
+    uint64_t *spec_data =
+        new uint64_t[num_full * N_full + (num_digits * dim - num_full) * N_last];
+    uint64_t **spec = new uint64_t *[num_digits * dim];
     PRG128 prg;
     prg.random_data(digits_exp, num_digits * dim * sizeof(uint64_t));
-    for (int i = 0; i < N_digits * dim; i++) {
-      int digit_idx = i / dim;
-      spec[i] = new uint64_t[N];
-      digits_exp[i] &= LUT_out_mask;
-      for (int j = 0; j < N; j++) {
-        int idx = (x_digits[i] + j) & digit_mask;
-        spec[i][j] = (lookup_neg_exp(idx, s_x - digit_size * digit_idx, s_y) -
-                      digits_exp[i]) &
-                     LUT_out_mask;
-      }
-    }
-    aux->lookup_table<uint64_t>(spec, nullptr, nullptr, N_digits * dim,
-                                digit_size, s_y + 2);
-
-    if (digit_size != last_digit_size) {
-      int offset = N_digits * dim;
-      int digit_idx = N_digits;
-      for (int i = offset; i < num_digits * dim; i++) {
-        spec[i] = new uint64_t[last_N];
+    uint64_t *spec_row = spec_data;
+    for (int digit_idx = 0; digit_idx < num_digits; digit_idx++) {
+      int cur_digit_size =
+          (digit_idx == num_digits - 1 ? last_digit_size : digit_size);
+      uint64_t N = 1ULL << cur_digit_size;
+      uint64_t cur_digit_mask = N - 1;
+      const vector<uint64_t> &table =
+          lookup_function_table(LUTFunction::NegExp, cur_digit_size,
+                                s_x - digit_size * digit_idx, s_y);
+      for (int i = digit_idx * dim; i < (digit_idx + 1) * dim; i++) {
+        spec[i] = spec_row;
+        spec_row += N;
         digits_exp[i] &= LUT_out_mask;
-        for (int j = 0; j < last_N; j++) {
-          int idx = (x_digits[i] + j) & last_digit_mask;
-          spec[i][j] = (lookup_neg_exp(idx, s_x - digit_size * digit_idx, s_y) -
+        for (uint64_t j = 0; j < N; j++) {
+          spec[i][j] = (table[(x_digits[i] + j) & cur_digit_mask] -
                         digits_exp[i]) &
                        LUT_out_mask;
         }
       }
-      aux->lookup_table<uint64_t>(spec + offset, nullptr, nullptr, dim,
+    }
+    if (num_full > 0) {
+      aux->lookup_table<uint64_t>(spec, nullptr, nullptr, num_full, digit_size,
+                                  s_y + 2);
+    }
+    if (num_full_digits < num_digits) {
+      aux->lookup_table<uint64_t>(spec + num_full, nullptr, nullptr, dim,
                                   last_digit_size, s_y + 2);
     }
 
-    for (int i = 0; i < num_digits * dim; i++)
-      delete[] spec[i];
+    delete[] spec_data;
     delete[] spec;
   } else {
-    aux->lookup_table<uint64_t>(nullptr, x_digits, digits_exp, N_digits * dim,
-                                digit_size, s_y + 2);
-    if (digit_size != last_digit_size) {
-      int offset = N_digits * dim;
-      aux->lookup_table<uint64_t>(nullptr, x_digits + offset,
-                                  digits_exp + offset, dim, last_digit_size,
+    if (num_full > 0) {
+      aux->lookup_table<uint64_t>(nullptr, x_digits, digits_exp, num_full,
+                                  digit_size, s_y + 2);
+    }
+    if (num_full_digits < num_digits) {
+      aux->lookup_table<uint64_t>(nullptr, x_digits + num_full,
+                                  digits_exp + num_full, dim, last_digit_size,
                                   s_y + 2);
     }
     for (int i = 0; i < num_digits * dim; i++) {
@@ -590,15 +641,6 @@ void MathFunctions::tanh(int32_t dim, uint64_t *x, uint64_t *y, int32_t bw_x,
   delete[] tanh_neg_x;
 }
 
-uint64_t lookup_sqrt(int32_t index, int32_t m, int32_t exp_parity) {
-  int32_t k = 1 << m;
-  double u = (1.0 + (double(index) / double(k))) * (1 << exp_parity);
-  double Y = 1.0 / sqrt(u);
-  int32_t scale = m + SQRT_LOOKUP_SCALE;
-  uint64_t val = (Y * (1ULL << scale));
-  return val;
-}
-
 void MathFunctions::sqrt(int32_t dim, uint64_t *x, uint64_t *y, int32_t bw_x,
                          int32_t bw_y, int32_t s_x, int32_t s_y, bool inverse) {
   int32_t m, iters;
@@ -647,25 +689,26 @@ void MathFunctions::sqrt(int32_t dim, uint64_t *x, uint64_t *y, int32_t bw_x,
   // Y: bw = m + SQRT_LOOKUP_SCALE + 1, scale = m + SQRT_LOOKUP_SCALE
   uint64_t *Y = new uint64_t[dim];
   if (party == ALICE) {
-    uint64_t **spec;
-    spec = new uint64_t *[dim];
+    const vector<uint64_t> &table =
+        lookup_function_table(LUTFunction::InvSqrt, m + 1);
+    uint64_t *spec_data = new uint64_t[uint64_t(dim) * M];
+    uint64_t **spec = new uint64_t *[dim];
     PRG128 prg;
     prg.random_data(Y, dim * sizeof(uint64_t));
     for (int i = 0; i < dim; i++) {
-      spec[i] = new uint64_t[M];
+      spec[i] = spec_data + uint64_t(i) * M;
       Y[i] &= Y_mask;
       for (int j = 0; j < M; j++) {
         // j = exp_parity || (adjusted_x_m) (LSB -> MSB)
         int32_t idx = (adjusted_x_m[i] + (j >> 1)) & m_mask;
         int32_t exp_parity_val = (exp_parity[i] ^ (j & 1));
-        spec[i][j] = (lookup_sqrt(idx, m, exp_parity_val) - Y[i]) & Y_mask;
+        spec[i][j] = (table[(idx << 1) | exp_parity_val] - Y[i]) & Y_mask;
       }
     }
     aux->lookup_table<uint64_t>(spec, nullptr, nullptr, dim, m + 1,
                                 m + SQRT_LOOKUP_SCALE + 1);
 
-    for (int i = 0; i < dim; i++)
-      delete[] spec[i];
+    delete[] spec_data;
     delete[] spec;
   } else {
     // lut_in = exp_parity || adjusted_x_m
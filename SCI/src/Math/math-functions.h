@@ -26,6 +26,12 @@ SOFTWARE.
 #include "BuildingBlocks/truncation.h"
 #include "BuildingBlocks/value-extension.h"
 #include "LinearOT/linear-ot.h"
+#include <map>
+#include <tuple>
+#include <vector>
+
+// Public functions that MathFunctions evaluates through lookup tables
+enum class LUTFunction { NegExp, Reciprocal, InvSqrt };
 
 class MathFunctions {
 public:
@@ -37,10 +43,29 @@ public:
   Truncation *trunc;
   LinearOT *mult;
 
+  // Size of the digits lookup_table_exp splits its input into (1 to 8 bits).
+  // Both parties must use the same value.
+  int32_t exp_digit_size = 8;
+
+  // Cleartext tables on all bw_in-bit inputs, keyed by (f, bw_in, s_in, s_out)
+  std::map<std::tuple<LUTFunction, int32_t, int32_t, int32_t>,
+           std::vector<uint64_t>>
+      lut_cache;
+
   MathFunctions(int party, sci::IOPack *iopack, sci::OTPack *otpack);
 
   ~MathFunctions();
 
+  // Returns the table of f on all bw_in-bit inputs, building it on first use
+  // - NegExp: exp(-idx / 2^s_in) at scale s_out, in s_out + 2 bits
+  // - Reciprocal: the (A0, A1) pair of reciprocal_approximation for m = bw_in
+  // - InvSqrt: the initial 1/sqrt guess of sqrt for m = bw_in - 1, indexed by
+  //   idx || exp_parity
+  const std::vector<uint64_t> &lookup_function_table(LUTFunction f,
+                                                     int32_t bw_in,
+                                                     int32_t s_in = 0,
+                                                     int32_t s_out = 0);
+
   // Current implementation assumes that dn is always of the form 1.y1y2y3..yn
   void reciprocal_approximation(int32_t dim, int32_t m, uint64_t *dn,
                                 uint64_t *out, int32_t bw_dn, int32_t bw_out,
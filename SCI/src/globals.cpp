@@ -40,6 +40,7 @@ MaxPoolProtocol<intType> *maxpool;
 MatMulUniform<sci::NetIO, intType, sci::IKNP<sci::NetIO>> *multUniform;
 #endif
 #ifdef SCI_HE
+HESession *he_session;
 ConvField *he_conv;
 FCField *he_fc;
 ElemWiseProdField *he_prod;
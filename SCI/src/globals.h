@@ -67,6 +67,7 @@ extern MaxPoolProtocol<intType> *maxpool;
 extern MatMulUniform<sci::NetIO, intType, sci::IKNP<sci::NetIO>> *multUniform;
 #endif
 #ifdef SCI_HE
+extern HESession *he_session;
 extern ConvField *he_conv;
 extern FCField *he_fc;
 extern ElemWiseProdField *he_prod;
@@ -22,6 +22,7 @@ SOFTWARE.
 #include "defines_float.h"
 #include "FloatingPoint/floating-point.h"
 #include "FloatingPoint/fp-math.h"
+#include "utils/ThreadPool.h"
 
 using namespace sci ;
 using namespace std ;
@@ -32,4 +33,6 @@ OTPack *otpackArr[MAX_THREADS] ;
 BoolOp *boolopArr[MAX_THREADS] ;
 FixOp *fixopArr[MAX_THREADS] ;
 FPOp *fpopArr[MAX_THREADS] ;
-FPMath *fpmathArr[MAX_THREADS] ;
\ No newline at end of file
+FPMath *fpmathArr[MAX_THREADS] ;
+
+ThreadPool *threadPool = nullptr ;
\ No newline at end of file
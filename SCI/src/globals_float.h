@@ -25,6 +25,7 @@ SOFTWARE.
 #include "defines_float.h"
 #include "FloatingPoint/floating-point.h"
 #include "FloatingPoint/fp-math.h"
+#include "utils/ThreadPool.h"
 
 using namespace sci ;
 using namespace std ;
@@ -37,4 +38,8 @@ extern FixOp *fixopArr[MAX_THREADS] ;
 extern FPOp *fpopArr[MAX_THREADS] ;
 extern FPMath *fpmathArr[MAX_THREADS] ;
 
+// Persistent workers that run the per-thread chunks of an operation; a chunk
+// handled by thread tid uses the ops and channels at index tid
+extern ThreadPool *threadPool ;
+
 #endif
\ No newline at end of file
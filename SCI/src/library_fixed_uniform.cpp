@@ -320,36 +320,19 @@ static void Conv2D(int32_t N, int32_t H, int32_t W, int32_t CI, int32_t FH,
   ClearMemSecret2(reshapedFilterRows, reshapedIPCols, matmulOP);
 }
 
-void Conv2DWrapper(signedIntType N, signedIntType H, signedIntType W,
-                   signedIntType CI, signedIntType FH, signedIntType FW,
-                   signedIntType CO, signedIntType zPadHLeft,
-                   signedIntType zPadHRight, signedIntType zPadWLeft,
-                   signedIntType zPadWRight, signedIntType strideH,
-                   signedIntType strideW, intType *inputArr, intType *filterArr,
-                   intType *outArr) {
-#ifdef LOG_LAYERWISE
-  INIT_ALL_IO_DATA_SENT;
-  INIT_TIMER;
-#endif
-
-  static int ctr = 1;
-  std::cout << "Conv2DCSF " << ctr << " called N=" << N << ", H=" << H
-            << ", W=" << W << ", CI=" << CI << ", FH=" << FH << ", FW=" << FW
-            << ", CO=" << CO << ", S=" << strideH << std::endl;
-  ctr++;
-
+#ifdef SCI_HE
+// HE based convolution, for G == 1 or a depthwise convolution (G == CI)
+static void HEConv2D(signedIntType N, signedIntType H, signedIntType W,
+                     signedIntType CI, signedIntType FH, signedIntType FW,
+                     signedIntType CO, signedIntType zPadHLeft,
+                     signedIntType zPadHRight, signedIntType zPadWLeft,
+                     signedIntType zPadWRight, signedIntType strideH,
+                     signedIntType strideW, signedIntType G, intType *inputArr,
+                     intType *filterArr, intType *outArr) {
+  assert(G == 1 || G == CI);
   signedIntType newH = (((H + (zPadHLeft + zPadHRight) - FH) / strideH) + 1);
   signedIntType newW = (((W + (zPadWLeft + zPadWRight) - FW) / strideW) + 1);
 
-#ifdef SCI_OT
-  // If its a ring, then its a OT based -- use the default Conv2DCSF
-  // implementation that comes from the EzPC library
-  Conv2D(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft, zPadWRight,
-         strideH, strideW, inputArr, filterArr, outArr);
-#endif
-
-#ifdef SCI_HE
-  // If its a field, then its a HE based -- use the HE based conv implementation
   std::vector<std::vector<std::vector<std::vector<intType>>>> inputVec;
   inputVec.resize(N, std::vector<std::vector<std::vector<intType>>>(
                          H, std::vector<std::vector<intType>>(
@@ -358,7 +341,7 @@ void Conv2DWrapper(signedIntType N, signedIntType H, signedIntType W,
   std::vector<std::vector<std::vector<std::vector<intType>>>> filterVec;
   filterVec.resize(FH, std::vector<std::vector<std::vector<intType>>>(
                            FW, std::vector<std::vector<intType>>(
-                                   CI, std::vector<intType>(CO, 0))));
+                                   CI / G, std::vector<intType>(CO, 0))));
 
   std::vector<std::vector<std::vector<std::vector<intType>>>> outputVec;
   outputVec.resize(N, std::vector<std::vector<std::vector<intType>>>(
@@ -377,18 +360,24 @@ void Conv2DWrapper(signedIntType N, signedIntType H, signedIntType W,
   }
   for (int i = 0; i < FH; i++) {
     for (int j = 0; j < FW; j++) {
-      for (int k = 0; k < CI; k++) {
+      for (int k = 0; k < CI / G; k++) {
         for (int p = 0; p < CO; p++) {
-          filterVec[i][j][k][p] =
-              getRingElt(Arr4DIdxRowM(filterArr, FH, FW, CI, CO, i, j, k, p));
+          filterVec[i][j][k][p] = getRingElt(
+              Arr4DIdxRowM(filterArr, FH, FW, CI / G, CO, i, j, k, p));
         }
       }
     }
   }
 
-  he_conv->convolution(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight,
-                       zPadWLeft, zPadWRight, strideH, strideW, inputVec,
-                       filterVec, outputVec);
+  if (G == 1) {
+    he_conv->convolution(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight,
+                         zPadWLeft, zPadWRight, strideH, strideW, inputVec,
+                         filterVec, outputVec);
+  } else {
+    he_conv->depthwise_convolution(N, H, W, CI, FH, FW, CO, zPadHLeft,
+                                   zPadHRight, zPadWLeft, zPadWRight, strideH,
+                                   strideW, inputVec, filterVec, outputVec);
+  }
 
   for (int i = 0; i < N; i++) {
     for (int j = 0; j < newH; j++) {
@@ -400,7 +389,41 @@ void Conv2DWrapper(signedIntType N, signedIntType H, signedIntType W,
       }
     }
   }
+}
+#endif
+
+void Conv2DWrapper(signedIntType N, signedIntType H, signedIntType W,
+                   signedIntType CI, signedIntType FH, signedIntType FW,
+                   signedIntType CO, signedIntType zPadHLeft,
+                   signedIntType zPadHRight, signedIntType zPadWLeft,
+                   signedIntType zPadWRight, signedIntType strideH,
+                   signedIntType strideW, intType *inputArr, intType *filterArr,
+                   intType *outArr) {
+#ifdef LOG_LAYERWISE
+  INIT_ALL_IO_DATA_SENT;
+  INIT_TIMER;
+#endif
 
+  static int ctr = 1;
+  std::cout << "Conv2DCSF " << ctr << " called N=" << N << ", H=" << H
+            << ", W=" << W << ", CI=" << CI << ", FH=" << FH << ", FW=" << FW
+            << ", CO=" << CO << ", S=" << strideH << std::endl;
+  ctr++;
+
+  signedIntType newH = (((H + (zPadHLeft + zPadHRight) - FH) / strideH) + 1);
+  signedIntType newW = (((W + (zPadWLeft + zPadWRight) - FW) / strideW) + 1);
+
+#ifdef SCI_OT
+  // If its a ring, then its a OT based -- use the default Conv2DCSF
+  // implementation that comes from the EzPC library
+  Conv2D(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft, zPadWRight,
+         strideH, strideW, inputArr, filterArr, outArr);
+#endif
+
+#ifdef SCI_HE
+  // If its a field, then its a HE based -- use the HE based conv implementation
+  HEConv2D(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft,
+           zPadWRight, strideH, strideW, 1, inputArr, filterArr, outArr);
 #endif
 
 #ifdef LOG_LAYERWISE
@@ -541,6 +564,9 @@ void Conv2DGroupWrapper(signedIntType N, signedIntType H, signedIntType W,
   if (G == 1)
     Conv2DWrapper(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft,
                   zPadWRight, strideH, strideW, inputArr, filterArr, outArr);
+  else if (G == CI)
+    HEConv2D(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft,
+             zPadWRight, strideH, strideW, G, inputArr, filterArr, outArr);
   else
     assert(false && "Grouped conv not implemented in HE");
 #endif
@@ -1552,7 +1578,8 @@ void StartComputation() {
 #ifdef SCI_OT
     multUniformArr[i] =
         new MatMulUniform<sci::NetIO, intType, sci::IKNP<sci::NetIO>>(
-            party, bitlength, ioArr[i], otInstanceArr[i], nullptr);
+            party, bitlength, ioArr[i], otInstanceArr[i], nullptr,
+            num_threads);
 #endif
     if (i & 1) {
       otpackArr[i] = new sci::OTPack(iopackArr[i], 3 - party);
@@ -1590,9 +1617,11 @@ void StartComputation() {
                                          MILL_PARAM, prime_mod, otpack);
   argmax = new ArgMaxProtocol<intType>(party, FIELD, iopack, bitlength,
                                        MILL_PARAM, prime_mod, otpack);
-  he_conv = new ConvField(party, io);
-  he_fc = new FCField(party, io);
-  he_prod = new ElemWiseProdField(party, io);
+  // The HE protocols share their keys
+  he_session = new HESession(party, io);
+  he_conv = new ConvField(party, io, he_session);
+  he_fc = new FCField(party, io, he_session);
+  he_prod = new ElemWiseProdField(party, io, he_session);
   assertFieldRun();
 #endif
 
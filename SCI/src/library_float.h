@@ -45,6 +45,12 @@ extern FPMath *__fp_math; // float math operations
 extern int __m_bits; // mantissa bits
 extern int __e_bits; // exponent bits
 
+// Mixed precision for Beacon linear layers (MatMul and the batched matrix
+// multiplications behind convolutions): FP32 operands are rounded to bfloat16,
+// multiplied exactly and accumulated into FP32 outputs, while activations,
+// weights and their updates stay in FP32. Can be toggled between layers.
+extern bool __mixed_precision;
+
 // Handy globals ;
 extern int BATCH;
 extern int __sz1 ;
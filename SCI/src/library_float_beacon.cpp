@@ -27,6 +27,27 @@ using namespace sci ;
 
 int __chunk_exp = 26 ;
 
+// Whether a linear layer over FP32 operands runs in bfloat16 (see __mixed_precision)
+bool use_bfloat16(int m_bits, int e_bits) {
+	return __mixed_precision && m_bits == FP32_M_BITS && e_bits == FP32_E_BITS ;
+}
+
+// Rounds FP32 matrices to bfloat16 in a single conversion
+vector<FPMatrix> to_bfloat16(int tid, const vector<FPMatrix> &x) {
+	vector<FPArray> flat(x.begin(), x.end()) ;
+	FPArray x_cat = concat(flat) ;
+	// the shares take the role this thread's FPOp plays
+	x_cat.party = WHICHPARTY ;
+	FPArray x_bf = fpopArr[tid]->FP32_to_bfloat16(x_cat) ;
+
+	vector<FPMatrix> ret ;
+	for (int i = 0, offset = 0 ; i < (int)x.size() ; i++) {
+		int sz = x[i].dim1*x[i].dim2 ;
+		ret.push_back(FPMatrix(x[i].dim1, x[i].dim2, x_bf.subset(offset, offset+sz))) ;
+		offset += sz ;
+	}
+	return ret ;
+}
 
 void MatMul_thread(
 	int tid, int m_chunk, int n, int p, int m_bits, int e_bits, FPMatrix B,
@@ -37,7 +58,11 @@ void MatMul_thread(
 	FPMatrix A_chunk = fpopArr[tid]->input(WHICHPARTY, m_chunk, n, A_s, A_z, A_m, A_e, m_bits, e_bits) ;
 	FPMatrix res ;
 
-	res = fpopArr[tid]->matrix_multiplication_beacon(A_chunk, B, __chunk_exp) ;
+	// B was already rounded by MatMul
+	if (use_bfloat16(m_bits, e_bits))
+		A_chunk = to_bfloat16(tid, {A_chunk})[0] ;
+
+	res = fpopArr[tid]->matrix_multiplication_beacon(A_chunk, B, __chunk_exp, m_bits) ;
 
 	memcpy(res_s, res.s, m_chunk*p*sizeof(uint8_t)) ;
 	memcpy(res_z, res.z, m_chunk*p*sizeof(uint8_t)) ;
@@ -103,6 +128,8 @@ void MatMul(int32_t m, int32_t n, int32_t p,
 		}
 	}
 	FPMatrix mat2 = __fp_op->input(__party, n, p, B_s, B_z, B_m, B_e, m_bits, e_bits) ;
+	if (use_bfloat16(m_bits, e_bits))
+		mat2 = to_bfloat16(0, {mat2})[0] ;
 
 	uint8_t *res_s = new uint8_t[m*p] ;
 	uint8_t *res_z = new uint8_t[m*p] ;
@@ -110,12 +137,12 @@ void MatMul(int32_t m, int32_t n, int32_t p,
 	uint64_t *res_e = new uint64_t[m*p] ;
 
 	vector<int> chunks = get_chunks(m, __nt) ;
-	thread threads[MAX_THREADS] ;
+	future<void> futures[MAX_THREADS] ;
 	int m_offset, A_offset, res_offset ;
 	m_offset = A_offset = res_offset = 0 ;
 	for (int i = 0 ; i < __nt ; i++) {
 		if (chunks[i] > 0) {
-			threads[i] = thread(MatMul_thread,
+			futures[i] = threadPool->enqueue(MatMul_thread,
 				i, chunks[i], n, p, m_bits, e_bits, mat2,
 				A_s+A_offset, A_z+A_offset, A_m+A_offset, A_e+A_offset,
 				res_s+res_offset, res_z+res_offset, res_m+res_offset, res_e+res_offset
@@ -129,7 +156,7 @@ void MatMul(int32_t m, int32_t n, int32_t p,
 
 	for (int i = 0 ; i < __nt ; i++) {
 		if (chunks[i] > 0)
-			threads[i].join() ;
+			futures[i].get() ;
 	}
 
 	for (int i = 0, k = 0 ; i < m ; i++) {
@@ -203,11 +230,11 @@ void getBiasDer(int32_t m, int32_t s2, vector<vector<FPArray>>& batchSoftDer, ve
 
 
 	vector<int> chunks = get_chunks(s2, __nt) ;
-	thread threads[MAX_THREADS] ;
+	future<void> futures[MAX_THREADS] ;
 	int offset = 0 ;
 	for (int i = 0 ; i < __nt ; i++) {
 		if (chunks[i] > 0) {
-			threads[i] = thread(vectorSum_thread,
+			futures[i] = threadPool->enqueue(vectorSum_thread,
 				i, chunks[i], m, m_bits, e_bits,
 				Row_s+offset, Row_z+offset, Row_m+offset, Row_e+offset,
 				row_s+offset, row_z+offset, row_m+offset, row_e+offset
@@ -218,7 +245,7 @@ void getBiasDer(int32_t m, int32_t s2, vector<vector<FPArray>>& batchSoftDer, ve
 
 	for (int i = 0 ; i < __nt ; i++)
 		if (chunks[i] > 0)
-			threads[i].join() ;
+			futures[i].get() ;
 
 	for (int i = 0 ; i < s2 ; i++) {
 		biasDer[i].m_bits = m_bits ;
@@ -301,11 +328,11 @@ void Softmax2(
 	}
 
 	vector<int> chunks = get_chunks(s1, __nt) ;
-	thread threads[MAX_THREADS] ;
+	future<void> futures[MAX_THREADS] ;
 	int offset = 0 ;
 	for (int i = 0 ; i < __nt ; i++) {
 		if (chunks[i] > 0) {
-			threads[i] = thread(Softmax2_thread,
+			futures[i] = threadPool->enqueue(Softmax2_thread,
 				i, chunks[i], s2, m_bits, e_bits,
 				row_s+offset, row_z+offset, row_m+offset, row_e+offset,
 				out_s+offset, out_z+offset, out_m+offset, out_e+offset
@@ -316,7 +343,7 @@ void Softmax2(
 
 	for (int i = 0 ; i < __nt ; i++)
 		if (chunks[i] > 0)
-			threads[i].join() ;
+			futures[i].get() ;
 
 
 	for (int i = 0 ; i < s1 ; i++) {
@@ -400,13 +427,13 @@ void dotProduct2(int32_t s1, int32_t s2,
 	}
 
 	vector<int> chunks = get_chunks(s1, __nt);
-	thread threads[MAX_THREADS];
+	future<void> futures[MAX_THREADS];
 	int offset = 0;
 	for (int i = 0; i < __nt; i++)
 	{
 		if (chunks[i] > 0)
 		{
-			threads[i] = thread(dotProduct_thread,
+			futures[i] = threadPool->enqueue(dotProduct_thread,
 								i, chunks[i], s2, m_bits, e_bits,
 								Row1_s + offset, Row1_z + offset, Row1_m + offset, Row1_e + offset,
 								Row2_s + offset, Row2_z + offset, Row2_m + offset, Row2_e + offset,
@@ -417,7 +444,7 @@ void dotProduct2(int32_t s1, int32_t s2,
 
 	for (int i = 0; i < __nt; i++)
 		if (chunks[i] > 0)
-			threads[i].join();
+			futures[i].get();
 
 	for (int i = 0; i < s1; i++)
 	{
@@ -479,13 +506,13 @@ void vectorSum2(
 	}
 
 	vector<int> chunks = get_chunks(s1, __nt);
-	thread threads[MAX_THREADS];
+	future<void> futures[MAX_THREADS];
 	int offset = 0;
 	for (int i = 0; i < __nt; i++)
 	{
 		if (chunks[i] > 0)
 		{
-			threads[i] = thread(vectorSum_thread,
+			futures[i] = threadPool->enqueue(vectorSum_thread,
 								i, chunks[i], s2, m_bits, e_bits,
 								Row_s + offset, Row_z + offset, Row_m + offset, Row_e + offset,
 								row_s + offset, row_z + offset, row_m + offset, row_e + offset);
@@ -495,7 +522,7 @@ void vectorSum2(
 
 	for (int i = 0; i < __nt; i++)
 		if (chunks[i] > 0)
-			threads[i].join();
+			futures[i].get();
 
 	for (int i = 0; i < s1; i++)
 	{
@@ -599,11 +626,11 @@ void ConvBiasDer(
 	}
 
 	vector<int> chunks = get_chunks(chan, __nt) ;
-	thread threads[MAX_THREADS] ;
+	future<void> futures[MAX_THREADS] ;
 	int offset = 0 ;
 	for (int i = 0 ; i < __nt ; i++) {
 		if (chunks[i] > 0) {
-			threads[i] = thread(vectorSum_thread, 
+			futures[i] = threadPool->enqueue(vectorSum_thread, 
 				i, chunks[i], sz, m_bits, e_bits,
 				Row_s+offset, Row_z+offset, Row_m+offset, Row_e+offset,
 				der_s+offset, der_z+offset, der_m+offset, der_e+offset
@@ -614,7 +641,7 @@ void ConvBiasDer(
 
 	for (int i = 0 ; i < __nt ; i++)
 		if (chunks[i] > 0)
-			threads[i].join() ;
+			futures[i].get() ;
 
 	for (int i = 0 ; i < chan ; i++) {
 		biasDer[i].s[0] = der_s[i] ;
@@ -641,8 +668,16 @@ void batched_matrix_multiplication_thread(int tid, int chunk, int matsize, int m
 	uint8_t** Row_s, uint8_t** Row_z, uint64_t** Row_m, uint64_t** Row_e
 	) {
 
+	if (use_bfloat16(m_bits, e_bits)) {
+		vector<FPMatrix> xy = x_chunk ;
+		xy.insert(xy.end(), y_chunk.begin(), y_chunk.end()) ;
+		xy = to_bfloat16(tid, xy) ;
+		x_chunk = {xy.begin(), xy.begin()+chunk} ;
+		y_chunk = {xy.begin()+chunk, xy.end()} ;
+	}
+
 	vector<FPMatrix> res ;
-	res = fpopArr[tid]->matrix_multiplication_beacon(x_chunk, y_chunk, __chunk_exp) ;
+	res = fpopArr[tid]->matrix_multiplication_beacon(x_chunk, y_chunk, __chunk_exp, m_bits) ;
 
 	for (int i = 0 ; i < chunk ; i++) {
 		memcpy(Row_s[i], res[i].s, matsize*sizeof(uint8_t)) ;
@@ -677,13 +712,13 @@ vector<FPMatrix> batched_matrix_multiplication(vector<FPMatrix> &x, vector<FPMat
 	}
 
 	vector<int> chunks = get_chunks(L, __nt) ;
-	thread threads[MAX_THREADS] ;
+	future<void> futures[MAX_THREADS] ;
 	int offset = 0 ;
 	for (int i = 0 ; i < __nt ; i++) {
 		if (chunks[i] > 0) {
 			vector<FPMatrix> x_chunk = {x.begin()+offset, x.begin()+offset+chunks[i]} ;
 			vector<FPMatrix> y_chunk = {y.begin()+offset, y.begin()+offset+chunks[i]} ;
-			threads[i] = thread(batched_matrix_multiplication_thread,
+			futures[i] = threadPool->enqueue(batched_matrix_multiplication_thread,
 				i, chunks[i], m*p, m_bits, e_bits,
 				x_chunk, y_chunk,
 				Row_s+offset, Row_z+offset, Row_m+offset, Row_e+offset
@@ -694,7 +729,7 @@ vector<FPMatrix> batched_matrix_multiplication(vector<FPMatrix> &x, vector<FPMat
 
 	for (int i = 0 ; i < __nt ; i++)
 		if (chunks[i] > 0)
-			threads[i].join() ;
+			futures[i].get() ;
 
 	vector<FPMatrix> ret ;
 	for (int i = 0 ; i < L ; i++) {
@@ -805,11 +840,11 @@ void Avgpool_nomask(
 	}
 
 	vector<int> chunks = get_chunks(size, __nt) ;
-	thread threads[MAX_THREADS] ;
+	future<void> futures[MAX_THREADS] ;
 	int offset = 0 ;
 	for (int i = 0 ; i < __nt ; i++) {
 		if (chunks[i] > 0) {
-			threads[i] = thread(Avgpool_thread,
+			futures[i] = threadPool->enqueue(Avgpool_thread,
 				i, chunks[i], filter_size, m_bits, e_bits,
 				Row_s+offset, Row_z+offset, Row_m+offset, Row_e+offset,
 				pooled_s+offset, pooled_z+offset, pooled_m+offset, pooled_e+offset
@@ -820,7 +855,7 @@ void Avgpool_nomask(
 
 	for (int i = 0 ; i < __nt ; i++)
 		if (chunks[i] > 0)
-			threads[i].join() ;
+			futures[i].get() ;
 	
 	for (uint32_t n = 0, outarr_k=0; n < N; n++) {
 		for (uint32_t c = 0; c < C; c++) {
@@ -42,6 +42,7 @@ FPMath *__fp_math = nullptr ;		// float math operations
 // Floating point descriptors
 int __m_bits = 23 ;					// mantissa bits
 int __e_bits = 8 ;					// exponent bits
+bool __mixed_precision = false ;	// bfloat16 linear layers (Beacon)
 
 // Other stuff from defines_float.h
 int __nt = MAX_THREADS ;
@@ -74,6 +75,7 @@ void __init(int __argc, char **__argv) {
 	__amap.arg("mbits", __m_bits, "mantissa bits") ;
 	__amap.arg("ebits", __e_bits, "exponent bits") ;
 	__amap.arg("chunk", __chunk_exp, "Chunk Size (in powers of 2) for computation breakdown") ;
+	__amap.arg("mixed", __mixed_precision, "Run linear layers in bfloat16 with FP32 accumulation (Beacon)") ;
 	__amap.arg("port", __port, "port") ;
 	__amap.arg("add", __address, "address") ;
 
@@ -116,6 +118,8 @@ void __init(int __argc, char **__argv) {
     __fp_op = fpopArr[0] ;    
     __fp_math = fpmathArr[0] ;
 
+    threadPool = new ThreadPool(__nt) ;
+
 	__start = clock_start() ;
 	__initial_rounds = __iopack->get_rounds() ;
 	__comm_start = __get_comm() ;
@@ -38,6 +38,8 @@ int pad_l = 0;
 int pad_r = 0;
 int stride = 2;
 int filter_precision = 12;
+int engine = 0;
+bool depthwise = false;
 
 void Conv(ConvField &he_conv, int32_t H, int32_t CI, int32_t FH, int32_t CO,
           int32_t zPadHLeft, int32_t zPadHRight, int32_t strideH) {
@@ -67,8 +69,10 @@ void Conv(ConvField &he_conv, int32_t H, int32_t CI, int32_t FH, int32_t CO,
     for (int i = 0; i < FH; i++) {
       filterArr[i].resize(FW);
       for (int j = 0; j < FW; j++) {
-        filterArr[i][j].resize(CI);
-        for (int k = 0; k < CI; k++) {
+        // A depthwise filter has a single input channel
+        int filter_chans = depthwise ? 1 : CI;
+        filterArr[i][j].resize(filter_chans);
+        for (int k = 0; k < filter_chans; k++) {
           filterArr[i][j][k].resize(CO);
           prg.random_data(filterArr[i][j][k].data(), CO * sizeof(uint64_t));
           for (int h = 0; h < CO; h++) {
@@ -89,12 +93,26 @@ void Conv(ConvField &he_conv, int32_t H, int32_t CI, int32_t FH, int32_t CO,
       }
     }
   }
-  uint64_t comm_start = he_conv.io->counter;
   INIT_TIMER;
+  if (party == ALICE) {
+    START_TIMER;
+    he_conv.prepare_filters(H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight,
+                            zPadWLeft, zPadWRight, strideH, strideW, filterArr,
+                            depthwise);
+    STOP_TIMER("Time for Filter Preparation");
+  }
+  uint64_t comm_start = he_conv.io->counter;
   START_TIMER;
-  he_conv.convolution(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft,
-                      zPadWRight, strideH, strideW, inputArr, filterArr, outArr,
-                      true, true);
+  if (depthwise) {
+    he_conv.depthwise_convolution(N, H, W, CI, FH, FW, CO, zPadHLeft,
+                                  zPadHRight, zPadWLeft, zPadWRight, strideH,
+                                  strideW, inputArr, filterArr, outArr, true,
+                                  true);
+  } else {
+    he_conv.convolution(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight,
+                        zPadWLeft, zPadWRight, strideH, strideW, inputArr,
+                        filterArr, outArr, true, true);
+  }
   STOP_TIMER("Total Time for Conv");
   uint64_t comm_end = he_conv.io->counter;
   cout << "Total Comm: " << (comm_end - comm_start) / (1.0 * (1ULL << 20))
@@ -116,6 +134,8 @@ int main(int argc, char **argv) {
   amap.arg("pl", pad_l, "Left Padding");
   amap.arg("pr", pad_r, "Right Padding");
   amap.arg("fp", filter_precision, "Filter Precision");
+  amap.arg("e", engine, "Engine: AUTO = 0; ROTATION = 1; COEFF = 2");
+  amap.arg("dw", depthwise, "Depthwise (Output Channels a multiple of Input)");
   amap.parse(argc, argv);
   prime_mod = sci::default_prime_mod.at(bitlength);
 
@@ -133,6 +153,7 @@ int main(int argc, char **argv) {
   NetIO *io = new NetIO(party == 1 ? nullptr : address.c_str(), port);
 
   ConvField he_conv(party, io);
+  he_conv.engine = (ConvEngine)engine;
 
   Conv(he_conv, image_h, inp_chans, filter_h, out_chans, pad_l, pad_r, stride);
 
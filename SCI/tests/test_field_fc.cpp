@@ -54,6 +54,11 @@ void MatMul(FCField &he_fc, int32_t num_rows, int32_t common_dim) {
     prg.random_mod_p<uint64_t>(B[i].data(), num_cols, prime_mod);
   }
   INIT_TIMER;
+  if (party == ALICE) {
+    START_TIMER;
+    he_fc.prepare_matrix(num_rows, common_dim, A);
+    STOP_TIMER("Time for Matrix Preparation");
+  }
   START_TIMER;
   he_fc.matrix_multiplication(num_rows, common_dim, num_cols, A, B, C, true,
                               true);
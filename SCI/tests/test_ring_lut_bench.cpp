@@ -0,0 +1,147 @@
+/*
+Authors: Deevashwer Rathee
+Copyright:
+Copyright (c) 2021 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Sweeps the digit size of MathFunctions::lookup_table_exp on repeated calls
+// over small vectors (as in one LSTM timestep), where the fixed cost per call
+// dominates.
+
+#include "Math/math-functions.h"
+#include <iostream>
+
+using namespace sci;
+using namespace std;
+
+int party, port = 32000;
+string address = "127.0.0.1";
+
+int dim = 64;
+int iters = 100;
+int min_digit_size = 1;
+int max_digit_size = 8;
+int bw_x = 16;
+int bw_y = 16;
+int s_x = 12;
+int s_y = 12;
+
+uint64_t computeULPErr(double calc, double actual, int SCALE) {
+  int64_t calc_fixed = (double(calc) * (1ULL << SCALE));
+  int64_t actual_fixed = (double(actual) * (1ULL << SCALE));
+  uint64_t ulp_err = (calc_fixed - actual_fixed) > 0
+                         ? (calc_fixed - actual_fixed)
+                         : (actual_fixed - calc_fixed);
+  return ulp_err;
+}
+
+int main(int argc, char **argv) {
+  /************* Argument Parsing  ************/
+  /********************************************/
+  ArgMapping amap;
+  amap.arg("r", party, "Role of party: ALICE = 1; BOB = 2");
+  amap.arg("p", port, "Port Number");
+  amap.arg("N", dim, "Number of exponentiations per call");
+  amap.arg("i", iters, "Number of calls per digit size");
+  amap.arg("dmin", min_digit_size, "Smallest digit size");
+  amap.arg("dmax", max_digit_size, "Largest digit size");
+  amap.arg("bx", bw_x, "Bitwidth of input");
+  amap.arg("sx", s_x, "Scale of input");
+  amap.arg("sy", s_y, "Scale of output");
+  amap.arg("ip", address, "IP Address of server (ALICE)");
+
+  amap.parse(argc, argv);
+
+  assert(min_digit_size >= 1 && max_digit_size <= 8);
+  bw_y = s_y + 4;
+  uint64_t mask_x = (bw_x == 64 ? -1 : ((1ULL << bw_x) - 1));
+
+  /********** Setup IO and Base OTs ***********/
+  /********************************************/
+  IOPack *iopack = new IOPack(party, port, address);
+  OTPack *otpack = new OTPack(iopack, party);
+  MathFunctions *math = new MathFunctions(party, iopack, otpack);
+  std::cout << "All Base OTs Done" << std::endl;
+
+  /************ Generate Test Data ************/
+  /********************************************/
+  PRG128 prg;
+
+  uint64_t *x = new uint64_t[dim];
+  uint64_t *x0 = new uint64_t[dim];
+  uint64_t *y = new uint64_t[dim];
+  uint64_t *y0 = new uint64_t[dim];
+
+  prg.random_data(x, dim * sizeof(uint64_t));
+
+  if (party == ALICE) {
+    iopack->io->send_data(x, dim * sizeof(uint64_t));
+  } else {
+    iopack->io->recv_data(x0, dim * sizeof(uint64_t));
+    for (int i = 0; i < dim; i++) {
+      // x is always negative
+      x[i] = ((1ULL << (bw_x - 1)) + (x[i] & (mask_x >> 1))) - x0[i];
+    }
+  }
+  for (int i = 0; i < dim; i++) {
+    x[i] &= mask_x;
+  }
+
+  /*************** Digit Sweep ****************/
+  /********************************************/
+  cout << "Digit size\tTime/call (us)\tBytes/call\tMax ULP error (Bob)"
+       << endl;
+  for (int d = min_digit_size; d <= max_digit_size; d++) {
+    math->exp_digit_size = d;
+    // The first call builds the tables and is not timed
+    math->lookup_table_exp(dim, x, y, bw_x, bw_y, s_x, s_y);
+
+    uint64_t comm = iopack->get_comm();
+    auto start = clock_start();
+    for (int it = 0; it < iters; it++) {
+      math->lookup_table_exp(dim, x, y, bw_x, bw_y, s_x, s_y);
+    }
+    long long t = time_from(start);
+    comm = iopack->get_comm() - comm;
+
+    uint64_t max_ULP_err = 0;
+    if (party == ALICE) {
+      iopack->io->send_data(y, dim * sizeof(uint64_t));
+    } else { // party == BOB
+      iopack->io->recv_data(y0, dim * sizeof(uint64_t));
+      for (int i = 0; i < dim; i++) {
+        double dbl_x = (signed_val(x0[i] + x[i], bw_x)) / double(1LL << s_x);
+        double dbl_y = (signed_val(y0[i] + y[i], bw_y)) / double(1ULL << s_y);
+        max_ULP_err =
+            std::max(max_ULP_err, computeULPErr(dbl_y, exp(dbl_x), s_y));
+      }
+    }
+    cout << d << "\t" << double(t) / iters << "\t" << comm / iters << "\t"
+         << max_ULP_err << endl;
+  }
+
+  /******************* Cleanup ****************/
+  /********************************************/
+  delete[] x;
+  delete[] x0;
+  delete[] y;
+  delete[] y0;
+  delete math;
+  delete otpack;
+  delete iopack;
+}
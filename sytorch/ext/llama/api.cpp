@@ -27,17 +27,24 @@ SOFTWARE.
 #include <llama/assert.h>
 #include <llama/freekey.h>
 #include <llama/api.h>
+#include <llama/key_cache.h>
+#include <llama/branches.h>
 #include "and.h"
 #include "conv.h"
 #include "mult.h"
 #include "pubdiv.h"
 #include "relu.h"
+#include "spline.h"
 
 #include <cassert>
 #include <iostream>
 #include <assert.h>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstring>
 #include <Eigen/Dense>
 
 template <typename T> using pair = std::pair<T,T>;
@@ -119,74 +126,240 @@ void llama::end()
 }
 
 const bool parallel_reconstruct = true;
-void reconstruct(int32_t size, GroupElement *arr, int bw)
+
+// Bytes needed to carry `size` elements of `bw` bits each, packed back to back.
+inline size_t packedBytes(int32_t size, int bw)
+{
+    return ((size_t)size * bw + 7) / 8;
+}
+
+// Packs the low `bw` bits of each element into a little-endian bitstream. The
+// 8/16/32/64 widths are plain narrowing copies, everything else (including the
+// 1-bit DReLU shares) goes through a 128-bit accumulator.
+void packShares(const GroupElement *arr, int32_t size, int bw, uint8_t *out)
 {
-    uint64_t *tmp = new uint64_t[size];
-    if (parallel_reconstruct)
+    if (bw == 64) {
+        memcpy(out, arr, 8 * (size_t)size);
+    }
+    else if (bw == 32) {
+        uint32_t *out32 = (uint32_t *)out;
+        for (int32_t i = 0; i < size; ++i) out32[i] = (uint32_t)arr[i];
+    }
+    else if (bw == 16) {
+        uint16_t *out16 = (uint16_t *)out;
+        for (int32_t i = 0; i < size; ++i) out16[i] = (uint16_t)arr[i];
+    }
+    else if (bw == 8) {
+        for (int32_t i = 0; i < size; ++i) out[i] = (uint8_t)arr[i];
+    }
+    else {
+        const uint64_t mask = (uint64_t(1) << bw) - 1;
+        unsigned __int128 acc = 0;
+        int accBits = 0;
+        size_t pos = 0;
+        for (int32_t i = 0; i < size; ++i) {
+            acc |= (unsigned __int128)(arr[i] & mask) << accBits;
+            accBits += bw;
+            if (accBits >= 64) {
+                uint64_t word = (uint64_t)acc;
+                memcpy(out + pos, &word, 8);
+                pos += 8;
+                acc >>= 64;
+                accBits -= 64;
+            }
+        }
+        for (; accBits > 0; accBits -= 8) {
+            out[pos++] = (uint8_t)acc;
+            acc >>= 8;
+        }
+    }
+}
+
+// Inverse of packShares, fused with the share addition: arr[i] = arr[i] + peer[i] mod 2^bw.
+void unpackAddShares(const uint8_t *in, int32_t size, int bw, GroupElement *arr)
+{
+    if (bw == 64) {
+        const uint64_t *in64 = (const uint64_t *)in;
+        for (int32_t i = 0; i < size; ++i) arr[i] += in64[i];
+    }
+    else if (bw == 32) {
+        const uint32_t *in32 = (const uint32_t *)in;
+        for (int32_t i = 0; i < size; ++i) arr[i] = (uint32_t)(arr[i] + in32[i]);
+    }
+    else if (bw == 16) {
+        const uint16_t *in16 = (const uint16_t *)in;
+        for (int32_t i = 0; i < size; ++i) arr[i] = (uint16_t)(arr[i] + in16[i]);
+    }
+    else if (bw == 8) {
+        for (int32_t i = 0; i < size; ++i) arr[i] = (uint8_t)(arr[i] + in[i]);
+    }
+    else {
+        const uint64_t mask = (uint64_t(1) << bw) - 1;
+        const size_t nbytes = packedBytes(size, bw);
+        unsigned __int128 acc = 0;
+        int accBits = 0;
+        size_t pos = 0;
+        for (int32_t i = 0; i < size; ++i) {
+            while (accBits < bw) {
+                if (pos + 8 <= nbytes) {
+                    uint64_t word;
+                    memcpy(&word, in + pos, 8);
+                    acc |= (unsigned __int128)word << accBits;
+                    accBits += 64;
+                    pos += 8;
+                }
+                else {
+                    acc |= (unsigned __int128)in[pos++] << accBits;
+                    accBits += 8;
+                }
+            }
+            arr[i] = (arr[i] + (uint64_t)acc) & mask;
+            acc >>= bw;
+            accBits -= bw;
+        }
+    }
+}
+
+// Full-duplex channel shared by all reconstruct calls. A single sender thread lives for
+// the whole run and pushes the packed send buffer while the calling thread receives,
+// so a round costs no thread creation and, once warmed up, no allocation.
+class ReconstructChannel {
+public:
+    std::vector<uint8_t> sendBuf;
+    std::vector<uint8_t> recvBuf;
+
+    ~ReconstructChannel()
     {
-        std::thread send_thread(&Peer::send_batched_input, peer, arr, size, bw);
-        std::thread recv_thread(&Peer::recv_batched_input, peer, tmp, size, bw);
-        send_thread.join();
-        recv_thread.join();
+        if (sender.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                stop = true;
+            }
+            cv.notify_all();
+            sender.join();
+        }
     }
-    else
+
+    // Sends sendBuf[0, sendSize) and receives recvSize bytes into recvBuf concurrently.
+    void exchange(size_t sendSize, size_t recvSize)
     {
-        peer->send_batched_input(arr, size, bw);
-        peer->recv_batched_input(tmp, size, bw);
+        if (recvBuf.size() < recvSize)
+            recvBuf.resize(recvSize);
+        if (!parallel_reconstruct) {
+            peer->send_uint8_array(sendBuf.data(), sendSize);
+            peer->recv_uint8_array(recvBuf.data(), recvSize);
+            return;
+        }
+        if (!sender.joinable())
+            sender = std::thread(&ReconstructChannel::sendLoop, this);
+        {
+            std::lock_guard<std::mutex> lock(m);
+            pendingSize = sendSize;
+            pending = true;
+        }
+        cv.notify_all();
+        peer->recv_uint8_array(recvBuf.data(), recvSize);
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [this] { return !pending; });
     }
-    for (int i = 0; i < size; i++)
+
+private:
+    std::thread sender;
+    std::mutex m;
+    std::condition_variable cv;
+    size_t pendingSize = 0;
+    bool pending = false;
+    bool stop = false;
+
+    void sendLoop()
     {
-        arr[i] = arr[i] + tmp[i];
+        std::unique_lock<std::mutex> lock(m);
+        while (true) {
+            cv.wait(lock, [this] { return pending || stop; });
+            if (stop)
+                return;
+            lock.unlock();
+            peer->send_uint8_array(sendBuf.data(), pendingSize);
+            lock.lock();
+            pending = false;
+            cv.notify_all();
+        }
     }
-    delete[] tmp;
+};
+
+ReconstructChannel reconstructChannel;
+
+void reconstruct(int32_t size, GroupElement *arr, int bw)
+{
+    if (in_branches()) {
+        branch_reconstruct({size, arr, bw, nullptr});
+        return;
+    }
+    size_t nbytes = packedBytes(size, bw);
+    auto &ch = reconstructChannel;
+    if (ch.sendBuf.size() < nbytes)
+        ch.sendBuf.resize(nbytes);
+    packShares(arr, size, bw, ch.sendBuf.data());
+    ch.exchange(nbytes, nbytes);
+    unpackAddShares(ch.recvBuf.data(), size, bw, arr);
     numRounds += 1;
 }
 
-void reconstructRT(int32_t size, GroupElement *arr, int bw)
+void reconstructWithBits(int32_t size, GroupElement *arr, int bw, GroupElement *bits)
 {
-    uint64_t *tmp = new uint64_t[size];
-    int bitarraySize = size % 8 == 0 ? size / 8 : size / 8 + 1;
-    // std::cerr << "bitarraySize = " << bitarraySize << "\n";
-    uint8_t *tmp2 = new uint8_t[bitarraySize];
-    uint8_t *tmp3 = new uint8_t[bitarraySize];
-    // std::cerr << "bits = ";
-    // for(int i = 0; i < size; ++i)
-    // {
-    //     std::cerr << arr[i + size] << "  ";
-    // }
-    // std::cerr << "\n";
-    packBitArray(arr + size, size, tmp2);
-    // std::cerr << "encoded = " << (int)tmp2[0] << "\n";
-    if (parallel_reconstruct)
-    {
-        std::thread send_thread(&Peer::send_batched_input, peer, arr, size, bw);
-        std::thread recv_thread(&Peer::recv_batched_input, peer, tmp, size, bw);
-        send_thread.join();
-        recv_thread.join();
-        std::thread send_thread2(&Peer::send_uint8_array, peer, tmp2, bitarraySize);
-        std::thread recv_thread2(&Peer::recv_uint8_array, peer, tmp3, bitarraySize);
-        send_thread2.join();
-        recv_thread2.join();
+    if (in_branches()) {
+        branch_reconstruct({size, arr, bw, bits});
+        return;
     }
-    else
-    {
-        peer->send_batched_input(arr, size, bw);
-        peer->send_uint8_array(tmp2, bitarraySize);
-        peer->recv_batched_input(tmp, size, bw);
-        peer->recv_uint8_array(tmp3, bitarraySize);
+    size_t valueBytes = packedBytes(size, bw);
+    size_t nbytes = valueBytes + packedBytes(size, 1);
+    auto &ch = reconstructChannel;
+    if (ch.sendBuf.size() < nbytes)
+        ch.sendBuf.resize(nbytes);
+    packShares(arr, size, bw, ch.sendBuf.data());
+    packShares(bits, size, 1, ch.sendBuf.data() + valueBytes);
+    ch.exchange(nbytes, nbytes);
+    unpackAddShares(ch.recvBuf.data(), size, bw, arr);
+    unpackAddShares(ch.recvBuf.data() + valueBytes, size, 1, bits);
+    numRounds += 1;
+}
+
+void reconstructBatch(const std::vector<ReconstructRequest> &requests)
+{
+    size_t nbytes = 0;
+    for (auto &r : requests) {
+        nbytes += packedBytes(r.size, r.bw) + (r.bits == nullptr ? 0 : packedBytes(r.size, 1));
     }
-    // std::cerr << "bits = ";
-    for (int i = 0; i < size; i++)
-    {
-        arr[i] = arr[i] + tmp[i];
-        // std::cerr << ((tmp3[i / 8] >> (i % 8)) & 1) << "  ";
-        arr[i + size] = arr[i + size] + ((tmp3[i / 8] >> (i % 8)) & 1);
+    auto &ch = reconstructChannel;
+    if (ch.sendBuf.size() < nbytes)
+        ch.sendBuf.resize(nbytes);
+    size_t offset = 0;
+    for (auto &r : requests) {
+        packShares(r.arr, r.size, r.bw, ch.sendBuf.data() + offset);
+        offset += packedBytes(r.size, r.bw);
+        if (r.bits != nullptr) {
+            packShares(r.bits, r.size, 1, ch.sendBuf.data() + offset);
+            offset += packedBytes(r.size, 1);
+        }
+    }
+    ch.exchange(nbytes, nbytes);
+    offset = 0;
+    for (auto &r : requests) {
+        unpackAddShares(ch.recvBuf.data() + offset, r.size, r.bw, r.arr);
+        offset += packedBytes(r.size, r.bw);
+        if (r.bits != nullptr) {
+            unpackAddShares(ch.recvBuf.data() + offset, r.size, 1, r.bits);
+            offset += packedBytes(r.size, 1);
+        }
     }
-    // std::cerr << "\n";
-    delete[] tmp;
     numRounds += 1;
 }
 
+void reconstructRT(int32_t size, GroupElement *arr, int bw)
+{
+    reconstructWithBits(size, arr, bw, arr + size);
+}
+
 inline std::pair<int32_t, int32_t> get_start_end(int32_t size, int32_t thread_idx)
 {
     int32_t chunk_size = size / num_threads;
@@ -226,9 +399,12 @@ void Conv2DWrapper(int32_t N, int32_t H, int32_t W,
             }
         }
 
+        bool cachedB = is_cached_model_tensor(filterArr_mask, FH * FW * CI * CO);
         auto keys = KeyGenConv2D(bitlength, bitlength, N, H, W, CI, FH, FW, CO,
             zPadHLeft, zPadHRight, zPadWLeft, zPadWRight, strideH, strideW, 
-            inputArr_mask, filterArr_mask, outArr_mask);
+            inputArr_mask, filterArr_mask, outArr_mask, cachedB);
+        if (cachedB)
+            model_key_cache_record("conv2d", filterArr_mask, N * H * W * CI, FH * FW * CI * CO, d0 * d1 * d2 * d3);
         
         auto local_end = std::chrono::high_resolution_clock::now();
         
@@ -244,7 +420,10 @@ void Conv2DWrapper(int32_t N, int32_t H, int32_t W,
     else {
 
         auto keyread_start = std::chrono::high_resolution_clock::now();
-        auto key = dealer->recv_conv2d_key(bitlength, bitlength, N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft, zPadWRight, strideH, strideW);
+        GroupElement *bShare = cached_b_share(filterArr, FH * FW * CI * CO);
+        auto key = dealer->recv_conv2d_key(bitlength, bitlength, N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft, zPadWRight, strideH, strideW, bShare != nullptr);
+        if (bShare != nullptr)
+            key.b = bShare;
         auto keyread_end = std::chrono::high_resolution_clock::now();
         auto keyread_time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(keyread_end -
                                                             keyread_start).count();
@@ -260,6 +439,8 @@ void Conv2DWrapper(int32_t N, int32_t H, int32_t W,
         convOnlineComm += (onlineComm1 - onlineComm0);
         auto local_end = std::chrono::high_resolution_clock::now();
         
+        if (bShare != nullptr)
+            key.b = nullptr;
         freeConv2dKey(key);
         auto compute_time = std::chrono::duration_cast<std::chrono::microseconds>(t1 -
                                                             local_start).count();
@@ -388,10 +569,10 @@ void ScaleUp(int32_t size, MASK_PAIR(GroupElement *inArr), int32_t sf)
 void ars_threads_helper(int thread_idx, int32_t size, GroupElement *inArr, GroupElement *outArr, ARSKeyPack *keys)
 {
     auto p = get_start_end(size, thread_idx);
+    if (p.second > p.first) {
+        evalARSBatched(party - 2, p.second - p.first, inArr + p.first, keys[p.first].shift, keys + p.first, outArr + p.first);
+    }
     for(int i = p.first; i < p.second; i += 1){
-        
-        outArr[i] = evalARS(party - 2, inArr[i], keys[i].shift, keys[i]);
-       
         freeARSKeyPack(keys[i]);
     }
 }
@@ -566,7 +747,10 @@ void MatMul2D(int32_t s1, int32_t s2, int32_t s3, MASK_PAIR(GroupElement *A),
             }
         }
 
-        auto keys = KeyGenMatMul(bitlength, bitlength, s1, s2, s3, A_mask, B_mask, C_mask);
+        bool cachedB = is_cached_model_tensor(B_mask, s2 * s3);
+        auto keys = KeyGenMatMul(bitlength, bitlength, s1, s2, s3, A_mask, B_mask, C_mask, cachedB);
+        if (cachedB)
+            model_key_cache_record("matmul", B_mask, s1 * s2, s2 * s3, s1 * s3);
         auto dealer_end = std::chrono::high_resolution_clock::now();
 
         // server->send_matmul_key(keys.first);
@@ -579,7 +763,10 @@ void MatMul2D(int32_t s1, int32_t s2, int32_t s3, MASK_PAIR(GroupElement *A),
     else {
 
         auto keyread_start = std::chrono::high_resolution_clock::now();
-        auto key = dealer->recv_matmul_key(bitlength, bitlength, s1, s2, s3);
+        GroupElement *bShare = cached_b_share(B, s2 * s3);
+        auto key = dealer->recv_matmul_key(bitlength, bitlength, s1, s2, s3, bShare != nullptr);
+        if (bShare != nullptr)
+            key.b = bShare;
         auto keyread_end = std::chrono::high_resolution_clock::now();
         auto keyread_time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(keyread_end -
                                                             keyread_start).count();
@@ -606,6 +793,8 @@ void MatMul2D(int32_t s1, int32_t s2, int32_t s3, MASK_PAIR(GroupElement *A),
         std::cerr << "   Online Time = " << (reconstruct_time + compute_time) / 1000.0 << " milliseconds\n";
         std::cerr << "   Online Comm = " << (onlineComm1 - onlineComm0) << " bytes\n";
         
+        if (bShare != nullptr)
+            key.b = nullptr;
         freeMatMulKey(key);
     }
 
@@ -1197,8 +1386,8 @@ void reluHelper(int thread_idx, int32_t size, GroupElement *inArr, GroupElement
 {
     auto thread_start = std::chrono::high_resolution_clock::now();
     auto p = get_start_end(size, thread_idx);
+    evalReluBatched(party - 2, p.second - p.first, inArr + p.first, keys + p.first, outArr + p.first, drelu + p.first);
     for(int i = p.first; i < p.second; i += 1){
-        outArr[i] = evalRelu(party - 2, inArr[i], keys[i], &drelu[i]);
         freeReluKeyPack(keys[i]);
     }
     auto thread_end = std::chrono::high_resolution_clock::now();
@@ -1274,8 +1463,7 @@ void Relu(int32_t size, MASK_PAIR(GroupElement *inArr), MASK_PAIR(GroupElement *
         auto mid = std::chrono::high_resolution_clock::now();
         // Step 3: Online Communication
         uint64_t onlineComm0 = peer->bytesReceived + peer->bytesSent;
-        reconstruct(size, outArr, bitlength);
-        reconstruct(size, drelu, 1);
+        reconstructWithBits(size, outArr, bitlength, drelu);
         uint64_t onlineComm1 = peer->bytesReceived + peer->bytesSent;
         reluOnlineComm += (onlineComm1 - onlineComm0);
         auto end = std::chrono::high_resolution_clock::now();
@@ -1293,6 +1481,163 @@ void Relu(int32_t size, MASK_PAIR(GroupElement *inArr), MASK_PAIR(GroupElement *
     std::cerr << ">> Relu (Spline) - End " << "\n";
 }
 
+void relu2RoundDreluHelper(int thread_idx, int32_t size, GroupElement *inArr, GroupElement *drelu, Relu2RoundKeyPack *keys)
+{
+    auto p = get_start_end(size, thread_idx);
+    for(int i = p.first; i < p.second; i += 1){
+        drelu[i] = evalRelu2_drelu(party - 2, inArr[i], keys[i]);
+    }
+}
+
+void relu2RoundMultHelper(int thread_idx, int32_t size, GroupElement *inArr, GroupElement *outArr, GroupElement *drelu, Relu2RoundKeyPack *keys)
+{
+    auto p = get_start_end(size, thread_idx);
+    for(int i = p.first; i < p.second; i += 1){
+        outArr[i] = evalRelu2_mult(party - 2, drelu[i], inArr[i], keys[i]);
+        freeRelu2RoundKeyPack(keys[i]);
+    }
+}
+
+// Relu for inputs known to satisfy |x| < 2^(effectiveInputBw - 1): the comparison runs in the
+// smaller ring, so the keys shrink with effectiveInputBw, at the cost of a second round to open
+// the drelu before the selection.
+void Relu2Round(int32_t size, MASK_PAIR(GroupElement *inArr), MASK_PAIR(GroupElement *outArr), GroupElement *drelu_cache, int effectiveInputBw)
+{
+    std::cerr << ">> Relu (2 round, " << effectiveInputBw << " bits) - Start" << "\n";
+    always_assert(effectiveInputBw >= 2 && effectiveInputBw <= bitlength);
+    if (party == DEALER) {
+        uint64_t dealer_total_time = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < size; i += 1){
+            auto rout = random_ge(bitlength);
+            drelu_cache[i] = random_ge(1);
+            auto keys = keyGenRelu2Round(effectiveInputBw, bitlength, inArr_mask[i], drelu_cache[i], rout);
+            outArr_mask[i] = rout;
+            server->send_relu_2round_key(keys.first);
+            client->send_relu_2round_key(keys.second);
+            freeRelu2RoundKeyPackPair(keys);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        dealer_total_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        dealerMicroseconds += dealer_total_time;
+        std::cerr << "   Dealer time = " << dealer_total_time / 1000.0 << " milliseconds" << "\n";
+    }
+    else {
+        Relu2RoundKeyPack *keys = new Relu2RoundKeyPack[size];
+        auto keyread_start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < size; i++){
+            keys[i] = dealer->recv_relu_2round_key(effectiveInputBw, bitlength);
+        }
+        auto keyread_end = std::chrono::high_resolution_clock::now();
+        auto keyread_time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(keyread_end -
+                                                            keyread_start).count();
+        peer->sync();
+        auto start = std::chrono::high_resolution_clock::now();
+        uint64_t onlineComm0 = peer->bytesReceived + peer->bytesSent;
+        auto runThreads = [&](auto helper, auto... args) {
+            if (num_threads == 1) {
+                helper(0, size, args...);
+                return;
+            }
+            std::thread thread_pool[num_threads];
+            for(int thread_idx = 0; thread_idx < num_threads; thread_idx++)
+            {
+                thread_pool[thread_idx] = std::thread(helper, thread_idx, size, args...);
+            }
+            for(int thread_idx = 0; thread_idx < num_threads; thread_idx++)
+            {
+                thread_pool[thread_idx].join();
+            }
+        };
+        runThreads(relu2RoundDreluHelper, inArr, drelu_cache, keys);
+        reconstruct(size, drelu_cache, 1);
+        runThreads(relu2RoundMultHelper, inArr, outArr, drelu_cache, keys);
+        reconstruct(size, outArr, bitlength);
+        uint64_t onlineComm1 = peer->bytesReceived + peer->bytesSent;
+        reluOnlineComm += (onlineComm1 - onlineComm0);
+        auto end = std::chrono::high_resolution_clock::now();
+        auto eval_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        std::cerr << "   Key Read Time = " << keyread_time_taken << " milliseconds\n";
+        std::cerr << "   Online Time = " << eval_time / 1000.0 << " milliseconds\n";
+        std::cerr << "   Online Comm = " << (onlineComm1 - onlineComm0) << " bytes\n";
+        evalMicroseconds += eval_time;
+        reluEvalMicroseconds += eval_time;
+        delete[] keys;
+    }
+    std::cerr << ">> Relu (2 round) - End " << "\n";
+}
+
+void splineHelper(int thread_idx, int32_t size, const SplineTable *t, GroupElement *inArr, GroupElement *outArr, SplineKeyPack *keys)
+{
+    auto p = get_start_end(size, thread_idx);
+    evalSpline(party - 2, *t, p.second - p.first, inArr + p.first, keys + p.first, outArr + p.first);
+    for(int i = p.first; i < p.second; i += 1){
+        freeSplineKey(keys[i]);
+    }
+}
+
+void Spline(int32_t size, MASK_PAIR(GroupElement *inArr), MASK_PAIR(GroupElement *outArr), const SplineTable &t)
+{
+    std::cerr << ">> Spline (" << t.numPoly() << " intervals, degree " << t.degree << ") - Start" << "\n";
+    always_assert(t.bw == bitlength);
+    if (party == DEALER) {
+        uint64_t dealer_total_time = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < size; i += 1){
+            auto rout = random_ge(bitlength);
+            auto keys = keyGenSpline(t, inArr_mask[i], rout);
+            outArr_mask[i] = rout;
+            server->send_spline_key(keys.first);
+            client->send_spline_key(keys.second);
+            freeSplineKeyPair(keys);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        dealer_total_time = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        dealerMicroseconds += dealer_total_time;
+        std::cerr << "   Dealer time = " << dealer_total_time / 1000.0 << " milliseconds" << "\n";
+    }
+    else {
+        SplineKeyPack *keys = new SplineKeyPack[size];
+        auto keyread_start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < size; i++){
+            keys[i] = dealer->recv_spline_key(bitlength, bitlength, t.numPoly(), t.degree);
+        }
+        auto keyread_end = std::chrono::high_resolution_clock::now();
+        auto keyread_time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(keyread_end -
+                                                            keyread_start).count();
+        peer->sync();
+        auto start = std::chrono::high_resolution_clock::now();
+        if (num_threads == 1) {
+            splineHelper(0, size, &t, inArr, outArr, keys);
+        }
+        else {
+            std::thread thread_pool[num_threads];
+            for(int thread_idx = 0; thread_idx < num_threads; thread_idx++)
+            {
+                thread_pool[thread_idx] = std::thread(splineHelper, thread_idx, size, &t, inArr, outArr, keys);
+            }
+            for(int thread_idx = 0; thread_idx < num_threads; thread_idx++)
+            {
+                thread_pool[thread_idx].join();
+            }
+        }
+        auto mid = std::chrono::high_resolution_clock::now();
+        uint64_t onlineComm0 = peer->bytesReceived + peer->bytesSent;
+        reconstruct(size, outArr, bitlength);
+        uint64_t onlineComm1 = peer->bytesReceived + peer->bytesSent;
+        auto end = std::chrono::high_resolution_clock::now();
+        auto compute_time = std::chrono::duration_cast<std::chrono::microseconds>(mid - start).count();
+        auto reconstruct_time = std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count();
+        std::cerr << "   Key Read Time = " << keyread_time_taken << " milliseconds\n";
+        std::cerr << "   Compute Time = " << compute_time / 1000.0 << " milliseconds\n";
+        std::cerr << "   Reconstruct Time = " << reconstruct_time / 1000.0 << " milliseconds\n";
+        std::cerr << "   Online Comm = " << (onlineComm1 - onlineComm0) << " bytes\n";
+        evalMicroseconds += (reconstruct_time + compute_time);
+        delete[] keys;
+    }
+    std::cerr << ">> Spline - End" << "\n";
+}
+
 #define BIG_LOOPY(e) for(int n = 0; n < N; ++n) {\
         for(int h = 0; h < H; ++h) {\
             for(int w = 0; w < W; ++w) {\
@@ -23,9 +23,12 @@ SOFTWARE.
 #include <llama/array.h>
 #include <llama/comms.h>
 #include <llama/utils.h>
+#include <llama/gemm.h>
+#include <llama/config.h>
+#include <chrono>
 #include <assert.h>
 
-std::pair<MatMulKey, MatMulKey> KeyGenMatMul(int Bin, int Bout, int s1, int s2, int s3, GroupElement *rin1, GroupElement *rin2, GroupElement *rout){
+std::pair<MatMulKey, MatMulKey> KeyGenMatMul(int Bin, int Bout, int s1, int s2, int s3, GroupElement *rin1, GroupElement *rin2, GroupElement *rout, bool cachedB){
     MatMulKey k0;
     MatMulKey k1;
 
@@ -35,11 +38,11 @@ std::pair<MatMulKey, MatMulKey> KeyGenMatMul(int Bin, int Bout, int s1, int s2,
     k1.s1 = s1; k1.s2 = s2; k1.s3 = s3;
 
     k0.a = make_array<GroupElement>(s1, s2);
-    k0.b = make_array<GroupElement>(s2, s3);
+    k0.b = cachedB ? nullptr : make_array<GroupElement>(s2, s3);
     k0.c = make_array<GroupElement>(s1, s3);
 
     k1.a = make_array<GroupElement>(s1, s2);
-    k1.b = make_array<GroupElement>(s2, s3);
+    k1.b = cachedB ? nullptr : make_array<GroupElement>(s2, s3);
     k1.c = make_array<GroupElement>(s1, s3);
     
     GroupElement *c = make_array<GroupElement>(s1, s3);
@@ -56,7 +59,8 @@ std::pair<MatMulKey, MatMulKey> KeyGenMatMul(int Bin, int Bout, int s1, int s2,
         }
     }
     
-    for(int i = 0; i < s2; i++)
+    // with cachedB the b-shares come from the model key cache instead
+    for(int i = 0; i < s2 && !cachedB; i++)
     {
         for(int j = 0; j < s3; j++)
         {
@@ -87,7 +91,7 @@ std::pair<Conv2DKey, Conv2DKey> KeyGenConv2D(
     int zPadHLeft, int zPadHRight, 
     int zPadWLeft, int zPadWRight,
     int strideH, int strideW,
-    GroupElement *rin1,  GroupElement * rin2, GroupElement * rout)
+    GroupElement *rin1,  GroupElement * rin2, GroupElement * rout, bool cachedB)
 {
     Conv2DKey k0;
     Conv2DKey k1;
@@ -101,8 +105,8 @@ std::pair<Conv2DKey, Conv2DKey> KeyGenConv2D(
     int d3 = CO;
     k0.a = make_array<GroupElement>(N, H, W, CI);
     k1.a = make_array<GroupElement>(N, H, W, CI);
-    k0.b = make_array<GroupElement>(FH, FW, CI, CO);
-    k1.b = make_array<GroupElement>(FH, FW, CI, CO);
+    k0.b = cachedB ? nullptr : make_array<GroupElement>(FH, FW, CI, CO);
+    k1.b = cachedB ? nullptr : make_array<GroupElement>(FH, FW, CI, CO);
     k0.c = make_array<GroupElement>(d0, d1, d2, d3);
     k1.c = make_array<GroupElement>(d0, d1, d2, d3);
     k0.N = N; k0.H = H; k0.W = W; k0.CI = CI; k0.FH = FH; k0.FW = FW; k0.CO = CO; 
@@ -132,7 +136,7 @@ std::pair<Conv2DKey, Conv2DKey> KeyGenConv2D(
         }
     }
 
-    for(int fh = 0; fh < FH; ++fh) {
+    for(int fh = 0; fh < FH && !cachedB; ++fh) {
         for(int fw = 0; fw < FW; ++fw) {
             for(int ci = 0; ci < CI; ++ci) {
                 for(int co = 0; co < CO; ++co) {
@@ -173,36 +177,29 @@ void EvalConv2D(int party, const Conv2DKey &key,
     int d2 = ((W - FW + (zPadWLeft + zPadWRight)) / strideW) + 1;
     int d3 = CO;
 
-    Conv2DCache cache = allocateConv2DCache(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft, zPadWRight, strideH, strideW);
     MatCopy4(d0, d1, d2, d3, key.c, output);
 
+    // the implicit-GEMM kernel accumulates straight into output, so no temporaries
+    // besides the server's masked filter are needed
+    auto start = std::chrono::high_resolution_clock::now();
     if (party == SERVER)
     {
         GroupElement *tempFilter = make_array<GroupElement>(FH, FW, CI, CO);
         MatSub4(FH, FW, CI, CO, filter, key.b, tempFilter);
-        Conv2DPlaintext(N, H, W, CI, FH, FW, CO,
-            zPadHLeft, zPadHRight, 
-            zPadWLeft, zPadWRight,
-            strideH, strideW, input, tempFilter, cache.temp, cache);
-        MatAdd4(d0, d1, d2, d3, cache.temp, output, output);
+        ringConv2D(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft, zPadWRight, strideH, strideW,
+            input, tempFilter, output, RingGemmMode::Add, LlamaConfig::num_threads);
         delete[] tempFilter;
     }
     else
     {
-        Conv2DPlaintext(N, H, W, CI, FH, FW, CO,
-            zPadHLeft, zPadHRight, 
-            zPadWLeft, zPadWRight,
-            strideH, strideW, input, key.b, cache.temp, cache);
-        MatSub4(d0, d1, d2, d3, output, cache.temp, output);
+        ringConv2D(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft, zPadWRight, strideH, strideW,
+            input, key.b, output, RingGemmMode::Subtract, LlamaConfig::num_threads);
     }
 
-    Conv2DPlaintext(N, H, W, CI, FH, FW, CO,
-        zPadHLeft, zPadHRight, 
-        zPadWLeft, zPadWRight,
-        strideH, strideW, key.a, filter, cache.temp, cache);
-    MatSub4(d0, d1, d2, d3, output, cache.temp, output);
-
-    freeConv2DCache(cache);
+    ringConv2D(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft, zPadWRight, strideH, strideW,
+        key.a, filter, output, RingGemmMode::Subtract, LlamaConfig::num_threads);
+    auto end = std::chrono::high_resolution_clock::now();
+    eigenMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
 }
 
 std::pair<Conv3DKey, Conv3DKey> KeyGenConv3D(
@@ -22,7 +22,7 @@ SOFTWARE.
 #include <llama/keypack.h>
 
 
-std::pair<MatMulKey, MatMulKey> KeyGenMatMul(int Bin, int Bout, int s1, int s2, int s3, GroupElement *rin1, GroupElement *rin2, GroupElement *rout);
+std::pair<MatMulKey, MatMulKey> KeyGenMatMul(int Bin, int Bout, int s1, int s2, int s3, GroupElement *rin1, GroupElement *rin2, GroupElement *rout, bool cachedB = false);
 
 std::pair<Conv2DKey, Conv2DKey> KeyGenConv2D(
     int Bin, int Bout,
@@ -30,7 +30,7 @@ std::pair<Conv2DKey, Conv2DKey> KeyGenConv2D(
     int zPadHLeft, int zPadHRight, 
     int zPadWLeft, int zPadWRight,
     int strideH, int strideW,
-    GroupElement *rin1,  GroupElement * rin2, GroupElement * rout);
+    GroupElement *rin1,  GroupElement * rin2, GroupElement * rout, bool cachedB = false);
 
 void EvalConv2D(int party, const Conv2DKey &key,
     int N, int H, int W, int CI, int FH, int FW, int CO,
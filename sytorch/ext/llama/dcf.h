@@ -53,6 +53,15 @@ void evalDCF(int Bin, int Bout, int groupSize,
 
 void evalDCFPartial(int party, GroupElement *res, GroupElement idx, const DCFKeyPack &key, int start, int len);
 
+// Evaluates n independent DCF keys (sharing Bin, Bout and groupSize) in lockstep, level by level.
+// Results match n calls to evalDCF, out is laid out as n x groupSize
+void evalDCFBatched(int party, int Bin, int Bout, int groupSize, int n,
+                GroupElement *out, // n * groupSize
+                const GroupElement *idx, // n
+                osuCrypto::block *const *k, // n pointers to bin + 1 blocks
+                GroupElement *const *g, // n pointers to groupSize elements
+                GroupElement *const *v); // n pointers to bin * groupSize elements
+
 std::pair<DualDCFKeyPack, DualDCFKeyPack> keyGenDualDCF(int Bin, int Bout, int groupSize, GroupElement idx, GroupElement *payload1, GroupElement *payload2);
 
 std::pair<DualDCFKeyPack, DualDCFKeyPack> keyGenDualDCF(int Bin, int Bout, GroupElement idx, GroupElement payload1, GroupElement payload2);
@@ -22,6 +22,7 @@ SOFTWARE.
 #pragma once
 
 #include <llama/group_element.h>
+#include <llama/spline_table.h>
 
 #define MASK_PAIR(x) x, x##_mask
 
@@ -90,14 +91,16 @@ void ElemWiseSecretSharedVectorMult(int32_t size, MASK_PAIR(GroupElement *inArr)
 
 void Floor(int32_t s1, MASK_PAIR(GroupElement *inArr), MASK_PAIR(GroupElement *outArr), int32_t sf);
 
-void PiranhaSoftmax(int32_t s1, int32_t s2, MASK_PAIR(GroupElement *inArr), MASK_PAIR(GroupElement *outArr), int32_t sf);
-
 void ARS(int32_t size, MASK_PAIR(GroupElement *inArr), MASK_PAIR(GroupElement *outArr), int32_t shift);
 
 void Select(int32_t size, GroupElement *s, GroupElement *x, GroupElement *out);
 
 void Relu2Round(int32_t size, MASK_PAIR(GroupElement *inArr), MASK_PAIR(GroupElement *outArr), GroupElement *drelu_cache, int effectiveInputBw);
 
+// evaluates the public piecewise polynomial t (see spline_table.h) on every element in one round,
+// the output is at scale t.scale and still has to be truncated by t.shift
+void Spline(int32_t size, MASK_PAIR(GroupElement *inArr), MASK_PAIR(GroupElement *outArr), const SplineTable &t);
+
 void MaxPoolDouble(int32_t N, int32_t H, int32_t W, int32_t C, int32_t FH,
              int32_t FW, int32_t zPadHLeft, int32_t zPadHRight,
              int32_t zPadWLeft, int32_t zPadWRight, int32_t strideH,
@@ -163,3 +166,5 @@ void ConvTranspose2DWrapper(int64_t N,
                             GroupElement *outArr);
 
 void reconstruct(int32_t size, GroupElement *arr, int bw);
+// reconstructs arr (bw bits) and bits (1 bit per element) in a single round
+void reconstructWithBits(int32_t size, GroupElement *arr, int bw, GroupElement *bits);
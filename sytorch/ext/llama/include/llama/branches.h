@@ -0,0 +1,55 @@
+/*
+Authors: Deepak Kumaraswamy, Kanav Gupta
+Copyright:
+Copyright (c) 2022 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#pragma once
+#include <llama/group_element.h>
+#include <functional>
+#include <vector>
+
+// Independent branches (computations that do not read each other's outputs) run with their
+// rounds merged: every branch runs until it has to open a value, and when all of them are
+// waiting, their values are opened together in one exchange. A wavefront of k branches then
+// takes as many rounds as its longest branch instead of the sum over the branches.
+//
+// Branches take turns on the CPU in index order, switching only at a reconstruct, so every
+// party runs the same schedule. The dealer runs the branches one after another and sends
+// each branch's keys as a separate segment, which the parties read before the branches start,
+// so a branch reads its own keys whatever order the branches run in. For the same reason each
+// branch draws from its own prngShared stream.
+void run_branches(const std::vector<std::function<void()>> &branches);
+
+// whether the caller runs inside run_branches
+bool in_branches();
+
+struct ReconstructRequest {
+    int32_t size;
+    GroupElement *arr;
+    int bw;
+    GroupElement *bits; // nullptr, or size more elements opened as 1 bit each
+};
+
+// called by reconstruct inside run_branches: queues the request and returns once it has been
+// opened along with the other branches' requests
+void branch_reconstruct(const ReconstructRequest &request);
+
+// opens all requests in one round, in order (defined in api.cpp)
+void reconstructBatch(const std::vector<ReconstructRequest> &requests);
@@ -39,6 +39,7 @@ SOFTWARE.
 #include <stdio.h>
 #include <string.h>
 #include <fstream>
+#include <vector>
 
 #define DEALER 1
 #define SERVER 2
@@ -51,7 +52,8 @@ public:
     std::fstream file;
     uint64_t bytesSent = 0;
     uint64_t bytesReceived = 0;
-    
+    // when set, keys are appended here instead of being sent (see llama/branches.h)
+    std::string *capture = nullptr;
 
     Peer(std::string ip, int port);
     Peer(int sendsocket, int recvsocket) {
@@ -65,6 +67,11 @@ public:
 
     void close();
 
+    void send_bytes(const char *buf, size_t size);
+
+    // a length-prefixed block of keys, read back with Dealer::recv_segment
+    void send_segment(const std::string &segment);
+
     void send_ge(const GroupElement &g, int bw);
     void send_ge_array(const GroupElement *g, int size);
 
@@ -132,9 +139,9 @@ public:
 
     void send_triple_key(const TripleKeyPack &kp);
 
-    void send_uint8_array(const uint8_t *data, int size);
+    void send_uint8_array(const uint8_t *data, size_t size);
 
-    void recv_uint8_array(uint8_t *data, int size);
+    void recv_uint8_array(uint8_t *data, size_t size);
 
     void sync();
 
@@ -156,7 +163,7 @@ public:
     bool ramdisk =true;
     char *ramdiskBuffer;
     char *ramdiskStart;
-    int ramdiskSize;
+    uint64_t ramdiskSize;
     bool ramdisk_path = false;
 
     Dealer(std::string ip, int port);
@@ -182,8 +189,22 @@ public:
         }
     }
 
+    // reads keys from a block of memory that outlives the keys, such as a segment
+    Dealer(char *buffer, uint64_t size) {
+        this->useFile = true;
+        this->ramdisk = true;
+        this->ramdisk_path = true;
+        this->ramdiskBuffer = buffer;
+        this->ramdiskStart = buffer;
+        this->ramdiskSize = size;
+    }
+
     void close();
 
+    // a block written by Peer::send_segment. Points into the key file when it is mapped,
+    // otherwise into storage.
+    char *recv_segment(std::vector<char> &storage, uint64_t &size);
+
     GroupElement recv_mask();
 
     MultKey recv_mult_key();
@@ -200,14 +221,14 @@ public:
 
     DualDCFKeyPack recv_ddcf_keypack(int Bin, int Bout, int groupSize);
 
-    MatMulKey recv_matmul_key(int bin, int bout, int s1, int s2, int s3);
+    MatMulKey recv_matmul_key(int bin, int bout, int s1, int s2, int s3, bool cachedB = false);
 
     Conv2DKey recv_conv2d_key(int bin, int bout, int64_t N, int64_t H, int64_t W,
                    int64_t CI, int64_t FH, int64_t FW,
                    int64_t CO, int64_t zPadHLeft,
                    int64_t zPadHRight, int64_t zPadWLeft,
                    int64_t zPadWRight, int64_t strideH,
-                   int64_t strideW);
+                   int64_t strideW, bool cachedB = false);
 
     Conv3DKey recv_conv3d_key(int bin, int bout, int64_t N, int64_t D, int64_t H, int64_t W,
                    int64_t CI, int64_t FD, int64_t FH, int64_t FW, int64_t CO,
@@ -0,0 +1,52 @@
+/*
+Authors: Deepak Kumaraswamy, Kanav Gupta
+Copyright:
+Copyright (c) 2022 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+// Linear algebra over Z_2^64. Results wrap like plain uint64_t arithmetic, so the same
+// kernels serve every bitlength <= 64 (callers reduce mod 2^bw where they need to).
+
+// How a kernel writes its result into C.
+enum class RingGemmMode {
+    Store,      // C = A * B
+    Add,        // C += A * B
+    Subtract    // C -= A * B
+};
+
+// C = / += / -= A * B, with A of size M x K and B of size K x N. Element (i, j) of A is
+// A[i * rsA + j * csA] (same for B), so transposed operands only need swapped strides.
+// C is row-major with row stride rsC. threads <= 0 uses the default OpenMP team size.
+void ringGemm(int64_t M, int64_t N, int64_t K,
+              const uint64_t *A, int64_t rsA, int64_t csA,
+              const uint64_t *B, int64_t rsB, int64_t csB,
+              uint64_t *C, int64_t rsC, RingGemmMode mode, int threads);
+
+// Implicit-GEMM convolution of an NHWC input with a CO x (FH * FW * CI) filter into an
+// NHWC output. Input patches are gathered straight into the packed panels, so no im2col
+// matrix is ever materialised.
+void ringConv2D(int64_t N, int64_t H, int64_t W, int64_t CI,
+                int64_t FH, int64_t FW, int64_t CO,
+                int64_t zPadHLeft, int64_t zPadHRight, int64_t zPadWLeft, int64_t zPadWRight,
+                int64_t strideH, int64_t strideW,
+                const uint64_t *input, const uint64_t *filter, uint64_t *output,
+                RingGemmMode mode, int threads);
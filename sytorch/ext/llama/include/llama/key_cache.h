@@ -0,0 +1,61 @@
+/*
+Authors: Deepak Kumaraswamy, Kanav Gupta
+Copyright:
+Copyright (c) 2022 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include <llama/group_element.h>
+#include <string>
+
+// Model key cache. When enabled, the server's model tensors are masked with a per-model
+// seed instead of the per-inference input PRNG. Their masks, the masked model held by the
+// client and the b-shares of MatMul/Conv2D keys whose second operand is a model tensor
+// then stay the same across inferences. They are computed once and kept on disk, and the
+// dealer only generates the per-query a and c terms of those keys.
+//
+// Files (all under the given prefix):
+//   model_keys.dealer    dealer: model seed
+//   model_keys.server    server: model seed (written by the dealer)
+//   model_keys.client    client: b-shares of every model tensor (written by the dealer)
+//   model_inputs.client  client: masked model (written by the client on the first run)
+//   model_keys.manifest  dealer: what is cached and what is still generated per query
+enum class ModelKeyCacheMode {
+    Off,
+    Build,  // dealer: create the cache; parties: first inference against a fresh cache
+    Reuse   // every later inference
+};
+
+// call on every party after the key files are opened and before the model is input
+void model_key_cache_init(ModelKeyCacheMode mode, const std::string &prefix = "");
+void model_key_cache_finalize();
+bool model_key_cache_enabled();
+
+// inputs a server-owned model tensor. Falls back to input_layer when the cache is off.
+// x is the tensor (nullptr on the dealer), x_mask receives the mask on the dealer.
+void input_model(GroupElement *x, GroupElement *x_mask, int size);
+
+// dealer: whether tensor (as passed to the layer) is a whole model tensor input through
+// input_model, in which case the b-share of its key is not generated
+bool is_cached_model_tensor(const GroupElement *tensor, int64_t size);
+// parties: this party's b-share for a cached model tensor, nullptr otherwise.
+// The returned array is owned by the cache.
+GroupElement *cached_b_share(const GroupElement *tensor, int64_t size);
+
+// dealer: notes a key that used the cache, for the manifest
+void model_key_cache_record(const char *op, const GroupElement *tensor, int64_t aSize, int64_t bSize, int64_t cSize);
@@ -0,0 +1,56 @@
+/*
+Authors: Deepak Kumaraswamy, Kanav Gupta
+Copyright:
+Copyright (c) 2022 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include <llama/group_element.h>
+#include <functional>
+#include <vector>
+
+// A public piecewise polynomial on Z_{2^bw}, evaluated under FSS by the Spline gate.
+// Interval i holds the inputs p[i] + 1 ... p[i + 1] taken as unsigned, where p[0] stands for -1
+// so that the first interval starts at 0 and p[numPoly()] = 2^bw - 1. On interval i the output is
+// polynomials[i] (highest power first) evaluated at x - center[i]. The polynomials output at
+// fixed-point scale `scale`, which keeps extra fractional bits; the caller truncates the output
+// by shift to get it at the scale the table was built for.
+struct SplineTable {
+    int bw;
+    int degree;
+    int scale;
+    int shift;
+    std::vector<GroupElement> p;
+    std::vector<GroupElement> center;
+    std::vector<std::vector<GroupElement>> polynomials;
+
+    int numPoly() const { return polynomials.size(); }
+};
+
+// Fits f on the reals [lo, hi] with inputs at scale scaleIn and outputs at scaleOut. Intervals
+// are made as wide as possible while the error stays under max(absTol, relTol * |f(x)|).
+// Inputs below lo output leftValue and inputs above hi output rightValue.
+SplineTable fitSplineTable(int bw, int scaleIn, int scaleOut, int degree, const std::function<double(double)> &f,
+                           double lo, double hi, double leftValue, double rightValue, double absTol, double relTol);
+
+// exp(x) for x <= 0, 0 once exp(x) is below half an ulp
+SplineTable nexpSplineTable(int bw, int scale);
+// 1 / x for 1 <= x <= max, as needed to normalise a softmax row of max elements
+SplineTable reciprocalSplineTable(int bw, int scale, double max);
+// 1 / sqrt(x) for x > 0
+SplineTable rsqrtSplineTable(int bw, int scale);
@@ -23,6 +23,7 @@ SOFTWARE.
 #include "dcf.h"
 #include <assert.h>
 #include <utility>
+#include <algorithm>
 
 std::pair<ScmpKeyPack, ScmpKeyPack> keyGenSCMP(int Bin, int Bout, GroupElement rin1, GroupElement rin2,
                                 GroupElement rout)
@@ -103,6 +104,22 @@ std::pair<ARSKeyPack, ARSKeyPack> keyGenARS(int Bin, int Bout, uint64_t shift, G
     return std::make_pair(k0, k1);
 }
 
+// combines the DCF outputs t_s and the dual DCF outputs (t_n, m_n) into the shifted share
+inline GroupElement evalARSFromShares(int party, GroupElement x, uint64_t shift, const ARSKeyPack &k,
+                        GroupElement t_s, const GroupElement *ddcfOut)
+{
+    if (k.Bout > k.Bin - k.shift) {
+        uint8_t x_msb = msb(x, k.Bin);
+        uint64_t x_n = x & (((uint64_t)1 << (k.Bin - 1)) - 1);
+        GroupElement t_n = ddcfOut[0], m_n = ddcfOut[1];
+        GroupElement mb = GroupElement(party * x_msb) + m_n - 2 * x_msb * m_n;
+        return party * GroupElement(x_n >> shift) + k.rb + t_s - ((uint64_t)1 << (k.Bin - shift - 1)) * (t_n + mb);
+    }
+    else {
+        return party * GroupElement(x >> shift) + k.rb + t_s;
+    }
+}
+
 GroupElement evalARS(int party, GroupElement x, uint64_t shift, const ARSKeyPack &k)
 {
     // last shift bits of x
@@ -110,7 +127,6 @@ GroupElement evalARS(int party, GroupElement x, uint64_t shift, const ARSKeyPack
     GroupElement x_s = x & ones;
 
     // last n-1 bits of x
-    uint8_t x_msb = msb(x, k.Bin);
     // todo: bitsize of x_n should have been k.Bin - 1
     uint64_t x_n = x & (((uint64_t)1 << (k.Bin - 1)) - 1);
     // std::cout << "x_n " << x_n << "\n";
@@ -122,20 +138,69 @@ GroupElement evalARS(int party, GroupElement x, uint64_t shift, const ARSKeyPack
         evalDCF(party, &t_s, dcfIdx, k.dcfKey);
     }
 
-    GroupElement res;
+    GroupElement ddcfOut[2];
     if (k.Bout > k.Bin - k.shift) {
+        GroupElement dualDcfIdx(((uint64_t)1 << (k.Bin - 1)) - x_n - 1);
+        evalDualDCF(party, ddcfOut, dualDcfIdx, k.dualDcfKey);
+    }
 
-    GroupElement dualDcfIdx(((uint64_t)1 << (k.Bin - 1)) - x_n - 1);
-    GroupElement ddcfOut[2];
-    evalDualDCF(party, ddcfOut, dualDcfIdx, k.dualDcfKey);
+    return evalARSFromShares(party, x, shift, k, t_s, ddcfOut);
+}
+
+// number of truncations whose DCF inputs are gathered per evalDCFBatched call
+#define ARS_BATCH 256
 
-    GroupElement t_n = ddcfOut[0], m_n = ddcfOut[1];
-    GroupElement mb = GroupElement(party * x_msb) + m_n - 2 * x_msb * m_n;
-    res = party * GroupElement(x_n >> shift) + k.rb + t_s - ((uint64_t)1 << (k.Bin - shift - 1)) * (t_n + mb);
+void evalARSBatched(int party, int size, const GroupElement *x, uint64_t shift, const ARSKeyPack *keys, GroupElement *out)
+{
+    if (size <= 0) {
+        return;
     }
-    else {
-        res = party * GroupElement(x >> shift) + k.rb + t_s;
+    const ARSKeyPack &k0 = keys[0];
+    const bool useDualDcf = k0.Bout > k0.Bin - (int)shift;
+    const uint64_t ones = ((uint64_t)1 << shift) - 1;
+
+    uint8_t *arena = new uint8_t[ARS_BATCH * (sizeof(GroupElement) * 4 + sizeof(osuCrypto::block *) + 2 * sizeof(GroupElement *))];
+    GroupElement *idx = (GroupElement *)arena;
+    GroupElement *ts = idx + ARS_BATCH;
+    GroupElement *ddcfOut = ts + ARS_BATCH; // ARS_BATCH x 2
+    osuCrypto::block **kp = (osuCrypto::block **)(ddcfOut + 2 * ARS_BATCH);
+    GroupElement **gp = (GroupElement **)(kp + ARS_BATCH);
+    GroupElement **vp = gp + ARS_BATCH;
+
+    for (int base = 0; base < size; base += ARS_BATCH) {
+        const int m = std::min(ARS_BATCH, size - base);
+
+        if (LlamaConfig::stochasticT) {
+            for (int i = 0; i < m; ++i) {
+                ts[i] = party;
+            }
+        }
+        else {
+            for (int i = 0; i < m; ++i) {
+                const DCFKeyPack &dk = keys[base + i].dcfKey;
+                idx[i] = ((uint64_t)1 << shift) - (x[base + i] & ones) - 1;
+                kp[i] = dk.k; gp[i] = dk.g; vp[i] = dk.v;
+            }
+            evalDCFBatched(party, k0.dcfKey.Bin, k0.dcfKey.Bout, 1, m, ts, idx, kp, gp, vp);
+        }
+
+        if (useDualDcf) {
+            for (int i = 0; i < m; ++i) {
+                const DCFKeyPack &dk = keys[base + i].dualDcfKey.dcfKey;
+                uint64_t x_n = x[base + i] & (((uint64_t)1 << (k0.Bin - 1)) - 1);
+                idx[i] = ((uint64_t)1 << (k0.Bin - 1)) - x_n - 1;
+                kp[i] = dk.k; gp[i] = dk.g; vp[i] = dk.v;
+            }
+            evalDCFBatched(party, k0.dualDcfKey.Bin, k0.dualDcfKey.Bout, 2, m, ddcfOut, idx, kp, gp, vp);
+            for (int i = 0; i < m; ++i) {
+                ddcfOut[2 * i] += keys[base + i].dualDcfKey.sb[0];
+                ddcfOut[2 * i + 1] += keys[base + i].dualDcfKey.sb[1];
+            }
+        }
+
+        for (int i = 0; i < m; ++i) {
+            out[base + i] = evalARSFromShares(party, x[base + i], shift, keys[base + i], ts[i], ddcfOut + 2 * i);
+        }
     }
-
-    return res; 
-}
\ No newline at end of file
+    delete[] arena;
+}
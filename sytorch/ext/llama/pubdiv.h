@@ -30,3 +30,6 @@ GroupElement evalSCMP(int party, ScmpKeyPack key, GroupElement x, GroupElement y
 std::pair<ARSKeyPack, ARSKeyPack> keyGenARS(int Bin, int Bout, uint64_t shift, GroupElement rin, GroupElement rout);
 
 GroupElement evalARS(int party, GroupElement x, uint64_t shift, const ARSKeyPack &k);
+
+// array version of evalARS, all keys must share Bin, Bout and shift
+void evalARSBatched(int party, int size, const GroupElement *x, uint64_t shift, const ARSKeyPack *keys, GroupElement *out);
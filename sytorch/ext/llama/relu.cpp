@@ -22,6 +22,7 @@ SOFTWARE.
 #include "relu.h"
 #include "dcf.h"
 #include <assert.h>
+#include <algorithm>
 
 std::pair<ReluKeyPack, ReluKeyPack> keyGenRelu(int Bin, int Bout,
                         GroupElement rin, GroupElement rout, GroupElement routDrelu)
@@ -85,23 +86,13 @@ std::pair<ReluKeyPack, ReluKeyPack> keyGenRelu(int Bin, int Bout,
     return std::make_pair(k0, k1);
 }
 
-GroupElement evalRelu(int party, GroupElement x, const ReluKeyPack &k, GroupElement *drelu)
+// combines the two spline DCF evaluations at x - 1 and x - 1 - 2^(Bin-1) into the relu output share
+inline GroupElement evalReluFromShares(int party, GroupElement x, const ReluKeyPack &k,
+                        const GroupElement *share_L, const GroupElement *share_R1, GroupElement *drelu)
 {
     int Bout = k.Bout;
-    int Bin = k.Bin;
-    mod(x, Bin);
-
-    GroupElement p = 0;
-    GroupElement q = GroupElement((((uint64_t)1 << (Bin-1)) - 1));
-    mod(q, Bin);
-    GroupElement q1 = q + 1, xL = x - 1, xR1 = x - 1 - q1;
-    mod(q1, Bin);
-    mod(xL, Bin);
-    mod(xR1, Bin);
-    GroupElement share_L[2]; 
-    evalDCF(Bin, Bout, 2, share_L, party, xL, k.k, k.g, k.v);
-    GroupElement share_R1[2];
-    evalDCF(Bin, Bout, 2, share_R1, party, xR1, k.k, k.g, k.v);
+    GroupElement q1 = GroupElement(((uint64_t)1 << (k.Bin-1)));
+    mod(q1, k.Bin);
 
     GroupElement cx = GroupElement((x > 0) - (x > q1));
     mod(cx, k.Bin);
@@ -123,6 +114,73 @@ GroupElement evalRelu(int party, GroupElement x, const ReluKeyPack &k, GroupElem
     return ub;
 }
 
+GroupElement evalRelu(int party, GroupElement x, const ReluKeyPack &k, GroupElement *drelu)
+{
+    int Bout = k.Bout;
+    int Bin = k.Bin;
+    mod(x, Bin);
+
+    GroupElement p = 0;
+    GroupElement q = GroupElement((((uint64_t)1 << (Bin-1)) - 1));
+    mod(q, Bin);
+    GroupElement q1 = q + 1, xL = x - 1, xR1 = x - 1 - q1;
+    mod(q1, Bin);
+    mod(xL, Bin);
+    mod(xR1, Bin);
+    GroupElement share_L[2]; 
+    evalDCF(Bin, Bout, 2, share_L, party, xL, k.k, k.g, k.v);
+    GroupElement share_R1[2];
+    evalDCF(Bin, Bout, 2, share_R1, party, xR1, k.k, k.g, k.v);
+
+    return evalReluFromShares(party, x, k, share_L, share_R1, drelu);
+}
+
+// number of relus whose DCF inputs are gathered per evalDCFBatched call
+#define RELU_BATCH 256
+
+void evalReluBatched(int party, int size, const GroupElement *x, const ReluKeyPack *keys, GroupElement *out, GroupElement *drelu)
+{
+    if (size <= 0) {
+        return;
+    }
+    const int Bin = keys[0].Bin;
+    const int Bout = keys[0].Bout;
+    const GroupElement q1 = GroupElement((uint64_t)1 << (Bin-1));
+
+    // each relu evaluates its key at two points, so lanes 2i and 2i+1 belong to relu i
+    const int lanes = 2 * RELU_BATCH;
+    uint8_t *arena = new uint8_t[lanes * (sizeof(GroupElement) * 3 + sizeof(osuCrypto::block *) + 2 * sizeof(GroupElement *))];
+    GroupElement *idx = (GroupElement *)arena;
+    GroupElement *shares = idx + lanes; // lanes x 2
+    osuCrypto::block **kp = (osuCrypto::block **)(shares + 2 * lanes);
+    GroupElement **gp = (GroupElement **)(kp + lanes);
+    GroupElement **vp = gp + lanes;
+
+    for (int base = 0; base < size; base += RELU_BATCH) {
+        const int m = std::min(RELU_BATCH, size - base);
+        for (int i = 0; i < m; ++i) {
+            const ReluKeyPack &k = keys[base + i];
+            GroupElement xi = x[base + i];
+            mod(xi, Bin);
+            GroupElement xL = xi - 1, xR1 = xi - 1 - q1;
+            mod(xL, Bin);
+            mod(xR1, Bin);
+            idx[2 * i] = xL;
+            idx[2 * i + 1] = xR1;
+            kp[2 * i] = kp[2 * i + 1] = k.k;
+            gp[2 * i] = gp[2 * i + 1] = k.g;
+            vp[2 * i] = vp[2 * i + 1] = k.v;
+        }
+        evalDCFBatched(party, Bin, Bout, 2, 2 * m, shares, idx, kp, gp, vp);
+        for (int i = 0; i < m; ++i) {
+            GroupElement xi = x[base + i];
+            mod(xi, Bin);
+            out[base + i] = evalReluFromShares(party, xi, keys[base + i], shares + 4 * i, shares + 4 * i + 2,
+                                drelu == nullptr ? nullptr : drelu + base + i);
+        }
+    }
+    delete[] arena;
+}
 
 std::pair<MaxpoolKeyPack, MaxpoolKeyPack> keyGenMaxpool(int Bin, int Bout, GroupElement rin1, GroupElement rin2, GroupElement rout, GroupElement routBit)
 {
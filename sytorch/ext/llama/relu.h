@@ -27,6 +27,8 @@ std::pair<ReluKeyPack, ReluKeyPack> keyGenRelu(int Bin, int Bout,
 
 // GroupElement evalRelu(int party, GroupElement x, const ReluKeyPack &k);
 GroupElement evalRelu(int party, GroupElement x, const ReluKeyPack &k, GroupElement *drelu = nullptr);
+// array version of evalRelu, all keys must share Bin and Bout
+void evalReluBatched(int party, int size, const GroupElement *x, const ReluKeyPack *keys, GroupElement *out, GroupElement *drelu = nullptr);
 
 std::pair<MaxpoolKeyPack, MaxpoolKeyPack> keyGenMaxpool(int Bin, int Bout, GroupElement rin1, GroupElement rin2, GroupElement rout, GroupElement routBit);
 GroupElement evalMaxpool(int party, GroupElement x, GroupElement y, const MaxpoolKeyPack &k, GroupElement &bit);
@@ -0,0 +1,156 @@
+/*
+Authors: Deepak Kumaraswamy, Kanav Gupta
+Copyright:
+Copyright (c) 2022 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "spline.h"
+#include "dcf.h"
+#include <vector>
+
+// coefficients (highest power first) of poly(x - shift)
+static std::vector<GroupElement> offsetPolynomial(int bw, const std::vector<GroupElement> &poly, GroupElement shift)
+{
+    int d = poly.size() - 1;
+    std::vector<GroupElement> res(d + 1, 0);
+    std::vector<GroupElement> binom(d + 1, 0);
+    GroupElement neg = -shift;
+    for (int k = 0; k <= d; ++k) {
+        // poly[d - k] * (x - shift)^k = sum_j C(k, j) x^j (-shift)^(k - j)
+        binom.assign(d + 1, 0);
+        binom[0] = 1;
+        for (int i = 1; i <= k; ++i)
+            for (int j = i; j > 0; --j)
+                binom[j] += binom[j - 1];
+        GroupElement negPow = 1;
+        for (int j = k; j >= 0; --j) {
+            res[d - j] += poly[d - k] * binom[j] * negPow;
+            negPow *= neg;
+        }
+    }
+    for (auto &c : res)
+        mod(c, bw);
+    return res;
+}
+
+// start of interval i, the knot before it plus one
+static inline GroupElement intervalStart(const SplineTable &t, int i)
+{
+    GroupElement l = (i == 0) ? 0 : t.p[i] + 1;
+    mod(l, t.bw);
+    return l;
+}
+
+std::pair<SplineKeyPack, SplineKeyPack> keyGenSpline(const SplineTable &t, GroupElement rin, GroupElement rout)
+{
+    const int bw = t.bw, m = t.numPoly(), d = t.degree;
+    SplineKeyPack k0, k1;
+    k0.Bin = k1.Bin = bw;
+    k0.Bout = k1.Bout = bw;
+    k0.numPoly = k1.numPoly = m;
+    k0.degree = k1.degree = d;
+    k0.p = k1.p = t.p;
+    k0.beta_b.resize(m * (d + 1));
+    k1.beta_b.resize(m * (d + 1));
+    k0.e_b.resize(m, std::vector<GroupElement>(d + 1));
+    k1.e_b.resize(m, std::vector<GroupElement>(d + 1));
+
+    // interval i evaluates polynomials[i] at (x + rin) - rin - center[i]
+    std::vector<GroupElement> beta(m * (d + 1));
+    for (int i = 0; i < m; ++i) {
+        auto b = offsetPolynomial(bw, t.polynomials[i], rin + t.center[i]);
+        for (int j = 0; j <= d; ++j)
+            beta[i * (d + 1) + j] = b[j];
+    }
+
+    GroupElement gamma = rin - 1;
+    mod(gamma, bw);
+    auto dcfKeys = keyGenDCF(bw, bw, m * (d + 1), gamma, beta.data());
+    k0.dcfKey = dcfKeys.first;
+    k1.dcfKey = dcfKeys.second;
+
+    // same correction as keyGenRelu, for the interval [L, R] of each polynomial
+    GroupElement neg1 = -1;
+    mod(neg1, bw);
+    for (int i = 0; i < m; ++i) {
+        GroupElement L = intervalStart(t, i), R1 = intervalStart(t, (i + 1) % m);
+        GroupElement alpha_L = L + rin, alpha_R = R1 - 1 + rin, alpha_R1 = R1 + rin;
+        mod(alpha_L, bw);
+        mod(alpha_R, bw);
+        mod(alpha_R1, bw);
+        GroupElement cr = GroupElement((alpha_L > alpha_R) - (alpha_L > L) + (alpha_R1 > R1) + (alpha_R == neg1));
+        for (int j = 0; j <= d; ++j) {
+            auto e = splitShare(beta[i * (d + 1) + j] * cr, bw);
+            k0.e_b[i][j] = e.first;
+            k1.e_b[i][j] = e.second;
+        }
+    }
+
+    for (int i = 0; i < m * (d + 1); ++i) {
+        auto b = splitShare(beta[i], bw);
+        k0.beta_b[i] = b.first;
+        k1.beta_b[i] = b.second;
+    }
+    auto r = splitShare(rout, bw);
+    k0.r_b = r.first;
+    k1.r_b = r.second;
+    return std::make_pair(k0, k1);
+}
+
+void evalSpline(int party, const SplineTable &t, int size, const GroupElement *x, const SplineKeyPack *keys, GroupElement *out)
+{
+    const int bw = t.bw, m = t.numPoly(), d = t.degree, groupSize = m * (d + 1);
+    std::vector<GroupElement> start(m);
+    for (int i = 0; i < m; ++i)
+        start[i] = intervalStart(t, i);
+
+    std::vector<GroupElement> s(groupSize), sL(groupSize), sR1(groupSize), coef(d + 1);
+    for (int e = 0; e < size; ++e) {
+        const SplineKeyPack &k = keys[e];
+        GroupElement xe = x[e];
+        mod(xe, bw);
+        // the DCF at x - 1 - start[i] is the left end of interval i and one past the right end
+        // of interval i - 1, so only those two payload slices are expanded
+        for (int i = 0; i < m; ++i) {
+            GroupElement xi = xe - 1 - start[i];
+            mod(xi, bw);
+            std::fill(s.begin(), s.end(), 0);
+            int prev = (i + m - 1) % m;
+            evalDCF(bw, bw, groupSize, s.data(), party, xi, k.dcfKey.k, k.dcfKey.g, k.dcfKey.v, false, prev * (d + 1), 2 * (d + 1));
+            std::copy(s.begin() + i * (d + 1), s.begin() + (i + 1) * (d + 1), sL.begin() + i * (d + 1));
+            std::copy(s.begin() + prev * (d + 1), s.begin() + (prev + 1) * (d + 1), sR1.begin() + prev * (d + 1));
+        }
+
+        std::fill(coef.begin(), coef.end(), 0);
+        for (int i = 0; i < m; ++i) {
+            GroupElement cx = GroupElement((xe > start[i]) - (xe > start[(i + 1) % m]));
+            for (int j = 0; j <= d; ++j) {
+                int idx = i * (d + 1) + j;
+                coef[j] += cx * k.beta_b[idx] - sL[idx] + sR1[idx] + k.e_b[i][j];
+            }
+        }
+
+        GroupElement res = coef[0];
+        for (int j = 1; j <= d; ++j)
+            res = res * xe + coef[j];
+        res += k.r_b;
+        mod(res, bw);
+        out[e] = res;
+    }
+}
@@ -0,0 +1,199 @@
+/*
+Authors: Deepak Kumaraswamy, Kanav Gupta
+Copyright:
+Copyright (c) 2022 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <llama/branches.h>
+#include <llama/comms.h>
+#include <llama/config.h>
+#include <llama/assert.h>
+#include <llama/prng.h>
+#include <cryptoTools/Crypto/AES.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace LlamaConfig;
+
+namespace {
+
+enum class BranchState { Ready, Waiting, Done };
+
+struct BranchScheduler {
+    std::mutex m;
+    std::condition_variable cv;
+    int current = -1;
+    std::vector<BranchState> state;
+    std::vector<ReconstructRequest> pending;
+    std::vector<Dealer *> dealers;
+    // per-branch prngShared streams, and the branch whose stream prngShared holds (-1: none)
+    std::vector<osuCrypto::PRNG> shared;
+    int sharedOwner = -1;
+};
+
+BranchScheduler *scheduler = nullptr;
+
+void resume(BranchScheduler &s, int b)
+{
+    s.current = b;
+    dealer = s.dealers[b];
+    if (s.sharedOwner != b) {
+        if (s.sharedOwner >= 0)
+            s.shared[s.sharedOwner] = std::move(prngShared);
+        prngShared = std::move(s.shared[b]);
+        s.sharedOwner = b;
+    }
+    s.cv.notify_all();
+}
+
+// The server derives its shares of the linear-layer keys from prngShared while it reads them,
+// so every branch draws from a stream of its own, seeded from the branch index. The dealer
+// fills them one branch after another and the server in the interleaved order of the
+// scheduler, and both still see the same values.
+std::vector<osuCrypto::PRNG> branchSharedPRNGs(int n)
+{
+    std::vector<osuCrypto::PRNG> prngs(n);
+    if (party == CLIENT)
+        return prngs;
+    osuCrypto::AES aes(prngShared.get<osuCrypto::block>());
+    for (int b = 0; b < n; ++b)
+        prngs[b].SetSeed(aes.ecbEncBlock(osuCrypto::toBlock((uint64_t)b)));
+    return prngs;
+}
+
+// Called with s.m held by branch `from`, which just started waiting or finished. Hands the
+// turn to the next branch that can run, or opens everything the branches wait on and starts
+// the next round from the first branch.
+void passTurn(BranchScheduler &s, int from)
+{
+    int n = s.state.size();
+    for (int b = from + 1; b < n; ++b) {
+        if (s.state[b] == BranchState::Ready) {
+            resume(s, b);
+            return;
+        }
+    }
+    std::vector<ReconstructRequest> requests;
+    for (int b = 0; b < n; ++b) {
+        if (s.state[b] == BranchState::Waiting)
+            requests.push_back(s.pending[b]);
+    }
+    if (requests.empty()) {
+        s.current = n;
+        s.cv.notify_all();
+        return;
+    }
+    reconstructBatch(requests);
+    int first = -1;
+    for (int b = 0; b < n; ++b) {
+        if (s.state[b] == BranchState::Waiting) {
+            s.state[b] = BranchState::Ready;
+            if (first < 0)
+                first = b;
+        }
+    }
+    resume(s, first);
+}
+
+}
+
+bool in_branches()
+{
+    return scheduler != nullptr;
+}
+
+void branch_reconstruct(const ReconstructRequest &request)
+{
+    auto &s = *scheduler;
+    std::unique_lock<std::mutex> lock(s.m);
+    int b = s.current;
+    s.pending[b] = request;
+    s.state[b] = BranchState::Waiting;
+    passTurn(s, b);
+    s.cv.wait(lock, [&] { return s.current == b && s.state[b] == BranchState::Ready; });
+}
+
+void run_branches(const std::vector<std::function<void()>> &branches)
+{
+    always_assert(scheduler == nullptr);
+    int n = branches.size();
+    if (n == 0)
+        return;
+
+    auto shared = branchSharedPRNGs(n);
+    osuCrypto::PRNG mainShared(std::move(prngShared));
+    if (party == DEALER) {
+        std::vector<std::string> serverKeys(n), clientKeys(n);
+        for (int b = 0; b < n; ++b) {
+            server->capture = &serverKeys[b];
+            client->capture = &clientKeys[b];
+            prngShared = std::move(shared[b]);
+            branches[b]();
+        }
+        server->capture = nullptr;
+        client->capture = nullptr;
+        prngShared = std::move(mainShared);
+        for (int b = 0; b < n; ++b) {
+            server->send_segment(serverKeys[b]);
+            client->send_segment(clientKeys[b]);
+        }
+        return;
+    }
+
+    BranchScheduler s;
+    s.shared = std::move(shared);
+    s.state.assign(n, BranchState::Ready);
+    s.pending.resize(n);
+    std::vector<std::vector<char>> storage(n);
+    Dealer *keys = dealer;
+    for (int b = 0; b < n; ++b) {
+        uint64_t size;
+        char *segment = keys->recv_segment(storage[b], size);
+        s.dealers.push_back(new Dealer(segment, size));
+    }
+
+    scheduler = &s;
+    std::vector<std::thread> threads;
+    for (int b = 0; b < n; ++b) {
+        threads.emplace_back([&s, &branches, b] {
+            std::unique_lock<std::mutex> lock(s.m);
+            s.cv.wait(lock, [&] { return s.current == b; });
+            lock.unlock();
+            branches[b]();
+            lock.lock();
+            s.state[b] = BranchState::Done;
+            passTurn(s, b);
+        });
+    }
+    {
+        std::lock_guard<std::mutex> lock(s.m);
+        resume(s, 0);
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    scheduler = nullptr;
+    dealer = keys;
+    prngShared = std::move(mainShared);
+    for (auto d : s.dealers) {
+        delete d;
+    }
+}
@@ -21,6 +21,7 @@ SOFTWARE.
 
 #include <llama/comms.h>
 #include <llama/assert.h>
+#include <llama/branches.h>
 
 using namespace LlamaConfig;
 
@@ -141,41 +142,42 @@ Peer* waitForPeer(int port) {
 }
 
 
+void Peer::send_bytes(const char *buf, size_t size) {
+    if (capture != nullptr) {
+        capture->append(buf, size);
+    } else if (useFile) {
+        this->file.write(buf, size);
+    } else {
+        send(sendsocket, buf, size, 0);
+    }
+}
+
+void Peer::send_segment(const std::string &segment) {
+    uint64_t size = segment.size();
+    send_bytes((const char *)&size, 8);
+    send_bytes(segment.data(), size);
+    bytesSent += 8; // the keys were counted when they were captured
+}
+
 void Peer::send_ge(const GroupElement &g, int bw) {
     if (bw > 32) {
         char *buf = (char *)(&g);
-        if (useFile) {
-            this->file.write(buf, 8);
-        } else {
-            send(sendsocket, buf, 8, 0);
-        }
+        send_bytes(buf, 8);
         bytesSent += 8;
     }
     else if (bw > 16) {
         char *buf = (char *)(&g);
-        if (useFile) {
-            this->file.write(buf, 4);
-        } else {
-            send(sendsocket, buf, 4, 0);
-        }
+        send_bytes(buf, 4);
         bytesSent += 4;
     }
     else if (bw > 8) {
         char *buf = (char *)(&g);
-        if (useFile) {
-            this->file.write(buf, 2);
-        } else {
-            send(sendsocket, buf, 2, 0);
-        }
+        send_bytes(buf, 2);
         bytesSent += 2;
     }
     else {
         char *buf = (char *)(&g);
-        if (useFile) {
-            this->file.write(buf, 1);
-        } else {
-            send(sendsocket, buf, 1, 0);
-        }
+        send_bytes(buf, 1);
         bytesSent += 1;
     }
 }
@@ -183,21 +185,13 @@ void Peer::send_ge(const GroupElement &g, int bw) {
 
 void Peer::send_ge_array(const GroupElement *g, int size) {
     char *buf = (char *)(g);
-    if (useFile) {
-        this->file.write(buf, 8*size);
-    } else {
-        send(sendsocket, buf, 8*size, 0);
-    }
+    send_bytes(buf, 8*size);
     bytesSent += (8*size);
 }
 
 void Peer::send_block(const osuCrypto::block &b) {
     char *buf = (char *)(&b);
-    if (useFile) {
-        this->file.write(buf, sizeof(osuCrypto::block));
-    } else {
-        send(sendsocket, buf, sizeof(osuCrypto::block), 0);
-    }
+    send_bytes(buf, sizeof(osuCrypto::block));
     bytesSent += sizeof(osuCrypto::block);
 }
 
@@ -217,11 +211,7 @@ void Peer::send_batched_input(GroupElement *g, int size, int bw)
             temp[i] = g[i];
         }
         char *buf = (char *)(temp);
-        if (useFile) {
-            this->file.write(buf, 8*size);
-        } else {
-            send(sendsocket, buf, 8*size, 0);
-        }
+        send_bytes(buf, 8*size);
         delete[] temp;
         bytesSent += 8*size;
     }
@@ -231,11 +221,7 @@ void Peer::send_batched_input(GroupElement *g, int size, int bw)
             temp[i] = (uint32_t)g[i];
         }
         char *buf = (char *)(temp);
-        if (useFile) {
-            this->file.write(buf, 4*size);
-        } else {
-            send(sendsocket, buf, 4*size, 0);
-        }
+        send_bytes(buf, 4*size);
         delete[] temp;
         bytesSent += 4*size;
     }
@@ -245,11 +231,7 @@ void Peer::send_batched_input(GroupElement *g, int size, int bw)
             temp[i] = (uint16_t)g[i];
         }
         char *buf = (char *)(temp);
-        if (useFile) {
-            this->file.write(buf, 2*size);
-        } else {
-            send(sendsocket, buf, 2*size, 0);
-        }
+        send_bytes(buf, 2*size);
         delete[] temp;
         bytesSent += 2*size;
     }
@@ -259,11 +241,7 @@ void Peer::send_batched_input(GroupElement *g, int size, int bw)
             temp[i] = (uint8_t)g[i];
         }
         char *buf = (char *)(temp);
-        if (useFile) {
-            this->file.write(buf, size);
-        } else {
-            send(sendsocket, buf, size, 0);
-        }
+        send_bytes(buf, size);
         delete[] temp;
         bytesSent += size;
     }
@@ -322,11 +300,7 @@ void Peer::recv_batched_input(uint64_t *g, int size, int bw)
 
 void Peer::send_mult_key(const MultKey &k) {
     char *buf = (char *)(&k);
-    if (useFile) {
-        this->file.write(buf, sizeof(MultKey));
-    } else {
-        send(sendsocket, buf, sizeof(MultKey), 0);
-    }
+    send_bytes(buf, sizeof(MultKey));
     bytesSent += sizeof(MultKey);
 }
 
@@ -341,7 +315,8 @@ void Peer::send_matmul_key(const MatMulKey &k) {
         }
     }
 
-    for(int i = 0; i < s2; i++) {
+    // b is null when it is served from the model key cache
+    for(int i = 0; i < s2 && k.b != nullptr; i++) {
         for(int j = 0; j < s3; j++) {
             send_ge(Arr2DIdx(k.b, s2, s3, i, j), k.Bin);
         }
@@ -385,7 +360,7 @@ void Peer::send_conv2d_key(const Conv2DKey &k) {
         }
     }
 
-    for(int fh = 0; fh < FH; ++fh) {
+    for(int fh = 0; fh < FH && k.b != nullptr; ++fh) {
         for(int fw = 0; fw < FW; ++fw) {
             for(int ci = 0; ci < CI; ++ci) {
                 for(int co = 0; co < CO; ++co) {
@@ -712,15 +687,15 @@ GroupElement Peer::recv_input() {
     return g;
 }
 
-void Peer::send_uint8_array(const uint8_t *data, int size)
+void Peer::send_uint8_array(const uint8_t *data, size_t size)
 {
-    always_assert(size == send(sendsocket, data, size, 0));
+    always_assert((ssize_t)size == send(sendsocket, data, size, 0));
     bytesSent += size;
 }
 
-void Peer::recv_uint8_array(uint8_t *data, int size)
+void Peer::recv_uint8_array(uint8_t *data, size_t size)
 {
-    always_assert(size == recv(recvsocket, data, size, MSG_WAITALL));
+    always_assert((ssize_t)size == recv(recvsocket, data, size, MSG_WAITALL));
     bytesReceived += size;
 }
 
@@ -755,6 +730,19 @@ void Dealer::close() {
     }
 }
 
+char *Dealer::recv_segment(std::vector<char> &storage, uint64_t &size) {
+    size = recv_ge(64);
+    bytesReceived += size;
+    if (ramdisk && ramdisk_path) {
+        char *segment = ramdiskBuffer;
+        ramdiskBuffer += size;
+        return segment;
+    }
+    storage.resize(size);
+    this->file.read(storage.data(), size);
+    return storage.data();
+}
+
 GroupElement Dealer::recv_mask() {
     char buf[8];
     if (useFile) {
@@ -988,7 +976,7 @@ MultKeyNew Dealer::recv_new_mult_key(int bw1, int bw2)
     return kp;
 }
 
-MatMulKey Dealer::recv_matmul_key(int Bin, int Bout, int s1, int s2, int s3) {
+MatMulKey Dealer::recv_matmul_key(int Bin, int Bout, int s1, int s2, int s3, bool cachedB) {
     MatMulKey k;
     k.Bin = Bin;
     k.Bout = Bout;
@@ -997,7 +985,7 @@ MatMulKey Dealer::recv_matmul_key(int Bin, int Bout, int s1, int s2, int s3) {
     k.s3 = s3;
 
     k.a = make_array<GroupElement>(s1, s2);
-    k.b = make_array<GroupElement>(s2, s3);
+    k.b = cachedB ? nullptr : make_array<GroupElement>(s2, s3);
     k.c = make_array<GroupElement>(s1, s3);
 
     for(int i = 0; i < s1; ++i) {
@@ -1007,7 +995,7 @@ MatMulKey Dealer::recv_matmul_key(int Bin, int Bout, int s1, int s2, int s3) {
         }
     }
     
-    for(int i = 0; i < s2; ++i) {
+    for(int i = 0; i < s2 && !cachedB; ++i) {
         for(int j = 0; j < s3; ++j) {
             Arr2DIdx(k.b, s2, s3, i, j) = (party == SERVER ? GroupElement(prngShared.get<uint64_t>()) : recv_ge(Bin));
             mod(Arr2DIdx(k.b, s2, s3, i, j), Bin);
@@ -1029,7 +1017,7 @@ Conv2DKey Dealer::recv_conv2d_key(int Bin, int Bout, int64_t N, int64_t H, int64
                 int64_t CO, int64_t zPadHLeft,
                 int64_t zPadHRight, int64_t zPadWLeft,
                 int64_t zPadWRight, int64_t strideH,
-                int64_t strideW) {
+                int64_t strideW, bool cachedB) {
     Conv2DKey k;
     k.Bin = Bin;
     k.Bout = Bout;
@@ -1053,7 +1041,7 @@ Conv2DKey Dealer::recv_conv2d_key(int Bin, int Bout, int64_t N, int64_t H, int64
     int d3 = CO;
 
     k.a = make_array<GroupElement>(N, H, W, CI);
-    k.b = make_array<GroupElement>(FH, FW, CI, CO);
+    k.b = cachedB ? nullptr : make_array<GroupElement>(FH, FW, CI, CO);
     k.c = make_array<GroupElement>(d0, d1, d2, d3);
 
     for(int n = 0; n < N; ++n) {
@@ -1067,7 +1055,7 @@ Conv2DKey Dealer::recv_conv2d_key(int Bin, int Bout, int64_t N, int64_t H, int64
         }
     }
 
-    for(int fh = 0; fh < FH; ++fh) {
+    for(int fh = 0; fh < FH && !cachedB; ++fh) {
         for(int fw = 0; fw < FW; ++fw) {
             for(int ci = 0; ci < CI; ++ci) {
                 for(int co = 0; co < CO; ++co) {
@@ -1241,6 +1229,9 @@ ARSKeyPack Dealer::recv_ars_key(int Bin, int Bout, int shift) {
 }
 
 void Peer::sync() {
+    // branches take turns, a barrier would only add a round trip per operation
+    if (in_branches())
+        return;
     char buf[1] = {1};
     send(sendsocket, buf, 1, 0);
     recv(recvsocket, buf, 1, MSG_WAITALL);
@@ -1285,7 +1276,7 @@ SplineKeyPack Dealer::recv_spline_key(int Bin, int Bout, int numPoly, int degree
     kp.Bout = Bout;
     kp.numPoly = numPoly;
     kp.degree = degree;
-    kp.dcfKey = recv_dcf_keypack(16, Bout, numPoly * (degree + 1));
+    kp.dcfKey = recv_dcf_keypack(Bin, Bout, numPoly * (degree + 1));
 
     kp.p.resize(numPoly + 1);
     for(int i = 0; i < numPoly + 1; ++i) {
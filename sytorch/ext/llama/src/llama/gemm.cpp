@@ -0,0 +1,364 @@
+/*
+Authors: Deepak Kumaraswamy, Kanav Gupta
+Copyright:
+Copyright (c) 2022 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <llama/gemm.h>
+#include <algorithm>
+#include <cstring>
+#include <omp.h>
+#include <vector>
+#if (defined(__AVX512F__) && defined(__AVX512DQ__)) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Register tile (MR x NR) and cache blocks: an MC x KC panel of A stays in L2 while a
+// KC x NC panel of B streams from L3.
+#define GEMM_MR 4
+#define GEMM_NR 16
+#define GEMM_KC 256
+#define GEMM_MC 128
+#define GEMM_NC 2048
+// below this many multiply-adds a call is not worth parallelising
+#define GEMM_MIN_PARALLEL_WORK (1 << 18)
+
+// tile[r][j] = sum_k a[k][r] * b[k][j], with a and b packed k-major.
+static inline void microKernel(int64_t kc, const uint64_t *a, const uint64_t *b, uint64_t *tile)
+{
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+    __m512i c00 = _mm512_setzero_si512(), c01 = _mm512_setzero_si512();
+    __m512i c10 = _mm512_setzero_si512(), c11 = _mm512_setzero_si512();
+    __m512i c20 = _mm512_setzero_si512(), c21 = _mm512_setzero_si512();
+    __m512i c30 = _mm512_setzero_si512(), c31 = _mm512_setzero_si512();
+    for (int64_t k = 0; k < kc; ++k) {
+        __m512i b0 = _mm512_loadu_si512(b);
+        __m512i b1 = _mm512_loadu_si512(b + 8);
+        __m512i a0 = _mm512_set1_epi64(a[0]);
+        c00 = _mm512_add_epi64(c00, _mm512_mullo_epi64(a0, b0));
+        c01 = _mm512_add_epi64(c01, _mm512_mullo_epi64(a0, b1));
+        __m512i a1 = _mm512_set1_epi64(a[1]);
+        c10 = _mm512_add_epi64(c10, _mm512_mullo_epi64(a1, b0));
+        c11 = _mm512_add_epi64(c11, _mm512_mullo_epi64(a1, b1));
+        __m512i a2 = _mm512_set1_epi64(a[2]);
+        c20 = _mm512_add_epi64(c20, _mm512_mullo_epi64(a2, b0));
+        c21 = _mm512_add_epi64(c21, _mm512_mullo_epi64(a2, b1));
+        __m512i a3 = _mm512_set1_epi64(a[3]);
+        c30 = _mm512_add_epi64(c30, _mm512_mullo_epi64(a3, b0));
+        c31 = _mm512_add_epi64(c31, _mm512_mullo_epi64(a3, b1));
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+    _mm512_storeu_si512(tile + 0 * GEMM_NR, c00); _mm512_storeu_si512(tile + 0 * GEMM_NR + 8, c01);
+    _mm512_storeu_si512(tile + 1 * GEMM_NR, c10); _mm512_storeu_si512(tile + 1 * GEMM_NR + 8, c11);
+    _mm512_storeu_si512(tile + 2 * GEMM_NR, c20); _mm512_storeu_si512(tile + 2 * GEMM_NR + 8, c21);
+    _mm512_storeu_si512(tile + 3 * GEMM_NR, c30); _mm512_storeu_si512(tile + 3 * GEMM_NR + 8, c31);
+#elif defined(__AVX2__)
+    // AVX2 has no 64-bit multiply. Mod 2^64, a * b = lo(a) * lo(b) + ((hi(a) * lo(b) +
+    // lo(a) * hi(b)) << 32), and the shift distributes over the sum, so the 32 x 32-bit
+    // products (vpmuludq) are summed into a low and a cross accumulator and combined once at
+    // the end. Eight accumulators per 4-column slice fit the 16 ymm registers, so the tile
+    // is done one slice at a time.
+    for (int jq = 0; jq < GEMM_NR; jq += 4) {
+        __m256i lo0 = _mm256_setzero_si256(), lo1 = _mm256_setzero_si256();
+        __m256i lo2 = _mm256_setzero_si256(), lo3 = _mm256_setzero_si256();
+        __m256i x0 = _mm256_setzero_si256(), x1 = _mm256_setzero_si256();
+        __m256i x2 = _mm256_setzero_si256(), x3 = _mm256_setzero_si256();
+        const uint64_t *ak = a, *bk = b + jq;
+        for (int64_t k = 0; k < kc; ++k) {
+            __m256i bv = _mm256_loadu_si256((const __m256i *)bk);
+            __m256i bh = _mm256_srli_epi64(bv, 32);
+            __m256i av, ah;
+            av = _mm256_set1_epi64x(ak[0]); ah = _mm256_srli_epi64(av, 32);
+            lo0 = _mm256_add_epi64(lo0, _mm256_mul_epu32(av, bv));
+            x0 = _mm256_add_epi64(x0, _mm256_add_epi64(_mm256_mul_epu32(ah, bv), _mm256_mul_epu32(av, bh)));
+            av = _mm256_set1_epi64x(ak[1]); ah = _mm256_srli_epi64(av, 32);
+            lo1 = _mm256_add_epi64(lo1, _mm256_mul_epu32(av, bv));
+            x1 = _mm256_add_epi64(x1, _mm256_add_epi64(_mm256_mul_epu32(ah, bv), _mm256_mul_epu32(av, bh)));
+            av = _mm256_set1_epi64x(ak[2]); ah = _mm256_srli_epi64(av, 32);
+            lo2 = _mm256_add_epi64(lo2, _mm256_mul_epu32(av, bv));
+            x2 = _mm256_add_epi64(x2, _mm256_add_epi64(_mm256_mul_epu32(ah, bv), _mm256_mul_epu32(av, bh)));
+            av = _mm256_set1_epi64x(ak[3]); ah = _mm256_srli_epi64(av, 32);
+            lo3 = _mm256_add_epi64(lo3, _mm256_mul_epu32(av, bv));
+            x3 = _mm256_add_epi64(x3, _mm256_add_epi64(_mm256_mul_epu32(ah, bv), _mm256_mul_epu32(av, bh)));
+            ak += GEMM_MR;
+            bk += GEMM_NR;
+        }
+        _mm256_storeu_si256((__m256i *)(tile + 0 * GEMM_NR + jq), _mm256_add_epi64(lo0, _mm256_slli_epi64(x0, 32)));
+        _mm256_storeu_si256((__m256i *)(tile + 1 * GEMM_NR + jq), _mm256_add_epi64(lo1, _mm256_slli_epi64(x1, 32)));
+        _mm256_storeu_si256((__m256i *)(tile + 2 * GEMM_NR + jq), _mm256_add_epi64(lo2, _mm256_slli_epi64(x2, 32)));
+        _mm256_storeu_si256((__m256i *)(tile + 3 * GEMM_NR + jq), _mm256_add_epi64(lo3, _mm256_slli_epi64(x3, 32)));
+    }
+#else
+    // written so that the compiler can vectorise the inner loop
+    uint64_t acc[GEMM_MR][GEMM_NR] = {};
+    for (int64_t k = 0; k < kc; ++k) {
+        for (int r = 0; r < GEMM_MR; ++r) {
+            uint64_t ar = a[r];
+            for (int j = 0; j < GEMM_NR; ++j)
+                acc[r][j] += ar * b[j];
+        }
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+    memcpy(tile, acc, sizeof(acc));
+#endif
+}
+
+static inline void storeTile(const uint64_t *tile, uint64_t *C, int64_t rsC, int64_t mr, int64_t nr, RingGemmMode mode)
+{
+    for (int64_t r = 0; r < mr; ++r) {
+        const uint64_t *t = tile + r * GEMM_NR;
+        uint64_t *c = C + r * rsC;
+        if (mode == RingGemmMode::Store)
+            for (int64_t j = 0; j < nr; ++j) c[j] = t[j];
+        else if (mode == RingGemmMode::Add)
+            for (int64_t j = 0; j < nr; ++j) c[j] += t[j];
+        else
+            for (int64_t j = 0; j < nr; ++j) c[j] -= t[j];
+    }
+}
+
+// Packs rows [i0, i0 + mc) and columns [k0, k0 + kc) of a strided matrix into MR-row
+// panels, zero padding the last panel.
+struct StridedPackA {
+    const uint64_t *A;
+    int64_t rsA, csA;
+
+    void operator()(int64_t i0, int64_t mc, int64_t k0, int64_t kc, uint64_t *ap) const
+    {
+        for (int64_t p = 0; p < mc; p += GEMM_MR) {
+            for (int r = 0; r < GEMM_MR; ++r) {
+                if (p + r < mc) {
+                    const uint64_t *src = A + (i0 + p + r) * rsA + k0 * csA;
+                    for (int64_t k = 0; k < kc; ++k)
+                        ap[k * GEMM_MR + r] = src[k * csA];
+                }
+                else {
+                    for (int64_t k = 0; k < kc; ++k)
+                        ap[k * GEMM_MR + r] = 0;
+                }
+            }
+            ap += kc * GEMM_MR;
+        }
+    }
+};
+
+// Gathers convolution patches directly from the NHWC input: row i of the implicit matrix
+// is output pixel (n, oh, ow) and column k is filter tap (fh, fw, ci), matching the
+// CO x (FH * FW * CI) filter layout.
+struct ConvPackA {
+    const uint64_t *input;
+    int64_t H, W, CI, FW, outH, outW;
+    int64_t zPadHLeft, zPadWLeft, strideH, strideW;
+
+    void operator()(int64_t i0, int64_t mc, int64_t k0, int64_t kc, uint64_t *ap) const
+    {
+        for (int64_t p = 0; p < mc; p += GEMM_MR) {
+            for (int r = 0; r < GEMM_MR; ++r) {
+                if (p + r >= mc) {
+                    for (int64_t k = 0; k < kc; ++k)
+                        ap[k * GEMM_MR + r] = 0;
+                    continue;
+                }
+                int64_t i = i0 + p + r;
+                int64_t ow = i % outW;
+                int64_t oh = (i / outW) % outH;
+                int64_t n = i / (outW * outH);
+                int64_t ih0 = oh * strideH - zPadHLeft;
+                int64_t iw0 = ow * strideW - zPadWLeft;
+                int64_t fh = k0 / (FW * CI);
+                int64_t fw = (k0 / CI) % FW;
+                int64_t ci = k0 % CI;
+                for (int64_t k = 0; k < kc;) {
+                    int64_t run = std::min(CI - ci, kc - k);
+                    int64_t ih = ih0 + fh, iw = iw0 + fw;
+                    uint64_t *dst = ap + k * GEMM_MR + r;
+                    if (ih >= 0 && ih < H && iw >= 0 && iw < W) {
+                        const uint64_t *src = input + ((n * H + ih) * W + iw) * CI + ci;
+                        for (int64_t q = 0; q < run; ++q)
+                            dst[q * GEMM_MR] = src[q];
+                    }
+                    else {
+                        for (int64_t q = 0; q < run; ++q)
+                            dst[q * GEMM_MR] = 0;
+                    }
+                    k += run;
+                    ci = 0;
+                    if (++fw == FW) {
+                        fw = 0;
+                        ++fh;
+                    }
+                }
+            }
+            ap += kc * GEMM_MR;
+        }
+    }
+};
+
+static void packB(const uint64_t *B, int64_t rsB, int64_t csB, int64_t k0, int64_t kc, int64_t j0, int64_t nc, uint64_t *bp)
+{
+    for (int64_t p = 0; p < nc; p += GEMM_NR) {
+        int64_t nr = std::min<int64_t>(GEMM_NR, nc - p);
+        for (int64_t k = 0; k < kc; ++k) {
+            const uint64_t *src = B + (k0 + k) * rsB + (j0 + p) * csB;
+            uint64_t *dst = bp + k * GEMM_NR;
+            if (csB == 1) {
+                memcpy(dst, src, nr * sizeof(uint64_t));
+            }
+            else {
+                for (int64_t j = 0; j < nr; ++j)
+                    dst[j] = src[j * csB];
+            }
+            for (int64_t j = nr; j < GEMM_NR; ++j)
+                dst[j] = 0;
+        }
+        bp += kc * GEMM_NR;
+    }
+}
+
+// Computes the [m0, m1) x [n0, n1) block of C with the packed, cache-blocked loop nest.
+template <typename PackA>
+static void gemmBlock(int64_t m0, int64_t m1, int64_t n0, int64_t n1, int64_t K,
+                      const PackA &packA, const uint64_t *B, int64_t rsB, int64_t csB,
+                      uint64_t *C, int64_t rsC, RingGemmMode mode)
+{
+    if (m0 >= m1 || n0 >= n1)
+        return;
+    if (K == 0) {
+        if (mode == RingGemmMode::Store)
+            for (int64_t i = m0; i < m1; ++i)
+                std::fill(C + i * rsC + n0, C + i * rsC + n1, 0);
+        return;
+    }
+    int64_t mcMax = std::min<int64_t>(GEMM_MC, m1 - m0);
+    int64_t ncMax = std::min<int64_t>(GEMM_NC, n1 - n0);
+    int64_t kcMax = std::min<int64_t>(GEMM_KC, K);
+    std::vector<uint64_t> ap(((mcMax + GEMM_MR - 1) / GEMM_MR) * GEMM_MR * kcMax);
+    std::vector<uint64_t> bp(((ncMax + GEMM_NR - 1) / GEMM_NR) * GEMM_NR * kcMax);
+    alignas(64) uint64_t tile[GEMM_MR * GEMM_NR];
+
+    for (int64_t jc = n0; jc < n1; jc += GEMM_NC) {
+        int64_t nc = std::min<int64_t>(GEMM_NC, n1 - jc);
+        for (int64_t pc = 0; pc < K; pc += GEMM_KC) {
+            int64_t kc = std::min<int64_t>(GEMM_KC, K - pc);
+            // only the first K block may overwrite C, the rest accumulate into it
+            RingGemmMode blockMode = (pc == 0 || mode == RingGemmMode::Subtract) ? mode : RingGemmMode::Add;
+            packB(B, rsB, csB, pc, kc, jc, nc, bp.data());
+            for (int64_t ic = m0; ic < m1; ic += GEMM_MC) {
+                int64_t mc = std::min<int64_t>(GEMM_MC, m1 - ic);
+                packA(ic, mc, pc, kc, ap.data());
+                for (int64_t jr = 0; jr < nc; jr += GEMM_NR) {
+                    const uint64_t *b = bp.data() + (jr / GEMM_NR) * kc * GEMM_NR;
+                    for (int64_t ir = 0; ir < mc; ir += GEMM_MR) {
+                        const uint64_t *a = ap.data() + (ir / GEMM_MR) * kc * GEMM_MR;
+                        microKernel(kc, a, b, tile);
+                        storeTile(tile, C + (ic + ir) * rsC + jc + jr, rsC,
+                                  std::min<int64_t>(GEMM_MR, mc - ir), std::min<int64_t>(GEMM_NR, nc - jr), blockMode);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Row-at-a-time kernel for skinny products (e.g. a single-query FC layer), where
+// packing B would cost as much as the multiply itself. Needs unit column stride in B.
+static void gemvBlock(int64_t m0, int64_t m1, int64_t n0, int64_t n1, int64_t K,
+                      const uint64_t *A, int64_t rsA, int64_t csA, const uint64_t *B, int64_t rsB,
+                      uint64_t *C, int64_t rsC, RingGemmMode mode)
+{
+    for (int64_t i = m0; i < m1; ++i) {
+        uint64_t *c = C + i * rsC;
+        if (mode == RingGemmMode::Store)
+            std::fill(c + n0, c + n1, 0);
+        for (int64_t k = 0; k < K; ++k) {
+            uint64_t a = A[i * rsA + k * csA];
+            if (mode == RingGemmMode::Subtract)
+                a = -a;
+            const uint64_t *b = B + k * rsB;
+            for (int64_t j = n0; j < n1; ++j)
+                c[j] += a * b[j];
+        }
+    }
+}
+
+// Splits the M x N output between the threads of an OpenMP team, along M when it is tall
+// enough and along N otherwise, keeping every slice aligned to the register tile.
+template <typename Fn>
+static void parallelFor2D(int64_t M, int64_t N, int64_t K, int threads, Fn fn)
+{
+    if (threads <= 0)
+        threads = omp_get_max_threads();
+    if (M * N * K < GEMM_MIN_PARALLEL_WORK)
+        threads = 1;
+    bool splitM = M >= (int64_t)threads * GEMM_MR * 4 || M >= N;
+    int64_t extent = splitM ? M : N;
+    int64_t align = splitM ? GEMM_MR : GEMM_NR;
+    int64_t units = (extent + align - 1) / align;
+    threads = (int)std::min<int64_t>(threads, units);
+    if (threads <= 1) {
+        fn(0, M, 0, N);
+        return;
+    }
+
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (int t = 0; t < threads; ++t) {
+        int64_t s = std::min(extent, (units * t / threads) * align);
+        int64_t e = std::min(extent, (units * (t + 1) / threads) * align);
+        if (splitM)
+            fn(s, e, 0, N);
+        else
+            fn(0, M, s, e);
+    }
+}
+
+void ringGemm(int64_t M, int64_t N, int64_t K,
+              const uint64_t *A, int64_t rsA, int64_t csA,
+              const uint64_t *B, int64_t rsB, int64_t csB,
+              uint64_t *C, int64_t rsC, RingGemmMode mode, int threads)
+{
+    if (M < GEMM_MR && csB == 1) {
+        parallelFor2D(M, N, K, threads, [&](int64_t m0, int64_t m1, int64_t n0, int64_t n1) {
+            gemvBlock(m0, m1, n0, n1, K, A, rsA, csA, B, rsB, C, rsC, mode);
+        });
+        return;
+    }
+    StridedPackA packA{A, rsA, csA};
+    parallelFor2D(M, N, K, threads, [&](int64_t m0, int64_t m1, int64_t n0, int64_t n1) {
+        gemmBlock(m0, m1, n0, n1, K, packA, B, rsB, csB, C, rsC, mode);
+    });
+}
+
+void ringConv2D(int64_t N, int64_t H, int64_t W, int64_t CI,
+                int64_t FH, int64_t FW, int64_t CO,
+                int64_t zPadHLeft, int64_t zPadHRight, int64_t zPadWLeft, int64_t zPadWRight,
+                int64_t strideH, int64_t strideW,
+                const uint64_t *input, const uint64_t *filter, uint64_t *output,
+                RingGemmMode mode, int threads)
+{
+    int64_t outH = (H + zPadHLeft + zPadHRight - FH) / strideH + 1;
+    int64_t outW = (W + zPadWLeft + zPadWRight - FW) / strideW + 1;
+    int64_t M = N * outH * outW;
+    int64_t K = FH * FW * CI;
+    ConvPackA packA{input, H, W, CI, FW, outH, outW, zPadHLeft, zPadWLeft, strideH, strideW};
+    // B(k, co) = filter[co][k]
+    parallelFor2D(M, CO, K, threads, [&](int64_t m0, int64_t m1, int64_t n0, int64_t n1) {
+        gemmBlock(m0, m1, n0, n1, K, packA, filter, 1, K, output, CO, mode);
+    });
+}
@@ -0,0 +1,293 @@
+/*
+Authors: Deepak Kumaraswamy, Kanav Gupta
+Copyright:
+Copyright (c) 2022 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <llama/key_cache.h>
+#include <llama/input_prng.h>
+#include <llama/comms.h>
+#include <llama/config.h>
+#include <llama/assert.h>
+#include <llama/stats.h>
+#include <cryptoTools/Crypto/AES.h>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace LlamaConfig;
+
+namespace {
+
+struct ModelTensor {
+    const GroupElement *data;
+    int64_t size;
+    int64_t offset;                     // position in the model PRF streams, always even
+    int64_t fileOffset;                 // byte offset in model_keys.client
+    std::vector<GroupElement> bShare;   // parties only
+};
+
+struct CachedKey {
+    std::string op;
+    int tensor;
+    int64_t aSize, bSize, cSize;
+};
+
+ModelKeyCacheMode cacheMode = ModelKeyCacheMode::Off;
+std::string cachePrefix;
+// two independent streams derived from the model seed: masks and server b-shares
+osuCrypto::AES maskPrf, sharePrf;
+int64_t streamLength = 0;
+std::vector<ModelTensor> tensors;
+std::vector<CachedKey> cachedKeys;
+std::fstream clientKeys;
+std::fstream clientInputs;
+
+void write_seed(const std::string &path, const osuCrypto::block &seed)
+{
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    always_assert(f.good());
+    f.write((const char *)&seed, sizeof(seed));
+}
+
+osuCrypto::block read_seed(const std::string &path)
+{
+    std::ifstream f(path, std::ios::binary);
+    if (!f.good()) {
+        std::cerr << "model key cache: cannot open " << path << ", run the dealer in Build mode first\n";
+        always_assert(false);
+    }
+    osuCrypto::block seed;
+    f.read((char *)&seed, sizeof(seed));
+    always_assert(f.good());
+    return seed;
+}
+
+void open_cache_file(std::fstream &f, const std::string &path, bool write)
+{
+    f.open(path, std::ios::binary | (write ? std::ios::out | std::ios::trunc : std::ios::in));
+    if (!f.good()) {
+        std::cerr << "model key cache: cannot open " << path << "\n";
+        always_assert(false);
+    }
+}
+
+// two elements per AES block, so offset has to be even
+void prf_thread(int thread_idx, const osuCrypto::AES *prf, int64_t offset, int64_t blocks, GroupElement *out)
+{
+    int64_t chunk = blocks / num_threads;
+    int64_t start = thread_idx * chunk;
+    int64_t end = (thread_idx == num_threads - 1) ? blocks : start + chunk;
+    if (end > start)
+        prf->ecbEncCounterMode(offset / 2 + start, end - start, (osuCrypto::block *)(out + 2 * start));
+}
+
+void prf_stream(const osuCrypto::AES &prf, int64_t offset, int64_t size, GroupElement *out)
+{
+    int64_t blocks = size / 2;
+    std::thread thread_pool[num_threads];
+    for (int i = 0; i < num_threads; ++i)
+        thread_pool[i] = std::thread(prf_thread, i, &prf, offset, blocks, out);
+    for (int i = 0; i < num_threads; ++i)
+        thread_pool[i].join();
+    if (size % 2 == 1) {
+        osuCrypto::block last;
+        prf.ecbEncCounterMode((offset + size) / 2, 1, &last);
+        out[size - 1] = _mm_extract_epi64(last, 0);
+    }
+}
+
+const ModelTensor *find_tensor(const GroupElement *tensor, int64_t size)
+{
+    for (auto &t : tensors) {
+        if (t.data == tensor && t.size == size)
+            return &t;
+    }
+    return nullptr;
+}
+
+}
+
+void model_key_cache_init(ModelKeyCacheMode mode, const std::string &prefix)
+{
+    cacheMode = mode;
+    cachePrefix = prefix;
+    streamLength = 0;
+    tensors.clear();
+    cachedKeys.clear();
+    if (mode == ModelKeyCacheMode::Off)
+        return;
+
+    bool build = (mode == ModelKeyCacheMode::Build);
+    osuCrypto::block seed;
+    if (party == DEALER) {
+        if (build) {
+            seed = osuCrypto::sysRandomSeed();
+            write_seed(prefix + "model_keys.dealer", seed);
+            write_seed(prefix + "model_keys.server", seed);
+            open_cache_file(clientKeys, prefix + "model_keys.client", true);
+        }
+        else {
+            seed = read_seed(prefix + "model_keys.dealer");
+        }
+    }
+    else if (party == SERVER) {
+        seed = read_seed(prefix + "model_keys.server");
+    }
+    else {
+        open_cache_file(clientKeys, prefix + "model_keys.client", false);
+        open_cache_file(clientInputs, prefix + "model_inputs.client", build);
+    }
+
+    if (party != CLIENT) {
+        osuCrypto::AES aesSeed(seed);
+        maskPrf.setKey(aesSeed.ecbEncBlock(osuCrypto::ZeroBlock));
+        sharePrf.setKey(aesSeed.ecbEncBlock(osuCrypto::OneBlock));
+    }
+}
+
+bool model_key_cache_enabled()
+{
+    return cacheMode != ModelKeyCacheMode::Off;
+}
+
+void input_model(GroupElement *x, GroupElement *x_mask, int size)
+{
+    if (cacheMode == ModelKeyCacheMode::Off) {
+        input_layer(x, x_mask, size, SERVER);
+        return;
+    }
+    if (size == 0) return;
+
+    bool build = (cacheMode == ModelKeyCacheMode::Build);
+    ModelTensor t;
+    t.size = size;
+    t.offset = streamLength;
+    t.fileOffset = streamLength * sizeof(GroupElement);
+    streamLength += size + (size % 2);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    if (party == DEALER) {
+        t.data = x_mask;
+        prf_stream(maskPrf, t.offset, size, x_mask);
+        if (build) {
+            std::vector<GroupElement> share(size);
+            prf_stream(sharePrf, t.offset, size, share.data());
+            for (int i = 0; i < size; ++i) {
+                share[i] = x_mask[i] - share[i];
+                mod(share[i], bitlength);
+            }
+            clientKeys.seekp(t.fileOffset);
+            clientKeys.write((const char *)share.data(), size * sizeof(GroupElement));
+        }
+    }
+    else if (party == SERVER) {
+        t.data = x;
+        prf_stream(maskPrf, t.offset, size, x_mask);
+        for (int i = 0; i < size; ++i) {
+            x[i] = x[i] + x_mask[i];
+        }
+        t.bShare.resize(size);
+        prf_stream(sharePrf, t.offset, size, t.bShare.data());
+        for (int i = 0; i < size; ++i) {
+            mod(t.bShare[i], bitlength);
+        }
+        if (build) {
+            peer->send_batched_input(x, size, bitlength);
+        }
+    }
+    else {
+        t.data = x;
+        if (build) {
+            peer->recv_batched_input(x, size, bitlength);
+            clientInputs.write((const char *)x, size * sizeof(GroupElement));
+        }
+        else {
+            clientInputs.read((char *)x, size * sizeof(GroupElement));
+            always_assert(clientInputs.good());
+        }
+        t.bShare.resize(size);
+        clientKeys.seekg(t.fileOffset);
+        clientKeys.read((char *)t.bShare.data(), size * sizeof(GroupElement));
+        always_assert(clientKeys.good());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    accumulatedInputTimeOffline += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    tensors.push_back(std::move(t));
+}
+
+bool is_cached_model_tensor(const GroupElement *tensor, int64_t size)
+{
+    return cacheMode != ModelKeyCacheMode::Off && find_tensor(tensor, size) != nullptr;
+}
+
+GroupElement *cached_b_share(const GroupElement *tensor, int64_t size)
+{
+    if (cacheMode == ModelKeyCacheMode::Off)
+        return nullptr;
+    auto t = find_tensor(tensor, size);
+    return t == nullptr ? nullptr : const_cast<GroupElement *>(t->bShare.data());
+}
+
+void model_key_cache_record(const char *op, const GroupElement *tensor, int64_t aSize, int64_t bSize, int64_t cSize)
+{
+    auto t = find_tensor(tensor, bSize);
+    always_assert(t != nullptr);
+    cachedKeys.push_back({op, int(t - tensors.data()), aSize, bSize, cSize});
+}
+
+void model_key_cache_finalize()
+{
+    if (cacheMode == ModelKeyCacheMode::Off)
+        return;
+
+    if (party == DEALER && cacheMode == ModelKeyCacheMode::Build) {
+        std::ofstream f(cachePrefix + "model_keys.manifest", std::ios::trunc);
+        int64_t reusable = 0, perQuery = 0;
+        f << "# llama model key cache\n";
+        f << "# reusable: depends only on the model and is read from the cache on every inference\n";
+        f << "# per-query: generated by the dealer for each inference\n";
+        f << "bitlength " << bitlength << "\n";
+        f << "tensors " << tensors.size() << "\n";
+        for (size_t i = 0; i < tensors.size(); ++i) {
+            auto &t = tensors[i];
+            f << "tensor " << i << " elements=" << t.size
+              << " mask=reusable masked-model=reusable b-share=reusable client-offset=" << t.fileOffset << "\n";
+            reusable += t.size;
+        }
+        f << "keys " << cachedKeys.size() << "\n";
+        for (size_t i = 0; i < cachedKeys.size(); ++i) {
+            auto &k = cachedKeys[i];
+            f << "key " << i << " " << k.op << " tensor=" << k.tensor
+              << " a=" << k.aSize << ":per-query b=" << k.bSize << ":reusable c=" << k.cSize << ":per-query\n";
+            perQuery += k.aSize + k.cSize;
+        }
+        f << "reusable-elements " << reusable << "\n";
+        f << "per-query-elements " << perQuery << "\n";
+    }
+
+    if (clientKeys.is_open()) clientKeys.close();
+    if (clientInputs.is_open()) clientInputs.close();
+    tensors.clear();
+    cachedKeys.clear();
+    cacheMode = ModelKeyCacheMode::Off;
+}
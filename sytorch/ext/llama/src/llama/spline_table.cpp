@@ -0,0 +1,211 @@
+/*
+Authors: Deepak Kumaraswamy, Kanav Gupta
+Copyright:
+Copyright (c) 2022 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <llama/spline_table.h>
+#include <llama/assert.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// One interval [a, b] of signed inputs (in ring units) and the real coefficients, lowest power
+// first, of the polynomial in the integer u = x - c.
+struct SplineSegment {
+    int64_t a, b, c;
+    std::vector<double> coef;
+};
+
+// Interpolates f at Chebyshev nodes of [a, b] (or at every point when there are too few).
+static SplineSegment fitSegment(int64_t a, int64_t b, int degree, int scaleIn, const std::function<double(double)> &f)
+{
+    SplineSegment s;
+    s.a = a;
+    s.b = b;
+    s.c = a + (b - a) / 2;
+    int n = (int)std::min<int64_t>(degree, b - a) + 1;
+    double mid = (double)(a - s.c) + (double)(b - a) / 2;
+    double hw = std::max(1.0, (double)(b - a) / 2);
+
+    // solve for coefficients of t = u / hw, which keeps the system well conditioned
+    std::vector<std::vector<long double>> m(n, std::vector<long double>(n + 1));
+    for (int i = 0; i < n; ++i) {
+        double u = (n == b - a + 1) ? (double)(a - s.c + i) : mid + (double)(b - a) / 2 * std::cos(M_PI * (2 * i + 1) / (2 * n));
+        long double t = u / hw, tk = 1;
+        for (int k = 0; k < n; ++k) {
+            m[i][k] = tk;
+            tk *= t;
+        }
+        m[i][n] = f(std::ldexp((double)s.c + u, -scaleIn));
+    }
+    for (int col = 0; col < n; ++col) {
+        int piv = col;
+        for (int i = col + 1; i < n; ++i)
+            if (std::fabs(m[i][col]) > std::fabs(m[piv][col])) piv = i;
+        std::swap(m[col], m[piv]);
+        for (int i = 0; i < n; ++i) {
+            if (i == col) continue;
+            long double r = m[i][col] / m[col][col];
+            for (int k = col; k <= n; ++k)
+                m[i][k] -= r * m[col][k];
+        }
+    }
+    s.coef.resize(n);
+    long double hwk = 1;
+    for (int k = 0; k < n; ++k) {
+        s.coef[k] = m[k][n] / m[k][k] / hwk;
+        hwk *= hw;
+    }
+    return s;
+}
+
+static std::vector<int64_t> quantize(const SplineSegment &s, int scale)
+{
+    std::vector<int64_t> q(s.coef.size());
+    for (size_t k = 0; k < q.size(); ++k)
+        q[k] = std::llround(std::ldexp(s.coef[k], scale));
+    return q;
+}
+
+// worst error of the quantized polynomial over the segment, relative to the tolerance
+static double segmentError(const SplineSegment &s, int scaleIn, int scale, const std::function<double(double)> &f,
+                           double absTol, double relTol)
+{
+    auto q = quantize(s, scale);
+    const int64_t samples = 64;
+    int64_t step = std::max<int64_t>(1, (s.b - s.a) / samples);
+    double worst = 0;
+    for (int64_t x = s.a;; x = (s.b - x > step) ? x + step : s.b) {
+        long double u = x - s.c, y = 0, uk = 1;
+        for (auto c : q) {
+            y += c * uk;
+            uk *= u;
+        }
+        double fx = f(std::ldexp((double)x, -scaleIn));
+        double err = std::fabs((double)std::ldexp(y, -scale) - fx) / std::max(absTol, relTol * std::fabs(fx));
+        worst = std::max(worst, err);
+        if (x == s.b) break;
+    }
+    return worst;
+}
+
+SplineTable fitSplineTable(int bw, int scaleIn, int scaleOut, int degree, const std::function<double(double)> &f,
+                           double lo, double hi, double leftValue, double rightValue, double absTol, double relTol)
+{
+    always_assert(bw <= 64 && lo < hi);
+    const int64_t minInt = bw == 64 ? std::numeric_limits<int64_t>::min() : -(int64_t(1) << (bw - 1));
+    const int64_t maxInt = bw == 64 ? std::numeric_limits<int64_t>::max() : (int64_t(1) << (bw - 1)) - 1;
+    int64_t intLo = (int64_t)std::ceil(std::ldexp(lo, scaleIn));
+    int64_t intHi = (int64_t)std::floor(std::ldexp(hi, scaleIn));
+    always_assert(minInt < intLo && intLo <= intHi && intHi < maxInt);
+
+    // the polynomials output with as many fractional bits as the ring leaves over
+    double maxAbs = std::max(std::fabs(leftValue), std::fabs(rightValue));
+    for (int i = 0; i <= 1024; ++i)
+        maxAbs = std::max(maxAbs, std::fabs(f(lo + (hi - lo) * i / 1024)));
+    int scale = bw - 3 - std::max(0, (int)std::ceil(std::log2(maxAbs)));
+    always_assert(scale >= scaleOut);
+
+    std::vector<SplineSegment> segs;
+    segs.push_back({minInt, intLo - 1, 0, {leftValue}});
+    for (int64_t a = intLo; a <= intHi;) {
+        auto fits = [&](int64_t b) { return segmentError(fitSegment(a, b, degree, scaleIn, f), scaleIn, scale, f, absTol, relTol) <= 1; };
+        // grow the interval while it fits, then binary search the largest one that does
+        int64_t good = a, bad = a;
+        for (int64_t w = 1; bad == a; w *= 2) {
+            int64_t b = (intHi - a > w) ? a + w : intHi;
+            if (fits(b)) good = b;
+            else bad = b;
+            if (b == intHi) break;
+        }
+        if (bad != a) {
+            while (bad - good > 1) {
+                int64_t b = good + (bad - good) / 2;
+                if (fits(b)) good = b;
+                else bad = b;
+            }
+        }
+        segs.push_back(fitSegment(a, good, degree, scaleIn, f));
+        a = good + 1;
+    }
+    segs.push_back({intHi + 1, maxInt, 0, {rightValue}});
+
+    // the gate walks the intervals in unsigned order, so the one holding 0 is split there
+    std::vector<SplineSegment> pos, neg;
+    for (auto &s : segs) {
+        if (s.a < 0 && s.b >= 0) {
+            SplineSegment l = s, r = s;
+            l.b = -1;
+            r.a = 0;
+            neg.push_back(l);
+            pos.push_back(r);
+        }
+        else if (s.a < 0) neg.push_back(s);
+        else pos.push_back(s);
+    }
+    pos.insert(pos.end(), neg.begin(), neg.end());
+
+    SplineTable t;
+    t.bw = bw;
+    t.degree = degree;
+    t.scale = scale;
+    t.shift = scale - scaleOut;
+    t.p.push_back(0);
+    for (auto &s : pos) {
+        GroupElement b = (GroupElement)s.b;
+        mod(b, bw);
+        t.p.push_back(b);
+        GroupElement c = (GroupElement)s.c;
+        mod(c, bw);
+        t.center.push_back(c);
+        auto q = quantize(s, scale);
+        std::vector<GroupElement> poly(degree + 1, 0);
+        for (size_t k = 0; k < q.size(); ++k) {
+            poly[degree - k] = (GroupElement)q[k];
+            mod(poly[degree - k], bw);
+        }
+        t.polynomials.push_back(poly);
+    }
+    return t;
+}
+
+SplineTable nexpSplineTable(int bw, int scale)
+{
+    double halfUlp = std::ldexp(1.0, -(scale + 1));
+    return fitSplineTable(bw, scale, scale, 2, [](double x) { return std::exp(x); },
+                          std::log(halfUlp), 0, 0, 1, halfUlp, 0);
+}
+
+SplineTable reciprocalSplineTable(int bw, int scale, double max)
+{
+    // a row sum is at least exp(0) = 1 up to the error of the exponentials
+    double halfUlp = std::ldexp(1.0, -(scale + 1));
+    return fitSplineTable(bw, scale, scale, 2, [](double x) { return 1 / x; },
+                          0.5, std::max(max, 1.0), 2, 1 / std::max(max, 1.0), halfUlp, 0);
+}
+
+SplineTable rsqrtSplineTable(int bw, int scale)
+{
+    // from one ulp up to where the result drops below half an ulp, accurate to a few ulps
+    // relative to the result so that (x - mean) * rsqrt(var) keeps its precision
+    double ulp = std::ldexp(1.0, -scale);
+    double hi = std::min(std::ldexp(1.0, 2 * scale + 2), std::ldexp(1.0, bw - scale - 3));
+    return fitSplineTable(bw, scale, scale, 2, [](double x) { return 1 / std::sqrt(x); },
+                          ulp, hi, 1 / std::sqrt(ulp), 0, ulp / 2, std::ldexp(1.0, -(scale - 2)));
+}
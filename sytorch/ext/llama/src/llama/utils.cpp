@@ -20,6 +20,8 @@ SOFTWARE.
 */
 
 #include <llama/utils.h>
+#include <llama/gemm.h>
+#include <llama/config.h>
 #include <llama/array.h>
 #include <llama/comms.h>
 #include <assert.h>
@@ -81,7 +83,9 @@ void MatSub5(int s0, int s1, int s2, int s3, int s4, GroupElement* A, GroupEleme
 void MatMul(int s1, int s2, int s3, eigenMatrix &A, eigenMatrix &B, eigenMatrix &C)
 {
     auto start = std::chrono::high_resolution_clock::now();
-    C = A * B;
+    // the matrices are column-major, so compute C^T = B^T * A^T in row-major terms
+    C.resize(s1, s3);
+    ringGemm(s3, s1, s2, B.data(), s2, 1, A.data(), s1, 1, C.data(), s1, RingGemmMode::Store, LlamaConfig::num_threads);
     auto end = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
     eigenMicroseconds += duration.count();
@@ -91,10 +95,7 @@ void MatMul(int s1, int s2, int s3, eigenMatrix &A, eigenMatrix &B, eigenMatrix
 void matmul_cleartext_eigen_llama(int dim1, int dim2, int dim3, GroupElement *inA,
                             GroupElement *inB, GroupElement *outC) {
   auto start = std::chrono::high_resolution_clock::now();
-  Eigen::Map<Eigen::Matrix<uint64_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eA(inA, dim1, dim2);
-  Eigen::Map<Eigen::Matrix<uint64_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eB(inB, dim2, dim3);
-  Eigen::Map<Eigen::Matrix<uint64_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eC(outC, dim1, dim3);
-  eC = eA * eB;
+  ringGemm(dim1, dim3, dim2, inA, dim2, 1, inB, dim3, 1, outC, dim3, RingGemmMode::Store, LlamaConfig::num_threads);
   auto end = std::chrono::high_resolution_clock::now();
   auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
   eigenMicroseconds += duration.count();
@@ -225,43 +226,22 @@ void Conv2DPlaintext(int N, int H, int W, int CI,
 				   GroupElement * filterArr, 
 				   GroupElement * outArr)
 {
-    size_t reshapedFilterRows = CO;
-	size_t reshapedFilterCols = FH*FW*CI;
-	size_t reshapedIPRows = FH*FW*CI;
-	size_t newH = (((H + (zPadHLeft+zPadHRight) - FH)/strideH) + 1);
-	size_t newW = (((W + (zPadWLeft+zPadWRight) - FW)/strideW) + 1);
-	size_t reshapedIPCols = N * newH * newW;
-
-    GroupElement *filterReshaped = filterArr;
-	GroupElement *inputReshaped = make_array<GroupElement>(reshapedIPRows, reshapedIPCols);
-	GroupElement *matmulOP = make_array<GroupElement>(reshapedFilterRows, reshapedIPCols);
-    
-    Conv2DReshapeInput(N, H, W, CI, FH, FW, zPadHLeft, zPadHRight, zPadWLeft, zPadWRight, strideH, strideW, reshapedIPRows, reshapedIPCols, inputArr, inputReshaped);
-    // Conv2DReshapeFilter(FH, FW, CI, CO, filterArr, filterReshaped);
-    MatMul(reshapedFilterRows, reshapedFilterCols, reshapedIPCols, filterReshaped, inputReshaped, matmulOP);
-    Conv2DReshapeOutput(N, newH, newW, CO, matmulOP, outArr);
-
-    // delete[] filterReshaped;
-    delete[] inputReshaped;
-    delete[] matmulOP;
-
+    auto start = std::chrono::high_resolution_clock::now();
+    ringConv2D(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft, zPadWRight, strideH, strideW,
+               inputArr, filterArr, outArr, RingGemmMode::Store, LlamaConfig::num_threads);
+    auto end = std::chrono::high_resolution_clock::now();
+    eigenMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
 }
 
 Conv2DCache allocateConv2DCache(int N, int H, int W, int CI, 
                                 int FH, int FW, int CO, 
                                 int zPadHLeft, int zPadHRight, int zPadWLeft, int zPadWRight, 
                                 int strideH, int strideW) {
-    int reshapedFilterRows = CO;
-	int reshapedFilterCols = FH*FW*CI;
-	int reshapedIPRows = reshapedFilterCols;
 	int newH = (((H + (zPadHLeft+zPadHRight) - FH)/strideH) + 1);
 	int newW = (((W + (zPadWLeft+zPadWRight) - FW)/strideW) + 1);
-	int reshapedIPCols = newH * newW;
 
+    // Conv2DPlaintext works on implicit GEMM, so only the output buffer is cached
     Conv2DCache cache;
-    cache.reshapedFilter = eigenMatrix(reshapedFilterRows, reshapedFilterCols);
-	cache.reshapedInput = eigenMatrix(reshapedIPRows, reshapedIPCols);
-	cache.matmulResult = eigenMatrix(reshapedFilterRows, reshapedIPCols);
     cache.temp = make_array<GroupElement>(N, newH, newW, CO);
 
     return cache;
@@ -283,19 +263,8 @@ void Conv2DPlaintext(int N, int H, int W, int CI,
 				   GroupElement * outArr,
                    Conv2DCache &cache)
 {
-    int reshapedFilterRows = CO;
-	int reshapedFilterCols = FH*FW*CI;
-	int reshapedIPRows = FH*FW*CI;
-	int newH = (((H + (zPadHLeft+zPadHRight) - FH)/strideH) + 1);
-	int newW = (((W + (zPadWLeft+zPadWRight) - FW)/strideW) + 1);
-	int reshapedIPCols = newH * newW;
-
-    Conv2DReshapeFilter(FH, FW, CI, CO, filterArr, cache.reshapedFilter);
-    for(int i = 0; i < N; ++i) {
-        Conv2DReshapeInputPartial(N, H, W, CI, FH, FW, zPadHLeft, zPadHRight, zPadWLeft, zPadWRight, strideH, strideW, reshapedIPRows, reshapedIPCols, inputArr, cache.reshapedInput, i);
-        MatMul(reshapedFilterRows, reshapedFilterCols, reshapedIPCols, cache.reshapedFilter, cache.reshapedInput, cache.matmulResult);
-        Conv2DReshapeOutputPartial(N, newH, newW, CO, cache.matmulResult, outArr, i);
-    }
+    Conv2DPlaintext(N, H, W, CI, FH, FW, CO, zPadHLeft, zPadHRight, zPadWLeft, zPadWRight, strideH, strideW,
+                    inputArr, filterArr, outArr);
 }
 
 void VecCopy(int s, GroupElement *input, GroupElement *output)
@@ -316,19 +285,18 @@ void MatCopy5(int s1, int s2, int s3, int s4, int s5, GroupElement *input, Group
 void matmul_eval_helper(int party, int dim1, int dim2, int dim3, GroupElement *A,
                             GroupElement *B, GroupElement *C, GroupElement *ka, GroupElement *kb, GroupElement *kc) {
     auto start = std::chrono::high_resolution_clock::now();
-    Eigen::Map<Eigen::Matrix<uint64_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eigen_A(A, dim1, dim2);
-    Eigen::Map<Eigen::Matrix<uint64_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eigen_ka(ka, dim1, dim2);
-    Eigen::Map<Eigen::Matrix<uint64_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eigen_B(B, dim2, dim3);
-    Eigen::Map<Eigen::Matrix<uint64_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eigen_kb(kb, dim2, dim3);
-    Eigen::Map<Eigen::Matrix<uint64_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eigen_C(C, dim1, dim3);
-    Eigen::Map<Eigen::Matrix<uint64_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eigen_kc(kc, dim1, dim3);
-
+    // server: C = kc + (A - ka) * B - A * kb, client: C = kc - ka * B - A * kb
+    memcpy(C, kc, sizeof(GroupElement) * dim1 * dim3);
     if (party == SERVER) {
-        eigen_C = (eigen_A - eigen_ka) * eigen_B - eigen_A * eigen_kb + eigen_kc;
+        GroupElement *t = make_array<GroupElement>(dim1, dim2);
+        for (int i = 0; i < dim1 * dim2; ++i) t[i] = A[i] - ka[i];
+        ringGemm(dim1, dim3, dim2, t, dim2, 1, B, dim3, 1, C, dim3, RingGemmMode::Add, LlamaConfig::num_threads);
+        delete[] t;
     }
     else {
-        eigen_C = eigen_kc - eigen_ka * eigen_B - eigen_A * eigen_kb;
+        ringGemm(dim1, dim3, dim2, ka, dim2, 1, B, dim3, 1, C, dim3, RingGemmMode::Subtract, LlamaConfig::num_threads);
     }
+    ringGemm(dim1, dim3, dim2, A, dim2, 1, kb, dim3, 1, C, dim3, RingGemmMode::Subtract, LlamaConfig::num_threads);
 
     auto end = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
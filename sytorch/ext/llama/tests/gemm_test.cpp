@@ -0,0 +1,120 @@
+/*
+Authors: Deepak Kumaraswamy, Kanav Gupta
+Copyright:
+Copyright (c) 2022 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Checks ringGemm and ringConv2D against direct loops, over shapes that leave ragged
+// register tiles and cache blocks, transposed strides, every output mode and several
+// thread counts.
+
+#include <llama/gemm.h>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static std::mt19937_64 rng(3);
+static long mismatches = 0;
+
+static void checkGemm(int64_t M, int64_t N, int64_t K, bool ta, bool tb, RingGemmMode mode, int threads)
+{
+    std::vector<uint64_t> A(M * K), B(K * N), C(M * N), R;
+    for (auto &x : A) x = rng();
+    for (auto &x : B) x = rng();
+    for (auto &x : C) x = rng();
+    R = C;
+    int64_t rsA = ta ? 1 : K, csA = ta ? M : 1, rsB = tb ? 1 : N, csB = tb ? K : 1;
+    for (int64_t i = 0; i < M; ++i) {
+        for (int64_t j = 0; j < N; ++j) {
+            uint64_t s = 0;
+            for (int64_t k = 0; k < K; ++k)
+                s += A[i * rsA + k * csA] * B[k * rsB + j * csB];
+            uint64_t &r = R[i * N + j];
+            r = mode == RingGemmMode::Store ? s : mode == RingGemmMode::Add ? r + s : r - s;
+        }
+    }
+    ringGemm(M, N, K, A.data(), rsA, csA, B.data(), rsB, csB, C.data(), N, mode, threads);
+    long bad = 0;
+    for (int64_t i = 0; i < M * N; ++i)
+        bad += C[i] != R[i];
+    if (bad) {
+        printf("ringGemm M=%ld N=%ld K=%ld ta=%d tb=%d mode=%d threads=%d: %ld mismatches\n",
+               (long)M, (long)N, (long)K, ta, tb, (int)mode, threads, bad);
+        mismatches += bad;
+    }
+}
+
+static void checkConv(int64_t N, int64_t H, int64_t W, int64_t CI, int64_t FH, int64_t FW, int64_t CO,
+                      int64_t pad, int64_t stride, int threads)
+{
+    int64_t outH = (H + 2 * pad - FH) / stride + 1, outW = (W + 2 * pad - FW) / stride + 1;
+    std::vector<uint64_t> in(N * H * W * CI), f(CO * FH * FW * CI), out(N * outH * outW * CO), ref(out.size());
+    for (auto &x : in) x = rng();
+    for (auto &x : f) x = rng();
+    for (int64_t n = 0; n < N; ++n)
+    for (int64_t oh = 0; oh < outH; ++oh)
+    for (int64_t ow = 0; ow < outW; ++ow)
+    for (int64_t co = 0; co < CO; ++co) {
+        uint64_t s = 0;
+        for (int64_t fh = 0; fh < FH; ++fh)
+        for (int64_t fw = 0; fw < FW; ++fw)
+        for (int64_t ci = 0; ci < CI; ++ci) {
+            int64_t ih = oh * stride - pad + fh, iw = ow * stride - pad + fw;
+            if (ih >= 0 && ih < H && iw >= 0 && iw < W)
+                s += in[((n * H + ih) * W + iw) * CI + ci] * f[co * FH * FW * CI + (fh * FW + fw) * CI + ci];
+        }
+        ref[((n * outH + oh) * outW + ow) * CO + co] = s;
+    }
+    ringConv2D(N, H, W, CI, FH, FW, CO, pad, pad, pad, pad, stride, stride,
+               in.data(), f.data(), out.data(), RingGemmMode::Store, threads);
+    long bad = 0;
+    for (size_t i = 0; i < out.size(); ++i)
+        bad += out[i] != ref[i];
+    if (bad) {
+        printf("ringConv2D N=%ld H=%ld W=%ld CI=%ld F=%ldx%ld CO=%ld pad=%ld stride=%ld: %ld mismatches\n",
+               (long)N, (long)H, (long)W, (long)CI, (long)FH, (long)FW, (long)CO, (long)pad, (long)stride, bad);
+        mismatches += bad;
+    }
+}
+
+int main()
+{
+    // edges of the register tile (4 x 16) and of the KC = 256, MC = 128 and NC = 2048 blocks
+    for (int64_t M : {1, 3, 4, 5, 17, 130})
+        for (int64_t N : {1, 15, 16, 17, 33})
+            for (int64_t K : {0, 1, 7, 256, 257})
+                checkGemm(M, N, K, false, false, RingGemmMode::Store, 1);
+    checkGemm(6, 2050, 3, false, false, RingGemmMode::Store, 1);
+    checkGemm(129, 40, 300, true, true, RingGemmMode::Add, 3);
+
+    for (int trial = 0; trial < 60; ++trial) {
+        int64_t M = 1 + rng() % 70, N = 1 + rng() % 70, K = rng() % 300;
+        checkGemm(M, N, K, rng() & 1, rng() & 1, (RingGemmMode)(rng() % 3), 1 + rng() % 4);
+    }
+    // enough work for the threaded split along M and along N
+    checkGemm(200, 70, 40, false, false, RingGemmMode::Subtract, 4);
+    checkGemm(9, 300, 200, false, true, RingGemmMode::Add, 4);
+
+    for (int trial = 0; trial < 30; ++trial) {
+        checkConv(1 + rng() % 2, 3 + rng() % 12, 3 + rng() % 12, 1 + rng() % 9, 1 + rng() % 3, 1 + rng() % 3,
+                  1 + rng() % 20, rng() % 2, 1 + rng() % 2, 1 + rng() % 3);
+    }
+
+    printf("gemm_test: %ld mismatches\n", mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
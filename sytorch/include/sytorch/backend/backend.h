@@ -3,6 +3,7 @@
 #include <sytorch/tensor.h>
 #include <llama/api.h>
 #include <llama/assert.h>
+#include <functional>
 
 #define NOT_IMPLEMENTED { \
         throw std::runtime_error("not implemented");\
@@ -46,14 +47,32 @@ public:
     // matmul API
     virtual void matmul(const Tensor2D<T> &a, const Tensor2D<T> &b, Tensor2D<T> &c) NOT_IMPLEMENTED;
 
+    // c = a * b + bias, with bias broadcast over the last axis of c
+    virtual void matmulBias(const Tensor2D<T> &a, const Tensor2D<T> &b, const Tensor1D<T> &bias, Tensor<T> &c) {
+        auto c_2d = c.as_2d();
+        matmul(a, b, c_2d);
+        addbias(c, bias);
+    }
+
     // conv API
     virtual void conv2D(u64 fh, u64 fw, u64 padding, u64 stride, u64 ci, u64 co, const Tensor4D<T> &input, const Tensor2D<T> &filter, Tensor4D<T> &output) NOT_IMPLEMENTED;
+    virtual void conv2DBias(u64 fh, u64 fw, u64 padding, u64 stride, u64 ci, u64 co, const Tensor4D<T> &input, const Tensor2D<T> &filter, const Tensor1D<T> &bias, Tensor<T> &output) {
+        auto output_4d = output.as_4d();
+        conv2D(fh, fw, padding, stride, ci, co, input, filter, output_4d);
+        addbias(output, bias);
+    }
     virtual void conv3D(u64 fd, u64 fh, u64 fw, u64 pd, u64 ph, u64 pw, u64 sd, u64 sh, u64 sw, u64 dd, u64 dh, u64 dw, u64 ci, u64 co, const Tensor5D<T> &input, const Tensor2D<T> &filter, Tensor5D<T> &output) NOT_IMPLEMENTED;
     virtual void convTranspose3D(u64 fd, u64 fh, u64 fw, u64 pd, u64 ph, u64 pw, u64 sd, u64 sh, u64 sw, u64 ci, u64 co, const Tensor5D<T> &input, const Tensor2D<T> &filter, Tensor5D<T> &output) NOT_IMPLEMENTED;
     virtual void convTranspose2D(u64 fh, u64 fw, u64 ph, u64 pw, u64 sh, u64 sw, u64 ci, u64 co, const Tensor4D<T> &input, const Tensor2D<T> &filter, Tensor4D<T> &output) NOT_IMPLEMENTED;
 
     // relu API
     virtual void relu(const Tensor<T> &in, const Tensor<T> &out, const Tensor<T> &drelu, u64 scale, int mode) NOT_IMPLEMENTED;
+    // relu followed by the forward truncation of its output, for ReLUs that took over the
+    // truncation of the layer before them
+    virtual void reluTruncate(const Tensor<T> &in, const Tensor<T> &out, const Tensor<T> &drelu, u64 shift, u64 scale, int mode, u8 truncMode) {
+        relu(in, out, drelu, scale, mode);
+        truncateForward(out, shift, truncMode);
+    }
 
     // leakyrelu API
     virtual void leakyRelu(const Tensor<T> &in, const Tensor<T> &out, const Tensor<T> &drelu, u64 scale, int mode, T alpha) NOT_IMPLEMENTED;
@@ -77,10 +96,25 @@ public:
     virtual void layernorm(const Tensor1D<T> &A, const Tensor1D<T> &B, const Tensor<T> &x, Tensor<T> &y, u64 scale) NOT_IMPLEMENTED;
     virtual void addbias(Tensor<T> &x, const Tensor1D<T> &bias) NOT_IMPLEMENTED;
     virtual void scalarmul(Tensor<T> &x, T scalar, Tensor<T> &y) NOT_IMPLEMENTED;
+    // y = x - scalar on the scores of keys after each query, see _AttentionMask
+    virtual void attention_mask(Tensor<T> &x, T scalar, Tensor<T> &y) NOT_IMPLEMENTED;
+
+    // cumulative communication counters, read around every layer when profiling
+    virtual CostCounters costCounters()
+    {
+        return CostCounters();
+    }
 
     virtual void optimize(LayerGraphNode<T> *root)
     {
         
     }
 
+    // runs layers that do not read each other's outputs, see SytorchModule::forwardGraph
+    virtual void runConcurrently(const std::vector<std::function<void()>> &tasks)
+    {
+        for (auto &t : tasks)
+            t();
+    }
+
 };
@@ -62,15 +62,18 @@ public:
     void modbw(Tensor5D<T> &x) { modbw(x.data, x.size()); }
 
     void matmul(const Tensor2D<T> &a, const Tensor2D<T> &b, Tensor2D<T> &c);
+    void matmulBias(const Tensor2D<T> &a, const Tensor2D<T> &b, const Tensor1D<T> &bias, Tensor<T> &c);
     void matmulTransposeA(const Tensor2D<T> &a, const Tensor2D<T> &b, Tensor2D<T> &c);
     void matmulTransposeB(const Tensor2D<T> &a, const Tensor2D<T> &b, Tensor2D<T> &c);
 
     void conv2D(u64 fh, u64 fw, u64 padding, u64 stride, u64 ci, u64 co, const Tensor4D<T> &input, const Tensor2D<T> &filter, Tensor4D<T> &output);
+    void conv2DBias(u64 fh, u64 fw, u64 padding, u64 stride, u64 ci, u64 co, const Tensor4D<T> &input, const Tensor2D<T> &filter, const Tensor1D<T> &bias, Tensor<T> &output);
     void conv3D(u64 fd, u64 fh, u64 fw, u64 pd, u64 ph, u64 pw, u64 sd, u64 sh, u64 sw, u64 dd, u64 dh, u64 dw, u64 ci, u64 co, const Tensor5D<T> &input, const Tensor2D<T> &filter, Tensor5D<T> &output);
     void convTranspose3D(u64 fd, u64 fh, u64 fw, u64 pd, u64 ph, u64 pw, u64 sd, u64 sh, u64 sw, u64 ci, u64 co, const Tensor5D<T> &input, const Tensor2D<T> &filter, Tensor5D<T> &output);
     void convTranspose2D(u64 fh, u64 fw, u64 ph, u64 pw, u64 sh, u64 sw, u64 ci, u64 co, const Tensor4D<T> &input, const Tensor2D<T> &filter, Tensor4D<T> &output);
 
     void relu(const Tensor<T> &in, const Tensor<T> &out, const Tensor<T> &drelu, u64 scale, int mode);
+    void reluTruncate(const Tensor<T> &in, const Tensor<T> &out, const Tensor<T> &drelu, u64 shift, u64 scale, int mode, u8 truncMode);
     void leakyRelu(const Tensor<T> &in, const Tensor<T> &out, const Tensor<T> &drelu, u64 scale, int mode, T alpha);
     // void truncate(const Tensor4D<T> &in, const Tensor4D<T> &out, u64 shift);
     // void truncate(const Tensor4D<T> &in, u64 shift);
@@ -90,4 +93,5 @@ public:
     void layernorm(const Tensor1D<T> &A, const Tensor1D<T> &B, const Tensor<T> &x, Tensor<T> &y, u64 scale);
     void addbias(Tensor<T> &x, const Tensor1D<T> &bias);
     void scalarmul(Tensor<T> &x, T scalar, Tensor<T> &y);
+    void attention_mask(Tensor<T> &x, T scalar, Tensor<T> &y);
 };
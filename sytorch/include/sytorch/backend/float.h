@@ -13,7 +13,7 @@ public:
     template <typename Functor>
     void fastfor(u64 size, Functor f)
     {
-//#pragma omp parallel for
+#pragma omp parallel for simd schedule(static) if(size >= (1 << 12))
         for (u64 i = 0; i < size; i++)
         {
             f(i);
@@ -42,9 +42,11 @@ public:
 
     void batchNormInference(const Tensor1D<T> &A, const Tensor1D<T> &B, const Tensor<T> &x, Tensor<T> &y, u64 scale);
     void add(const std::vector<Tensor<T> *> &in, Tensor<T> &out);
-    void gelu(const Tensor<T> &in, const Tensor<T> &out, u64 scale, u64 mode = 0);
+    void gelu(const Tensor<T> &in, const Tensor<T> &out, u64 scale) { gelu(in, out, scale, 0); }
+    void gelu(const Tensor<T> &in, const Tensor<T> &out, u64 scale, u64 mode);
     void tanh(const Tensor<T> &in, const Tensor<T> &out, u64 scale);
-    void softmax(Tensor<T> &in, Tensor<T> &out, u64 scale, u64 mode = 0);
+    void softmax(Tensor<T> &in, Tensor<T> &out, u64 scale) { softmax(in, out, scale, 0); }
+    void softmax(Tensor<T> &in, Tensor<T> &out, u64 scale, u64 mode);
     void layernorm(const Tensor1D<T> &A, const Tensor1D<T> &B, const Tensor<T> &x, Tensor<T> &y, u64 scale);
     void addbias(Tensor<T> &x, const Tensor1D<T> &bias);
     void scalarmul(Tensor<T> &x, T scalar, Tensor<T> &y);
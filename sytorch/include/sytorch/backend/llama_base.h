@@ -3,8 +3,11 @@
 #include "cleartext.h"
 #include <llama/config.h>
 #include <llama/input_prng.h>
+#include <llama/key_cache.h>
 #include <llama/comms.h>
 #include <llama/api.h>
+#include <llama/stats.h>
+#include <llama/branches.h>
 #include "backend.h"
 #include <sytorch/layers/layers.h>
 
@@ -65,8 +68,17 @@ public:
         input_prng_init();
     }
 
+    // Keep the model-dependent correlations (weight masks, masked weights and the b-shares
+    // of linear layer keys) on disk under prefix. Call on every party after init() and
+    // before initializeInferencePartyA, with Build for the first inference and Reuse after.
+    void useModelKeyCache(ModelKeyCacheMode mode, const std::string &prefix = "")
+    {
+        model_key_cache_init(mode, prefix);
+    }
+
     void finalize()
     {
+        model_key_cache_finalize();
         switch (LlamaConfig::party)
 		{
 		case 1:
@@ -83,6 +95,27 @@ public:
 		}
     }
 
+    CostCounters costCounters()
+    {
+        CostCounters c;
+        if (LlamaConfig::party == DEALER) {
+            c.keyBytes = LlamaConfig::server->bytesSent + LlamaConfig::client->bytesSent;
+        }
+        else {
+            c.keyBytes = LlamaConfig::dealer->bytesReceived;
+            c.bytesSent = LlamaConfig::peer->bytesSent;
+            c.bytesReceived = LlamaConfig::peer->bytesReceived;
+        }
+        c.rounds = numRounds;
+        return c;
+    }
+
+    // the tasks share rounds, see llama/branches.h
+    void runConcurrently(const std::vector<std::function<void()>> &tasks)
+    {
+        run_branches(tasks);
+    }
+
     void initializeInferencePartyB(Tensor<T>&data){
         u64 size = data.size();
         if(LlamaConfig::party == 1){
@@ -102,23 +135,37 @@ public:
         }
     }
 
+    // all queries of a batch are input in one go, see SytorchModule::forwardBatch
+    void initializeInferencePartyB(const std::vector<Tensor<T> *> &queries)
+    {
+        Tensor<T> batched({});
+        stackBatch(queries, batched);
+        initializeInferencePartyB(batched);
+        auto views = splitBatch(batched, queries);
+        for (u64 i = 0; i < queries.size(); ++i) {
+            queries[i]->copy(views[i], false);
+        }
+    }
+
     void initializeInferencePartyA(LayerGraphNode<T> *root) {
          topologicalApply(root, [&](LayerGraphNode<T> *node, LayerGraphNode<T> *_root) {
             auto layer = node->layer;
+            if (layer->isIdentity)
+                return; // folded away, its parameters live in another layer now
             auto weights = layer->getweights();
             auto bias = layer->getbias();
             if(LlamaConfig::party == 1){
-                input_layer(nullptr, weights.data, weights.size, 2);
+                input_model(nullptr, weights.data, weights.size);
                 if (layer->useBias) {
-                    input_layer(nullptr, bias.data, bias.size, 2);
+                    input_model(nullptr, bias.data, bias.size);
                 }
             }
             else{
                 Tensor1D<T> tmp(weights.size);
-                input_layer(weights.data, tmp.data, weights.size, 2);
+                input_model(weights.data, tmp.data, weights.size);
                 if(layer->useBias){
                     Tensor1D<T> tmp2(bias.size);
-                    input_layer(bias.data, tmp2.data, bias.size, 2);
+                    input_model(bias.data, tmp2.data, bias.size);
                 }
             }
         });
@@ -410,4 +457,23 @@ public:
         ct->scalarmul(x, scalar, y);
         delete ct;
     }
+
+    void attention_mask(Tensor<T> &x, T scalar, Tensor<T> &y) {
+        // subtracting a public constant is done by the evaluators only, the masks stay as they are
+        always_assert(x.is_same_shape(y));
+        always_assert(x.shape.size() == 2);
+        always_assert(x.shape[1] >= x.shape[0]);
+        u64 queries = x.shape[0], keys = x.shape[1];
+        u64 past = keys - queries;
+        auto ct = new ClearText<T>;
+        ct->fastfor(queries, [&](u64 j) {
+            for (u64 k = 0; k < keys; ++k) {
+                T v = x.data[j * keys + k];
+                if (LlamaConfig::party != DEALER && k > past + j)
+                    v -= scalar;
+                y.data[j * keys + k] = v;
+            }
+        });
+        delete ct;
+    }
 };
\ No newline at end of file
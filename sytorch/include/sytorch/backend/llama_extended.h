@@ -1,5 +1,8 @@
 #pragma once
 #include <sytorch/backend/llama_base.h>
+#include <sytorch/fusion.h>
+#include <map>
+#include <tuple>
 
 template <typename T>
 class Sequential;
@@ -12,7 +15,12 @@ public:
         assert(in.is_same_shape(out));
         assert(in.is_same_shape(drelu));
         int sz = in.size();
-        Relu(sz, in.data, in.data, out.data, out.data, drelu.data);
+        // inputs that fit in fewer bits (see SytorchModule::inferBitwidths) compare in that ring
+        u64 bw = in.graphNode == nullptr ? 0 : in.graphNode->bitwidth;
+        if (bw >= 2 && bw < LlamaConfig::bitlength)
+            Relu2Round(sz, in.data, in.data, out.data, out.data, drelu.data, bw);
+        else
+            Relu(sz, in.data, in.data, out.data, out.data, drelu.data);
     }
 
     void leakyRelu(const Tensor<T> &in, const Tensor<T> &out, const Tensor<T> &drelu, u64 scale, int mode, T alpha)
@@ -120,10 +128,109 @@ public:
         delete ct;
     }
 
+    // max of every row of cols elements, all rows together in ceil(log2(cols)) rounds of
+    // max(a, b) = b + relu(a - b)
+    void rowMax(const Tensor<T> &in, Tensor<T> &max, u64 rows, u64 cols)
+    {
+        auto ct = new ClearText<T>;
+        std::vector<T> cur(in.data, in.data + rows * cols);
+        u64 width = cols;
+        while (width > 1) {
+            u64 half = width / 2;
+            u64 next = width - half;
+            Tensor<T> diff({rows * half});
+            Tensor<T> relu({rows * half});
+            Tensor<T> drelu({rows * half});
+            ct->fastfor(rows * half, [&](u64 i) {
+                u64 r = i / half, j = i % half;
+                diff.data[i] = cur[r * width + 2 * j] - cur[r * width + 2 * j + 1];
+            });
+            Relu(rows * half, diff.data, diff.data, relu.data, relu.data, drelu.data);
+            std::vector<T> nextCur(rows * next);
+            ct->fastfor(rows, [&](u64 r) {
+                for (u64 j = 0; j < half; ++j)
+                    nextCur[r * next + j] = cur[r * width + 2 * j + 1] + relu.data[r * half + j];
+                if (width % 2 == 1)
+                    nextCur[r * next + half] = cur[r * width + width - 1];
+            });
+            cur.swap(nextCur);
+            width = next;
+        }
+        std::copy(cur.begin(), cur.end(), max.data);
+        delete ct;
+    }
+
+    // Public functions that softmax and layernorm evaluate through spline tables
+    enum class SplineFunction { NegExp, Reciprocal, InvSqrt };
+
+    // Fitted tables keyed by (f, bitlength, scale, cols), cols being 0 where the table does
+    // not depend on it. Fitting is a greedy search over intervals, too slow to repeat for
+    // every attention layer and decoded token.
+    std::map<std::tuple<SplineFunction, int, u64, u64>, SplineTable> splineTables;
+
+    const SplineTable &splineTable(SplineFunction f, u64 scale, u64 cols = 0)
+    {
+        auto key = std::make_tuple(f, LlamaConfig::bitlength, scale, cols);
+        auto it = splineTables.find(key);
+        if (it == splineTables.end()) {
+            SplineTable t;
+            switch (f) {
+            case SplineFunction::NegExp:
+                t = nexpSplineTable(LlamaConfig::bitlength, scale);
+                break;
+            case SplineFunction::Reciprocal:
+                t = reciprocalSplineTable(LlamaConfig::bitlength, scale, cols);
+                break;
+            case SplineFunction::InvSqrt:
+                t = rsqrtSplineTable(LlamaConfig::bitlength, scale);
+                break;
+            }
+            it = splineTables.emplace(key, std::move(t)).first;
+        }
+        return it->second;
+    }
+
     void softmax(Tensor<T> &in, Tensor<T> &out, u64 scale)
     {
-        // TODO: teehee
-        out.copy(in, false);
+        // exp(x - max) / sum over the last axis. Every row goes through the same gates, so the
+        // whole tensor takes ceil(log2(cols)) comparison rounds and three spline or product
+        // rounds, each followed by a truncation, however many rows (or heads) there are
+        always_assert(in.is_same_shape(out));
+        u64 cols = in.shape.back();
+        u64 rows = in.size() / cols;
+        auto ct = new ClearText<T>;
+
+        Tensor<T> max({rows});
+        rowMax(in, max, rows, cols);
+
+        // exp(x - max), with x - max <= 0
+        Tensor<T> z(in.shape);
+        ct->fastfor(in.size(), [&](u64 i) {
+            z.data[i] = in.data[i] - max.data[i / cols];
+        });
+        auto &nexp = splineTable(SplineFunction::NegExp, scale);
+        Spline(z.size(), z.data, z.data, out.data, out.data, nexp);
+        Backend<T>::truncate(out, nexp.shift);
+
+        // 1 / sum, the sum is between 1 and cols
+        Tensor<T> sum({rows});
+        ct->fastfor(rows, [&](u64 r) {
+            sum.data[r] = 0;
+            for (u64 j = 0; j < cols; ++j)
+                sum.data[r] += out.data[r * cols + j];
+        });
+        Tensor<T> inv({rows});
+        auto &reciprocal = splineTable(SplineFunction::Reciprocal, scale, cols);
+        Spline(rows, sum.data, sum.data, inv.data, inv.data, reciprocal);
+        Backend<T>::truncate(inv, reciprocal.shift);
+
+        auto &invExpand = z;
+        ct->fastfor(in.size(), [&](u64 i) {
+            invExpand.data[i] = inv.data[i / cols];
+        });
+        ElemWiseSecretSharedVectorMult(out.size(), out.data, out.data, invExpand.data, invExpand.data, out.data, out.data);
+        Backend<T>::truncate(out, scale);
+        delete ct;
     }
 
     void layernorm(const Tensor1D<T> &A, const Tensor1D<T> &B, const Tensor<T> &x, Tensor<T> &y, u64 scale)
@@ -166,11 +273,23 @@ public:
             }
         });
 
-        Backend<T>::truncate(var, scale);
-        LlamaBase<T>::div(var, channels, scale);
+        // the sum of squares is at scale 2 * scale, dividing by channels and dropping one scale
+        // are done by a single truncation
+        if (!(channels & (channels - 1))) {
+            Backend<T>::truncate(var, scale + LlamaBase<T>::log2(channels));
+        }
+        else {
+            T divfp = (1LL << scale) / channels;
+            ct->fastfor(var.size(), [&](u64 i) {
+                var.data[i] *= divfp;
+            });
+            Backend<T>::truncate(var, 2 * scale);
+        }
 
-        // TODO: invvar = invsqrt(var)
-        auto &invvar = var;
+        Tensor<T> invvar(shape2);
+        auto &rsqrt = splineTable(SplineFunction::InvSqrt, scale);
+        Spline(var.size(), var.data, var.data, invvar.data, invvar.data, rsqrt);
+        Backend<T>::truncate(invvar, rsqrt.shift);
 
         ct->fastfor(x.size() / channels, [&](u64 i) {
             for (u64 j = 0; j < channels; j++) {
@@ -200,32 +319,15 @@ public:
     }
 
 
-    void doOptimize(LayerGraphNode<T> *node, LayerGraphNode<T> *root)
-    {
-        if (node->layer->doTruncationForward) {
-            if (node->children.size() == 1) {
-                // std::cout << "yeah.." << "\n";
-                LayerGraphNode<T> *child = node->children[0];
-                if (child->layer->doTruncationForward) {
-                    // no optimization possible
-                    // this is set to true for FC, Conv2D and BatchNormInference
-                }
-                else {
-                    if (child->layer->name == "MaxPool2D" || child->layer->name == "ReLU") {
-                        // optimize
-                        node->layer->doTruncationForward = false;
-                        child->layer->doTruncationForward = true;
-                    }
-                }
-            }
-        }
-    }
-
     void optimize(LayerGraphNode<T> *root)
     {
-        topologicalApply(root, [&](LayerGraphNode<T> *n, LayerGraphNode<T> *r) {
-            doOptimize(n, r);
-        });
+        // BatchNormInference folds into the FC or Conv2D before it, which drops its MatMul
+        // key and truncation. The folded weights round differently from running the BN on
+        // its own, so backends that do not fold keep their numerics.
+        applyFusionPatterns(root, {foldBatchNormPattern<T>()});
+        // the truncation after FC, Conv2D and BatchNormInference moves onto a following
+        // ReLU or MaxPool2D, and a ReLU that ends up truncating does both in one call
+        applyFusionPatterns(root, {moveTruncationPattern<T>(), fuseReluTruncatePattern<T>()});
     }
 
 };
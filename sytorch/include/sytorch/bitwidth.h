@@ -0,0 +1,179 @@
+#pragma once
+#include <sytorch/layers/layers.h>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Bitwidth inference for activations, run by SytorchModule::inferBitwidths and
+// SytorchModule::inferBitwidthsFromWeights.
+//
+// A bound on the magnitude of the input (in ring units) is pushed through the graph: a Conv2D or
+// FC output is bounded by the largest L1 norm of a filter times the input bound plus the bias, a
+// forward truncation divides the bound by 2^scale, and so on. The parameters are either the
+// actual ones, which leaks what the bitwidths reveal about them to whoever receives the
+// bitwidths, or a public bound declared on every weight and bias (paramBound, in real units).
+// node->bitwidth is then the number of bits that holds every value the node can output in two's
+// complement. The bounds are worst case, so they hold for any input within the input bound.
+// Layers not understood here, and everything after them, keep bitwidth 0 (the full ring).
+
+// bits to hold [-bound, bound] in two's complement, 0 when unbounded
+inline u64 bitsForBound(double bound)
+{
+    if (!std::isfinite(bound))
+        return 0;
+    u64 bits = 1;
+    while (bits < 64 && std::ldexp(1.0, bits - 1) <= bound)
+        ++bits;
+    return bits < 64 ? bits : 0;
+}
+
+// largest L1 norm over output channels of a weight matrix plus |bias| scaled by the input bound
+template <typename T>
+double linearBound(const T *w, u64 channels, u64 k, u64 rowStride, u64 colStride, const Tensor1D<T> *bias, double inBound)
+{
+    double res = 0;
+    for (u64 c = 0; c < channels; ++c) {
+        double l1 = 0;
+        for (u64 j = 0; j < k; ++j)
+            l1 += std::abs((double)(i64)w[c * rowStride + j * colStride]);
+        double b = bias == nullptr ? 0 : std::abs((double)(i64)(*bias)(c));
+        res = std::max(res, l1 * inBound + b);
+    }
+    return res;
+}
+
+// largest |weight| * k * inBound + |bias| when every parameter is at most paramBound in real
+// units, weights at scale and biases at 2 * scale like the rest of sytorch
+inline double declaredLinearBound(u64 k, bool useBias, u64 scale, double paramBound, double inBound)
+{
+    return std::ldexp(paramBound, scale) * k * inBound + (useBias ? std::ldexp(paramBound, 2 * scale) : 0);
+}
+
+// bound on the output of one layer given bounds on its inputs, before its forward truncation.
+// A negative paramBound reads the actual parameters.
+template <typename T>
+double layerOutputBound(Layer<T> *layer, const std::vector<double> &in, double paramBound = -1)
+{
+    const double unbounded = std::numeric_limits<double>::infinity();
+    auto &name = layer->name;
+    bool declared = paramBound >= 0;
+    if (layer->isIdentity || name == "ReLU" || name == "MaxPool2D" || name == "AvgPool2D" || name == "GlobalAvgPool2D"
+        || name == "Flatten" || name == "Identity" || name == "View" || name == "Transpose" || name == "Split"
+        || name == "LeakyReLU" || name == "KVCache") {
+        // averages get one unit of slack for the rounding of the division
+        return in[0] + ((name == "AvgPool2D" || name == "GlobalAvgPool2D") ? 1 : 0);
+    }
+    if (name == "SumPool2D") {
+        auto ks = ((SumPool2D<T> *)layer)->ks;
+        return in[0] * ks * ks;
+    }
+    if (name == "Add") {
+        double s = 0;
+        for (auto b : in) s += b;
+        return s;
+    }
+    if (name == "Concat") {
+        double m = 0;
+        for (auto b : in) m = std::max(m, b);
+        return m;
+    }
+    if (name == "Conv2D") {
+        auto conv = (Conv2D<T> *)layer;
+        if (declared)
+            return declaredLinearBound(conv->filter.d2, conv->useBias, layer->scale, paramBound, in[0]);
+        return linearBound(conv->filter.data, conv->co, conv->filter.d2, conv->filter.d2, (u64)1,
+                            conv->useBias ? &conv->bias : nullptr, in[0]);
+    }
+    if (name == "FC") {
+        auto fc = (FC<T> *)layer;
+        if (declared)
+            return declaredLinearBound(fc->in, fc->useBias, layer->scale, paramBound, in[0]);
+        return linearBound(fc->weight.data, fc->out, fc->in, (u64)1, fc->out,
+                            fc->useBias ? &fc->bias : nullptr, in[0]);
+    }
+    if (name == "BatchNormInference") {
+        auto bn = (BatchNormInference<T> *)layer;
+        if (declared)
+            return declaredLinearBound(1, true, layer->scale, paramBound, in[0]);
+        double m = 0;
+        for (u64 c = 0; c < bn->A.d1; ++c)
+            m = std::max(m, std::abs((double)(i64)bn->A(c)) * in[0] + std::abs((double)(i64)bn->B(c)));
+        return m;
+    }
+    return unbounded;
+}
+
+// Sets node->bitwidth on root and every node in order (which must be in execution order),
+// for inputs with magnitude at most inputBound in ring units. Returns the bounds it found.
+// With paramBound >= 0 only the architecture and paramBound are used (see layerOutputBound).
+template <typename T>
+std::vector<double> inferActivationBitwidths(LayerGraphNode<T> *root, const std::vector<LayerGraphNode<T> *> &order, double inputBound,
+                                             double paramBound = -1)
+{
+    static_assert(std::is_integral<T>::value, "bitwidth inference needs a fixed-point ring");
+    std::map<LayerGraphNode<T> *, double> bound;
+    bound[root] = inputBound;
+    root->bitwidth = bitsForBound(inputBound);
+
+    std::vector<double> res;
+    for (auto node : order) {
+        auto layer = node->layer;
+        std::vector<double> in;
+        for (auto p : node->parents)
+            in.push_back(bound.at(p));
+        double b = layerOutputBound(layer, in, paramBound);
+        // a truncation rounds towards -inf, so allow one unit more
+        if (layer->doTruncationForward && !layer->isIdentity)
+            b = std::ldexp(b, -(int)layer->scale) + 1;
+        bound[node] = b;
+        node->bitwidth = bitsForBound(b);
+        res.push_back(b);
+    }
+    return res;
+}
+
+// whether every weight and bias of the layers in order is at most paramBound in real units, as
+// declared to inferActivationBitwidths. Parties without the weights hold zeros and pass.
+template <typename T>
+bool parametersWithinBound(const std::vector<LayerGraphNode<T> *> &order, double paramBound)
+{
+    for (auto node : order) {
+        auto layer = node->layer;
+        if (layer->isIdentity)
+            continue; // folded away, its parameters are not used
+        auto w = layer->getweights();
+        auto b = layer->getbias();
+        double wMax = std::ldexp(paramBound, layer->scale), bMax = std::ldexp(paramBound, 2 * layer->scale);
+        for (u64 i = 0; i < w.size; ++i)
+            if (std::abs((double)(i64)w.data[i]) > wMax)
+                return false;
+        for (u64 i = 0; i < b.size; ++i)
+            if (std::abs((double)(i64)b.data[i]) > bMax)
+                return false;
+    }
+    return true;
+}
+
+// one bitwidth per line, root first and then the nodes in order
+template <typename T>
+void saveActivationBitwidths(LayerGraphNode<T> *root, const std::vector<LayerGraphNode<T> *> &order, const std::string &path)
+{
+    std::ofstream f(path);
+    f << root->bitwidth << "\n";
+    for (auto node : order)
+        f << node->bitwidth << "\n";
+}
+
+template <typename T>
+void loadActivationBitwidths(LayerGraphNode<T> *root, const std::vector<LayerGraphNode<T> *> &order, const std::string &path)
+{
+    std::ifstream f(path);
+    always_assert(f.good());
+    always_assert(f >> root->bitwidth);
+    for (auto node : order)
+        always_assert(f >> node->bitwidth);
+}
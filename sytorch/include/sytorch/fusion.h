@@ -0,0 +1,175 @@
+#pragma once
+#include <sytorch/layers/layers.h>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Graph rewrites run by the backends' optimize, which SytorchModule::optimize calls.
+//
+// A pattern looks at one node and, if it matches, rewrites the layers around it by
+// changing their flags and parameters. Execution still goes through the module's
+// _forward, so a rewrite never adds or removes nodes: a layer that gets absorbed by a
+// neighbour is marked isIdentity and only passes its input on. Patterns must not match
+// again once applied, since they are rerun until the graph stops changing.
+
+template <typename T>
+struct FusionPattern {
+    std::string name;
+    std::function<bool(LayerGraphNode<T> *)> apply;
+};
+
+template <typename T>
+u64 applyFusionPatterns(LayerGraphNode<T> *root, const std::vector<FusionPattern<T>> &patterns, bool verbose = false)
+{
+    u64 total = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        topologicalApply(root, [&](LayerGraphNode<T> *node, LayerGraphNode<T> *_root) {
+            if (node->layer == nullptr)
+                return;
+            for (auto &p : patterns) {
+                if (p.apply(node)) {
+                    if (verbose)
+                        std::cerr << "fusion: " << p.name << " at " << node->layer->name << "\n";
+                    changed = true;
+                    ++total;
+                }
+            }
+        });
+    }
+    return total;
+}
+
+// the first node after node that is not an identity, when the path there has no branches
+template <typename T>
+LayerGraphNode<T> *nextComputeNode(LayerGraphNode<T> *node)
+{
+    if (node->children.size() != 1)
+        return nullptr;
+    auto child = node->children[0];
+    while (child->layer->isIdentity) {
+        if (child->children.size() != 1)
+            return nullptr;
+        child = child->children[0];
+    }
+    return child;
+}
+
+// Folds y = A * x + B (A at scale s, B at 2s) into the Conv2D or FC producing x, so that
+// W' = W * A >> s and bias' = (bias * A >> s) + B. Called when the fold is decided and again
+// by load, once the real parameters are known.
+template <typename T>
+void foldBatchNorm(Layer<T> *target, BatchNormInference<T> *bn)
+{
+    u64 channels = bn->A.d1;
+    u64 s = bn->scale;
+    auto mul = [&](T x, T a) -> T {
+        if constexpr (std::is_floating_point<T>::value) {
+            return x * a;
+        }
+        else {
+            i64 round = (s == 0) ? 0 : (1LL << (s - 1));
+            return (T)(((i64)x * (i64)a + round) >> s);
+        }
+    };
+
+    T *w;
+    u64 rowStride, colStride, k;
+    Tensor1D<T> *bias;
+    if (target->name == "Conv2D") {
+        auto conv = (Conv2D<T> *)target;
+        always_assert(conv->co == channels);
+        w = conv->filter.data;
+        k = conv->filter.d2;
+        rowStride = conv->filter.d2;
+        colStride = 1;
+        bias = &conv->bias;
+    }
+    else {
+        always_assert(target->name == "FC");
+        auto fc = (FC<T> *)target;
+        always_assert(fc->out == channels);
+        w = fc->weight.data;
+        k = fc->in;
+        rowStride = 1;
+        colStride = fc->out;
+        bias = &fc->bias;
+    }
+
+    for (u64 c = 0; c < channels; ++c) {
+        T a = bn->A(c);
+        for (u64 j = 0; j < k; ++j) {
+            T &v = w[c * rowStride + j * colStride];
+            v = mul(v, a);
+        }
+        (*bias)(c) = mul((*bias)(c), a) + bn->B(c);
+    }
+}
+
+// Conv2D/FC -> BatchNormInference becomes a single Conv2D/FC with a bias. The BN loses its
+// truncation too, which saves one truncation per output element.
+template <typename T>
+FusionPattern<T> foldBatchNormPattern()
+{
+    return {"fold-batchnorm", [](LayerGraphNode<T> *node) {
+        auto layer = node->layer;
+        if (layer->name != "Conv2D" && layer->name != "FC")
+            return false;
+        if (node->children.size() != 1)
+            return false;
+        auto child = node->children[0];
+        if (child->layer->name != "BatchNormInference" || child->layer->isIdentity || child->parents.size() != 1)
+            return false;
+        auto bn = (BatchNormInference<T> *)child->layer;
+        if (layer->isTrainingMode || !layer->doTruncationForward || !bn->doTruncationForward)
+            return false;
+        if (layer->doPostSignExtension || bn->doPreSignExtension || bn->doPostSignExtension)
+            return false;
+
+        if (!layer->useBias) {
+            layer->useBias = true;
+            layer->biasFromFold = true;
+            layer->getbias().zero();
+        }
+        foldBatchNorm(layer, bn);
+        bn->isIdentity = true;
+        bn->doTruncationForward = false;
+        bn->foldedInto = layer;
+        return true;
+    }};
+}
+
+// Moves the forward truncation of a layer onto a following ReLU or MaxPool2D, where it
+// runs on the (smaller or cheaper to truncate) output instead.
+template <typename T>
+FusionPattern<T> moveTruncationPattern()
+{
+    return {"move-truncation", [](LayerGraphNode<T> *node) {
+        if (node->layer->isIdentity || !node->layer->doTruncationForward || node->layer->doPostSignExtension)
+            return false;
+        auto next = nextComputeNode(node);
+        if (next == nullptr || next->layer->doTruncationForward)
+            return false;
+        if (next->layer->name != "MaxPool2D" && next->layer->name != "ReLU")
+            return false;
+        node->layer->doTruncationForward = false;
+        next->layer->doTruncationForward = true;
+        return true;
+    }};
+}
+
+// A ReLU that truncates its output does both in one backend call (Backend::reluTruncate).
+template <typename T>
+FusionPattern<T> fuseReluTruncatePattern()
+{
+    return {"relu-truncate", [](LayerGraphNode<T> *node) {
+        auto layer = node->layer;
+        if (layer->name != "ReLU" || layer->isIdentity || layer->fusedTruncation || !layer->doTruncationForward)
+            return false;
+        layer->fusedTruncation = true;
+        return true;
+    }};
+}
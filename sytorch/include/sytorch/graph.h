@@ -2,6 +2,10 @@
 #include <set>
 #include <fstream>
 #include <queue>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <iomanip>
 
 template <typename T>
 class Layer;
@@ -9,6 +13,34 @@ class Layer;
 template <typename T>
 class Tensor;
 
+// Cumulative counters a backend reports for profiling, see Backend::costCounters.
+struct CostCounters {
+    uint64_t keyBytes = 0;
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t rounds = 0;
+
+    void add(const CostCounters &o)
+    {
+        keyBytes += o.keyBytes;
+        bytesSent += o.bytesSent;
+        bytesReceived += o.bytesReceived;
+        rounds += o.rounds;
+    }
+};
+
+// one forward call of a profiled node
+struct NodeCostSample {
+    uint64_t startMicroseconds;
+    uint64_t durationMicroseconds;
+    CostCounters cost;
+};
+
+inline uint64_t profilerMicroseconds()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 template <typename T>
 struct LayerGraphNode {
     Layer<T> *layer;
@@ -17,7 +49,42 @@ struct LayerGraphNode {
     int numUsages = 0;
     Tensor<T> *currTensor = nullptr;
     bool mark = false;
+    // where the activation lives when the module has a memory plan
+    T *plannedData = nullptr;
+    uint64_t plannedSize = 0;
+    // bits that hold every value of the output, 0 for the full ring (see bitwidth.h)
+    uint64_t bitwidth = 0;
     std::vector<LayerGraphNode<T> *> *allNodesInExecutionOrderRef = nullptr;
+    // filled by Layer::forward when profiling, see sytorch/profiler.h
+    bool profiling = false;
+    std::vector<NodeCostSample> costSamples;
+
+    void recordCost(uint64_t start, const CostCounters &before, const CostCounters &after)
+    {
+        auto delta = [](uint64_t a, uint64_t b) { return b >= a ? b - a : 0; }; // counters may be reset mid-run
+        NodeCostSample s;
+        s.startMicroseconds = start;
+        s.durationMicroseconds = profilerMicroseconds() - start;
+        s.cost.keyBytes = delta(before.keyBytes, after.keyBytes);
+        s.cost.bytesSent = delta(before.bytesSent, after.bytesSent);
+        s.cost.bytesReceived = delta(before.bytesReceived, after.bytesReceived);
+        s.cost.rounds = delta(before.rounds, after.rounds);
+        costSamples.push_back(s);
+    }
+
+    uint64_t totalMicroseconds() const
+    {
+        uint64_t t = 0;
+        for (auto &s : costSamples) t += s.durationMicroseconds;
+        return t;
+    }
+
+    CostCounters totalCost() const
+    {
+        CostCounters c;
+        for (auto &s : costSamples) c.add(s.cost);
+        return c;
+    }
 
     bool incrementAndGc()
     {
@@ -26,7 +93,9 @@ struct LayerGraphNode {
         }
         numUsages++; // todo: make it atomic
         if (numUsages == children.size()) {
-            currTensor->free();
+            // planned activations live in the module's arena and are not freed one by one
+            if (currTensor->isOwner)
+                currTensor->free();
             return true;
         }
         return false;
@@ -77,6 +146,14 @@ void print_dot_graph(LayerGraphNode<T> *root)
                 }
                 label += "(" + args + ")";
             }
+            if (!node->costSamples.empty()) {
+                auto cost = node->totalCost();
+                std::ostringstream ss;
+                ss << std::fixed << std::setprecision(3) << "\\n" << node->totalMicroseconds() / 1000.0 << " ms, "
+                   << cost.rounds << " rounds\\nkey " << cost.keyBytes / 1024.0 << " KiB, sent "
+                   << cost.bytesSent / 1024.0 << " KiB, recv " << cost.bytesReceived / 1024.0 << " KiB";
+                label += ss.str();
+            }
             dotfile << node->layer->name + std::to_string((uint64_t)(node->layer)) << " [label=\"" << label << "\"" + (node->mark ? std::string(" color=\"red\"") : std::string("")) + "];" << "\n";
             for (auto &child : node->children) {
                 dotfile << node->layer->name + std::to_string((uint64_t)(node->layer)) << " -> " << child->layer->name + std::to_string((uint64_t)(child->layer)) << ";" << "\n";
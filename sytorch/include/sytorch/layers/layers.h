@@ -21,6 +21,12 @@ public:
     int forwardTruncationMode = 0;
     bool useBias = true;
     bool isTrainingMode = false;
+    // the output may overwrite an input that nothing reads afterwards
+    bool canRunInPlace = false;
+    // set by graph rewrites (see fusion.h)
+    bool isIdentity = false;        // folded into a neighbour, forward only passes the input on
+    bool fusedTruncation = false;   // _forward already applies the forward truncation
+    bool biasFromFold = false;      // the bias was introduced by a fold and is not in the weights file
     std::string paramstring  = "";
 
     LayerGraphNode<T> *node = nullptr;
@@ -39,7 +45,15 @@ public:
     virtual void _resize(const std::vector<std::vector<u64>> &shapes) {};
     void resize(const std::vector<std::vector<u64>> &shapes) {
         auto outdims = this->get_output_dims(shapes);
-        activation.resize(outdims);
+        if (node != nullptr && node->plannedData != nullptr) {
+            u64 sz = 1;
+            for (auto d : outdims) sz *= d;
+            always_assert(sz <= node->plannedSize);
+            activation.bind(node->plannedData, outdims);
+        }
+        else {
+            activation.resize(outdims);
+        }
         _resize(shapes);
     }
 
@@ -89,18 +103,36 @@ public:
         node->currTensor = &activation;
         activation.graphNode = node;
 
+        if (isIdentity) {
+            always_assert(a.size() == 1);
+            if (activation.data != a[0]->data)
+                activation.copy(*a[0], false);
+            a[0]->graphNode->incrementAndGc();
+            return activation;
+        }
+
+        CostCounters costBefore;
+        u64 costStart = 0;
+        if (node->profiling) {
+            costBefore = this->backend->costCounters();
+            costStart = profilerMicroseconds();
+        }
+
         if (doPreSignExtension) {
             for(auto &i : a) {
                 this->backend->signext(*i, scale);
             }
         }
         _forward(a);
-        if (doTruncationForward) {
+        if (doTruncationForward && !fusedTruncation) {
             this->backend->truncateForward(activation, scale, forwardTruncationMode);
         }
         if (doPostSignExtension) {
             this->backend->signext(activation, scale);
         }
+        if (node->profiling) {
+            node->recordCost(costStart, costBefore, this->backend->costCounters());
+        }
         for(auto &i : a) {
             i->graphNode->incrementAndGc();
         }
@@ -168,10 +200,13 @@ public:
         assert(a.shape[3] == ci);
         if (this->isTrainingMode)
             inp.copy(a, false);
-        auto act_4d = this->activation.as_4d();
-        this->backend->conv2D(fh, fw, padding, stride, ci, co, a.as_4d(), filter, act_4d);
-        if (this->useBias)
-            this->backend->addbias(this->activation, bias);
+        if (this->useBias) {
+            this->backend->conv2DBias(fh, fw, padding, stride, ci, co, a.as_4d(), filter, bias, this->activation);
+        }
+        else {
+            auto act_4d = this->activation.as_4d();
+            this->backend->conv2D(fh, fw, padding, stride, ci, co, a.as_4d(), filter, act_4d);
+        }
     }
 
     TensorRef<T> getweights() { return filter.ref(); }
@@ -469,10 +504,13 @@ public:
     void _forward(Tensor<T> &a) {
         this->inp.copy(a, false);
         auto a_2d = a.as_2d();
-        auto act_2d = this->activation.as_2d();
-        this->backend->matmul(a_2d, weight, act_2d);
-        if (this->useBias)
-            this->backend->addbias(this->activation, bias);
+        if (this->useBias) {
+            this->backend->matmulBias(a_2d, weight, bias, this->activation);
+        }
+        else {
+            auto act_2d = this->activation.as_2d();
+            this->backend->matmul(a_2d, weight, act_2d);
+        }
     }
 
     TensorRef<T> getweights() { return weight.ref(); }
@@ -491,7 +529,9 @@ template <typename T>
 class ReLU: public Layer<T> {
 public:
     Tensor<T> drelu;
-    ReLU() :  Layer<T>("ReLU"), drelu({0}) {}
+    ReLU() :  Layer<T>("ReLU"), drelu({0}) {
+        this->canRunInPlace = true;
+    }
 
     void _resize(const std::vector<std::vector<u64>> &shapes) {
         always_assert(shapes.size() == 1);
@@ -500,7 +540,10 @@ public:
     }
 
     void _forward(Tensor<T> &a) {
-        this->backend->relu(a, this->activation, this->drelu, this->scale, this->mode);
+        if (this->fusedTruncation && this->doTruncationForward)
+            this->backend->reluTruncate(a, this->activation, this->drelu, this->scale, this->scale, this->mode, this->forwardTruncationMode);
+        else
+            this->backend->relu(a, this->activation, this->drelu, this->scale, this->mode);
     }
 
     std::vector<u64> get_output_dims(const std::vector<std::vector<u64>> &inShapes) {
@@ -545,6 +588,7 @@ class BatchNormInference : public Layer<T> {
 public:
     Tensor1D<T> A; // scale = s
     Tensor1D<T> B; // scale = 2s
+    Layer<T> *foldedInto = nullptr; // Conv2D or FC that absorbed this layer, see fusion.h
 
     BatchNormInference(u64 channels) : Layer<T>("BatchNormInference"), A(channels), B(channels) {
         this->A.fill(0);
@@ -803,7 +847,9 @@ public:
 template <typename T>
 class Add: public Layer<T> {
 public:
-    Add() :  Layer<T>("Add") {}
+    Add() :  Layer<T>("Add") {
+        this->canRunInPlace = true;
+    }
 
     void _resize(const std::vector<std::vector<u64>> &shapes) {
         auto &shape0 = shapes[0];
@@ -921,9 +967,10 @@ class SoftMax: public Layer<T> {
 public:
     SoftMax() :  Layer<T>("SoftMax") {}
 
+    // over the last axis, so attention scores of shape (heads, queries, keys) work as they are
     void _resize(const std::vector<std::vector<u64>> &shapes) {
         always_assert(shapes.size() == 1);
-        always_assert(shapes[0].size() == 2);
+        always_assert(shapes[0].size() >= 1);
     }
 
     void _forward(Tensor<T> &a) {
@@ -932,7 +979,7 @@ public:
 
     std::vector<u64> get_output_dims(const std::vector<std::vector<u64>> &inShapes) {
         always_assert(inShapes.size() == 1);
-        always_assert(inShapes[0].size() == 2);
+        always_assert(inShapes[0].size() >= 1);
         auto &inShape = inShapes[0];
         return inShape;
     }
@@ -1047,6 +1094,8 @@ class Transpose: public Layer<T> {
 public:
     std::vector<u64> perm;
     Transpose(const std::vector<u64> &perm) : Layer<T>("Transpose"), perm(perm) {}
+    // matrix transpose, as used by SytorchModule::transpose
+    Transpose() : Layer<T>("Transpose"), perm({1, 0}) {}
 
     void _resize(const std::vector<std::vector<u64>> &shapes) {
         always_assert(shapes.size() == 1);
@@ -1206,3 +1255,73 @@ public:
         return shape0;
     }
 };
+
+// Keeps every row it has been given and outputs all of them, oldest first. Used for the keys
+// and values of attention during autoregressive decoding, so that a step only computes the
+// projections of the new tokens (see SytorchModule::kvcache). The rows are whatever the backend
+// holds: under LLAMA the evaluators keep masked values and the dealer keeps their masks, so the
+// cache needs no communication.
+template <typename T>
+class KVCache: public Layer<T> {
+public:
+    std::vector<T> rows;
+    u64 features = 0;
+
+    KVCache() : Layer<T>("KVCache") {}
+
+    u64 length() const {
+        return features == 0 ? 0 : rows.size() / features;
+    }
+
+    void reset() {
+        rows.clear();
+        features = 0;
+    }
+
+    void _resize(const std::vector<std::vector<u64>> &shapes) {
+        always_assert(shapes.size() == 1);
+        always_assert(shapes[0].size() == 2);
+        always_assert(features == 0 || shapes[0][1] == features);
+    }
+
+    void _forward(Tensor<T> &a) {
+        features = a.shape[1];
+        rows.insert(rows.end(), a.data, a.data + a.size());
+        std::copy(rows.begin(), rows.end(), this->activation.data);
+    }
+
+    std::vector<u64> get_output_dims(const std::vector<std::vector<u64>> &inShapes) {
+        always_assert(inShapes.size() == 1);
+        auto &shape0 = inShapes[0];
+        always_assert(shape0.size() == 2);
+        return {length() + shape0[0], shape0[1]};
+    }
+};
+
+// Causal mask for attention scores of shape (queries, keys) where the queries are the last
+// tokens of the keys: query j only sees keys up to keys - queries + j, the later scores get
+// scalar subtracted so that a following softmax sends them to 0.
+template <typename T>
+class _AttentionMask: public Layer<T> {
+public:
+    double scalar;
+
+    _AttentionMask(double scalar) : Layer<T>("_AttentionMask"), scalar(scalar) {}
+
+    void _resize(const std::vector<std::vector<u64>> &shapes) {
+        always_assert(shapes.size() == 1);
+        always_assert(shapes[0].size() == 2);
+        always_assert(shapes[0][1] >= shapes[0][0]);
+    }
+
+    void _forward(Tensor<T> &a) {
+        T scalarFix = scalar * (1LL << this->scale);
+        this->backend->attention_mask(a, scalarFix, this->activation);
+    }
+
+    std::vector<u64> get_output_dims(const std::vector<std::vector<u64>> &inShapes) {
+        always_assert(inShapes.size() == 1);
+        auto &shape0 = inShapes[0];
+        return shape0;
+    }
+};
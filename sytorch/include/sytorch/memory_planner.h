@@ -0,0 +1,130 @@
+#pragma once
+#include <sytorch/layers/layers.h>
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <vector>
+
+// Static placement of layer activations in one arena.
+//
+// Nodes are visited in execution order and every activation gets a buffer that is live
+// from the step that writes it to the last step that reads it. Layers with canRunInPlace
+// write straight into an input buffer when they are its last reader. Buffers are then
+// placed largest first, each at the lowest offset that does not overlap a buffer whose
+// lifetime intersects its own. Activations with no readers (the module outputs) are kept
+// alive until the end.
+
+struct PlannedBuffer {
+    u64 size;       // elements, rounded up so every buffer starts on a cache line
+    int start;
+    int end;
+    u64 offset = 0;
+};
+
+struct ActivationPlan {
+    u64 arenaSize = 0;      // elements needed for the whole arena
+    u64 peakLive = 0;       // largest set of activations live at the same step
+    u64 totalSize = 0;      // every activation kept at once
+    std::vector<int> bufferOf;
+    std::vector<PlannedBuffer> buffers;
+};
+
+template <typename T>
+ActivationPlan planActivationMemory(const std::vector<LayerGraphNode<T> *> &nodes, const std::vector<u64> &inputShape)
+{
+    const u64 align = 64 / sizeof(T) > 0 ? 64 / sizeof(T) : 1;
+    int n = nodes.size();
+    ActivationPlan plan;
+    plan.bufferOf.resize(n);
+
+    std::map<LayerGraphNode<T> *, int> step;
+    for (int i = 0; i < n; ++i) {
+        step[nodes[i]] = i;
+    }
+
+    std::vector<std::vector<u64>> shapes(n);
+    for (int i = 0; i < n; ++i) {
+        auto node = nodes[i];
+        std::vector<std::vector<u64>> inShapes;
+        for (auto parent : node->parents) {
+            if (step.find(parent) == step.end()) {
+                always_assert(parent->layer->name == "Input");
+                inShapes.push_back(inputShape);
+            }
+            else {
+                inShapes.push_back(shapes[step[parent]]);
+            }
+        }
+        shapes[i] = node->layer->get_output_dims(inShapes);
+        u64 size = 1;
+        for (auto d : shapes[i]) size *= d;
+        size = (size + align - 1) / align * align;
+        plan.totalSize += size;
+
+        int lastUse = node->children.empty() ? n : i;
+        for (auto child : node->children) {
+            lastUse = std::max(lastUse, step.at(child));
+        }
+
+        int buf = -1;
+        if (node->layer->canRunInPlace || node->layer->isIdentity) {
+            for (auto parent : node->parents) {
+                auto it = step.find(parent);
+                if (it == step.end()) continue;
+                auto &pb = plan.buffers[plan.bufferOf[it->second]];
+                if (pb.end == i && pb.size == size) {
+                    buf = plan.bufferOf[it->second];
+                    break;
+                }
+            }
+        }
+        if (buf >= 0) {
+            plan.buffers[buf].end = lastUse;
+        }
+        else {
+            buf = plan.buffers.size();
+            plan.buffers.push_back({size, i, lastUse});
+        }
+        plan.bufferOf[i] = buf;
+    }
+
+    auto &buffers = plan.buffers;
+    auto overlaps = [&](int a, int b) {
+        return buffers[a].start <= buffers[b].end && buffers[b].start <= buffers[a].end;
+    };
+
+    std::vector<int> order(buffers.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return buffers[a].size > buffers[b].size;
+    });
+
+    std::vector<int> placed;
+    for (int b : order) {
+        std::vector<std::pair<u64, u64>> busy;
+        for (int o : placed) {
+            if (overlaps(b, o))
+                busy.push_back({buffers[o].offset, buffers[o].offset + buffers[o].size});
+        }
+        std::sort(busy.begin(), busy.end());
+        u64 offset = 0;
+        for (auto &r : busy) {
+            if (r.first >= offset + buffers[b].size) break;
+            offset = std::max(offset, r.second);
+        }
+        buffers[b].offset = offset;
+        plan.arenaSize = std::max(plan.arenaSize, offset + buffers[b].size);
+        placed.push_back(b);
+    }
+
+    for (int t = 0; t <= n; ++t) {
+        u64 live = 0;
+        for (auto &b : buffers) {
+            if (b.start <= t && t <= b.end)
+                live += b.size;
+        }
+        plan.peakLive = std::max(plan.peakLive, live);
+    }
+
+    return plan;
+}
@@ -1,36 +1,90 @@
 #include <sytorch/tensor.h>
+#include <sytorch/memory_planner.h>
+#include <sytorch/fusion.h>
+#include <sytorch/profiler.h>
+#include <sytorch/bitwidth.h>
 #include <fstream>
 #include <filesystem>
 #include <map>
 #include <algorithm>
+#include <cstring>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 
+// Native fixed-point weights, written by SytorchModule::dumpQuantized: this header followed
+// by the parameters as T, in the order load visits them.
+constexpr char quantizedWeightsMagic[8] = {'S', 'Y', 'T', 'Q', 'W', 'T', 'S', '1'};
+
+struct QuantizedWeightsHeader {
+    char magic[8];
+    u64 elementSize;
+    u64 scale;
+    u64 numParameters;
+};
+
+inline bool isQuantizedWeights(const char *file, size_t size)
+{
+    return size >= sizeof(QuantizedWeightsHeader) && std::memcmp(file, quantizedWeightsMagic, sizeof(quantizedWeightsMagic)) == 0;
+}
+
+template <typename T>
+void quantizeWeights(const float *src, T *dst, u64 size, float multiplier)
+{
+    #pragma omp parallel for simd schedule(static) if(size > (1 << 14))
+    for (u64 i = 0; i < size; ++i) {
+        dst[i] = type_cast<T>(src[i] * multiplier);
+    }
+}
+
+template <typename T>
+void copyWeights(const T *src, T *dst, u64 size)
+{
+    #pragma omp parallel for schedule(static) if(size > (1 << 16))
+    for (u64 i = 0; i < size; ++i) {
+        dst[i] = src[i];
+    }
+}
+
 template <typename T>
 class SytorchModule {
 public:
 
     Tensor<T> activation;
+    Tensor<T> batchedInput;
     Backend<T> *backend = new ClearText<T>;
     LayerGraphNode<T> *root = nullptr;
+    LayerGraphNode<T> *outputNode = nullptr;
     bool debug = true;
+    // run the graph a wavefront at a time instead of through _forward, see forwardGraph.
+    // Ignored while a memory plan is active, since the plan reuses slots in _forward order.
+    bool concurrentBranches = false;
     u64 scale;
 
     std::vector<LayerGraphNode<T> *> allNodesInExecutionOrder;
-    const std::vector<std::string> functionalLayers = {"Add", "Concat", "GeLU", "SoftMax", "Split", "View", "Transpose", "_MatMul", "_ScalarMul"};
+    T *activationArena = nullptr;
+    std::vector<u64> plannedInputShape;
+    u64 plannedCachedTokens = 0;
+    // chains of layers (see forwardGraph) grouped by their depth below the input
+    std::vector<std::vector<std::vector<LayerGraphNode<T> *>>> wavefronts;
+    const std::vector<std::string> functionalLayers = {"Add", "Concat", "GeLU", "SoftMax", "Split", "View", "Transpose", "_MatMul", "_ScalarMul", "KVCache", "_AttentionMask"};
     static std::map<std::string, LayerGraphNode<T> *> functionalLayerMap;
 
 public:
 
     virtual Tensor<T>& _forward(Tensor<T> &input) = 0;
 
-    SytorchModule() : activation({}), allNodesInExecutionOrder(0)
+    SytorchModule() : activation({}), batchedInput({}), allNodesInExecutionOrder(0)
     {
 
     }
 
+    virtual ~SytorchModule()
+    {
+        clearMemoryPlan();
+    }
+
     void generateFunctionalLayerMap()
     {
         // functionalLayerMap.clear();
@@ -84,6 +138,7 @@ public:
         auto &res = this->_forward(ip);
         ip.graphGenMode = false;
         root = ip.graphNode;
+        outputNode = res.graphNode;
     }
 
     void init(u64 scale)
@@ -120,12 +175,28 @@ public:
         }
 
         if (input.graphNode == nullptr) { // when the module is a top level module
+            if (activationArena != nullptr && (input.shape != plannedInputShape || cachedTokens() != plannedCachedTokens)) {
+                planMemory(input.shape);
+            }
             topologicalApply(root, [](LayerGraphNode<T> *node, LayerGraphNode<T> *_root) {
                 node->numUsages = 0;
             });
             input.graphNode = root;
             input.graphNode->currTensor = &input;
         }
+        if (concurrentBranches && activationArena == nullptr && input.graphNode == root) {
+            auto& res = forwardGraph(input);
+            this->activation.resize(res.shape);
+            this->activation.copy(res);
+            return this->activation;
+        }
+        if (activationArena != nullptr) {
+            // the output already sits in the arena and is never overwritten there
+            auto& res = this->_forward(input);
+            this->activation.bind(res.data, res.shape);
+            this->activation.graphNode = res.graphNode;
+            return this->activation;
+        }
         if (debug) {
             auto& res = this->_forward(input);
             this->activation.resize(res.shape);
@@ -140,80 +211,348 @@ public:
         }
     }
 
+    // Runs the generated graph in place of _forward. The graph is cut into chains, runs of
+    // layers that each only feed the next, and the chains at the same depth below the input
+    // form a wavefront that goes to the backend in one call. Under LLAMA the chains of a
+    // wavefront share rounds, so parallel branches (Inception blocks, residual shortcuts,
+    // attention heads) cost the rounds of the longest one instead of all of them.
+    Tensor<T>& forwardGraph(Tensor<T> &input)
+    {
+        // the memory plan follows the execution order of _forward, forward runs planned
+        // modules sequentially
+        always_assert(activationArena == nullptr);
+        if (wavefronts.empty()) {
+            std::map<LayerGraphNode<T> *, std::pair<u64, u64>> chainOf; // node -> (depth, index in wavefront)
+            for (auto node : allNodesInExecutionOrder) {
+                if (node->parents.size() == 1) {
+                    auto p = node->parents[0];
+                    if (p != root && p->children.size() == 1) {
+                        auto c = chainOf.at(p);
+                        wavefronts[c.first][c.second].push_back(node);
+                        chainOf[node] = c;
+                        continue;
+                    }
+                }
+                u64 d = 0;
+                for (auto p : node->parents) {
+                    if (p != root)
+                        d = std::max(d, chainOf.at(p).first + 1);
+                }
+                if (wavefronts.size() <= d)
+                    wavefronts.resize(d + 1);
+                chainOf[node] = {d, wavefronts[d].size()};
+                wavefronts[d].push_back({node});
+            }
+        }
+        for (auto &wave : wavefronts) {
+            std::vector<std::function<void()>> tasks;
+            for (auto &chain : wave) {
+                tasks.push_back([&chain] {
+                    for (auto node : chain) {
+                        std::vector<Tensor<T> *> inputs;
+                        for (auto p : node->parents)
+                            inputs.push_back(p->currTensor);
+                        node->layer->forward(inputs);
+                    }
+                });
+            }
+            if (tasks.size() == 1)
+                tasks[0]();
+            else
+                backend->runConcurrently(tasks);
+        }
+        return *outputNode->currTensor;
+    }
+
+    // Runs several queries as one batch: they are stacked along the batch axis and go
+    // through the graph once, so under LLAMA they share every round and one key per layer.
+    // Returns views of activation holding each query's output rows.
+    std::vector<Tensor<T>> forwardBatch(const std::vector<Tensor<T> *> &queries)
+    {
+        stackBatch(queries, batchedInput);
+        auto &res = forward(batchedInput);
+        return splitBatch(res, queries);
+    }
+
+    // Per-node cost recording, see profiler.h. Samples accumulate over forward calls
+    // until clearProfile.
+    void enableProfiling(bool enable = true)
+    {
+        for (auto &node : allNodesInExecutionOrder) {
+            node->profiling = enable;
+        }
+    }
+
+    void clearProfile()
+    {
+        for (auto &node : allNodesInExecutionOrder) {
+            node->costSamples.clear();
+        }
+    }
+
+    void writeProfileTrace(const std::string &path, int pid = 0)
+    {
+        writeChromeTrace(allNodesInExecutionOrder, path, pid);
+    }
+
+    void writeProfileCsv(const std::string &path)
+    {
+        writeCostCsv(allNodesInExecutionOrder, path);
+    }
+
+    // Graph rewrites chosen by the backend (see fusion.h). A BatchNormInference folded by
+    // them is folded again by load.
     void optimize()
     {
         backend->optimize(root);
     }
 
+    // Per-activation bitwidths, used by backends that can run an op in a smaller ring (see
+    // bitwidth.h), for inputs of magnitude at most inputBound in real units. Run after load
+    // and optimize; until then every node uses the full ring.
+    //
+    // This one only uses public information: every party passes the same paramBound, a
+    // declared bound on the magnitude of every weight and bias (after any folding by optimize),
+    // and gets the same bitwidths from the architecture. The party holding the weights checks
+    // that they keep to the bound.
+    void inferBitwidths(double inputBound, double paramBound)
+    {
+        always_assert(paramBound >= 0);
+        always_assert(parametersWithinBound(allNodesInExecutionOrder, paramBound));
+        inferActivationBitwidths(root, allNodesInExecutionOrder, std::ldexp(inputBound, scale), paramBound);
+        printBitwidths();
+    }
+
+    // Tighter bitwidths from the actual weights: L1 norms of the filters and the biases. Only
+    // the party holding the weights can run it, and the other parties load the saved file, so
+    // they learn these bitwidths and with them a bound on every layer's private weights. Opt in
+    // only where that leakage is acceptable.
+    void inferBitwidthsFromWeights(double inputBound)
+    {
+        inferActivationBitwidths(root, allNodesInExecutionOrder, std::ldexp(inputBound, scale));
+        printBitwidths();
+    }
+
+    void printBitwidths()
+    {
+        if (debug) {
+            for (int i = 0; i < allNodesInExecutionOrder.size(); ++i) {
+                auto node = allNodesInExecutionOrder[i];
+                std::cerr << "Bitwidth: " << node->layer->name << " #" << i << " " << node->bitwidth << "\n";
+            }
+        }
+    }
+
+    // hand the result of inferBitwidthsFromWeights to the other parties
+    void saveBitwidths(const std::string &path)
+    {
+        saveActivationBitwidths(root, allNodesInExecutionOrder, path);
+    }
+
+    void loadBitwidths(const std::string &path)
+    {
+        loadActivationBitwidths(root, allNodesInExecutionOrder, path);
+    }
+
+    // Put every layer activation in one arena sized by a liveness plan for this input
+    // shape (see memory_planner.h). forward replans when it sees a different shape, or
+    // when the KV caches have grown since.
+    void planMemory(const std::vector<u64> &inputShape)
+    {
+        clearMemoryPlan();
+        auto plan = planActivationMemory(allNodesInExecutionOrder, inputShape);
+        activationArena = new T[plan.arenaSize];
+        for (int i = 0; i < allNodesInExecutionOrder.size(); ++i) {
+            auto node = allNodesInExecutionOrder[i];
+            auto &buf = plan.buffers[plan.bufferOf[i]];
+            node->plannedData = activationArena + buf.offset;
+            node->plannedSize = buf.size;
+        }
+        plannedInputShape = inputShape;
+        plannedCachedTokens = cachedTokens();
+        if (debug) {
+            std::cerr << "Activation arena: " << plan.arenaSize * sizeof(T) << " bytes (largest live set "
+                      << plan.peakLive * sizeof(T) << " bytes, all activations " << plan.totalSize * sizeof(T) << " bytes)\n";
+        }
+    }
+
+    void clearMemoryPlan()
+    {
+        if (activationArena == nullptr)
+            return;
+        for (auto &node : allNodesInExecutionOrder) {
+            node->layer->activation.unbind();
+            node->plannedData = nullptr;
+            node->plannedSize = 0;
+        }
+        this->activation.unbind();
+        delete[] activationArena;
+        activationArena = nullptr;
+        plannedInputShape.clear();
+        plannedCachedTokens = 0;
+    }
+
+    // Parameters of one layer in a weights file, in elements of the file's format.
+    struct WeightsRange {
+        u64 begin;
+        u64 end;
+    };
+
+    std::vector<WeightsRange> weightsLayout(bool quantized)
+    {
+        std::vector<WeightsRange> ranges;
+        u64 idx = 0;
+        for (auto &node: allNodesInExecutionOrder) {
+            auto layer = node->layer;
+            u64 n;
+            if (layer->name == "BatchNormInference") {
+                // float files hold gamma, beta, mean and var, quantized ones A and B
+                n = (quantized ? 2 : 4) * ((BatchNormInference<T>*) layer)->A.d1;
+            }
+            else {
+                n = layer->getweights().size;
+                if (layer->useBias && !layer->biasFromFold)
+                    n += layer->getbias().size;
+            }
+            ranges.push_back({idx, idx + n});
+            idx += n;
+        }
+        return ranges;
+    }
+
+    // Loads either a float32 weights file, scaled to fixed point here, or a file written by
+    // dumpQuantized, which is copied as is. The file is mapped read-only and consumed layer
+    // by layer: the next layer is prefetched while the current one is converted on all
+    // cores, and converted pages are dropped, so loading starts before the file is paged
+    // in and a large model is never resident twice.
     void load(const std::string weightsFile)
     {
-        size_t size_in_bytes = std::filesystem::file_size(weightsFile);
-        always_assert(size_in_bytes % 4 == 0); // as it's float
-        size_t numParameters = size_in_bytes / 4;
-        float *floatWeights = new float[numParameters];
-        //float *buffer;
-        int buffersize = 0;
-        
-        // std::ifstream file(weightsFile, std::ios::binary);
-        // file.read((char*) floatWeights, size_in_bytes);
-        // file.close();
-        int fd1 = open(weightsFile.c_str(), O_RDWR | O_CREAT, 0);
+        int fd1 = open(weightsFile.c_str(), O_RDONLY);
+        if (fd1 < 0) {
+            std::cerr << "cannot open weights file " << weightsFile << "\n";
+            always_assert(false);
+        }
         struct stat sb;
         fstat(fd1, &sb);
-        buffersize = sb.st_size;
-        int advise=posix_fadvise(fd1, 0, sb.st_size, POSIX_FADV_WILLNEED);
-        floatWeights= (float*)mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd1, 0);
-        //floatWeights = buffer;
-        std::cerr << "Model Weights Size: " << sb.st_size << " bytes" << "\n";
+        size_t fileSize = sb.st_size;
+        posix_fadvise(fd1, 0, fileSize, POSIX_FADV_SEQUENTIAL);
+        char *file = (char *)mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd1, 0);
+        always_assert(file != MAP_FAILED);
         ::close(fd1);
+        madvise(file, fileSize, MADV_SEQUENTIAL);
+        std::cerr << "Model Weights Size: " << fileSize << " bytes" << "\n";
         u64 scale = this->scale;
-        
-        size_t wIdx = 0;
-        for (auto &node: allNodesInExecutionOrder) {
-            
-            auto layer = node->layer;
+
+        bool quantized = isQuantizedWeights(file, fileSize);
+        size_t dataOffset = 0, elemSize = sizeof(float);
+        if (quantized) {
+            auto header = (const QuantizedWeightsHeader *)file;
+            always_assert(header->elementSize == sizeof(T));
+            always_assert(header->scale == scale);
+            dataOffset = sizeof(QuantizedWeightsHeader);
+            elemSize = sizeof(T);
+        }
+        auto ranges = weightsLayout(quantized);
+        u64 numParameters = ranges.empty() ? 0 : ranges.back().end;
+        always_assert(fileSize == dataOffset + numParameters * elemSize);
+
+        size_t page = sysconf(_SC_PAGESIZE);
+        auto advise = [&](const WeightsRange &r, int advice) {
+            size_t b = dataOffset + r.begin * elemSize;
+            size_t e = dataOffset + r.end * elemSize;
+            if (advice == MADV_DONTNEED) {
+                // only pages that hold nothing of the neighbouring layers
+                b = (b + page - 1) / page * page;
+                e = e / page * page;
+            }
+            else {
+                b = b / page * page;
+            }
+            if (e > b)
+                madvise(file + b, e - b, advice);
+        };
+
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            if (i + 1 < ranges.size())
+                advise(ranges[i + 1], MADV_WILLNEED);
+            auto layer = allNodesInExecutionOrder[i]->layer;
+            const char *src = file + dataOffset + ranges[i].begin * elemSize;
             if (layer->name == "BatchNormInference") {
                 auto bn = (BatchNormInference<T>*) layer;
                 auto channel = bn->A.d1;
-                auto gammaPtr = floatWeights + wIdx;
-                auto betaPtr = floatWeights + wIdx + channel;
-                auto meanPtr = floatWeights + wIdx + 2 * channel;
-                auto varPtr = floatWeights + wIdx + 3 * channel;
-                for (int j = 0; j < channel; ++j) {
-                    bn->A(j) = type_cast<T>((gammaPtr[j] / std::sqrt(varPtr[j])) * (1LL << scale));
-                    bn->B(j) = type_cast<T>((betaPtr[j] - gammaPtr[j] * meanPtr[j] / std::sqrt(varPtr[j])) * (1LL << (2 * scale)));
+                if (quantized) {
+                    copyWeights((const T *)src, bn->A.data, channel);
+                    copyWeights((const T *)src + channel, bn->B.data, channel);
+                }
+                else {
+                    auto gammaPtr = (const float *)src;
+                    auto betaPtr = gammaPtr + channel;
+                    auto meanPtr = gammaPtr + 2 * channel;
+                    auto varPtr = gammaPtr + 3 * channel;
+                    for (int j = 0; j < channel; ++j) {
+                        bn->A(j) = type_cast<T>((gammaPtr[j] / std::sqrt(varPtr[j])) * (1LL << scale));
+                        bn->B(j) = type_cast<T>((betaPtr[j] - gammaPtr[j] * meanPtr[j] / std::sqrt(varPtr[j])) * (1LL << (2 * scale)));
+                    }
+                }
+                if (bn->foldedInto != nullptr) {
+                    foldBatchNorm(bn->foldedInto, bn);
                 }
-                wIdx += 4 * channel;
             }
             else {
                 auto weights = layer->getweights();
-                for (u64 j = 0; j < weights.size; j++) {
-                    weights.data[j] = type_cast<T>(floatWeights[wIdx + j] * (1LL << scale));
-                }
-
-                wIdx += weights.size;
-                
-
                 auto bias = layer->getbias();
-                if (layer->useBias) {
-
-                    for (u64 j = 0; j < bias.size; ++j) {
-                        bias.data[j] = type_cast<T>(floatWeights[wIdx + j] * (float)(1LL << (2*scale)));
-                    }
-
-                    wIdx += bias.size;
+                bool hasBias = layer->useBias && !layer->biasFromFold;
+                if (quantized) {
+                    copyWeights((const T *)src, weights.data, weights.size);
+                    if (hasBias)
+                        copyWeights((const T *)src + weights.size, bias.data, bias.size);
                 }
                 else {
+                    quantizeWeights((const float *)src, weights.data, weights.size, (float)(1LL << scale));
+                    if (hasBias)
+                        quantizeWeights((const float *)src + weights.size, bias.data, bias.size, (float)(1LL << (2*scale)));
+                }
+                if (!hasBias) {
                     bias.zero();
                 }
             }
+            advise(ranges[i], MADV_DONTNEED);
+        }
+
+        munmap(file, fileSize);
+    }
+
+    // Writes the parameters in the native fixed-point format read back by load without any
+    // conversion. Like dumpi64, call it before optimize.
+    void dumpQuantized(const std::string weightsFile)
+    {
+        std::ofstream file(weightsFile, std::ios::binary);
+        auto ranges = weightsLayout(true);
+        QuantizedWeightsHeader header;
+        std::memcpy(header.magic, quantizedWeightsMagic, sizeof(header.magic));
+        header.elementSize = sizeof(T);
+        header.scale = this->scale;
+        header.numParameters = ranges.empty() ? 0 : ranges.back().end;
+        file.write((char *)&header, sizeof(header));
+
+        for (auto &node: allNodesInExecutionOrder) {
+            auto layer = node->layer;
+            always_assert(!layer->isIdentity && !layer->biasFromFold);
+            if (layer->name == "BatchNormInference") {
+                auto bn = (BatchNormInference<T>*) layer;
+                file.write((char *)bn->A.data, bn->A.d1 * sizeof(T));
+                file.write((char *)bn->B.data, bn->B.d1 * sizeof(T));
+            }
+            else {
+                auto weights = layer->getweights();
+                file.write((char *)weights.data, weights.size * sizeof(T));
+                if (layer->useBias) {
+                    auto bias = layer->getbias();
+                    file.write((char *)bias.data, bias.size * sizeof(T));
+                }
+            }
         }
-        
-        always_assert(wIdx == numParameters);
-    
-        //delete floatWeights;
-        munmap(floatWeights, buffersize);
-       
+        always_assert(file.good());
     }
 
     void dumpi64(const std::string weightsFile)
@@ -223,6 +562,8 @@ public:
 
         for (auto &node: allNodesInExecutionOrder) {
             auto layer = node->layer;
+            // folded parameters have no place in the unfused layout, dump before optimize
+            always_assert(!layer->isIdentity && !layer->biasFromFold);
             if (layer->name == "BatchNormInference") {
                 auto bn = (BatchNormInference<T>*) layer;
                 auto channel = bn->A.d1;
@@ -388,6 +729,54 @@ public:
         return c;
     }
 
+    // Decoding with KV caches: call resetKVCache, run forward once on the prompt, then once per
+    // generated token with only that token as input. Every kvcache in _forward appends the rows
+    // it gets and returns all of them, and attentionMask lines the new queries up with the end
+    // of the keys, so each step costs the projections of one token plus one row of attention.
+    // Under LLAMA the dealer has to run the same sequence of forwards with the same shapes to
+    // generate the keys of every step.
+    Tensor<T>& kvcache(Tensor<T> &a)
+    {
+        if (a.graphGenMode) {
+            auto &c = functionalGraphGen<KVCache<T>>({&a});
+            return c;
+        }
+
+        auto cNode = getFunctionalNode("KVCache", {&a});
+        auto &c = cNode->layer->forward(a);
+        return c;
+    }
+
+    Tensor<T>& attentionMask(Tensor<T> &a, double scalar)
+    {
+        if (a.graphGenMode) {
+            auto &c = functionalGraphGen<_AttentionMask<T>>({&a}, scalar);
+            return c;
+        }
+
+        auto cNode = getFunctionalNode("_AttentionMask", {&a}, scalar);
+        auto &c = cNode->layer->forward(a);
+        return c;
+    }
+
+    void resetKVCache()
+    {
+        for (auto &node : allNodesInExecutionOrder) {
+            if (node->layer->name == "KVCache")
+                ((KVCache<T> *)node->layer)->reset();
+        }
+    }
+
+    // tokens held by the KV caches, 0 when the graph has none
+    u64 cachedTokens()
+    {
+        for (auto &node : allNodesInExecutionOrder) {
+            if (node->layer->name == "KVCache")
+                return ((KVCache<T> *)node->layer)->length();
+        }
+        return 0;
+    }
+
     T invsqrt(double x)
     {
         double t = 1/sqrt(x);
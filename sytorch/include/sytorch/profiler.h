@@ -0,0 +1,69 @@
+#pragma once
+#include <sytorch/layers/layers.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Per-node cost reports. SytorchModule::enableProfiling makes every Layer::forward record
+// its wall time and the backend's key bytes, bytes sent and received, and rounds (see
+// LayerGraphNode::costSamples). Nodes are named <layer>#<position in execution order> so
+// layers of the same type can be told apart; print_dot_graph shows the same totals.
+
+template <typename T>
+std::string profileNodeName(const std::vector<LayerGraphNode<T> *> &nodes, u64 i)
+{
+    auto layer = nodes[i]->layer;
+    std::string name = layer->name + "#" + std::to_string(i);
+    if (layer->paramstring != "") {
+        std::string args = layer->paramstring;
+        std::replace(args.begin(), args.end(), '|', ',');
+        if (args.back() == ',')
+            args.pop_back();
+        name += "(" + args + ")";
+    }
+    return name;
+}
+
+// Chrome trace event format, loadable in chrome://tracing or Perfetto. pid separates the
+// parties when their traces are merged.
+template <typename T>
+void writeChromeTrace(const std::vector<LayerGraphNode<T> *> &nodes, const std::string &path, int pid = 0)
+{
+    u64 origin = UINT64_MAX;
+    for (auto &node : nodes)
+        for (auto &s : node->costSamples)
+            origin = std::min(origin, s.startMicroseconds);
+
+    std::ofstream f(path);
+    f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (u64 i = 0; i < nodes.size(); ++i) {
+        auto name = profileNodeName(nodes, i);
+        for (auto &s : nodes[i]->costSamples) {
+            if (!first) f << ",\n";
+            first = false;
+            f << "{\"name\":\"" << name << "\",\"cat\":\"" << nodes[i]->layer->name << "\",\"ph\":\"X\""
+              << ",\"ts\":" << s.startMicroseconds - origin << ",\"dur\":" << s.durationMicroseconds
+              << ",\"pid\":" << pid << ",\"tid\":0,\"args\":{\"key_bytes\":" << s.cost.keyBytes
+              << ",\"bytes_sent\":" << s.cost.bytesSent << ",\"bytes_received\":" << s.cost.bytesReceived
+              << ",\"rounds\":" << s.cost.rounds << "}}";
+        }
+    }
+    f << "\n]}\n";
+}
+
+// one row per node with the totals over all recorded calls
+template <typename T>
+void writeCostCsv(const std::vector<LayerGraphNode<T> *> &nodes, const std::string &path)
+{
+    std::ofstream f(path);
+    f << "node,layer,calls,time_us,key_bytes,bytes_sent,bytes_received,rounds\n";
+    for (u64 i = 0; i < nodes.size(); ++i) {
+        auto node = nodes[i];
+        auto cost = node->totalCost();
+        f << "\"" << profileNodeName(nodes, i) << "\"," << node->layer->name << "," << node->costSamples.size() << ","
+          << node->totalMicroseconds() << "," << cost.keyBytes << "," << cost.bytesSent << ","
+          << cost.bytesReceived << "," << cost.rounds << "\n";
+    }
+}
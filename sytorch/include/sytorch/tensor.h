@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
 #include <cassert>
 #include <Eigen/Dense>
@@ -13,6 +14,7 @@
 #include <fcntl.h>
 #include <fstream>
 #include <unistd.h>
+#include <vector>
 typedef uint64_t u64;
 typedef uint8_t u8;
 typedef int64_t i64;
@@ -136,6 +138,25 @@ public:
         allocate(s);
     }
 
+    // point the tensor at storage owned by someone else, e.g. an activation arena
+    void bind(T *data, const std::vector<u64> &s) {
+        if (isOwner)
+            free();
+        this->data = data;
+        this->shape = s;
+        this->isOwner = false;
+    }
+
+    // undo bind, leaving an empty tensor that owns its storage again
+    void unbind() {
+        if (isOwner)
+            return;
+        this->data = nullptr;
+        this->shape = {};
+        this->isOwner = true;
+        this->isFreed = true;
+    }
+
     Tensor(const std::vector<u64> &s) {
         allocate(s);
     }
@@ -321,12 +342,13 @@ public:
     {
         size_t size_in_bytes = std::filesystem::file_size(filename);
         always_assert(size_in_bytes == size() * 4);
-        float *floatInput = new float[size()];
+        float *floatInput;
         int buffersize;
         // std::ifstream file(filename, std::ios::binary);
         // file.read((char*) floatInput, size_in_bytes);
         // file.close();
-        int fd2 = open(filename.c_str(), O_RDWR | O_CREAT, 0);
+        int fd2 = open(filename.c_str(), O_RDONLY);
+        always_assert(fd2 >= 0);
         struct stat sb;
         fstat(fd2, &sb);
         buffersize = sb.st_size;
@@ -367,6 +389,17 @@ public:
         newshape.erase(newshape.begin());
         return Tensor<T>(data + i * newsize, newshape);
     }
+
+    // rows [begin, begin + count) of the batch axis, sharing storage
+    Tensor<T> slice(u64 begin, u64 count)
+    {
+        always_assert(shape.size() >= 1);
+        always_assert(begin + count <= shape[0]);
+        u64 rowsize = size() / shape[0];
+        auto newshape = shape;
+        newshape[0] = count;
+        return Tensor<T>(data + begin * rowsize, newshape);
+    }
 };
 
 template <typename T>
@@ -625,3 +658,45 @@ public:
     }
 
 };
+
+// Stacks queries along the batch axis so that they run through the graph, and through
+// every LLAMA round, together. All queries must agree on the dimensions past the batch
+// axis; their batch sizes may differ.
+template <typename T>
+void stackBatch(const std::vector<Tensor<T> *> &queries, Tensor<T> &out)
+{
+    always_assert(queries.size() > 0);
+    auto shape = queries[0]->shape;
+    always_assert(shape.size() >= 1);
+    u64 rows = 0;
+    for (auto &q : queries) {
+        always_assert(q->shape.size() == shape.size());
+        always_assert(std::equal(q->shape.begin() + 1, q->shape.end(), shape.begin() + 1));
+        rows += q->shape[0];
+    }
+    shape[0] = rows;
+    out.resize(shape);
+    u64 offset = 0;
+    for (auto &q : queries) {
+        std::copy(q->data, q->data + q->size(), out.data + offset);
+        offset += q->size();
+    }
+}
+
+// The rows of a batched result belonging to each query, as views into it. The result
+// must keep the batch axis of the stacked input (one row per query row).
+template <typename T>
+std::vector<Tensor<T>> splitBatch(Tensor<T> &batched, const std::vector<Tensor<T> *> &queries)
+{
+    u64 rows = 0;
+    for (auto &q : queries) rows += q->shape[0];
+    always_assert(batched.shape.size() >= 1 && batched.shape[0] == rows);
+    std::vector<Tensor<T>> res;
+    res.reserve(queries.size());
+    u64 begin = 0;
+    for (auto &q : queries) {
+        res.push_back(batched.slice(begin, q->shape[0]));
+        begin += q->shape[0];
+    }
+    return res;
+}
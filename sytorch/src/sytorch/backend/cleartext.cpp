@@ -1,12 +1,26 @@
 
 #include <sytorch/backend/cleartext.h>
+#include <llama/gemm.h>
 #include <Eigen/Dense>
+#include <algorithm>
+#include <type_traits>
+
+// 64-bit integer rings go through the cache-blocked mod 2^64 kernels, since Eigen has
+// no vectorised path for 64-bit integer products; other types stay on Eigen.
+template <typename T>
+constexpr bool useRingKernels = std::is_integral<T>::value && sizeof(T) == 8;
 
 template <typename T>
 void ClearText<T>::matmul(const Tensor2D<T> &a, const Tensor2D<T> &b, Tensor2D<T> &c) {
     assert(a.d2 == b.d1);
     assert(c.d1 == a.d1);
     assert(c.d2 == b.d2);
+    if constexpr (useRingKernels<T>) {
+        ringGemm(a.d1, b.d2, a.d2, (const uint64_t *)a.data, a.d2, 1, (const uint64_t *)b.data, b.d2, 1,
+                 (uint64_t *)c.data, c.d2, RingGemmMode::Store, 0);
+        modbw(c);
+        return;
+    }
     Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eA(a.data, a.d1, a.d2);
     Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eB(b.data, b.d1, b.d2);
     Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eC(c.data, c.d1, c.d2);
@@ -14,12 +28,40 @@ void ClearText<T>::matmul(const Tensor2D<T> &a, const Tensor2D<T> &b, Tensor2D<T
     modbw(c);
 }
 
+// The ring kernels start from the broadcast bias and accumulate the product onto it, so
+// the bias costs no extra pass over the output.
+template <typename T>
+void ClearText<T>::matmulBias(const Tensor2D<T> &a, const Tensor2D<T> &b, const Tensor1D<T> &bias, Tensor<T> &c) {
+    auto c_2d = c.as_2d();
+    if constexpr (useRingKernels<T>) {
+        assert(a.d2 == b.d1);
+        assert(c_2d.d1 == a.d1);
+        assert(c_2d.d2 == b.d2);
+        always_assert(bias.d1 == b.d2);
+        for (u64 i = 0; i < c_2d.d1; ++i) {
+            std::copy(bias.data, bias.data + bias.d1, c_2d.data + i * c_2d.d2);
+        }
+        ringGemm(a.d1, b.d2, a.d2, (const uint64_t *)a.data, a.d2, 1, (const uint64_t *)b.data, b.d2, 1,
+                 (uint64_t *)c_2d.data, c_2d.d2, RingGemmMode::Add, 0);
+        modbw(c);
+        return;
+    }
+    matmul(a, b, c_2d);
+    addbias(c, bias);
+}
+
 template <typename T>
 void ClearText<T>::matmulTransposeA(const Tensor2D<T> &a, const Tensor2D<T> &b, Tensor2D<T> &c) {
     assert(a.d1 == b.d1);
     assert(c.d1 == a.d2);
     assert(c.d2 == b.d2);
 //    c.zero();
+    if constexpr (useRingKernels<T>) {
+        ringGemm(a.d2, b.d2, a.d1, (const uint64_t *)a.data, 1, a.d2, (const uint64_t *)b.data, b.d2, 1,
+                 (uint64_t *)c.data, c.d2, RingGemmMode::Store, 0);
+        modbw(c);
+        return;
+    }
     Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>> eA(a.data, a.d2, a.d1);
     Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eB(b.data, b.d1, b.d2);
     Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eC(c.data, c.d1, c.d2);
@@ -32,6 +74,12 @@ void ClearText<T>::matmulTransposeB(const Tensor2D<T> &a, const Tensor2D<T> &b,
     assert(a.d2 == b.d2);
     assert(c.d1 == a.d1);
     assert(c.d2 == b.d1);
+    if constexpr (useRingKernels<T>) {
+        ringGemm(a.d1, b.d1, a.d2, (const uint64_t *)a.data, a.d2, 1, (const uint64_t *)b.data, 1, b.d2,
+                 (uint64_t *)c.data, c.d2, RingGemmMode::Store, 0);
+        modbw(c);
+        return;
+    }
     Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eA(a.data, a.d1, a.d2);
     Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>> eB(b.data, b.d2, b.d1);
     Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eC(c.data, c.d1, c.d2);
@@ -52,6 +100,13 @@ void ClearText<T>::conv2D(u64 fh, u64 fw, u64 padding, u64 stride, u64 ci, u64 c
     assert(output.d3 == newW);
     assert(output.d4 == co);
 
+    if constexpr (useRingKernels<T>) {
+        ringConv2D(input.d1, input.d2, input.d3, ci, fh, fw, co, padding, padding, padding, padding, stride, stride,
+                   (const uint64_t *)input.data, (const uint64_t *)filter.data, (uint64_t *)output.data, RingGemmMode::Store, 0);
+        modbw(output);
+        return;
+    }
+
     Tensor2D<T> reshapedInput = reshapeInputTransposed<T>(input, padding, stride, fh, fw);
     Tensor2D<T> tempOutput(filter.d1, reshapedInput.d1);
     matmulTransposeB(filter, reshapedInput, tempOutput);
@@ -59,6 +114,29 @@ void ClearText<T>::conv2D(u64 fh, u64 fw, u64 padding, u64 stride, u64 ci, u64 c
     modbw(output);
 }
 
+template <typename T>
+void ClearText<T>::conv2DBias(u64 fh, u64 fw, u64 padding, u64 stride, u64 ci, u64 co, const Tensor4D<T> &input, const Tensor2D<T> &filter, const Tensor1D<T> &bias, Tensor<T> &output)
+{
+    auto output_4d = output.as_4d();
+    if constexpr (useRingKernels<T>) {
+        assert(input.d4 == ci);
+        assert(filter.d1 == co);
+        assert(filter.d2 == fh * fw * ci);
+        assert(output_4d.d4 == co);
+        always_assert(bias.d1 == co);
+        u64 pixels = output.size() / co;
+        for (u64 i = 0; i < pixels; ++i) {
+            std::copy(bias.data, bias.data + co, output.data + i * co);
+        }
+        ringConv2D(input.d1, input.d2, input.d3, ci, fh, fw, co, padding, padding, padding, padding, stride, stride,
+                   (const uint64_t *)input.data, (const uint64_t *)filter.data, (uint64_t *)output.data, RingGemmMode::Add, 0);
+        modbw(output);
+        return;
+    }
+    conv2D(fh, fw, padding, stride, ci, co, input, filter, output_4d);
+    addbias(output, bias);
+}
+
 template <typename T>
 void ClearText<T>::conv3D(u64 fd, u64 fh, u64 fw, u64 pd, u64 ph, u64 pw, u64 sd, u64 sh, u64 sw, u64 dd, u64 dh, u64 dw, u64 ci, u64 co, const Tensor5D<T> &input, const Tensor2D<T> &filter, Tensor5D<T> &output)
 {
@@ -135,6 +213,24 @@ void ClearText<T>::relu(const Tensor<T> &in, const Tensor<T> &out, const Tensor<
     });
 }
 
+// One pass instead of relu followed by truncateForward. Only the exact truncation can be
+// folded in; the probabilistic and emulated modes keep their own truncation.
+template <typename T>
+void ClearText<T>::reluTruncate(const Tensor<T> &in, const Tensor<T> &out, const Tensor<T> &drelu, u64 shift, u64 scale, int mode, u8 truncMode) {
+    if constexpr (std::is_floating_point<T>::value || probablistic || localTruncationEmulation) {
+        relu(in, out, drelu, scale, mode);
+        this->truncateForward(out, shift, truncMode);
+    }
+    else {
+        assert(in.is_same_shape(out));
+        assert(in.is_same_shape(drelu));
+        fastfor(in.size(), [&] (u64 i) {
+            drelu.data[i] = (T)(in.data[i] > 0);
+            out.data[i] = (drelu.data[i] == 1) ? (in.data[i] >> shift) : 0;
+        });
+    }
+}
+
 template <typename T>
 void ClearText<T>::leakyRelu(const Tensor<T> &in, const Tensor<T> &out, const Tensor<T> &drelu, u64 scale, int mode, T alpha)
 {
@@ -406,43 +502,41 @@ void ClearText<T>::gelu(const Tensor<T> &in, const Tensor<T> &out, u64 scale)
 }
 
 template <typename T>
-void ClearText<T>::softmax(Tensor<T> &_in, Tensor<T> &_out, u64 scale)
+void ClearText<T>::softmax(Tensor<T> &in, Tensor<T> &out, u64 scale)
 {
-    always_assert(_in.shape.size() == 2);
-    always_assert(_out.shape.size() == 2);
-    always_assert(_in.shape[0] == _out.shape[0]);
-    always_assert(_in.shape[1] == _out.shape[1]);
+    // over the last axis, every other axis is a batch of rows
+    always_assert(in.is_same_shape(out));
     always_assert(std::is_integral<T>::value || (scale == 0));
 
-    auto in = _in.as_2d();
-    auto out = _out.as_2d();
-    auto batchSize = in.d1;
-    auto numClasses = in.d2;
-    for(int b = 0; b < batchSize; ++b) {
-        T max = in(b, 0);
+    auto numClasses = in.shape.back();
+    auto batchSize = in.size() / numClasses;
+    for(u64 b = 0; b < batchSize; ++b) {
+        T *x = in.data + b * numClasses;
+        T *y = out.data + b * numClasses;
+        T max = x[0];
         for(u64 j = 1; j < numClasses; ++j) {
-            if(in(b, j) > max) {
-                max = in(b, j);
+            if(x[j] > max) {
+                max = x[j];
             }
         }
         double den = 0.0;
         double exps[numClasses];
         for(u64 j = 0; j < numClasses; ++j) {
-            double x = in(b, j) - max;
+            double v = x[j] - max;
             if (scale == 0) {
-                exps[j] = std::exp(x);
+                exps[j] = std::exp(v);
             } else {
-                exps[j] = std::exp(x / (1LL << scale));
+                exps[j] = std::exp(v / (1LL << scale));
             }
             den += exps[j];
         }
 
         for(u64 j = 0; j < numClasses; ++j) {
             if (scale == 0) {
-                out(b, j) = exps[j] / den;
+                y[j] = exps[j] / den;
             } else {
                 auto t = (exps[j] / den) * (1LL << scale);
-                out(b, j) = (T)(t);
+                y[j] = (T)(t);
             }
         }
     }
@@ -519,6 +613,23 @@ void ClearText<T>::scalarmul(Tensor<T> &x, T scalar, Tensor<T> &y)
     modbw(y);
 }
 
+template <typename T>
+void ClearText<T>::attention_mask(Tensor<T> &x, T scalar, Tensor<T> &y)
+{
+    // the queries are the last rows of the keys, query j sees keys up to past + j
+    always_assert(x.is_same_shape(y));
+    always_assert(x.shape.size() == 2);
+    always_assert(x.shape[1] >= x.shape[0]);
+    u64 queries = x.shape[0], keys = x.shape[1];
+    u64 past = keys - queries;
+    fastfor(queries, [&](u64 j) {
+        for (u64 k = 0; k < keys; ++k) {
+            y.data[j * keys + k] = (k <= past + j) ? x.data[j * keys + k] : x.data[j * keys + k] - scalar;
+        }
+    });
+    modbw(y);
+}
+
 template class ClearText<i64>;
 template class ClearText<i32>;
 template class ClearText<u64>;
@@ -1,6 +1,8 @@
 
 #include <sytorch/backend/float.h>
 #include <Eigen/Dense>
+#include <algorithm>
+#include <vector>
 
 template <typename T>
 void FloatClearText<T>::matmul(const Tensor2D<T> &a, const Tensor2D<T> &b, Tensor2D<T> &c)
@@ -50,6 +52,11 @@ void FloatClearText<T>::matmulTransposeB(const Tensor2D<T> &a, const Tensor2D<T>
     eC = eA * eB;
 }
 
+// Blocked implicit-GEMM convolution. Output pixels (over the whole batch) are taken in
+// tiles; each tile gathers its input patches into a buffer small enough to stay in cache
+// and is multiplied with the filter straight into the NHWC output. Tiles run in
+// parallel, so both large batches and large images use every core, and the full im2col
+// matrix is never built.
 template <typename T>
 void FloatClearText<T>::conv2D(u64 fh, u64 fw, u64 padding, u64 stride, u64 ci, u64 co, const Tensor4D<T> &input, const Tensor2D<T> &filter, Tensor4D<T> &output)
 {
@@ -62,10 +69,47 @@ void FloatClearText<T>::conv2D(u64 fh, u64 fw, u64 padding, u64 stride, u64 ci,
     assert(output.d2 == newH);
     assert(output.d3 == newW);
     assert(output.d4 == co);
-    Tensor2D<T> reshapedInput = reshapeInputTransposed<T>(input, padding, stride, fh, fw);
-    Tensor2D<T> tempOutput(filter.d1, reshapedInput.d1);
-    matmulTransposeB(filter, reshapedInput, tempOutput);
-    reshapeOutput<T>(tempOutput, input.d1, (((input.d2 + 2 * padding - fh) / stride) + 1), (((input.d3 + 2 * padding - fw) / stride) + 1), co, output);
+
+    u64 K = fh * fw * ci;
+    u64 pixels = input.d1 * newH * newW;
+    u64 tile = std::max<u64>(16, (1 << 15) / K);
+    u64 numTiles = (pixels + tile - 1) / tile;
+    Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eF(filter.data, co, K);
+
+#pragma omp parallel
+    {
+        std::vector<T> patches(tile * K);
+#pragma omp for schedule(dynamic)
+        for (u64 t = 0; t < numTiles; ++t)
+        {
+            u64 p0 = t * tile;
+            u64 rows = std::min(tile, pixels - p0);
+            for (u64 r = 0; r < rows; ++r)
+            {
+                u64 p = p0 + r;
+                u64 n = p / (newH * newW);
+                i64 oh = (p / newW) % newH;
+                i64 ow = p % newW;
+                T *dst = patches.data() + r * K;
+                for (i64 i = 0; i < fh; ++i)
+                {
+                    i64 h = oh * stride + i - padding;
+                    for (i64 j = 0; j < fw; ++j)
+                    {
+                        i64 w = ow * stride + j - padding;
+                        T *d = dst + (i * fw + j) * ci;
+                        if (h < 0 || h >= input.d2 || w < 0 || w >= input.d3)
+                            std::fill(d, d + ci, T(0));
+                        else
+                            std::copy(&input(n, h, w, 0), &input(n, h, w, 0) + ci, d);
+                    }
+                }
+            }
+            Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eP(patches.data(), rows, K);
+            Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> eO(output.data + p0 * co, rows, co);
+            eO.noalias() = eP * eF.transpose();
+        }
+    }
 }
 
 template <typename T>
@@ -204,21 +248,24 @@ void FloatClearText<T>::sumPool2D(u64 ks, u64 padding, u64 stride, const Tensor4
     u64 newW = (in.d3 + 2 * padding - ks) / stride + 1;
     assert(out.d2 == newH);
     assert(out.d3 == newW);
-    fastfor(in.d1, [&](int i)
-            {
+#pragma omp parallel for collapse(2)
+    for (int i = 0; i < in.d1; i++) {
         for(int j = 0; j < newH; j++) {
             for(int k = 0; k < newW; k++) {
-                for(int l = 0; l < in.d4; l++) {
-                    T sum = 0;
-                    for(int m = 0; m < ks; m++) {
-                        for(int n = 0; n < ks; n++) {
-                            sum += in(i, j*stride+m, k*stride+n, l);
+                T *dst = &out(i, j, k, 0);
+                std::fill(dst, dst + in.d4, T(0));
+                for(int m = 0; m < ks; m++) {
+                    for(int n = 0; n < ks; n++) {
+                        const T *src = &in(i, j*stride+m, k*stride+n, 0);
+#pragma omp simd
+                        for(int l = 0; l < in.d4; l++) {
+                            dst[l] += src[l];
                         }
                     }
-                    out(i, j, k, l) = sum;
                 }
             }
-        } });
+        }
+    }
 }
 
 template <typename T>
@@ -238,8 +285,8 @@ void FloatClearText<T>::maxPool2D(u64 ks, u64 padding, u64 stride, const Tensor4
     u64 newW = (in.d3 + 2 * padding - ks) / stride + 1;
     assert(out.d2 == newH);
     assert(out.d3 == newW);
-    fastfor(in.d1, [&](int i)
-            {
+#pragma omp parallel for collapse(2)
+    for (int i = 0; i < in.d1; i++) {
         for(int j = 0; j < newH; j++) {
             for(int k = 0; k < newW; k++) {
                 for(int l = 0; l < in.d4; l++) {
@@ -264,7 +311,8 @@ void FloatClearText<T>::maxPool2D(u64 ks, u64 padding, u64 stride, const Tensor4
                     maxIdx(i, j, k, l) = maxIdxI * ks + maxIdxJ;
                 }
             }
-        } });
+        }
+    }
 }
 
 template <typename T>
@@ -308,42 +356,39 @@ void FloatClearText<T>::gelu(const Tensor<T> &in, const Tensor<T> &out, u64 scal
 }
 
 template <typename T>
-void FloatClearText<T>::softmax(Tensor<T> &_in, Tensor<T> &_out, u64 scale, u64 mode)
+void FloatClearText<T>::softmax(Tensor<T> &in, Tensor<T> &out, u64 scale, u64 mode)
 {
-    always_assert(_in.shape.size() == 2);
-    always_assert(_out.shape.size() == 2);
-    always_assert(_in.shape[0] == _out.shape[0]);
-    always_assert(_in.shape[1] == _out.shape[1]);
+    // over the last axis, every other axis is a batch of rows
+    always_assert(in.is_same_shape(out));
     always_assert((scale == 0));
 
-    auto in = _in.as_2d();
-    auto out = _out.as_2d();
-
-    auto batchSize = in.d1;
-    auto numClasses = in.d2;
+    auto numClasses = in.shape.back();
+    auto batchSize = in.size() / numClasses;
+#pragma omp parallel for schedule(static)
     for (int b = 0; b < batchSize; ++b)
     {
-        T max = in(b, 0);
+        T *x = in.data + b * numClasses;
+        T *y = out.data + b * numClasses;
+        T max = x[0];
         for (u64 j = 1; j < numClasses; ++j)
         {
-            if (in(b, j) > max)
+            if (x[j] > max)
             {
-                max = in(b, j);
+                max = x[j];
             }
         }
 
         double den = 0.0;
-        double exps[numClasses];
+        std::vector<double> exps(numClasses);
         for (u64 j = 0; j < numClasses; ++j)
         {
-            double x = in(b, j) - max;
-            exps[j] = std::exp(x);
+            exps[j] = std::exp(x[j] - max);
             den += exps[j];
         }
 
         for (u64 j = 0; j < numClasses; ++j)
         {
-            out(b, j) = exps[j] / den;
+            y[j] = exps[j] / den;
         }
     }
 }
@@ -408,21 +453,25 @@ void FloatClearText<T>::scalarmul(Tensor<T> &x, T scalar, Tensor<T> &y)
 template <typename T>
 void FloatClearText<T>::attention_mask(Tensor<T> &x, T scalar, Tensor<T> &y)
 {
+    // the queries are the last rows of the keys, query j sees keys up to past + j
     always_assert(x.is_same_shape(y));
     always_assert(x.shape.size() == 2);
-    always_assert(x.shape[0] == x.shape[1]);
+    always_assert(x.shape[1] >= x.shape[0]);
 
     u64 n_seq = x.shape[0];
+    u64 n_keys = x.shape[1];
+    u64 past = n_keys - n_seq;
     auto y_2d = y.as_2d();
     auto x_2d = x.as_2d();
 
+#pragma omp parallel for schedule(static)
     for (u64 j = 0; j < n_seq; ++j)
     {
-        for (u64 k = 0; k < j + 1; ++k)
+        for (u64 k = 0; k < past + j + 1; ++k)
         {
             y_2d(j, k) = x_2d(j, k);
         }
-        for (u64 k = j + 1; k < n_seq; ++k)
+        for (u64 k = past + j + 1; k < n_keys; ++k)
         {
             y_2d(j, k) = x_2d(j, k) - scalar;
         }
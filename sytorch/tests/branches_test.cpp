@@ -0,0 +1,157 @@
+/*
+Authors: Deepak Kumaraswamy, Kanav Gupta
+Copyright:
+Copyright (c) 2022 Microsoft Research
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Runs a graph with two parallel branches of two convolutions each under LLAMA, with the
+// dealer, server and client forked from this process, once layer by layer and once with
+// concurrentBranches, and checks that the client gets the same output both times.
+
+#include <sytorch/backend/llama_extended.h>
+#include <sytorch/layers/layers.h>
+#include <sytorch/module.h>
+#include <sytorch/utils.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdio>
+#include <vector>
+
+template <typename T>
+class TwoBranches : public SytorchModule<T> {
+public:
+    Conv2D<T> *a1, *a2, *b1, *b2;
+    ReLU<T> *ra, *rb;
+
+    TwoBranches()
+    {
+        a1 = new Conv2D<T>(3, 4, 3, 1, 1, true);
+        ra = new ReLU<T>();
+        a2 = new Conv2D<T>(4, 4, 1, 0, 1, true);
+        b1 = new Conv2D<T>(3, 4, 1, 0, 1, true);
+        rb = new ReLU<T>();
+        b2 = new Conv2D<T>(4, 4, 3, 1, 1, true);
+    }
+
+    Tensor<T>& _forward(Tensor<T> &input)
+    {
+        auto &a = a2->forward(ra->forward(a1->forward(input)));
+        auto &b = b2->forward(rb->forward(b1->forward(input)));
+        return this->add(a, b);
+    }
+};
+
+static void runParty(int party, bool concurrent, int outFd)
+{
+    LlamaConfig::bitlength = 40;
+    LlamaConfig::party = party;
+    LlamaConfig::stochasticT = false;
+    LlamaConfig::stochasticRT = false;
+    LlamaConfig::num_threads = 2;
+    auto llama = new LlamaExtended<u64>();
+    llama->init("127.0.0.1", true);
+
+    TwoBranches<u64> net;
+    net.init(12);
+    net.setBackend(llama);
+    net.optimize();
+    net.concurrentBranches = concurrent;
+    if (party == SERVER) {
+        u64 v = 7;
+        topologicalApply(net.root, [&](LayerGraphNode<u64> *node, LayerGraphNode<u64> *) {
+            auto w = node->layer->getweights();
+            auto b = node->layer->getbias();
+            for (u64 i = 0; i < w.size; ++i) {
+                v = v * 6364136223846793005ULL + 1;
+                w.data[i] = (int64_t)((v >> 40) % 2048) - 1024;
+            }
+            for (u64 i = 0; i < b.size; ++i)
+                b.data[i] = (int64_t)(i * 100) - 300;
+        });
+    }
+    else if (party == DEALER) {
+        net.zero();
+    }
+
+    llama::start();
+    llama->initializeInferencePartyA(net.root);
+    Tensor<u64> x({1, 6, 6, 3});
+    for (u64 i = 0; i < x.size(); ++i)
+        x.data[i] = party == CLIENT ? (i * 37) % 4096 : 0;
+    llama->initializeInferencePartyB(x);
+    net.forward(x);
+    llama::end();
+    llama->outputA(net.activation);
+    if (party == CLIENT) {
+        for (u64 i = 0; i < net.activation.size(); ++i) {
+            u64 v = net.activation.data[i] & ((1ULL << LlamaConfig::bitlength) - 1);
+            always_assert(write(outFd, &v, sizeof(u64)) == sizeof(u64));
+        }
+    }
+    llama->finalize();
+}
+
+static pid_t spawn(int party, bool concurrent, int outFd)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        runParty(party, concurrent, outFd);
+        _exit(0);
+    }
+    return pid;
+}
+
+static bool exitedCleanly(pid_t pid)
+{
+    int status;
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Returns the client's output, or nothing if a party failed
+static std::vector<u64> runSession(bool concurrent)
+{
+    int fds[2];
+    always_assert(pipe(fds) == 0);
+    // the dealer writes the keys to disk before the server and client start
+    bool ok = exitedCleanly(spawn(DEALER, concurrent, -1));
+    pid_t server = spawn(SERVER, concurrent, -1);
+    pid_t client = spawn(CLIENT, concurrent, fds[1]);
+    close(fds[1]);
+    std::vector<u64> out;
+    u64 v;
+    while (read(fds[0], &v, sizeof(u64)) == sizeof(u64))
+        out.push_back(v);
+    close(fds[0]);
+    ok = exitedCleanly(server) && ok;
+    ok = exitedCleanly(client) && ok;
+    return ok ? out : std::vector<u64>();
+}
+
+int main()
+{
+    sytorch_init();
+    auto sequential = runSession(false);
+    auto concurrent = runSession(true);
+    long mismatches = 0;
+    for (size_t i = 0; i < std::min(sequential.size(), concurrent.size()); ++i)
+        mismatches += sequential[i] != concurrent[i];
+    bool ok = !sequential.empty() && sequential.size() == concurrent.size() && mismatches == 0;
+    printf("branches_test: %zu outputs sequentially, %zu concurrently, %ld mismatches\n",
+           sequential.size(), concurrent.size(), mismatches);
+    return ok ? 0 : 1;
+}